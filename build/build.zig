@@ -45,6 +45,8 @@ pub fn build(b: *std.Build) void {
         "src/gui/gui_inventory.c",
         "src/gui/gui_buttons.c",
         "src/gui/gui_map.c",
+        "src/gui/gui_bench.c",
+        "src/gui/gui_playout.c",
         "src/gui/dots.c",
         "src/gui/display.c",
         "src/gui/teleport.c",
@@ -58,6 +60,7 @@ pub fn build(b: *std.Build) void {
         // CLIENT
         "src/client/client.c",
         "src/client/skill.c",
+        "src/client/replay.c",
         "src/client/protocol.c",
 
         // GAME
@@ -79,7 +82,13 @@ pub fn build(b: *std.Build) void {
         "src/sdl/sdl_texture.c",
         "src/sdl/sdl_image.c",
         "src/sdl/sdl_effects.c",
+        "src/sdl/sdl_rowfx.c",
+        "src/sdl/sdl_diskcache.c",
+        "src/sdl/sdl_archive.c",
+        "src/sdl/sdl_pack.c",
         "src/sdl/sdl_draw.c",
+        "src/sdl/sdl_atlas.c",
+        "src/sdl/sdl_stats.c",
         "src/sdl/sound.c",
 
         // HELPERS
@@ -351,7 +360,7 @@ pub fn build(b: *std.Build) void {
         b.getInstallStep().dependOn(&amod_install.step);
     }
 
-    // Helper tools (anicopy, convert) are built via Makefile instead of Zig
+    // Helper tools (anicopy, convert, gfxpack) are built via Makefile instead of Zig
 
     const run = b.addRunArtifact(exe);
     if (b.args) |args| run.addArgs(args);
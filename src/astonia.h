@@ -167,6 +167,9 @@ extern char *localdata;
 #define GO_HIDE_SKILLS  (1ull << 22) // Hide native skills panel
 #define GO_HIDE_BOTTOM  (1ull << 23) // Hide bottom stats/bars UI
 
+#define GO_VERTEXLIGHT (1ull << 24) // Light map sprites at draw time from one unlit texture
+#define GO_NETTHREAD   (1ull << 25) // Read and inflate the server's data on a thread of its own
+
 #define GO_NOTSET (1ull << 63) // No -o given on command line
 
 DLL_EXPORT extern uint64_t game_options;
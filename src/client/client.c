@@ -43,6 +43,17 @@ DLL_EXPORT char password[16];
 static int zsinit;
 static struct z_stream_s zs;
 
+static struct replay *rec_file = NULL; // record_client(): copy of all we receive
+static Uint64 rec_start;
+static size_t rec_session; // bytes recorded for the current connection
+
+static struct replay *play_file = NULL; // replay_client(): the server is a file
+static Uint64 play_start;
+static const unsigned char *play_data;
+static size_t play_len, play_done, play_session;
+static uint32_t play_ms;
+int replay_fast = 0; // do not pace the replay
+
 DLL_EXPORT char username[40];
 DLL_EXPORT tick_t tick;
 DLL_EXPORT uint32_t mirror = 0;
@@ -50,21 +61,53 @@ DLL_EXPORT uint32_t realtime;
 DLL_EXPORT int protocol_version = 0;
 
 uint32_t newmirror = 0;
-int lasttick; // ticks in inbuf
+int lasttick; // ticks received, not prefetched yet
 static size_t lastticksize; // size inbuf must reach to get the last tick complete in the queue
 
+// When each tick arrived. client_received() writes in_times[in_ticks] once the
+// last byte of a tick is in, client_decode() reads in_times[in_decoded] for the
+// tick it takes. If more than IN_TIMES ticks wait in inbuf, the oldest get a
+// later time.
+#define IN_TIMES 256 // power of two
+static uint64_t in_times[IN_TIMES];
+static unsigned int in_ticks, in_decoded;
+static size_t in_stamped; // size of the ticks in inbuf that have their time
+
+// Decoded ticks. client_decode() fills queue[q_head], next_tick() prefetches
+// queue[q_in] and do_tick() processes queue[q_out]. The counters only grow,
+// the slot is the counter & (Q_SIZE-1). With GO_NETTHREAD client_decode()
+// runs on the network thread, q_head and q_out are how the two sides talk.
 static struct queue queue[Q_SIZE];
-int q_in, q_out, q_size;
+static unsigned int q_head, q_in, q_out;
+int q_size; // prefetched, not processed yet
+
+// GO_NETTHREAD: net_loop() owns sock, zs and inbuf while it runs
+#define NET_OK         0
+#define NET_LOST_READ  1
+#define NET_LOST_WRITE 2
+#define NET_BROKEN     3 // a tick could not be inflated
+#define NET_WAIT       2 // ms net_loop() waits for data before it looks at outbuf again
+
+static SDL_Thread *net_thread = NULL;
+static SDL_Mutex *net_mutex = NULL; // guards outbuf
+static SDL_AtomicInt net_quit, net_status;
+static SDL_AtomicInt net_send; // sockstate is 4, outbuf may go out
+
+static void net_stop(void);
 
 double server_cycles;
 
+// inbuf and outbuf are rings, the data starts at inpos/outpos and may wrap
+// around the end
 static size_t ticksize;
 static size_t inused;
 static size_t indone;
+static size_t inpos;
 int login_done;
 static unsigned char inbuf[MAX_INBUF];
 
 static size_t outused;
+static size_t outpos;
 static unsigned char outbuf[MAX_OUTBUF];
 
 DLL_EXPORT uint16_t act;
@@ -121,12 +164,41 @@ DLL_EXPORT int frames_per_second = TICKS;
 // Unaligned load/store helpers
 DLL_EXPORT void client_send(void *buf, size_t len)
 {
-	if (len > MAX_OUTBUF - outused) {
-		return;
+	size_t end, first;
+
+	SDL_LockMutex(net_mutex); // does nothing without the network thread
+
+	if (len <= MAX_OUTBUF - outused) {
+		end = (outpos + outused) & (MAX_OUTBUF - 1);
+		first = min(len, MAX_OUTBUF - end);
+		memcpy(outbuf + end, buf, first);
+		memcpy(outbuf, (unsigned char *)buf + first, len - first);
+		outused += len;
 	}
 
-	memcpy(outbuf + outused, buf, len);
-	outused += len;
+	SDL_UnlockMutex(net_mutex);
+}
+
+// Byte n of what is waiting in inbuf
+static inline unsigned char in_byte(size_t n)
+{
+	return inbuf[(inpos + n) & (MAX_INBUF - 1)];
+}
+
+// Like net_read16() at byte n of what is waiting in inbuf
+static inline size_t in_read16(size_t n)
+{
+	return ((size_t)in_byte(n) << 8) | in_byte(n + 1);
+}
+
+// The free space at the end of the data in inbuf, as far as it goes without
+// wrapping
+static unsigned char *in_space(size_t *len)
+{
+	size_t end = (inpos + inused) & (MAX_INBUF - 1);
+
+	*len = min(MAX_INBUF - inused, MAX_INBUF - end);
+	return inbuf + end;
 }
 
 void bzero_client(int part)
@@ -134,9 +206,13 @@ void bzero_client(int part)
 	if (part == 0) {
 		lasttick = 0;
 		lastticksize = 0;
+		in_ticks = in_decoded = 0;
+		in_stamped = 0;
 
 		bzero(queue, sizeof(queue));
-		q_in = q_out = q_size = 0;
+		q_head = q_in = q_out = 0;
+		q_size = 0;
+		playout_reset();
 
 		server_cycles = 0;
 
@@ -146,10 +222,12 @@ void bzero_client(int part)
 		ticksize = 0;
 		inused = 0;
 		indone = 0;
+		inpos = 0;
 		login_done = 0;
 		bzero(inbuf, sizeof(inbuf));
 
 		outused = 0;
+		outpos = 0;
 		bzero(outbuf, sizeof(outbuf));
 	}
 
@@ -204,10 +282,19 @@ void bzero_client(int part)
 
 int close_client(void)
 {
+	net_stop();
 	if (sock) {
 		astonia_net_close(sock);
 		sock = NULL;
 	}
+	if (rec_file) {
+		replay_close(rec_file);
+		rec_file = NULL;
+	}
+	if (play_file) {
+		replay_close(play_file);
+		play_file = NULL;
+	}
 	if (zsinit) {
 		inflateEnd(&zs);
 		zsinit = 0;
@@ -252,8 +339,405 @@ static void send_info(astonia_sock *s)
 	(void)astonia_net_send(s, buf, 12);
 }
 
+// Write everything the server sends to filename, with the time it arrived
+int record_client(char *filename)
+{
+	rec_file = replay_create(filename);
+	if (!rec_file) {
+		return -1;
+	}
+	rec_start = 0;
+	rec_session = 0;
+
+	note("Recording to %s", filename);
+	return 0;
+}
+
+static void record_bytes(const unsigned char *buf, size_t len)
+{
+	if (!rec_start) {
+		rec_start = SDL_GetTicks();
+	}
+	if (replay_write(rec_file, (uint32_t)(SDL_GetTicks() - rec_start), buf, len)) {
+		replay_close(rec_file);
+		rec_file = NULL;
+		return;
+	}
+	rec_session += len;
+}
+
+// Play filename instead of connecting to a server, in real time or, with
+// fast set, as fast as the client takes it
+int replay_client(char *filename, int fast)
+{
+	play_file = replay_open(filename);
+	if (!play_file) {
+		return -1;
+	}
+	play_len = play_done = play_session = 0;
+	play_ms = 0;
+	replay_fast = fast;
+
+	note("Playing %s", filename);
+	return 0;
+}
+
+static int replay_chunk(void)
+{
+	if (replay_next(play_file, &play_ms, &play_data, &play_len) != 1) {
+		note("End of replay");
+		quit = 1;
+		return 0;
+	}
+	play_done = 0;
+	return 1;
+}
+
+// The replayed connection starts here, right after the one before ended
+static int replay_connect(void)
+{
+	// skip what is left of the last connection, up to its end marker
+	while (play_session) {
+		if (!replay_chunk()) {
+			return -1;
+		}
+		if (!play_len) {
+			play_session = 0;
+		}
+	}
+	play_done = play_len;
+
+	if (inflateInit(&zs)) {
+		note("zsinit failed");
+		sockstate = -5; // fail - no retry
+		return -1;
+	}
+	zsinit = 1;
+
+	play_start = SDL_GetTicks() - play_ms;
+	sockstate = 3;
+
+	return 0;
+}
+
+// Like astonia_net_recv(): the number of bytes, 0 if the recorded connection
+// ended here and -1 if there is nothing to read yet
+static int replay_recv(unsigned char *buf, size_t size)
+{
+	size_t len;
+
+	if (play_done == play_len && !replay_chunk()) {
+		return -1;
+	}
+	if (!play_len) {
+		play_session = 0;
+		return 0;
+	}
+	if (!replay_fast && SDL_GetTicks() - play_start < play_ms) {
+		return -1;
+	}
+
+	len = min(play_len - play_done, size);
+	if (!len) {
+		return -1;
+	}
+	memcpy(buf, play_data + play_done, len);
+	play_done += len;
+	play_session += len;
+
+	return (int)len;
+}
+
+// n new bytes are in inbuf: count the ticks that are complete now
+static void client_received(size_t n)
+{
+	int ticks = 0;
+	size_t size;
+	uint64_t now = SDL_GetTicksNS();
+
+	inused += n;
+	rec_bytes += (int)n;
+
+	while (1) {
+		if (inused >= lastticksize + 1 && in_byte(lastticksize) & 0x40) {
+			lastticksize += 1 + (in_byte(lastticksize) & 0x3F);
+		} else if (inused >= lastticksize + 2) {
+			lastticksize += 2 + (in_read16(lastticksize) & 0x3FFF);
+		} else {
+			break;
+		}
+
+		ticks++;
+	}
+
+	// lastticksize counts a tick once its header is in, stamp it when it is complete
+	while (in_stamped < lastticksize) {
+		if (in_byte(in_stamped) & 0x40) {
+			size = 1 + (in_byte(in_stamped) & 0x3F);
+		} else {
+			size = 2 + (in_read16(in_stamped) & 0x3FFF);
+		}
+		if (in_stamped + size > inused) {
+			break;
+		}
+		in_times[in_ticks++ & (IN_TIMES - 1)] = now;
+		in_stamped += size;
+	}
+
+	if (ticks) {
+		__atomic_add_fetch(&lasttick, ticks, __ATOMIC_RELAXED);
+	}
+}
+
+// Send what we can of outbuf, in two parts if it wraps around the end.
+// Returns -1 if the connection is lost.
+static int send_outbuf(void)
+{
+	size_t len;
+	int n;
+
+	while (outused) {
+		len = min(outused, MAX_OUTBUF - outpos);
+		n = (int)astonia_net_send(sock, outbuf + outpos, len);
+		if (n == 0) {
+			return -1;
+		} else if (n < 0) {
+			// would-block -> no progress this frame
+			break;
+		}
+
+		outpos = (outpos + (size_t)n) & (MAX_OUTBUF - 1);
+		outused -= (size_t)n;
+		sent_bytes += n;
+		if (!outused) {
+			outpos = 0;
+		}
+		if ((size_t)n < len) {
+			break;
+		}
+	}
+
+	return 0;
+}
+
+// Read what the socket has, waiting up to timeout ms for it. Returns the
+// number of bytes, 0 for none (or no room in inbuf) and -1 if the connection
+// is lost.
+static int recv_inbuf(int timeout)
+{
+	unsigned char *space;
+	size_t len;
+	int n;
+
+	space = in_space(&len);
+	if (!len || astonia_net_poll(sock, 1, timeout) <= 0) {
+		return 0;
+	}
+
+	n = (int)astonia_net_recv(sock, (char *)space, len);
+	if (n < 0) {
+		return 0; /* would-block */
+	} else if (n == 0) {
+		return -1;
+	}
+
+	if (rec_file) {
+		record_bytes(space, (size_t)n);
+	}
+	client_received((size_t)n);
+
+	return n;
+}
+
+// Take the next tick out of inbuf and inflate it into the queue. Returns 1 if
+// there was one, 0 if there is none yet or no room for it and -1 if it could
+// not be inflated.
+static int client_decode(void)
+{
+	size_t tick_sz, start, len, first;
+	struct queue *q;
+	unsigned char head;
+	int ret;
+
+	// no room for next tick, leave it in inbuf
+	if (q_head - __atomic_load_n(&q_out, __ATOMIC_ACQUIRE) == Q_SIZE) {
+		return 0;
+	}
+	q = &queue[q_head & (Q_SIZE - 1)];
+
+	// do we have a new tick
+	head = in_byte(0);
+	if (inused >= 1 && (head & 0x40)) {
+		tick_sz = 1 + (head & 0x3F);
+		if (inused < tick_sz) {
+			return 0;
+		}
+		indone = 1;
+	} else if (inused >= 2 && !(head & 0x40)) {
+		tick_sz = 2 + (in_read16(0) & 0x3FFF);
+		if (inused < tick_sz) {
+			return 0;
+		}
+		indone = 2;
+	} else {
+		return 0;
+	}
+
+	// the tick's data, the first part up to the end of inbuf
+	start = (inpos + indone) & (MAX_INBUF - 1);
+	len = tick_sz - indone;
+	first = min(len, MAX_INBUF - start);
+
+	// decompress
+	if (head & 0x80) {
+		zs.next_in = inbuf + start;
+		zs.avail_in = (unsigned int)first;
+
+		zs.next_out = q->buf;
+		zs.avail_out = sizeof(q->buf);
+
+		ret = inflate(&zs, Z_SYNC_FLUSH);
+		if (ret == Z_OK && len > first) {
+			zs.next_in = inbuf;
+			zs.avail_in = (unsigned int)(len - first);
+			ret = inflate(&zs, Z_SYNC_FLUSH);
+		}
+		if (ret != Z_OK) {
+			warn("Compression error %d\n", ret);
+			return -1;
+		}
+
+		if (zs.avail_in) {
+			warn("HELP (%d)\n", zs.avail_in);
+			return 0;
+		}
+
+		q->size = (int)(sizeof(q->buf) - zs.avail_out);
+	} else {
+		q->size = (int)len;
+		memcpy(q->buf, inbuf + start, first);
+		memcpy(q->buf + first, inbuf, len - first);
+	}
+	q->time = in_times[in_decoded++ & (IN_TIMES - 1)];
+
+	__atomic_store_n(&q_head, q_head + 1, __ATOMIC_RELEASE);
+
+	// remove tick from inbuf
+	if (inused < tick_sz) {
+		note("kuckuck!");
+	}
+	inpos = (inpos + tick_sz) & (MAX_INBUF - 1);
+	inused = inused - tick_sz;
+	if (!inused) {
+		inpos = 0;
+	}
+	lastticksize -= tick_sz;
+	in_stamped -= tick_sz;
+
+	return 1;
+}
+
+// GO_NETTHREAD: reads and inflates as soon as the data is there, no matter
+// how long the main thread takes for a frame, and sends outbuf
+static int net_loop(void *ptr)
+{
+	int n;
+
+	(void)ptr;
+
+	while (!SDL_GetAtomicInt(&net_quit)) {
+		if (SDL_GetAtomicInt(&net_send)) {
+			SDL_LockMutex(net_mutex);
+			n = send_outbuf();
+			SDL_UnlockMutex(net_mutex);
+			if (n < 0) {
+				SDL_SetAtomicInt(&net_status, NET_LOST_WRITE);
+				break;
+			}
+		}
+
+		while ((n = client_decode()) > 0) {
+			;
+		}
+		if (n < 0) {
+			SDL_SetAtomicInt(&net_status, NET_BROKEN);
+			break;
+		}
+
+		// the game is behind and inbuf is full, nothing to do until it catches up
+		if (inused == MAX_INBUF) {
+			SDL_Delay(1);
+			continue;
+		}
+		if (recv_inbuf(NET_WAIT) < 0) {
+			SDL_SetAtomicInt(&net_status, NET_LOST_READ);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void net_start(void)
+{
+	net_mutex = SDL_CreateMutex();
+	if (!net_mutex) {
+		warn("Could not create the network mutex, reading the network on the main thread");
+		return;
+	}
+
+	SDL_SetAtomicInt(&net_quit, 0);
+	SDL_SetAtomicInt(&net_status, NET_OK);
+	SDL_SetAtomicInt(&net_send, 0);
+
+	net_thread = SDL_CreateThread(net_loop, "moac network", NULL);
+	if (!net_thread) {
+		warn("Could not create the network thread, reading the network on the main thread");
+		SDL_DestroyMutex(net_mutex);
+		net_mutex = NULL;
+	}
+}
+
+static void net_stop(void)
+{
+	if (!net_thread) {
+		return;
+	}
+
+	SDL_SetAtomicInt(&net_quit, 1);
+	SDL_WaitThread(net_thread, NULL);
+	net_thread = NULL;
+
+	SDL_DestroyMutex(net_mutex);
+	net_mutex = NULL;
+}
+
+// net_loop() ends by itself when the connection breaks
+static int net_check(void)
+{
+	int status = SDL_GetAtomicInt(&net_status);
+
+	if (status == NET_OK) {
+		return 0;
+	}
+
+	net_stop();
+
+	if (status == NET_BROKEN) {
+		quit = 1;
+		return -1;
+	}
+
+	addline(status == NET_LOST_READ ? "connection lost during read\n" : "connection lost during write\n");
+	sockstate = 0;
+	socktimeout = time(NULL);
+	return -1;
+}
+
 int poll_network(void)
 {
+	unsigned char *space;
+	size_t len;
 	int n;
 
 	// something fatal failed (sockstate will somewhen tell you what)
@@ -268,6 +752,7 @@ int poll_network(void)
 		}
 
 		// reset socket
+		net_stop();
 		if (sock) {
 			astonia_net_close(sock);
 			sock = NULL;
@@ -287,6 +772,14 @@ int poll_network(void)
 			socktimeout = time(NULL);
 		}
 
+		if (rec_file && rec_session) {
+			record_bytes(NULL, 0); // end of the recorded connection
+			rec_session = 0;
+		}
+		if (play_file) {
+			return replay_connect();
+		}
+
 		// connect to server (non-blocking); require hostname string
 		if (target_server == NULL) {
 			fail("Server URL not specified.");
@@ -370,6 +863,10 @@ int poll_network(void)
 
 		// statechange
 		sockstate = 3;
+
+		if (game_options & GO_NETTHREAD) {
+			net_start();
+		}
 	}
 
 	// here we go ...
@@ -396,59 +893,90 @@ int poll_network(void)
 		}
 	}
 
+	// the network thread does the rest
+	if (net_thread) {
+		SDL_SetAtomicInt(&net_send, sockstate == 4);
+		return net_check();
+	}
+
+	// nobody listens to a replay
+	if (play_file) {
+		outused = 0;
+	}
+
 	// send
-	if (outused && sockstate == 4 && sock) {
-		n = (int)astonia_net_send(sock, outbuf, outused);
-		if (n == 0) {
-			addline("connection lost during write\n");
-			sockstate = 0;
-			socktimeout = time(NULL);
-			return -1;
-		} else if (n < 0) {
-			// would-block -> no progress this frame
-			n = 0;
-		} else {
-			memmove(outbuf, outbuf + n, outused - (size_t)n);
-			outused -= (size_t)n;
-			sent_bytes += n;
-		}
+	if (outused && sockstate == 4 && sock && send_outbuf() < 0) {
+		addline("connection lost during write\n");
+		sockstate = 0;
+		socktimeout = time(NULL);
+		return -1;
 	}
 
 	// recv
-	n = 0;
-	if (sock && astonia_net_poll(sock, 1, 0) > 0) {
-		n = (int)astonia_net_recv(sock, (char *)inbuf + inused, MAX_INBUF - inused);
+	if (play_file) {
+		space = in_space(&len);
+		if (!len) {
+			return 0; /* inbuf is full, next_tick() has to make room first */
+		}
+
+		n = replay_recv(space, len);
 		if (n < 0) {
-			n = 0; /* would-block */
+			return 0;
 		} else if (n == 0) {
-			addline("connection lost during read\n");
 			sockstate = 0;
 			socktimeout = time(NULL);
-			return -1;
+			return 0;
 		}
-	} else {
-		return 0; /* no data this frame */
+
+		if (rec_file) {
+			record_bytes(space, (size_t)n);
+		}
+		client_received((size_t)n);
+	} else if (sock && recv_inbuf(0) < 0) {
+		addline("connection lost during read\n");
+		sockstate = 0;
+		socktimeout = time(NULL);
+		return -1;
 	}
 
-	inused += (size_t)n;
-	rec_bytes += n;
+	return 0;
+}
 
-	// count ticks
-	while (1) {
-		if (inused >= lastticksize + 1 && *(inbuf + lastticksize) & 0x40) {
-			lastticksize += 1 + (*(inbuf + lastticksize) & 0x3F);
-		} else if (inused >= lastticksize + 2) {
-			lastticksize += 2 + (net_read16(inbuf + lastticksize) & 0x3FFF);
-		} else {
-			break;
-		}
+// Start a session without a server, the ticks come from client_feed()
+int client_start_offline(void)
+{
+	close_client();
 
-		lasttick++;
+	if (inflateInit(&zs)) {
+		note("zsinit failed");
+		return -1;
 	}
+	zsinit = 1;
+	sockstate = 3;
 
 	return 0;
 }
 
+// Add bytes as if they came from the server. Returns the number of bytes
+// taken, less than len if inbuf is full.
+size_t client_feed(const void *buf, size_t len)
+{
+	unsigned char *space;
+	size_t first;
+
+	if (len > MAX_INBUF - inused) {
+		len = MAX_INBUF - inused;
+	}
+
+	space = in_space(&first);
+	first = min(len, first);
+	memcpy(space, buf, first);
+	memcpy(inbuf, (const unsigned char *)buf + first, len - first);
+	client_received(len);
+
+	return len;
+}
+
 static void auto_tick(struct map *cmap)
 {
 	unsigned int x, y;
@@ -471,89 +999,43 @@ static void auto_tick(struct map *cmap)
 	}
 }
 
+// Prefetch the next decoded tick, decode it first without the network thread
 tick_t next_tick(void)
 {
-	size_t tick_sz;
-	int size, ret;
+	struct queue *q;
 	tick_t attick;
 
-	// no room for next tick, leave it in in-queue
-	if (q_size == Q_SIZE) {
+	if (!net_thread && client_decode() < 0) {
+		quit = 1;
 		return 0;
 	}
 
-	// do we have a new tick
-	if (inused >= 1 && (*(inbuf) & 0x40)) {
-		tick_sz = 1 + (*(inbuf) & 0x3F);
-		if (inused < tick_sz) {
-			return 0;
-		}
-		indone = 1;
-	} else if (inused >= 2 && !(*(inbuf) & 0x40)) {
-		tick_sz = 2 + (net_read16(inbuf) & 0x3FFF);
-		if (inused < tick_sz) {
-			return 0;
-		}
-		indone = 2;
-	} else {
+	if (q_in == __atomic_load_n(&q_head, __ATOMIC_ACQUIRE)) {
 		return 0;
 	}
+	q = &queue[q_in & (Q_SIZE - 1)];
 
-	// decompress
-	if (*inbuf & 0x80) {
-		zs.next_in = inbuf + indone;
-		zs.avail_in = (unsigned int)(tick_sz - indone);
-
-		zs.next_out = queue[q_in].buf;
-		zs.avail_out = sizeof(queue[q_in].buf);
-
-		ret = inflate(&zs, Z_SYNC_FLUSH);
-		if (ret != Z_OK) {
-			warn("Compression error %d\n", ret);
-			quit = 1;
-			return 0;
-		}
-
-		if (zs.avail_in) {
-			warn("HELP (%d)\n", zs.avail_in);
-			return 0;
-		}
-
-		size = (int)(sizeof(queue[q_in].buf) - zs.avail_out);
-	} else {
-		size = (int)(tick_sz - indone);
-		memcpy(queue[q_in].buf, inbuf + indone, (size_t)size);
-	}
-	queue[q_in].size = size;
-
+	playout_arrival(q->time);
 	auto_tick(map2);
-	attick = prefetch(queue[q_in].buf, queue[q_in].size);
+	attick = prefetch(q->buf, q->size);
 
-	q_in = (q_in + 1) % Q_SIZE;
+	q_in++;
 	q_size++;
-
-	// remove tick from inbuf
-	if (inused >= tick_sz) {
-		memmove(inbuf, inbuf + tick_sz, inused - tick_sz);
-	} else {
-		note("kuckuck!");
-	}
-	inused = inused - tick_sz;
-
-	// adjust some values
-	lasttick--;
-	lastticksize -= tick_sz;
+	__atomic_sub_fetch(&lasttick, 1, __ATOMIC_RELAXED);
 
 	return attick;
 }
 
 int do_tick(void)
 {
+	struct queue *q;
+
 	// process tick
 	if (q_size > 0) {
+		q = &queue[q_out & (Q_SIZE - 1)];
 		auto_tick(map);
-		process(queue[q_out].buf, queue[q_out].size);
-		q_out = (q_out + 1) % Q_SIZE;
+		process(q->buf, q->size);
+		__atomic_store_n(&q_out, q_out + 1, __ATOMIC_RELEASE); // the slot is free again
 		q_size--;
 		hover_capture_tick();
 
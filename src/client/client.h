@@ -475,7 +475,7 @@ DLL_EXPORT extern uint32_t experience;
 DLL_EXPORT extern uint32_t experience_used;
 DLL_EXPORT extern uint32_t gold;
 DLL_EXPORT extern tick_t tick;
-extern int lasttick; // ticks in inbuf
+extern int lasttick; // ticks received, not prefetched yet
 extern int q_size;
 
 DLL_EXPORT extern unsigned int cflags; // current item (item under mouse cursor) flags
@@ -571,13 +571,26 @@ void cmd_teleport(int nr);
 int poll_network(void);
 tick_t next_tick(void);
 int do_tick(void);
+int client_start_offline(void);
+size_t client_feed(const void *buf, size_t len);
 void cl_client_info(struct client_info *ci);
 void cl_ticker(void);
 int close_client(void);
 int is_char_ceffect(int type);
 
+int record_client(char *filename);
+int replay_client(char *filename, int fast);
+
+struct replay;
+struct replay *replay_create(const char *filename);
+int replay_write(struct replay *r, uint32_t ms, const void *data, size_t len);
+struct replay *replay_open(const char *filename);
+int replay_next(struct replay *r, uint32_t *ms, const unsigned char **data, size_t *len);
+int replay_close(struct replay *r);
+
 extern double server_cycles;
 extern int change_area;
 extern int login_done;
+extern int replay_fast;
 extern unsigned int unique;
 extern unsigned int usum;
@@ -76,17 +76,17 @@
 #define SV_MAP10 128
 #define SV_MAP11 (64 + 128)
 
-#define MAX_INBUF  0xFFFFF
-#define MAX_OUTBUF 0xFFFFF
+#define MAX_INBUF  0x100000 // rings, must be powers of two
+#define MAX_OUTBUF 0x100000
 
-#define Q_SIZE 16
+#define Q_SIZE 16 // power of two
 
 struct queue {
 	unsigned char buf[16384];
 	int size;
+	uint64_t time; // SDL_GetTicksNS() when the tick arrived
 };
 
-int record_client(char *filename);
 int open_client(char *username, char *password);
 int init_network(void);
 void exit_network(void);
@@ -206,20 +206,17 @@ static size_t svl_ping(unsigned char *buf)
 	int diff;
 
 	t = load_u32(buf + 1);
-	diff = (int)((int64_t)SDL_GetTicks() - (int64_t)t);
-	addline("RTT1: %.2fms", diff / 1000.0);
+	diff = (int)((uint32_t)SDL_GetTicks() - t);
+	playout_rtt_sample(diff);
 
 	return 5;
 }
 
+// svl_ping() took the RTT sample when the tick was prefetched, closer to its
+// arrival
 static size_t sv_ping(unsigned char *buf)
 {
-	uint32_t t;
-	int diff;
-
-	t = load_u32(buf + 1);
-	diff = (int)((int64_t)SDL_GetTicks() - (int64_t)t);
-	addline("RTT2: %.2fms", diff / 1000.0);
+	(void)buf;
 
 	return 5;
 }
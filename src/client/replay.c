@@ -0,0 +1,172 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * Replay Files
+ *
+ * A replay holds the bytes the server sent during a game, in the order and
+ * at the time they arrived, so the session can be played back through the
+ * client without a server. The file starts with the magic REPLAY_MAGIC and
+ * REPLAY_VERSION, followed by one chunk per receive: the milliseconds since
+ * the first one, the number of bytes and the bytes. All numbers are 32 bit
+ * little endian. A chunk without bytes marks the end of a connection, the
+ * chunks after it belong to the next one (after an area change).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "client/client.h"
+#include "client/client_private.h"
+
+#define REPLAY_MAGIC   0x43525341 // "ASRC"
+#define REPLAY_VERSION 1
+
+struct replay {
+	FILE *fp;
+	unsigned char *buf;
+	size_t size;
+};
+
+static uint32_t replay_get32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void replay_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+static struct replay *replay_alloc(FILE *fp)
+{
+	struct replay *r;
+
+	r = xmalloc(sizeof(struct replay), MEM_TEMP);
+	r->fp = fp;
+	r->buf = NULL;
+	r->size = 0;
+
+	return r;
+}
+
+struct replay *replay_create(const char *filename)
+{
+	unsigned char head[8];
+	FILE *fp;
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		warn("Could not create replay %s", filename);
+		return NULL;
+	}
+
+	replay_put32(head, REPLAY_MAGIC);
+	replay_put32(head + 4, REPLAY_VERSION);
+	if (fwrite(head, sizeof(head), 1, fp) != 1) {
+		warn("Could not write replay %s", filename);
+		fclose(fp);
+		return NULL;
+	}
+
+	return replay_alloc(fp);
+}
+
+// Add a chunk of len bytes that arrived ms milliseconds after the first one.
+// Returns 0 on success, -1 if the file could not be written.
+int replay_write(struct replay *r, uint32_t ms, const void *data, size_t len)
+{
+	unsigned char head[8];
+
+	replay_put32(head, ms);
+	replay_put32(head + 4, (uint32_t)len);
+	if (fwrite(head, sizeof(head), 1, r->fp) != 1 || (len && fwrite(data, len, 1, r->fp) != 1)) {
+		warn("Could not write replay");
+		return -1;
+	}
+
+	return 0;
+}
+
+struct replay *replay_open(const char *filename)
+{
+	unsigned char head[8];
+	FILE *fp;
+
+	fp = fopen(filename, "rb");
+	if (!fp) {
+		warn("Could not open replay %s", filename);
+		return NULL;
+	}
+
+	if (fread(head, sizeof(head), 1, fp) != 1 || replay_get32(head) != REPLAY_MAGIC) {
+		warn("%s is not a replay", filename);
+		fclose(fp);
+		return NULL;
+	}
+	if (replay_get32(head + 4) != REPLAY_VERSION) {
+		warn("Replay %s has version %u, expected %u", filename, replay_get32(head + 4), REPLAY_VERSION);
+		fclose(fp);
+		return NULL;
+	}
+
+	return replay_alloc(fp);
+}
+
+// Read the next chunk. *data stays valid until the next call. Returns 1 for
+// a chunk, 0 at the end of the file and -1 if the file is damaged.
+int replay_next(struct replay *r, uint32_t *ms, const unsigned char **data, size_t *len)
+{
+	unsigned char head[8];
+	size_t n;
+
+	n = fread(head, 1, sizeof(head), r->fp);
+	if (n == 0) {
+		return 0;
+	}
+	if (n != sizeof(head)) {
+		warn("Replay ends inside a chunk header");
+		return -1;
+	}
+
+	*ms = replay_get32(head);
+	*len = replay_get32(head + 4);
+	if (*len > MAX_INBUF) {
+		warn("Replay chunk of %zu bytes is too large", *len);
+		return -1;
+	}
+
+	if (*len > r->size) {
+		r->buf = xrealloc(r->buf, *len, MEM_TEMP);
+		r->size = *len;
+	}
+	if (*len && fread(r->buf, *len, 1, r->fp) != 1) {
+		warn("Replay ends inside a chunk");
+		return -1;
+	}
+
+	*data = r->buf;
+	return 1;
+}
+
+// Returns -1 if a replay being written could not be completed
+int replay_close(struct replay *r)
+{
+	int err;
+
+	if (!r) {
+		return 0;
+	}
+	err = fclose(r->fp) ? -1 : 0;
+	xfree(r->buf);
+	xfree(r);
+
+	if (err) {
+		warn("Could not write replay");
+	}
+	return err;
+}
@@ -130,6 +130,9 @@ int render_create_font_png(RenderFont *dst, uint32_t *pixel, int dx, int dy, int
 DLL_EXPORT int render_sprite_fx(RenderFX *fx, int scrx, int scry);
 DLL_EXPORT void render_sprite(unsigned int sprite, int scrx, int scry, char light, char align);
 void render_sprite_callfx(unsigned int sprite, int scrx, int scry, char light, char mli, char align);
+void render_batch_begin(void);
+void render_batch_flush(void);
+void render_batch_end(void);
 
 // Basic drawing primitives
 DLL_EXPORT void render_pixel(int x, int y, unsigned short col);
@@ -21,7 +21,7 @@
 // Sprite counters - shared with game_display.c
 int fsprite_cnt = 0, f2sprite_cnt = 0, gsprite_cnt = 0, g2sprite_cnt = 0, isprite_cnt = 0, csprite_cnt = 0;
 // Timing statistics - shared with game_display.c
-static Uint32 qs_time = 0;
+uint32_t qs_time = 0;
 int dg_time = 0, ds_time = 0;
 int stom_off_x = 0, stom_off_y = 0;
 
@@ -173,12 +173,16 @@ void dl_play(void)
 	stat_dlsortcalls = 0;
 	stat_dlused = dlused;
 	qsort(dlsort, (size_t)dlused, sizeof(DL *), dl_qcmp);
-	qs_time += SDL_GetTicks() - start;
+	qs_time += (uint32_t)(SDL_GetTicks() - start);
+
+	// Sprites go out in batched runs; everything else has to flush them first
+	render_batch_begin();
 
 	for (d = 0; d < dlused && !quit; d++) {
 		if (dlsort[d]->call == 0) {
 			render_sprite_fx(&dlsort[d]->renderfx, dlsort[d]->x, dlsort[d]->y - dlsort[d]->h);
 		} else {
+			render_batch_flush();
 			switch (dlsort[d]->call) {
 			case DLC_STRIKE:
 				render_display_strike(dlsort[d]->call_x1, dlsort[d]->call_y1, dlsort[d]->call_x2, dlsort[d]->call_y2);
@@ -216,13 +220,17 @@ void dl_play(void)
 		}
 	}
 
+	render_batch_end();
+
 	dlused = 0;
 }
 
 void sdl_pre_add(unsigned int sprite, signed char sink, unsigned char freeze, unsigned char scale, char cr, char cg,
-    char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl);
+    char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl,
+    int urgent);
 
-void dl_prefetch(void)
+// urgent: the list belongs to the next tick to be shown, workers do it before other prefetches
+void dl_prefetch(int urgent)
 {
 	void helper_add_dl(int attick, DL **dl, int dlused);
 	int d;
@@ -235,7 +243,7 @@ void dl_prefetch(void)
 			    dlsort[d]->renderfx.scale, dlsort[d]->renderfx.cr, dlsort[d]->renderfx.cg, dlsort[d]->renderfx.cb,
 			    dlsort[d]->renderfx.clight, dlsort[d]->renderfx.sat, dlsort[d]->renderfx.c1, dlsort[d]->renderfx.c2,
 			    dlsort[d]->renderfx.c3, dlsort[d]->renderfx.shine, dlsort[d]->renderfx.ml, dlsort[d]->renderfx.ll,
-			    dlsort[d]->renderfx.rl, dlsort[d]->renderfx.ul, dlsort[d]->renderfx.dl);
+			    dlsort[d]->renderfx.rl, dlsort[d]->renderfx.ul, dlsort[d]->renderfx.dl, urgent);
 		}
 	}
 
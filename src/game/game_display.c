@@ -1395,7 +1395,8 @@ void prefetch_game(tick_t attick)
 	set_map_values(map2, attick);
 	set_mapadd(-map2[mapmn(MAPDX / 2, MAPDY / 2)].xadd, -map2[mapmn(MAPDX / 2, MAPDY / 2)].yadd);
 	display_game_map(map2);
-	dl_prefetch();
+	// q_size == 1: this tick is the next one do_tick() shows
+	dl_prefetch(q_size == 1);
 
 #ifdef TICKPRINT
 	printf("Prefetch %u\n", attick);
@@ -147,6 +147,7 @@ void render_display_pulseback(int fx, int fy, int tx, int ty);
 
 // Shared global variables
 extern int ds_time, dg_time; // timing statistics
+extern uint32_t qs_time;
 extern int fsprite_cnt, f2sprite_cnt, gsprite_cnt, g2sprite_cnt, isprite_cnt, csprite_cnt; // sprite counters
 
 // From game_core.c
@@ -156,7 +157,7 @@ DL *dl_next(void);
 DL *dl_next_set(int layer, unsigned int sprite, int scrx, int scry, unsigned char light);
 int dl_qcmp(const void *ca, const void *cb);
 void dl_play(void);
-void dl_prefetch(void);
+void dl_prefetch(int urgent);
 void add_bubble(int x, int y, int h);
 void show_bubbles(void);
 void make_quick(int game, int mcx, int mcy);
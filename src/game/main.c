@@ -257,7 +257,10 @@ void display_usage(void)
 	const char *help =
 	    "The Astonia Client can only be started from the command line or with a specially created shortcut.\n\n"
 	    "Usage: moac -u playername -p password -d url\n ... [-w width] [-h height]\n"
-	    " ... [-m threads] [-o options]\n ... [-k framespersecond]\n\n"
+	    " ... [-m threads] [-o options]\n ... [-k framespersecond]\n ... [-c cacheentries] [-b cachebudget]\n ... [-s diskcache]\n"
+	    " ... [-r recording]\n\n"
+	    "Or: moac -i replay (or -f replay) [-w width] [-h height] ...\n"
+	    "Or: moac -x replay [-w width] [-h height]\n\n"
 	    "url being, for example, \"server.astonia.com\" or \"192.168.77.132\" (without the quotes).\n\n"
 	    "width and height are the desired window size. If this matches the desktop size the client "
 	    "will start in windowed borderless pseudo-fullscreen mode.\n\n"
@@ -276,7 +279,16 @@ void display_usage(void)
 	    "Bit 17 reduces lighting effects (more performance, less pretty).\n"
 	    "Bit 18 disables the minimap.\n"
 	    "Default depends on screen height.\n\n"
-	    "framespersecond will set the display rate in frames per second.\n\n";
+	    "framespersecond will set the display rate in frames per second.\n\n"
+	    "cacheentries is the number of texture cache slots (1000 to 16000, default 16000).\n\n"
+	    "cachebudget is the texture cache size in megabytes. Default is 64 times the square of the "
+	    "graphics scale.\n\n"
+	    "diskcache is the size of the sprite cache on disk in megabytes. Default is 128 times the square of the "
+	    "graphics scale, -1 disables it.\n\n"
+	    "recording is a file to write everything the server sends to, with the time it arrived.\n\n"
+	    "replay is such a recording. -i plays it back instead of connecting to a server, in real time, -f "
+	    "as fast as the client can take it. -x plays it without a window as fast as possible and prints how "
+	    "long each stage of a frame took.\n\n";
 
 	SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_INFORMATION, "Usage", help, NULL);
 	printf("%s", help);
@@ -286,6 +298,10 @@ DLL_EXPORT char server_url[256];
 DLL_EXPORT int server_port = 0;
 DLL_EXPORT int want_width = 0;
 DLL_EXPORT int want_height = 0;
+static char *bench_file = NULL;
+static char *record_file = NULL;
+static char *replay_file = NULL;
+static int replay_unpaced = 0;
 
 int parse_args(int argc, char *argv[])
 {
@@ -384,12 +400,43 @@ int parse_args(int argc, char *argv[])
 			}
 			break;
 		case 'c':
-			// Legacy flag: cache size is now statically allocated (MAX_TEXCACHE = 8000).
-			// Accept but ignore this flag for backward compatibility.
 			if (!val && i + 1 < argc) {
 				val = argv[++i];
 			}
-			// Silently ignored - cache is compile-time fixed
+			if (val) {
+				long c = strtol(val, &end, 10);
+				if (c < INT_MIN || c > INT_MAX) {
+					sdl_cache_size = 0;
+				} else {
+					sdl_cache_size = (int)c;
+				}
+			}
+			break;
+		case 'b':
+			if (!val && i + 1 < argc) {
+				val = argv[++i];
+			}
+			if (val) {
+				long b = strtol(val, &end, 10);
+				if (b < 0 || b > INT_MAX) {
+					sdl_cache_budget = 0;
+				} else {
+					sdl_cache_budget = (int)b;
+				}
+			}
+			break;
+		case 's':
+			if (!val && i + 1 < argc) {
+				val = argv[++i];
+			}
+			if (val) {
+				long s = strtol(val, &end, 10);
+				if (s < INT_MIN || s > INT_MAX) {
+					sdl_disk_budget = 0;
+				} else {
+					sdl_disk_budget = (int)s;
+				}
+			}
 			break;
 		case 'k':
 			if (!val && i + 1 < argc) {
@@ -404,6 +451,32 @@ int parse_args(int argc, char *argv[])
 				}
 			}
 			break;
+		case 'x':
+			if (!val && i + 1 < argc) {
+				val = argv[++i];
+			}
+			if (val) {
+				bench_file = val;
+			}
+			break;
+		case 'r':
+			if (!val && i + 1 < argc) {
+				val = argv[++i];
+			}
+			if (val) {
+				record_file = val;
+			}
+			break;
+		case 'i':
+		case 'f':
+			if (!val && i + 1 < argc) {
+				val = argv[++i];
+			}
+			if (val) {
+				replay_file = val;
+				replay_unpaced = (opt == 'f');
+			}
+			break;
 		case 't':
 			if (!val && i + 1 < argc) {
 				val = argv[++i];
@@ -562,12 +635,13 @@ int main(int argc, char *argv[])
 	load_options();
 
 	// set some stuff
-	if (!*username || !*password || !*server_url) {
+	if (!bench_file && !replay_file && (!*username || !*password || !*server_url)) {
 		display_usage();
 		return 0;
 	}
 
-	xlog(errorfp, "Client started with -h%d -w%d -o%" PRIu64, want_height, want_width, game_options);
+	xlog(errorfp, "Client started with -h%d -w%d -o%" PRIu64 " -c%d -b%d", want_height, want_width, game_options,
+	    sdl_cache_size, sdl_cache_budget);
 
 #ifdef _WIN32
 	SetProcessDPIAware();
@@ -575,6 +649,13 @@ int main(int argc, char *argv[])
 
 	target_server = server_url;
 
+	if (record_file && record_client(record_file)) {
+		return -1;
+	}
+	if (replay_file && replay_client(replay_file, replay_unpaced)) {
+		return -1;
+	}
+
 	if (server_port) {
 		if (server_port < 0 || server_port > UINT16_MAX) {
 			target_port = 0;
@@ -586,6 +667,16 @@ int main(int argc, char *argv[])
 	// init random
 	rrandomize();
 
+	// the benchmark runs headless: no window, no GPU, no sound
+	if (bench_file) {
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+		SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+		if (!want_width && !want_height) {
+			want_width = 800;
+		}
+	}
+
 	determine_resolution();
 
 	sprintf(buf, "Astonia 3 v%d.%d.%d", (VERSION >> 16) & 255, (VERSION >> 8) & 255, (VERSION) & 255);
@@ -605,7 +696,11 @@ int main(int argc, char *argv[])
 	main_init();
 	update_user_keys();
 
-	main_loop();
+	if (bench_file) {
+		ret = bench_run(bench_file);
+	} else {
+		ret = main_loop();
+	}
 
 #ifdef ENABLE_SHAREDMEM
 	sharedmem_exit();
@@ -633,5 +728,5 @@ int main(int argc, char *argv[])
 	if (errorfp != stderr) {
 		fclose(errorfp);
 	}
-	return 0;
+	return ret;
 }
@@ -213,14 +213,21 @@ int render_exit(void)
  */
 DLL_EXPORT int render_sprite_fx(RenderFX *fx, int scrx, int scry)
 {
-	int stx;
+	int stx, lit;
 
 	assert(fx != NULL && "render_sprite_fx: fx=NULL");
 	assert(fx->light >= 0 && fx->light <= 16 && "render_sprite_fx: fx->light out of range");
 	assert(fx->freeze >= 0 && fx->freeze < RENDERFX_MAX_FREEZE && "render_sprite_fx: fx->freeze out of range");
 
-	stx = sdl_tx_load(fx->sprite, fx->sink, fx->freeze, fx->scale, fx->cr, fx->cg, fx->cb, fx->clight, fx->sat, fx->c1,
-	    fx->c2, fx->c3, fx->shine, fx->ml, fx->ll, fx->rl, fx->ul, fx->dl, NULL, 0, 0, NULL, 0, 0);
+	// With draw time lighting all light variants share the texture made with lights at 15
+	lit = sdl_light_at_draw(fx->freeze, fx->ml, fx->ll, fx->rl, fx->ul, fx->dl);
+	if (lit) {
+		stx = sdl_tx_load(fx->sprite, fx->sink, fx->freeze, fx->scale, fx->cr, fx->cg, fx->cb, fx->clight, fx->sat,
+		    fx->c1, fx->c2, fx->c3, fx->shine, 15, 15, 15, 15, 15, NULL, 0, 0, NULL, 0, 0);
+	} else {
+		stx = sdl_tx_load(fx->sprite, fx->sink, fx->freeze, fx->scale, fx->cr, fx->cg, fx->cb, fx->clight, fx->sat,
+		    fx->c1, fx->c2, fx->c3, fx->shine, fx->ml, fx->ll, fx->rl, fx->ul, fx->dl, NULL, 0, 0, NULL, 0, 0);
+	}
 
 	if (stx == -1) {
 		return 0;
@@ -250,7 +257,12 @@ DLL_EXPORT int render_sprite_fx(RenderFX *fx, int scrx, int scry)
 	if (fx->alpha) {
 		sdl_tex_alpha(stx, fx->alpha);
 	}
-	sdl_blit(stx, scrx, scry, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+	if (lit) {
+		sdl_blit_light(stx, scrx, scry, clipsx, clipsy, clipex, clipey, x_offset, y_offset, fx->ml, fx->ll, fx->rl,
+		    fx->ul, fx->dl);
+	} else {
+		sdl_blit(stx, scrx, scry, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+	}
 	if (fx->alpha) {
 		sdl_tex_alpha(stx, 255);
 	}
@@ -309,6 +321,32 @@ DLL_EXPORT void render_sprite(unsigned int sprite, int scrx, int scry, char ligh
 	render_sprite_fx(&fx, scrx, scry);
 }
 
+/**
+ * Start collecting sprite blits into batched draw calls.
+ * Until render_batch_end(), any drawing that is not a sprite must be
+ * preceded by render_batch_flush() to keep the painter's order.
+ */
+void render_batch_begin(void)
+{
+	sdl_batch_begin();
+}
+
+/**
+ * Submit all sprite blits collected so far.
+ */
+void render_batch_flush(void)
+{
+	sdl_batch_flush();
+}
+
+/**
+ * Submit the remaining sprite blits and go back to immediate blitting.
+ */
+void render_batch_end(void)
+{
+	sdl_batch_end();
+}
+
 /**
  * Draw a filled rectangle.
  * Renders a solid colored rectangle with clipping support.
@@ -437,51 +475,43 @@ void render_display_pulseback(int fx, int fy, int tx, int ty)
 
 // text
 
-/**
- * Calculate the pixel width of text.
- * Stops at text terminator character.
- *
- * @return Width in pixels
- */
-DLL_EXPORT int render_text_length(int flags, const char *text)
+// Font for flags: the size, and the shaded or framed variant for the outline pass
+static RenderFont *render_text_font(int flags)
 {
-	RenderFont *font;
-	int x;
-	const char *c;
-
-	if (flags & RENDER_TEXT_SMALL) {
-		font = fontb;
-	} else if (flags & RENDER_TEXT_BIG) {
-		font = fontc;
+	if (flags & RENDER__SHADED_FONT) {
+		if (flags & RENDER_TEXT_SMALL) {
+			return fontb_shaded;
+		} else if (flags & RENDER_TEXT_BIG) {
+			return fontc_shaded;
+		} else {
+			return fonta_shaded;
+		}
+	} else if (flags & RENDER__FRAMED_FONT) {
+		if (flags & RENDER_TEXT_SMALL) {
+			return fontb_framed;
+		} else if (flags & RENDER_TEXT_BIG) {
+			return fontc_framed;
+		} else {
+			return fonta_framed;
+		}
 	} else {
-		font = fonta;
-	}
-
-	for (x = 0, c = text; *c && *c != RENDER_TEXT_TERMINATOR; c++) {
-		x += font[(unsigned char)*c].dim;
+		if (flags & RENDER_TEXT_SMALL) {
+			return fontb;
+		} else if (flags & RENDER_TEXT_BIG) {
+			return fontc;
+		} else {
+			return fonta;
+		}
 	}
-
-	return x;
 }
 
-int render_text_len(int flags, const char *text, int n)
+// Width of the first n characters of text (all of them if n is negative),
+// stopping at the text terminator
+static int render_text_width(RenderFont *font, const char *text, int n)
 {
-	RenderFont *font;
 	int x;
 	const char *c;
 
-	if (n < 0) {
-		return render_text_length(flags, text);
-	}
-
-	if (flags & RENDER_TEXT_SMALL) {
-		font = fontb;
-	} else if (flags & RENDER_TEXT_BIG) {
-		font = fontc;
-	} else {
-		font = fonta;
-	}
-
 	for (x = 0, c = text; *c && *c != RENDER_TEXT_TERMINATOR && n; c++, n--) {
 		x += font[(unsigned char)*c].dim;
 	}
@@ -490,72 +520,55 @@ int render_text_len(int flags, const char *text, int n)
 }
 
 /**
- * Render text at specified position.
- * Supports multiple fonts, alignment, shadows, and outlines.
+ * Calculate the pixel width of text.
+ * Stops at text terminator character.
  *
- * @return Final X coordinate after rendering
+ * @return Width in pixels
  */
-DLL_EXPORT int render_text(int sx, int sy, unsigned short int color, int flags, const char *text)
+DLL_EXPORT int render_text_length(int flags, const char *text)
 {
-	RenderFont *font;
+	return render_text_width(render_text_font(flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG)), text, -1);
+}
 
-	if (flags & RENDER__SHADED_FONT) {
-		if (flags & RENDER_TEXT_SMALL) {
-			font = fontb_shaded;
-		} else if (flags & RENDER_TEXT_BIG) {
-			font = fontc_shaded;
-		} else {
-			font = fonta_shaded;
-		}
-	} else if (flags & RENDER__FRAMED_FONT) {
-		if (flags & RENDER_TEXT_SMALL) {
-			font = fontb_framed;
-		} else if (flags & RENDER_TEXT_BIG) {
-			font = fontc_framed;
-		} else {
-			font = fonta_framed;
-		}
-	} else {
-		if (flags & RENDER_TEXT_SMALL) {
-			font = fontb;
-		} else if (flags & RENDER_TEXT_BIG) {
-			font = fontc;
-		} else {
-			font = fonta;
-		}
-	}
+int render_text_len(int flags, const char *text, int n)
+{
+	return render_text_width(render_text_font(flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG)), text, n < 0 ? -1 : n);
+}
+
+// render_text() for callers who know the width of the text already, dx is -1 if not
+static int render_text_dx(int sx, int sy, unsigned short int color, int flags, const char *text, int dx)
+{
+	RenderFont *font, *ofont = NULL;
+	unsigned short int ocolor = IRGB(0, 0, 0);
+
+	font = render_text_font(flags);
 	if (!font) {
 		return 42;
 	}
 
+	// The shadow or frame is a font of its own, drawn in the same batch as the text
 	if (flags & RENDER_TEXT_SHADED) {
-		render_text(sx - 1, sy - 1, IRGB(0, 0, 0),
-		    RENDER_TEXT_LEFT |
-		        (flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG | RENDER_ALIGN_CENTER | RENDER_TEXT_RIGHT |
-		                     RENDER_TEXT_NOCACHE)) |
-		        RENDER__SHADED_FONT,
-		    text);
+		ofont = render_text_font((flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG)) | RENDER__SHADED_FONT);
 	} else if (flags & RENDER_TEXT_FRAMED) {
+		ofont = render_text_font((flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG)) | RENDER__FRAMED_FONT);
 		if (flags & 512) {
-			render_text(sx - 1, sy - 1, IRGB(31, 31, 31),
-			    RENDER_TEXT_LEFT |
-			        (flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG | RENDER_ALIGN_CENTER | RENDER_TEXT_RIGHT |
-			                     RENDER_TEXT_NOCACHE)) |
-			        RENDER__FRAMED_FONT,
-			    text);
-		} else {
-			render_text(sx - 1, sy - 1, IRGB(0, 0, 0),
-			    RENDER_TEXT_LEFT |
-			        (flags & (RENDER_TEXT_SMALL | RENDER_TEXT_BIG | RENDER_ALIGN_CENTER | RENDER_TEXT_RIGHT |
-			                     RENDER_TEXT_NOCACHE)) |
-			        RENDER__FRAMED_FONT,
-			    text);
+			ocolor = IRGB(31, 31, 31);
 		}
 	}
 
-	sx = sdl_drawtext(sx, sy, color, flags, text, font, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+	return sdl_drawtext_outlined(
+	    sx, sy, color, ocolor, flags, text, font, ofont, dx, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+}
 
-	return sx;
+/**
+ * Render text at specified position.
+ * Supports multiple fonts, alignment, shadows, and outlines.
+ *
+ * @return Final X coordinate after rendering
+ */
+DLL_EXPORT int render_text(int sx, int sy, unsigned short int color, int flags, const char *text)
+{
+	return render_text_dx(sx, sy, color, flags, text, -1);
 }
 
 /**
@@ -586,7 +599,7 @@ DLL_EXPORT int render_text_break(int x, int y, int breakx, unsigned short color,
 			xp = x;
 			y += 10;
 		}
-		render_text(xp, y, color, flags, buf);
+		render_text_dx(xp, y, color, flags, buf, size);
 		xp += size + 4;
 	}
 	return y + 10;
@@ -73,6 +73,46 @@ static void cmd_version(void)
 	}
 }
 
+// /stats toggles the texture cache graphs, /stats csv and /stats json write
+// the frames we have statistics for to a file
+static void cmd_stats(char *ptr)
+{
+	char filename[MAX_PATH];
+	int json, frames;
+
+	while (isspace(*ptr)) {
+		ptr++;
+	}
+
+	if (!*ptr) {
+		display_stats ^= 1;
+		addline("Texture cache statistics %s", display_stats ? "on" : "off");
+		return;
+	}
+
+	if (!strncmp(ptr, "csv", 3)) {
+		json = 0;
+	} else if (!strncmp(ptr, "json", 4)) {
+		json = 1;
+	} else {
+		addline("Usage: /stats [csv|json]");
+		return;
+	}
+
+	if (localdata) {
+		snprintf(filename, sizeof(filename), "%stexstats.%s", localdata, json ? "json" : "csv");
+	} else {
+		snprintf(filename, sizeof(filename), "bin/data/texstats.%s", json ? "json" : "csv");
+	}
+
+	frames = sdl_stats_write(filename, json);
+	if (frames < 0) {
+		addline("Could not write %s", filename);
+	} else {
+		addline("Wrote %d frames to %s", frames, filename);
+	}
+}
+
 static int client_cmd(char *buf)
 {
 	if (!strncmp(buf, "#ps ", 3)) {
@@ -120,6 +160,10 @@ static int client_cmd(char *buf)
 		addline("Volume is now at %d", sound_volume);
 		return 1;
 	}
+	if (!strncmp(buf, "#stats", 6) || !strncmp(buf, "/stats", 6)) {
+		cmd_stats(buf + 6);
+		return 1;
+	}
 	if (!strncmp(buf, "#version", 5) || !strncmp(buf, "/version", 5)) {
 		cmd_version();
 		return 1;
@@ -53,6 +53,10 @@ void update_user_keys(void);
 
 int main_init(void);
 int main_loop(void);
+int bench_run(const char *filename);
+void playout_reset(void);
+void playout_arrival(uint64_t time);
+void playout_rtt_sample(int ms);
 void main_exit(void);
 void gui_dump(FILE *fp);
 void gui_sdl_keyproc(SDL_Keycode wparam);
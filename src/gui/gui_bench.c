@@ -0,0 +1,245 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * Graphical User Interface - Replay benchmark
+ *
+ * Feeds a replay through the same tick and frame pipeline main_loop() uses,
+ * one tick per frame and as fast as the client can go, and prints the p50,
+ * p95 and p99 of every stage and of the whole frame. The existing timing
+ * counters (sdl_time_*, dg_time, ds_time, qs_time) are sampled every frame to
+ * break the stages down further. Meant to run on the offscreen video driver
+ * with the software renderer, see "-x" in main.c.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL3/SDL.h>
+
+#include "astonia.h"
+#include "gui/gui.h"
+#include "gui/gui_private.h"
+#include "client/client.h"
+#include "game/game.h"
+#include "sdl/sdl.h"
+#include "modder/modder.h"
+
+// Stages of one frame, in microseconds
+enum { BS_FEED, BS_TICK, BS_PROCESS, BS_DISPLAY, BS_UPLOAD, BS_PRESENT, BS_FRAME, BS_COUNT };
+static const char *bench_stage_name[BS_COUNT] = {
+    "feed", "next_tick", "do_tick", "display", "sdl_pre_do", "present", "frame"};
+
+// Existing counters, in milliseconds per frame
+enum {
+	BC_PRELOAD,
+	BC_MAKE,
+	BC_LOAD,
+	BC_ALLOC,
+	BC_TEX,
+	BC_TEXT,
+	BC_BLIT,
+	BC_PRE2,
+	BC_DG,
+	BC_DS,
+	BC_QS,
+	BC_COUNT
+};
+static const char *bench_counter_name[BC_COUNT] = {"sdl_time_preload", "sdl_time_make", "sdl_time_load",
+    "sdl_time_alloc", "sdl_time_tex", "sdl_time_text", "sdl_time_blit", "sdl_time_pre2", "dg_time", "ds_time",
+    "qs_time"};
+
+struct bench_frame {
+	uint32_t us[BS_COUNT];
+	uint32_t ms[BC_COUNT];
+};
+
+static void bench_counters(long long *c)
+{
+	extern long long sdl_time_preload, sdl_time_make, sdl_time_load, sdl_time_alloc, sdl_time_tex, sdl_time_text,
+	    sdl_time_blit, sdl_time_pre2;
+	extern int dg_time;
+	extern uint32_t qs_time;
+
+	c[BC_PRELOAD] = sdl_time_preload;
+	c[BC_MAKE] = sdl_time_make;
+	c[BC_LOAD] = sdl_time_load;
+	c[BC_ALLOC] = sdl_time_alloc;
+	c[BC_TEX] = sdl_time_tex;
+	c[BC_TEXT] = sdl_time_text;
+	c[BC_BLIT] = sdl_time_blit;
+	c[BC_PRE2] = sdl_time_pre2;
+	c[BC_DG] = dg_time;
+	c[BC_DS] = 0; // not a sum, display_game() sets it to its own time
+	c[BC_QS] = qs_time;
+}
+
+static uint32_t bench_us(Uint64 start)
+{
+	return (uint32_t)((SDL_GetTicksNS() - start) / 1000);
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	uint32_t va = *(const uint32_t *)a, vb = *(const uint32_t *)b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+// Sorts val[0..n-1] and prints its percentiles, in ms with div 1000 for
+// microseconds and div 1 for milliseconds
+static void bench_print(const char *name, uint32_t *val, int n, double div)
+{
+	uint64_t sum = 0;
+	int i;
+
+	qsort(val, (size_t)n, sizeof(uint32_t), bench_cmp);
+	for (i = 0; i < n; i++) {
+		sum += val[i];
+	}
+
+	printf("%-18s %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, (double)sum / n / div, val[n * 50 / 100] / div,
+	    val[n * 95 / 100] / div, val[n * 99 / 100] / div, val[n - 1] / div);
+}
+
+// Play the replay in filename and print the results. Returns 0 on success,
+// -1 if the replay could not be read.
+int bench_run(const char *filename)
+{
+	void prefetch_game(tick_t attick);
+	int sdl_pre_do(uint64_t deadline);
+	extern int ds_time;
+	struct bench_frame *f = NULL;
+	int size = 0, used = 0, ticks = 0, i, k, err = 0;
+	long long last[BC_COUNT], cur[BC_COUNT];
+	const unsigned char *data = NULL;
+	size_t len = 0, done = 0;
+	uint32_t ms, *val;
+	struct replay *r;
+	Uint64 start, frame_start, bench_start;
+	tick_t attick;
+
+	r = replay_open(filename);
+	if (!r) {
+		return -1;
+	}
+	if (client_start_offline()) {
+		replay_close(r);
+		return -1;
+	}
+
+	amod_gamestart();
+	bench_start = SDL_GetTicksNS();
+	bench_counters(last);
+
+	while (!quit) {
+		now = SDL_GetTicks();
+		frame_start = SDL_GetTicksNS();
+		if (used == size) {
+			size = size ? size * 2 : 4096;
+			f = xrealloc(f, (size_t)size * sizeof(struct bench_frame), MEM_TEMP);
+		}
+
+		// feed the replay until we have a tick to show
+		start = SDL_GetTicksNS();
+		while (lasttick + q_size < 1) {
+			if (done == len) {
+				if ((err = replay_next(r, &ms, &data, &len)) != 1) {
+					break;
+				}
+				done = 0;
+				continue;
+			}
+			done += client_feed(data + done, len - done);
+		}
+		if (lasttick + q_size < 1) {
+			break; // end of the replay
+		}
+		f[used].us[BS_FEED] = bench_us(start);
+
+		start = SDL_GetTicksNS();
+		while ((attick = next_tick())) {
+			prefetch_game(attick);
+		}
+		f[used].us[BS_TICK] = bench_us(start);
+
+		start = SDL_GetTicksNS();
+		if (do_tick()) {
+			ticks++;
+			amod_tick();
+		}
+		if (sockstate == 3 && login_done) {
+			sockstate = 4;
+		}
+		if (change_area || kicked_out) {
+			break; // the replay only holds one session
+		}
+		f[used].us[BS_PROCESS] = bench_us(start);
+
+		start = SDL_GetTicksNS();
+		sdl_clear();
+		display();
+		amod_frame();
+		display_mouseover();
+		minimap_update();
+		f[used].us[BS_DISPLAY] = bench_us(start);
+
+		start = SDL_GetTicksNS();
+		sdl_loop();
+		sdl_pre_do(SDL_GetTicks());
+		f[used].us[BS_UPLOAD] = bench_us(start);
+
+		start = SDL_GetTicksNS();
+		sdl_render();
+		f[used].us[BS_PRESENT] = bench_us(start);
+
+		f[used].us[BS_FRAME] = bench_us(frame_start);
+
+		bench_counters(cur);
+		for (k = 0; k < BC_COUNT; k++) {
+			f[used].ms[k] = (uint32_t)(cur[k] - last[k]);
+			last[k] = cur[k];
+		}
+		f[used].ms[BC_DS] = (uint32_t)ds_time;
+
+		// frames before the login are not part of the game
+		if (sockstate == 4) {
+			used++;
+		}
+	}
+
+	replay_close(r);
+
+	if (err < 0) {
+		xfree(f);
+		return -1;
+	}
+	if (!used) {
+		printf("%s: no frames to measure\n", filename);
+		xfree(f);
+		return 0;
+	}
+
+	printf("%s: %d frames, %d ticks, %.2f s\n\n", filename, used, ticks,
+	    (double)(SDL_GetTicksNS() - bench_start) / 1e9);
+	printf("%-18s %9s %9s %9s %9s %9s\n", "stage (ms)", "mean", "p50", "p95", "p99", "max");
+
+	val = xmalloc((size_t)used * sizeof(uint32_t), MEM_TEMP);
+	for (k = 0; k < BS_COUNT; k++) {
+		for (i = 0; i < used; i++) {
+			val[i] = f[i].us[k];
+		}
+		bench_print(bench_stage_name[k], val, used, 1000.0);
+	}
+	printf("\n%-18s %9s %9s %9s %9s %9s\n", "counter (ms)", "mean", "p50", "p95", "p99", "max");
+	for (k = 0; k < BC_COUNT; k++) {
+		for (i = 0; i < used; i++) {
+			val[i] = f[i].ms[k];
+		}
+		bench_print(bench_counter_name[k], val, used, 1.0);
+	}
+
+	xfree(val);
+	xfree(f);
+
+	return 0;
+}
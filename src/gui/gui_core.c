@@ -32,6 +32,7 @@ int skip = 1, idle = 0, tota = 1, frames = 0;
 // globals display
 
 int display_vc = 0;
+int display_stats = 0;
 int display_help = 0, display_quest = 0;
 
 int playersprite_override = 0;
@@ -184,8 +185,6 @@ void set_invoff(int bymouse, int ny);
 void set_skloff(int bymouse, int ny);
 void set_conoff(int bymouse, int ny);
 void display(void);
-int calc_tick_delay_short(int size);
-int calc_tick_delay_normal(int size);
 
 static void init_colors(void)
 {
@@ -248,11 +247,11 @@ void main_exit(void)
 static void flip_at(unsigned int t)
 {
 	Uint64 tnow;
-	int sdl_pre_do(void);
+	int sdl_pre_do(uint64_t deadline);
 
 	do {
 		sdl_loop();
-		if (!sdl_is_shown() || !sdl_pre_do()) {
+		if (!sdl_is_shown() || !sdl_pre_do(t)) {
 			SDL_Delay(1);
 		}
 		tnow = SDL_GetTicks();
@@ -312,6 +311,9 @@ int main_loop(void)
 				if (sockstate == 4 && ltick % TICKS == 0) {
 					cl_ticker();
 				}
+				if (sockstate == 4) {
+					playout_ping(ltick);
+				}
 				amod_tick();
 #ifdef ENABLE_SHAREDMEM
 				sharedmem_update();
@@ -361,10 +363,12 @@ int main_loop(void)
 		}
 
 		if (do_one_tick) {
-			if (game_options & GO_SHORT) {
-				tmp = calc_tick_delay_short(lasttick + q_size);
+			if (replay_fast) {
+				// an unpaced replay: the next tick is due right away
+				nexttick = (int)SDL_GetTicks();
+				tmp = 0;
 			} else {
-				tmp = calc_tick_delay_normal(lasttick + q_size);
+				tmp = playout_delay(lasttick + q_size);
 			}
 			nexttick += tmp;
 			tota += tmp;
@@ -391,97 +395,6 @@ int main_loop(void)
 	return 0;
 }
 
-int calc_tick_delay_short(int size)
-{
-	int tmp;
-	switch (size) {
-	case 0:
-		tmp = (int)(MPT * 2.00);
-		break;
-	case 1:
-		tmp = (int)(MPT * 1.25);
-		break;
-	case 2:
-		tmp = (int)(MPT * 1.10);
-		break;
-	case 3:
-		tmp = MPT;
-		break; // optimal
-	case 4:
-		tmp = MPT - 1;
-		break;
-	case 5:
-		tmp = MPT - 1;
-		break;
-	case 6:
-		tmp = (int)(MPT * 0.90);
-		break;
-	case 7:
-		tmp = (int)(MPT * 0.75);
-		break;
-	case 8:
-		tmp = (int)(MPT * 0.60);
-		break;
-	case 9:
-		tmp = (int)(MPT * 0.50);
-		break;
-	default:
-		tmp = (int)(MPT * 0.25);
-		break;
-	}
-	return tmp;
-}
-
-int calc_tick_delay_normal(int size)
-{
-	int tmp;
-	switch (size) {
-	case 0:
-		tmp = (int)(MPT * 2.00);
-		break;
-	case 1:
-		tmp = (int)(MPT * 1.50);
-		break;
-	case 2:
-		tmp = (int)(MPT * 1.40);
-		break;
-	case 3:
-		tmp = (int)(MPT * 1.25);
-		break;
-	case 4:
-		tmp = (int)(MPT * 1.10);
-		break;
-	case 5:
-		tmp = MPT + 1;
-		break;
-	case 6:
-		tmp = MPT;
-		break; // optimal
-	case 7:
-		tmp = MPT - 1;
-		break;
-	case 8:
-		tmp = MPT - 1;
-		break;
-	case 9:
-		tmp = (int)(MPT * 0.90);
-		break;
-	case 10:
-		tmp = (int)(MPT * 0.75);
-		break;
-	case 11:
-		tmp = (int)(MPT * 0.60);
-		break;
-	case 12:
-		tmp = (int)(MPT * 0.50);
-		break;
-	default:
-		tmp = (int)(MPT * 0.25);
-		break;
-	}
-	return tmp;
-}
-
 int vk_special_dec(void)
 {
 	int n, panic = 99;
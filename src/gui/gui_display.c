@@ -125,6 +125,35 @@ void dx_copysprite_emerald(int scrx, int scry, int emx, int emy)
 
 size_t get_memory_usage(void);
 
+// Texture cache statistics of the last 100 frames, toggled with /stats
+static void display_texstats(void)
+{
+	extern int x_offset, y_offset;
+	struct sdl_stats s;
+	int px = 10, py = 35 + (!(game_options & GO_SMALLTOP) ? 0 : gui_topoff);
+	unsigned short col = IRGB(8, 31, 8);
+	int flags = RENDER_TEXT_LEFT | RENDER_TEXT_FRAMED | RENDER_TEXT_NOCACHE;
+
+	if (!sdl_stats_get(0, &s)) {
+		return;
+	}
+
+	render_text_fmt(px, py += 10, col, flags, "Miss %u (%u hit, %u pre)", s.miss, s.hit, s.pre);
+	sdl_stats_graph(px, py += 40, SDL_STAT_MISS, 1, x_offset, y_offset);
+
+	render_text_fmt(px, py += 10, col, flags, "Upload %u (%uKB)", s.upload, s.upload_bytes / 1024);
+	sdl_stats_graph(px, py += 40, SDL_STAT_UPLOAD_KB, 64, x_offset, y_offset);
+
+	render_text_fmt(px, py += 10, col, flags, "Evict %u (%u used)", s.evict, s.used);
+	sdl_stats_graph(px, py += 40, SDL_STAT_EVICT, 1, x_offset, y_offset);
+
+	render_text_fmt(px, py += 10, col, flags, "Jobs %u", s.queue);
+	sdl_stats_graph(px, py += 40, SDL_STAT_QUEUE, 4, x_offset, y_offset);
+
+	render_text_fmt(px, py += 10, col, flags, "Wait %ums", s.wait);
+	sdl_stats_graph(px, py += 40, SDL_STAT_WAIT, 1, x_offset, y_offset);
+}
+
 void display(void)
 {
 	extern long long sdl_time_make, sdl_time_tex, sdl_time_tex_main, sdl_time_text, sdl_time_blit;
@@ -244,8 +273,11 @@ display_graphs:;
 
 	int64_t duration = (int64_t)(SDL_GetTicks() - start);
 
+	if (display_stats) {
+		display_texstats();
+	}
+
 	if (display_vc) {
-		extern long long texc_miss, texc_pre; // mem_tex,
 		extern uint64_t sdl_backgnd_wait, sdl_backgnd_work, sdl_time_preload, sdl_time_load, gui_time_network;
 		extern uint64_t gui_frametime, gui_ticktime;
 		extern uint64_t sdl_time_pre1, sdl_time_pre2, sdl_time_pre3, sdl_time_mutex, sdl_time_alloc, sdl_time_make_main;
@@ -255,6 +287,8 @@ display_graphs:;
 		static unsigned char dur_graph[100], size1_graph[100], size2_graph[100],
 		    size3_graph[100]; //,size_graph[100];load_graph[100],
 		static unsigned char pre1_graph[100], pre2_graph[100], pre3_graph[100];
+		static unsigned char wait_graph[100];
+		extern uint64_t sdl_render_wait, sdl_render_wait_count, sdl_render_steals;
 		// static int frame_min=99,frame_max=0,frame_step=0;
 		// static int tick_min=99,tick_max=0,tick_step=0;
 		int px = 800 - 110, py = 35 + (!(game_options & GO_SMALLTOP) ? 0 : gui_topoff);
@@ -340,9 +374,14 @@ display_graphs:;
 
 
 		size = (lasttick + q_size) * 2;
-		render_text_fmt(px, py += 10, IRGB(8, 31, 8), RENDER_TEXT_FRAMED | RENDER_TEXT_LEFT, "Queue %d", size / 2);
+		render_text_fmt(px, py += 10, IRGB(8, 31, 8), RENDER_TEXT_NOCACHE | RENDER_TEXT_FRAMED | RENDER_TEXT_LEFT,
+		    "Queue %d/%d %d%%", size / 2, playout_target, playout_speed);
 		sdl_bargraph_add(sizeof(pre2_graph), size3_graph, size < 42 ? size : 42);
 		sdl_bargraph(px, py += 40, sizeof(pre2_graph), size3_graph, x_offset, y_offset);
+		render_text_fmt(px, py += 10, IRGB(8, 31, 8), RENDER_TEXT_NOCACHE | RENDER_TEXT_FRAMED | RENDER_TEXT_LEFT,
+		    "Jitter %d RTT %d", playout_jitter, playout_rtt);
+		render_text_fmt(px, py += 10, IRGB(8, 31, 8), RENDER_TEXT_NOCACHE | RENDER_TEXT_FRAMED | RENDER_TEXT_LEFT,
+		    "Stalls %d", playout_stalls);
 #if 0
 	    size=sdl_time_alloc;
 	    render_text(px,py+=10,IRGB(8,31,8),RENDER_TEXT_LEFT|RENDER_TEXT_FRAMED,"Alloc");
@@ -372,6 +411,13 @@ display_graphs:;
 		}
 		sdl_bargraph_add(sizeof(pre1_graph), pre1_graph, size);
 		sdl_bargraph(px, py += 40, sizeof(pre1_graph), pre1_graph, x_offset, y_offset);
+
+		// Render thread blocked on sprites the workers had not finished (count, made inline)
+		size = sdl_render_wait > 42 ? 42 : (int)sdl_render_wait;
+		render_text_fmt(px, py += 10, IRGB(8, 31, 8), RENDER_TEXT_NOCACHE | RENDER_TEXT_LEFT | RENDER_TEXT_FRAMED,
+		    "Wait %" PRIu64 " (%" PRIu64 "/%" PRIu64 ")", sdl_render_wait, sdl_render_wait_count, sdl_render_steals);
+		sdl_bargraph_add(sizeof(wait_graph), wait_graph, size);
+		sdl_bargraph(px, py += 40, sizeof(wait_graph), wait_graph, x_offset, y_offset);
 #if 0
 	        render_text_fmt(px,py+=10,IRGB(8,31,8),RENDER_TEXT_SMALL|RENDER_TEXT_LEFT|RENDER_TEXT_FRAMED,"Mutex");
 	        sdl_bargraph_add(sizeof(pre2_graph),pre2_graph,sdl_time_mutex/sdl_multi<42?sdl_time_mutex/sdl_multi:42);
@@ -431,10 +477,11 @@ display_graphs:;
 		sdl_time_pre3 = 0;
 		sdl_time_mutex = 0;
 		sdl_time_tex_main = 0;
+		sdl_render_wait = 0;
+		sdl_render_wait_count = 0;
+		sdl_render_steals = 0;
 		gui_time_misc = 0;
 		sdl_time_alloc = 0;
-		texc_miss = 0;
-		texc_pre = 0;
 		sdl_time_make_main = 0;
 		gui_time_network = 0;
 #if 0
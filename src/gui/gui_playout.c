@@ -0,0 +1,181 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * Graphical User Interface - Tick Playout
+ *
+ * Decides when the next tick is shown. The server sends TICKS ticks per
+ * second, but they arrive with jitter, so we keep some of them buffered and
+ * play them a little faster or slower to hold the buffer at a target depth.
+ * The target follows the connection: every tick's arrival is compared to a
+ * steady schedule, and the spread of that lateness over the last PO_WINDOW
+ * ticks (about ten seconds) is the jitter we have to cover. Half the spread
+ * of the RTTs from sv_ping counts as well, in case the ticks arrive too
+ * bunched up to tell. A good connection gets a shallow buffer and little
+ * delay, a bad one a deeper buffer and smooth animations. GO_SHORT trades
+ * more stutter for less delay: it covers less of the spread and keeps no
+ * spare tick.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+
+#include "astonia.h"
+#include "gui/gui.h"
+#include "gui/gui_private.h"
+#include "client/client.h"
+#include "client/client_private.h"
+#include "client/protocol.h"
+
+#define PO_WINDOW     256 // ticks of arrival history, power of two
+#define PO_RTTS       16 // RTT samples, power of two
+#define PO_WARMUP     (TICKS * 2) // ticks before we trust the history
+#define PO_MAX_TARGET (Q_SIZE - 4) // room to catch up before the queue is full
+#define PO_PING       (TICKS * 2) // ticks between two pings
+
+#define PO_TICK_NS (1000000000ull / TICKS)
+
+// Live metrics, see display_vc
+int playout_depth; // ticks buffered when the last tick was shown
+int playout_target = 1; // depth we aim for
+int playout_speed = 100; // playout speed in percent, above 100 means catching up
+int playout_jitter; // ms of arrival jitter we cover
+int playout_rtt; // ms, the smallest recent RTT
+int playout_stalls; // ticks that were due with nothing buffered
+
+static uint64_t po_base; // arrival of the first tick, in ns
+static uint64_t po_count; // ticks arrived since playout_reset()
+static int32_t po_late[PO_WINDOW]; // µs each tick arrived behind the schedule
+static int po_rtt[PO_RTTS];
+static unsigned int po_rtt_count;
+
+// Speed for a buffer below the target (po_slow) and above (po_fast),
+// indexed by the difference. Lifted from the old fixed tables.
+static const double po_slow[] = {1.00, 1.10, 1.25, 1.40};
+static const double po_fast[] = {1.00, 0.98, 0.98, 0.90, 0.75, 0.60, 0.50, 0.25};
+
+// A new connection, its ticks start a new schedule
+void playout_reset(void)
+{
+	po_base = 0;
+	po_count = 0;
+	po_rtt_count = 0;
+	playout_rtt = 0;
+	playout_jitter = 0;
+}
+
+// A tick that arrived at time (SDL_GetTicksNS()) is being prefetched
+void playout_arrival(uint64_t time)
+{
+	int64_t late;
+
+	if (!po_count) {
+		po_base = time;
+	}
+
+	late = ((int64_t)(time - po_base) - (int64_t)(po_count * PO_TICK_NS)) / 1000;
+	po_late[po_count & (PO_WINDOW - 1)] = (int32_t)(late > INT32_MAX ? INT32_MAX : late);
+	po_count++;
+}
+
+// sv_ping() got the answer to a ping sent ms ago
+void playout_rtt_sample(int ms)
+{
+	int n, cnt;
+
+	if (ms < 0) {
+		return;
+	}
+	po_rtt[po_rtt_count & (PO_RTTS - 1)] = ms;
+	po_rtt_count++;
+
+	cnt = po_rtt_count < PO_RTTS ? (int)po_rtt_count : PO_RTTS;
+	playout_rtt = po_rtt[0];
+	for (n = 1; n < cnt; n++) {
+		playout_rtt = min(playout_rtt, po_rtt[n]);
+	}
+}
+
+static int po_cmp(const void *a, const void *b)
+{
+	int32_t va = *(const int32_t *)a, vb = *(const int32_t *)b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+// Spread of the arrivals in ms: how late the p-th percentile tick was,
+// compared to the earliest one
+static int po_spread(int p)
+{
+	static int32_t tmp[PO_WINDOW];
+	int cnt;
+
+	cnt = po_count < PO_WINDOW ? (int)po_count : PO_WINDOW;
+	memcpy(tmp, po_late, (size_t)cnt * sizeof(int32_t));
+	qsort(tmp, (size_t)cnt, sizeof(int32_t), po_cmp);
+
+	return (tmp[(cnt - 1) * p / 100] - tmp[0]) / 1000;
+}
+
+static int po_rtt_spread(void)
+{
+	int n, cnt, high = 0;
+
+	cnt = po_rtt_count < PO_RTTS ? (int)po_rtt_count : PO_RTTS;
+	for (n = 0; n < cnt; n++) {
+		high = max(high, po_rtt[n]);
+	}
+
+	return cnt > 1 ? high - playout_rtt : 0;
+}
+
+static void po_update_target(void)
+{
+	int shortcut = (game_options & GO_SHORT) != 0;
+
+	// not enough history yet, start where the old tables settled
+	if (po_count < PO_WARMUP) {
+		playout_target = shortcut ? 3 : 6;
+		return;
+	}
+
+	playout_jitter = max(po_spread(shortcut ? 90 : 99), po_rtt_spread() / 2);
+
+	// one tick to cover the phase between arrival and display, enough for the
+	// jitter (rounded) and, without GO_SHORT, one to spare
+	playout_target = 1 + (playout_jitter + MPT / 2) / MPT + !shortcut;
+	playout_target = min(playout_target, PO_MAX_TARGET);
+}
+
+// Milliseconds until the next tick is due, with depth ticks buffered. Called
+// once for every tick shown.
+int playout_delay(int depth)
+{
+	int diff;
+	double speed;
+
+	po_update_target();
+	playout_depth = depth;
+
+	diff = depth - playout_target;
+	if (!depth) {
+		playout_stalls++;
+		speed = 0.5; // nothing to show, wait for it
+	} else if (diff < 0) {
+		speed = 1.0 / po_slow[min(-diff, (int)ARRAYSIZE(po_slow) - 1)];
+	} else {
+		speed = 1.0 / po_fast[min(diff, (int)ARRAYSIZE(po_fast) - 1)];
+	}
+	playout_speed = (int)(speed * 100 + 0.5);
+
+	return (int)(MPT / speed);
+}
+
+// Called for every tick shown while connected, keeps the RTT samples coming
+void playout_ping(int ltick)
+{
+	if (ltick % PO_PING == 0) {
+		cmd_ping();
+	}
+}
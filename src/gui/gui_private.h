@@ -332,6 +332,7 @@ extern int act_lck;
 extern uint64_t gui_time_misc;
 extern int skip, idle, tota, frames;
 extern int display_vc;
+extern int display_stats;
 extern int display_help, display_quest;
 extern int playersprite_override;
 extern int update_skltab;
@@ -355,6 +356,13 @@ extern uint64_t gui_frametime;
 extern uint64_t gui_ticktime;
 DLL_EXPORT extern int game_slowdown;
 
+// ============================================================================
+// Shared variables from gui_playout.c
+// ============================================================================
+extern int playout_depth, playout_target, playout_speed, playout_jitter, playout_rtt, playout_stalls;
+int playout_delay(int depth);
+void playout_ping(int ltick);
+
 // Platform-specific GUI functions
 void gui_sdl_draghack(void);
 
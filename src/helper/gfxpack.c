@@ -0,0 +1,354 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * gfxpack
+ *
+ * Builds the sprite pack the client maps instead of decoding PNGs. Every sprite
+ * in res/gx1*.zip and res/gx<scale>*.zip is run through the client's own
+ * sdl_load_image(), so the archives are searched in the same order (mod, then
+ * patch, then base, high res before up-scaled standard), and the trimmed,
+ * premultiplied result is stored in res/gx<scale>.pack.
+ *
+ * Usage: gfxpack <scale> [-z]
+ *
+ * -z compresses each sprite with LZ4. The pack gets a lot smaller, but the
+ * client has to unpack the sprites instead of using them in place.
+ *
+ * Run it from the main folder, like the client. The client ignores the pack
+ * once any of the archives changes, so run it again after every update.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+#include <png.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+// What sdl_image.c, sdl_archive.c and sdl_pack.c expect from the rest of the client
+int sdl_scale = 1;
+long long mem_png = 0;
+struct sdl_archive *sdl_zip1 = NULL, *sdl_zip1p = NULL, *sdl_zip1m = NULL;
+struct sdl_archive *sdl_zip2 = NULL, *sdl_zip2p = NULL, *sdl_zip2m = NULL;
+
+int note(const char *format, ...)
+{
+	va_list va;
+
+	va_start(va, format);
+	vprintf(format, va);
+	va_end(va);
+	printf("\n");
+
+	return 0;
+}
+
+int warn(const char *format, ...)
+{
+	va_list va;
+
+	va_start(va, format);
+	printf("WARN: ");
+	vprintf(format, va);
+	va_end(va);
+	printf("\n");
+
+	return 0;
+}
+
+int fail(const char *format, ...)
+{
+	va_list va;
+
+	va_start(va, format);
+	printf("FAIL: ");
+	vprintf(format, va);
+	va_end(va);
+	printf("\n");
+
+	return 0;
+}
+
+void display_messagebox(char *title, char *text)
+{
+	printf("%s: %s\n", title, text);
+}
+
+void *xmalloc(size_t size, uint8_t ID)
+{
+	return calloc(1, size);
+}
+
+void xfree(void *ptr)
+{
+	free(ptr);
+}
+
+// ============================================================================
+// LZ4 block compressor, greedy, counterpart of sdl_lz4_decode()
+// ============================================================================
+
+#define LZ4_HASHBITS     16
+#define LZ4_MINMATCH     4
+#define LZ4_LASTLITERALS 5 // the last 5 bytes are always literals
+#define LZ4_MFLIMIT      12 // no match may start in the last 12 bytes
+
+static uint32_t lz4_table[1 << LZ4_HASHBITS];
+
+static uint32_t lz4_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint8_t *lz4_length(uint8_t *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+
+	return op;
+}
+
+static uint8_t *lz4_sequence(uint8_t *op, const uint8_t *lit, size_t litlen, size_t off, size_t matchlen)
+{
+	uint8_t *token = op++;
+
+	*token = (uint8_t)((litlen < 15 ? litlen : 15) << 4);
+	if (litlen >= 15) {
+		op = lz4_length(op, litlen - 15);
+	}
+	memcpy(op, lit, litlen);
+	op += litlen;
+
+	if (!matchlen) {
+		return op;
+	}
+
+	*op++ = (uint8_t)(off & 0xff);
+	*op++ = (uint8_t)(off >> 8);
+	matchlen -= LZ4_MINMATCH;
+	*token |= (uint8_t)(matchlen < 15 ? matchlen : 15);
+	if (matchlen >= 15) {
+		op = lz4_length(op, matchlen - 15);
+	}
+
+	return op;
+}
+
+// Worst case size of the block for len bytes of input
+static size_t lz4_bound(size_t len)
+{
+	return len + len / 255 + 16;
+}
+
+static size_t lz4_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t ip = 0, anchor = 0, ref, matchlen;
+	uint32_t h;
+	uint8_t *op = dst;
+
+	memset(lz4_table, 0, sizeof(lz4_table));
+
+	while (len > LZ4_MFLIMIT && ip < len - LZ4_MFLIMIT) {
+		h = (lz4_read32(src + ip) * 2654435761u) >> (32 - LZ4_HASHBITS);
+		ref = lz4_table[h];
+		lz4_table[h] = (uint32_t)ip + 1;
+
+		if (!ref-- || ip - ref > 65535 || lz4_read32(src + ref) != lz4_read32(src + ip)) {
+			ip++;
+			continue;
+		}
+
+		matchlen = LZ4_MINMATCH;
+		while (ip + matchlen < len - LZ4_LASTLITERALS && src[ref + matchlen] == src[ip + matchlen]) {
+			matchlen++;
+		}
+
+		op = lz4_sequence(op, src + anchor, ip - anchor, ip - ref, matchlen);
+		ip += matchlen;
+		anchor = ip;
+	}
+
+	op = lz4_sequence(op, src + anchor, len - anchor, 0, 0);
+
+	return (size_t)(op - dst);
+}
+
+// ============================================================================
+// Pack
+// ============================================================================
+
+static void open_archives(int scale)
+{
+	char filename[80];
+
+	sdl_zip1 = sdl_archive_open("res/gx1.zip");
+	sdl_zip1p = sdl_archive_open("res/gx1_patch.zip");
+	sdl_zip1m = sdl_archive_open("res/gx1_mod.zip");
+
+	if (scale > 1) {
+		snprintf(filename, sizeof(filename), "res/gx%d.zip", scale);
+		sdl_zip2 = sdl_archive_open(filename);
+		snprintf(filename, sizeof(filename), "res/gx%d_patch.zip", scale);
+		sdl_zip2p = sdl_archive_open(filename);
+		snprintf(filename, sizeof(filename), "res/gx%d_mod.zip", scale);
+		sdl_zip2m = sdl_archive_open(filename);
+	}
+}
+
+static int write_all(FILE *fp, const void *data, size_t len)
+{
+	return fwrite(data, 1, len, fp) == len;
+}
+
+int main(int argc, char *args[])
+{
+	struct sdl_pack_header head = {0};
+	struct sdl_pack_entry *index;
+	struct sdl_image si;
+	uint8_t *packed = NULL, pad[16] = {0};
+	uint64_t offset, raw = 0, stored = 0;
+	uint32_t count = 0, sprite;
+	size_t bytes, len, packed_size = 0;
+	char filename[80], tmpname[84];
+	int compress = 0, done = 0, total = 0;
+	FILE *fp;
+
+	if (argc < 2 || (sdl_scale = atoi(args[1])) < 1 || sdl_scale > 4) {
+		printf("Usage: %s <scale> [-z]\n", args[0]);
+		printf("Scale is 1 to 4, -z compresses the sprites with LZ4.\n");
+		return 1;
+	}
+	if (argc > 2 && !strcmp(args[2], "-z")) {
+		compress = 1;
+	}
+
+	open_archives(sdl_scale);
+	if (!sdl_zip1) {
+		printf("Could not open res/gx1.zip. Please run gfxpack from the main folder.\n");
+		return 1;
+	}
+
+	sdl_zip_index_init();
+	for (sprite = 0; sprite < MAXSPRITE; sprite++) {
+		if (sdl_zip_index_has(sprite)) {
+			count = sprite + 1;
+			total++;
+		}
+	}
+
+	index = calloc(count ? count : 1, sizeof(struct sdl_pack_entry));
+	if (!index) {
+		printf("Out of memory\n");
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "res/gx%d.pack", sdl_scale);
+	snprintf(tmpname, sizeof(tmpname), "%s.new", filename);
+	fp = fopen(tmpname, "wb");
+	if (!fp) {
+		printf("Could not create %s\n", tmpname);
+		return 1;
+	}
+
+	head.magic = SPK_MAGIC;
+	head.version = SPK_VERSION;
+	head.scale = (uint32_t)sdl_scale;
+	head.count = count;
+	head.stamp = sdl_archive_stamp(sdl_scale);
+	head.index = sizeof(head);
+
+	// Header and index are written again once all offsets are known
+	offset = head.index + (uint64_t)count * sizeof(struct sdl_pack_entry);
+	if (!write_all(fp, &head, sizeof(head)) || !write_all(fp, index, (size_t)count * sizeof(struct sdl_pack_entry)) ||
+	    !write_all(fp, pad, (size_t)(-offset & 15))) {
+		printf("Could not write %s\n", tmpname);
+		return 1;
+	}
+	offset = (offset + 15) & ~(uint64_t)15;
+
+	for (sprite = 0; sprite < count; sprite++) {
+		if (!sdl_zip_index_has(sprite)) {
+			continue;
+		}
+
+		memset(&si, 0, sizeof(si));
+		if (sdl_load_image(&si, (int)sprite)) {
+			continue;
+		}
+
+		bytes = (size_t)si.xres * si.yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale;
+		index[sprite].offset = offset;
+		index[sprite].xres = si.xres;
+		index[sprite].yres = si.yres;
+		index[sprite].xoff = si.xoff;
+		index[sprite].yoff = si.yoff;
+
+		len = bytes;
+		if (compress && bytes) {
+			if (packed_size < lz4_bound(bytes)) {
+				packed_size = lz4_bound(bytes);
+				free(packed);
+				packed = malloc(packed_size);
+				if (!packed) {
+					printf("Out of memory\n");
+					return 1;
+				}
+			}
+			len = lz4_encode((uint8_t *)si.pixel, bytes, packed);
+			if (len < bytes) {
+				index[sprite].flags = SPK_LZ4;
+			} else {
+				len = bytes; // does not compress, keep it raw
+			}
+		}
+		index[sprite].bytes = (uint32_t)len;
+
+		if (!write_all(fp, (index[sprite].flags & SPK_LZ4) ? (void *)packed : (void *)si.pixel, len) ||
+		    !write_all(fp, pad, (size_t)(-len & 15))) {
+			printf("Could not write %s\n", tmpname);
+			return 1;
+		}
+		offset += (len + 15) & ~(size_t)15;
+
+		raw += bytes;
+		stored += len;
+		FREE(si.pixel);
+
+		if (++done % 1000 == 0) {
+			printf("\r%d of %d sprites", done, total);
+			fflush(stdout);
+		}
+	}
+
+	if (fseek(fp, 0, SEEK_SET) || !write_all(fp, &head, sizeof(head)) ||
+	    !write_all(fp, index, (size_t)count * sizeof(struct sdl_pack_entry)) || fclose(fp)) {
+		printf("Could not write %s\n", tmpname);
+		return 1;
+	}
+
+	remove(filename);
+	if (rename(tmpname, filename)) {
+		printf("Could not rename %s to %s\n", tmpname, filename);
+		return 1;
+	}
+
+	sdl_zip_index_exit();
+
+	printf("\r%s: %d sprites, %.1fMB of pixels stored in %.1fMB\n", filename, done,
+	    (double)raw / (1024.0 * 1024.0), (double)stored / (1024.0 * 1024.0));
+
+	return 0;
+}
@@ -0,0 +1,678 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * stubserver
+ *
+ * Stands in for the game server when testing the client's network path on a
+ * machine without outside network. It accepts the login the client sends in
+ * poll_network() (name, password, magic code, send_info()) and then streams
+ * ticks: either scripted ones (SV_LOGINDONE, then padding up to a given size,
+ * compressed like the real server does) or the first connection of a replay
+ * written with "moac -r". The link can be made worse on purpose: limited
+ * bandwidth, latency, jitter and several ticks coalesced into one packet.
+ * CL_PING is answered with SV_PING, inside the next scripted tick or, in a
+ * replay, as a tick of its own between two replayed ones, so the tick stream
+ * stays in sync and the client keeps getting its playout RTT samples.
+ *
+ * Usage: stubserver [-p port] [-r replay] [-t ticks] [-s size] [-u]
+ *                   [-b bytes/s] [-l ms] [-j ms] [-c ms] [-n connections] [-S seed]
+ *
+ * Connect with "moac -u name -p pass -d 127.0.0.1 -t port". POSIX only.
+ *
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "client/client.h"
+#include "client/client_private.h"
+
+#define STUB_LOGIN_SIZE (40 + 16 + 4 + 12) // name, password, magic, send_info()
+#define STUB_MAGIC      (0x8fd46100 | 0x01)
+#define STUB_MAX_TICK   16000 // what fits into the client's queue
+#define STUB_MAX_PINGS  16
+
+// What replay.c expects from the rest of the client
+void *xmalloc(size_t size, uint8_t ID)
+{
+	return calloc(1, size);
+}
+
+void *xrealloc(void *ptr, size_t size, uint8_t ID)
+{
+	return realloc(ptr, size);
+}
+
+void xfree(void *ptr)
+{
+	free(ptr);
+}
+
+int warn(const char *format, ...)
+{
+	va_list va;
+
+	va_start(va, format);
+	printf("WARN: ");
+	vprintf(format, va);
+	va_end(va);
+	printf("\n");
+
+	return 0;
+}
+
+// ============================================================================
+// Settings and helpers
+// ============================================================================
+
+static int opt_port = 5556;
+static char *opt_replay = NULL;
+static int opt_ticks = 0; // 0 is endless
+static int opt_size = 64;
+static int opt_raw = 0;
+static int opt_bandwidth = 0; // bytes per second, 0 is unlimited
+static int opt_latency = 0;
+static int opt_jitter = 0;
+static int opt_coalesce = 0;
+static int opt_connections = 0; // 0 is endless
+static uint32_t rnd_state = 1;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v)); // the client reads with load_u32(), in its own byte order
+}
+
+// Length of the client command at buf, 0 if unknown or not complete yet
+static size_t cl_length(const unsigned char *buf, size_t avail)
+{
+	switch (buf[0]) {
+	case CL_NOP:
+	case CL_MAGICSHIELD:
+	case CL_FREEZE:
+	case CL_FLASH:
+	case CL_WARCRY:
+	case CL_STOP:
+	case CL_DROP_GOLD:
+	case CL_JUNK_ITEM:
+	case CL_PULSE:
+	case CL_GETQUESTLOG:
+		return 1;
+	case CL_SWAP:
+	case CL_CONTAINER:
+	case CL_USE_INV:
+	case CL_LOOK_CONTAINER:
+	case CL_LOOK_INV:
+	case CL_SPEED:
+	case CL_CONTAINER_FAST:
+	case CL_FASTSELL:
+	case CL_REOPENQUEST:
+		return 2;
+	case CL_KILL:
+	case CL_BLESS:
+	case CL_HEAL:
+	case CL_RAISE:
+	case CL_LOOK_CHAR:
+	case CL_GIVE:
+	case CL_TELEPORT:
+		return 3;
+	case CL_MOVE:
+	case CL_TAKE:
+	case CL_DROP:
+	case CL_USE:
+	case CL_FIREBALL:
+	case CL_BALL:
+	case CL_LOOK_MAP:
+	case CL_LOOK_ITEM:
+	case CL_TAKE_GOLD:
+	case CL_TICKER:
+	case CL_PING:
+		return 5;
+	case CL_TEXT:
+	case CL_LOG:
+		return avail < 2 ? 0 : 2 + (size_t)buf[1];
+	default:
+		return 0;
+	}
+}
+
+// ============================================================================
+// Outgoing data: blocks that become due after latency, jitter and coalescing
+// ============================================================================
+
+struct block {
+	struct block *next;
+	uint64_t due;
+	size_t len, done;
+	unsigned char data[];
+};
+
+struct conn {
+	int fd;
+	uint64_t start;
+	struct block *head, *tail;
+	uint64_t last_due;
+	double tokens;
+	uint64_t token_time;
+	z_stream zs;
+	unsigned char in[4096];
+	size_t inused;
+	uint32_t pings[STUB_MAX_PINGS];
+	int ping_cnt;
+	// where the replayed stream is, see replay_follow()
+	unsigned char hdr[2];
+	int hdr_len;
+	size_t tick_left;
+	// statistics
+	uint64_t sent, ticks, raw_bytes, answered;
+};
+
+static void conn_queue(struct conn *c, const unsigned char *data, size_t len)
+{
+	uint64_t due, step = (uint64_t)opt_coalesce;
+	struct block *b;
+
+	b = malloc(sizeof(struct block) + len);
+	if (!b) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	memcpy(b->data, data, len);
+	b->len = len;
+	b->done = 0;
+	b->next = NULL;
+
+	due = now_ms() + (uint64_t)opt_latency;
+	if (opt_jitter) {
+		due += rnd() % (uint32_t)(2 * opt_jitter + 1);
+		due = due > (uint64_t)opt_jitter ? due - (uint64_t)opt_jitter : 0;
+	}
+	if (step) {
+		due = c->start + (due - c->start + step - 1) / step * step;
+	}
+	if (due < c->last_due) {
+		due = c->last_due; // TCP keeps the order
+	}
+	b->due = c->last_due = due;
+
+	if (c->tail) {
+		c->tail->next = b;
+	} else {
+		c->head = b;
+	}
+	c->tail = b;
+}
+
+// Frame one tick like the server: 1 byte header up to 63 bytes, 2 otherwise,
+// 0x80 marks a compressed tick
+static void conn_tick(struct conn *c, const unsigned char *tick, size_t len)
+{
+	unsigned char buf[2 + STUB_MAX_TICK + 256], *out = buf + 2;
+	size_t size, head;
+	int flag = 0;
+
+	if (!opt_raw) {
+		c->zs.next_in = (unsigned char *)tick;
+		c->zs.avail_in = (unsigned int)len;
+		c->zs.next_out = out;
+		c->zs.avail_out = sizeof(buf) - 2;
+		if (deflate(&c->zs, Z_SYNC_FLUSH) != Z_OK || c->zs.avail_in) {
+			printf("deflate failed\n");
+			exit(1);
+		}
+		size = sizeof(buf) - 2 - c->zs.avail_out;
+		flag = 0x80;
+	} else {
+		memcpy(out, tick, len);
+		size = len;
+	}
+
+	if (size <= 63) {
+		head = 1;
+		out[-1] = (unsigned char)(flag | 0x40 | size);
+	} else {
+		head = 2;
+		out[-2] = (unsigned char)(flag | (size >> 8));
+		out[-1] = (unsigned char)size;
+	}
+
+	conn_queue(c, out - head, size + head);
+	c->ticks++;
+	c->raw_bytes += len;
+}
+
+// Scripted tick n: log in with the first, then pad to opt_size with
+// SV_CYCLES, which only feeds the client's server load display
+static void script_tick(struct conn *c, int n)
+{
+	unsigned char tick[STUB_MAX_TICK];
+	size_t len = 0;
+	int i;
+
+	if (n == 0) {
+		tick[len++] = SV_LOGINDONE;
+	}
+	for (i = 0; i < c->ping_cnt; i++) {
+		tick[len++] = SV_PING;
+		put32(tick + len, c->pings[i]);
+		len += 4;
+		c->answered++;
+	}
+	c->ping_cnt = 0;
+
+	while (len + 5 <= (size_t)opt_size) {
+		tick[len++] = SV_CYCLES;
+		put32(tick + len, rnd() & 0xffff);
+		len += 4;
+	}
+
+	conn_tick(c, tick, len);
+}
+
+// Follow the tick headers of a replayed chunk. The chunks are what one recv()
+// returned while recording, so ticks can span several of them.
+static void replay_follow(struct conn *c, const unsigned char *data, size_t len)
+{
+	size_t n;
+
+	while (len) {
+		if (c->tick_left) {
+			n = len < c->tick_left ? len : c->tick_left;
+			c->tick_left -= n;
+			data += n;
+			len -= n;
+			continue;
+		}
+		c->hdr[c->hdr_len++] = *data++;
+		len--;
+		if (c->hdr[0] & 0x40) {
+			c->tick_left = c->hdr[0] & 0x3F;
+			c->hdr_len = 0;
+		} else if (c->hdr_len == 2) {
+			c->tick_left = (size_t)(((c->hdr[0] << 8) | c->hdr[1]) & 0x3FFF);
+			c->hdr_len = 0;
+		}
+	}
+}
+
+// Pings during a replay go out as extra uncompressed ticks, the compressed
+// stream is the recorded one and cannot take anything else. They wait until
+// the stream is between two ticks.
+static void replay_pings(struct conn *c)
+{
+	unsigned char tick[6];
+	int i;
+
+	if (c->tick_left || c->hdr_len) {
+		return;
+	}
+
+	for (i = 0; i < c->ping_cnt; i++) {
+		tick[0] = 0x40 | 5;
+		tick[1] = SV_PING;
+		put32(tick + 2, c->pings[i]);
+		conn_queue(c, tick, sizeof(tick));
+		c->answered++;
+	}
+	c->ping_cnt = 0;
+}
+
+// Send what is due and the bandwidth allows. Returns -1 if the client left.
+static int conn_send(struct conn *c)
+{
+	uint64_t now = now_ms();
+	struct block *b;
+	size_t len;
+	ssize_t n;
+
+	if (opt_bandwidth) {
+		c->tokens += (double)(now - c->token_time) * opt_bandwidth / 1000.0;
+		if (c->tokens > opt_bandwidth / 10.0 + 1500) {
+			c->tokens = opt_bandwidth / 10.0 + 1500; // 100ms of burst
+		}
+		c->token_time = now;
+	}
+
+	while ((b = c->head) && b->due <= now) {
+		len = b->len - b->done;
+		if (opt_bandwidth) {
+			if (c->tokens < 1) {
+				return 0;
+			}
+			if (len > (size_t)c->tokens) {
+				len = (size_t)c->tokens;
+			}
+		}
+
+		n = send(c->fd, b->data + b->done, len, 0); // SIGPIPE is ignored
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 0;
+			}
+			return -1;
+		}
+		b->done += (size_t)n;
+		c->sent += (uint64_t)n;
+		if (opt_bandwidth) {
+			c->tokens -= (double)n;
+		}
+
+		if (b->done < b->len) {
+			return 0;
+		}
+		c->head = b->next;
+		if (!c->head) {
+			c->tail = NULL;
+		}
+		free(b);
+	}
+
+	return 0;
+}
+
+// Read what the client sends, keep the pings. Returns -1 if the client left.
+static int conn_recv(struct conn *c)
+{
+	size_t len, pos = 0;
+	ssize_t n;
+
+	n = recv(c->fd, c->in + c->inused, sizeof(c->in) - c->inused, 0);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		return -1;
+	}
+	if (n < 0) {
+		return 0;
+	}
+	c->inused += (size_t)n;
+
+	while (pos < c->inused) {
+		len = cl_length(c->in + pos, c->inused - pos);
+		if (!len) {
+			if (c->in[pos] != CL_TEXT && c->in[pos] != CL_LOG) {
+				pos = c->inused; // unknown command (a mod?), drop the rest
+			}
+			break;
+		}
+		if (pos + len > c->inused) {
+			break;
+		}
+		if (c->in[pos] == CL_PING && c->ping_cnt < STUB_MAX_PINGS) {
+			memcpy(&c->pings[c->ping_cnt++], c->in + pos + 1, 4);
+		}
+		pos += len;
+	}
+	memmove(c->in, c->in + pos, c->inused - pos);
+	c->inused -= pos;
+
+	return 0;
+}
+
+// ============================================================================
+// One connection
+// ============================================================================
+
+static int read_login(int fd)
+{
+	unsigned char buf[STUB_LOGIN_SIZE];
+	size_t got = 0;
+	uint32_t magic;
+	ssize_t n;
+
+	while (got < sizeof(buf)) {
+		n = recv(fd, buf + got, sizeof(buf) - got, 0);
+		if (n <= 0) {
+			printf("Client left during the login\n");
+			return -1;
+		}
+		got += (size_t)n;
+	}
+
+	memcpy(&magic, buf + 56, sizeof(magic));
+	if (magic != STUB_MAGIC) {
+		printf("Wrong magic code %08X\n", magic);
+		return -1;
+	}
+	buf[39] = 0;
+	printf("Login from %s\n", (char *)buf);
+
+	return 0;
+}
+
+static void serve(int fd)
+{
+	struct conn c;
+	struct replay *r = NULL;
+	const unsigned char *data = NULL;
+	size_t len = 0;
+	uint32_t ms = 0;
+	uint64_t now, next;
+	int tick = 0, more = 1, have = 0, one = 1, timeout;
+	struct pollfd pfd;
+	struct block *b;
+
+	if (read_login(fd)) {
+		return;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	memset(&c, 0, sizeof(c));
+	c.fd = fd;
+	c.start = c.token_time = now_ms();
+	if (!opt_raw && deflateInit(&c.zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		printf("deflateInit failed\n");
+		return;
+	}
+	if (opt_replay && !(r = replay_open(opt_replay))) {
+		return;
+	}
+
+	while (more || c.head) {
+		now = now_ms();
+
+		// produce what is due
+		if (r) {
+			while (more) {
+				if (!have) {
+					if (replay_next(r, &ms, &data, &len) != 1 || !len) {
+						more = 0; // end of the file or of its first connection
+						break;
+					}
+					have = 1;
+				}
+				if (c.start + ms > now) {
+					break;
+				}
+				conn_queue(&c, data, len);
+				replay_follow(&c, data, len);
+				c.raw_bytes += len;
+				have = 0;
+				replay_pings(&c);
+			}
+			replay_pings(&c);
+		} else {
+			while (more && c.start + (uint64_t)tick * 1000 / TICKS <= now) {
+				script_tick(&c, tick++);
+				if (opt_ticks && tick >= opt_ticks) {
+					more = 0;
+				}
+			}
+		}
+
+		if (conn_send(&c) || conn_recv(&c)) {
+			printf("Client left\n");
+			break;
+		}
+
+		// sleep until something is due
+		if (r) {
+			next = have ? c.start + ms : now + 50;
+		} else {
+			next = c.start + (uint64_t)tick * 1000 / TICKS;
+		}
+		if (c.head && c.head->due < next) {
+			next = c.head->due;
+		}
+		now = now_ms();
+		timeout = next > now ? (int)(next - now) : 0;
+		if (opt_bandwidth && c.head && c.tokens < 1) {
+			timeout = 1;
+		}
+
+		pfd.fd = fd;
+		pfd.events = POLLIN | (c.head && c.head->due <= now ? POLLOUT : 0);
+		poll(&pfd, 1, timeout);
+	}
+
+	now = now_ms() - c.start;
+	if (!r) {
+		printf("%llu ticks, ", (unsigned long long)c.ticks);
+	}
+	printf("%llu bytes of tick data, %llu bytes sent in %.1f s (%.1f kB/s), %llu pings answered\n",
+	    (unsigned long long)c.raw_bytes, (unsigned long long)c.sent, now / 1000.0, now ? c.sent / (double)now : 0.0,
+	    (unsigned long long)c.answered);
+
+	while ((b = c.head)) {
+		c.head = b->next;
+		free(b);
+	}
+	if (!opt_raw) {
+		deflateEnd(&c.zs);
+	}
+	replay_close(r);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-p port] [-r replay] [-t ticks] [-s size] [-u]\n", name);
+	printf("          [-b bytes/s] [-l ms] [-j ms] [-c ms] [-n connections] [-S seed]\n\n");
+	printf("-p  port to listen on (5556)\n");
+	printf("-r  stream the first connection of a replay recorded with moac -r\n");
+	printf("-t  number of scripted ticks, 0 for endless (0)\n");
+	printf("-s  size of a scripted tick in bytes before compression (64)\n");
+	printf("-u  send the scripted ticks uncompressed\n");
+	printf("-b  bandwidth in bytes per second, 0 for unlimited (0)\n");
+	printf("-l  latency in ms (0)\n");
+	printf("-j  jitter in ms, added to or taken from the latency (0)\n");
+	printf("-c  coalesce, send what is due only every this many ms (0)\n");
+	printf("-n  number of connections to serve, 0 for endless (0)\n");
+	printf("-S  seed for jitter and padding (1)\n");
+}
+
+int main(int argc, char *args[])
+{
+	struct sockaddr_in addr;
+	int opt, fd, cfd, one = 1, served = 0;
+
+	while ((opt = getopt(argc, args, "p:r:t:s:ub:l:j:c:n:S:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			opt_port = atoi(optarg);
+			break;
+		case 'r':
+			opt_replay = optarg;
+			break;
+		case 't':
+			opt_ticks = atoi(optarg);
+			break;
+		case 's':
+			opt_size = atoi(optarg);
+			break;
+		case 'u':
+			opt_raw = 1;
+			break;
+		case 'b':
+			opt_bandwidth = atoi(optarg);
+			break;
+		case 'l':
+			opt_latency = atoi(optarg);
+			break;
+		case 'j':
+			opt_jitter = atoi(optarg);
+			break;
+		case 'c':
+			opt_coalesce = atoi(optarg);
+			break;
+		case 'n':
+			opt_connections = atoi(optarg);
+			break;
+		case 'S':
+			rnd_state = (uint32_t)strtoul(optarg, NULL, 10) | 1;
+			break;
+		default:
+			usage(args[0]);
+			return 1;
+		}
+	}
+	if (opt_port < 1 || opt_port > 65535 || opt_size < 0 || opt_size > STUB_MAX_TICK - 128 || opt_bandwidth < 0 ||
+	    opt_latency < 0 || opt_jitter < 0 || opt_coalesce < 0) {
+		usage(args[0]);
+		return 1;
+	}
+	if (opt_replay) {
+		opt_raw = 1; // the replay brings its own compression
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((uint16_t)opt_port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+		perror("bind");
+		return 1;
+	}
+	printf("Listening on 127.0.0.1:%d\n", opt_port);
+
+	while (!opt_connections || served < opt_connections) {
+		cfd = accept(fd, NULL, NULL);
+		if (cfd < 0) {
+			perror("accept");
+			continue;
+		}
+		serve(cfd);
+		close(cfd);
+		served++;
+	}
+
+	close(fd);
+	return 0;
+}
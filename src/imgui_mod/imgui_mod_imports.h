@@ -101,6 +101,8 @@ DLL_IMPORT void cmd_raise(int vn);
 // Get SDL_Texture* for a sprite with default item lighting
 // Returns NULL if sprite loading fails - texture is cache-managed, don't destroy
 DLL_IMPORT SDL_Texture *sdl_get_sprite_texture(unsigned int sprite, int *out_width, int *out_height);
+// Same, but small sprites share an atlas texture: uv[4] receives (u0, v0, u1, v1) of the sprite
+DLL_IMPORT SDL_Texture *sdl_get_sprite_texture_uv(unsigned int sprite, int *out_width, int *out_height, float *uv);
 
 // Buff/status text strings (updated by display_selfspells)
 DLL_IMPORT extern char hover_bless_text[120];
@@ -14,7 +14,8 @@
 static void draw_equip_sprite(ImDrawList* draw_list, float slot_x, float slot_y, float slot_size, uint32_t sprite_id)
 {
     int tex_w, tex_h;
-    SDL_Texture* tex = sdl_get_sprite_texture(sprite_id, &tex_w, &tex_h);
+    float uv[4];
+    SDL_Texture* tex = sdl_get_sprite_texture_uv(sprite_id, &tex_w, &tex_h, uv);
 
     if (tex) {
         // Calculate scale to fit in slot while preserving aspect ratio
@@ -37,7 +38,9 @@ static void draw_equip_sprite(ImDrawList* draw_list, float slot_x, float slot_y,
         draw_list->AddImage(
             (ImTextureID)tex,
             ImVec2(draw_x, draw_y),
-            ImVec2(draw_x + draw_w, draw_y + draw_h)
+            ImVec2(draw_x + draw_w, draw_y + draw_h),
+            ImVec2(uv[0], uv[1]),
+            ImVec2(uv[2], uv[3])
         );
     }
 }
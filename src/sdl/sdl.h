@@ -44,6 +44,8 @@ struct renderfont;
 typedef struct renderfont RenderFont;
 
 DLL_EXPORT extern int sdl_cache_size;
+DLL_EXPORT extern int sdl_cache_budget;
+DLL_EXPORT extern int sdl_disk_budget;
 DLL_EXPORT extern int sdl_scale;
 DLL_EXPORT extern int sdl_frames;
 DLL_EXPORT extern int sdl_multi;
@@ -75,8 +77,19 @@ int sdlt_xres(int cache_index);
 int sdlt_yres(int cache_index);
 void sdl_blit(
     int cache_index, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset);
+// Draw time lighting (GO_VERTEXLIGHT)
+int sdl_light_at_draw(unsigned char freeze, char ml, char ll, char rl, char ul, char dl);
+void sdl_blit_light(int cache_index, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey, int x_offset,
+    int y_offset, char ml, char ll, char rl, char ul, char dl);
+// Collect blits into batched draw calls; other drawing must flush first
+void sdl_batch_begin(void);
+void sdl_batch_flush(void);
+void sdl_batch_end(void);
 int sdl_drawtext(int sx, int sy, unsigned short int color, int flags, const char *text, struct renderfont *font,
     int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset);
+int sdl_drawtext_outlined(int sx, int sy, unsigned short int color, unsigned short int ocolor, int flags,
+    const char *text, struct renderfont *font, struct renderfont *ofont, int dx, int clipsx, int clipsy, int clipex,
+    int clipey, int x_offset, int y_offset);
 // Basic drawing primitives
 void sdl_pixel(int x, int y, unsigned short color, int x_offset, int y_offset);
 void sdl_pixel_alpha(int x, int y, unsigned short color, unsigned char alpha, int x_offset, int y_offset);
@@ -169,6 +182,31 @@ void sdl_clear_render_target(int target_id);
 
 void sdl_flush_textinput(void);
 void sdl_dump(FILE *fp);
+
+// Per frame texture cache statistics, see sdl_stats.c
+struct sdl_stats {
+	uint32_t frame; // sdl_frames
+	uint32_t time; // SDL_GetTicks()
+	uint32_t hit, miss, pre, evict; // texture cache lookups and evictions during the frame
+	uint32_t upload, upload_bytes; // textures made and the bytes sent to the GPU for them
+	uint32_t queue; // jobs waiting for the workers at the end of the frame
+	uint32_t wait; // ms the render thread waited for sprites
+	uint32_t used; // texture cache entries in use
+};
+
+#define SDL_STAT_HIT       0
+#define SDL_STAT_MISS      1
+#define SDL_STAT_EVICT     2
+#define SDL_STAT_UPLOAD    3
+#define SDL_STAT_UPLOAD_KB 4
+#define SDL_STAT_QUEUE     5
+#define SDL_STAT_WAIT      6
+
+void sdl_stats_frame(void);
+int sdl_stats_frames(void);
+int sdl_stats_get(int back, struct sdl_stats *s);
+int sdl_stats_write(const char *filename, int json);
+void sdl_stats_graph(int sx, int sy, int what, int div, int x_offset, int y_offset);
 #ifdef DEVELOPER
 void sdl_dump_spritecache(void);
 #endif
@@ -179,4 +217,7 @@ long long sdl_get_mem_tex(void);
 // Get SDL_Texture* for a sprite with default item lighting
 // Returns NULL if sprite loading fails
 // Caller should NOT destroy the returned texture - it's managed by the cache
+// Always a texture of its own, see sdl_get_sprite_texture_uv() for the atlas version
 DLL_EXPORT SDL_Texture *sdl_get_sprite_texture(unsigned int sprite, int *out_width, int *out_height);
+// Same, but also returns the sprite's part of the texture in uv[4] (u0, v0, u1, v1)
+DLL_EXPORT SDL_Texture *sdl_get_sprite_texture_uv(unsigned int sprite, int *out_width, int *out_height, float *uv);
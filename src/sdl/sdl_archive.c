@@ -0,0 +1,522 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * SDL - Archive Reader
+ *
+ * Read-only access to the graphics archives (res/gx*.zip). Each archive is
+ * mapped into memory once and its central directory parsed once. After
+ * sdl_archive_open() an archive is never written again, so any number of
+ * threads can read entries from it at the same time. Each reader brings its
+ * own struct sdl_archive_file, which holds the inflate stream.
+ *
+ * Only what the archives use is supported: stored and deflated entries, with
+ * or without ZIP64 records. No encryption, no multi-disk archives.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <SDL3/SDL.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "dll.h"
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+#define ZA_EOCD      0x06054b50
+#define ZA_EOCD64    0x06064b50
+#define ZA_LOCATOR64 0x07064b50
+#define ZA_CENTRAL   0x02014b50
+#define ZA_LOCAL     0x04034b50
+
+#define ZA_STORED  0
+#define ZA_DEFLATE 8
+
+struct za_entry {
+	uint64_t offset; // of the local header
+	uint64_t csize; // compressed size
+	uint64_t usize; // uncompressed size
+	uint32_t name; // offset in names
+	uint16_t method; // ZA_STORED or ZA_DEFLATE, anything else can not be read
+	uint16_t pad;
+};
+
+struct sdl_archive {
+	uint8_t *map; // mapped read only
+	size_t size;
+
+	struct za_entry *entry;
+	uint32_t count;
+
+	char *names; // all entry names, each 0 terminated
+
+	uint32_t *hash; // entry+1 by name, 0 is an empty slot
+	uint32_t hashmask;
+};
+
+// ============================================================================
+// Mapping
+// ============================================================================
+
+// Map filename read-only. Returns NULL if the file is missing or empty.
+void *sdl_map_file(const char *filename, size_t *size)
+{
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER fsize;
+	void *map;
+
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+	if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart <= 0 || (unsigned long long)fsize.QuadPart > SIZE_MAX) {
+		CloseHandle(file);
+		return NULL;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) {
+		return NULL;
+	}
+	map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping); // the view keeps the mapping alive
+	if (!map) {
+		return NULL;
+	}
+	*size = (size_t)fsize.QuadPart;
+	return map;
+#else
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) || st.st_size <= 0 || (unsigned long long)st.st_size > SIZE_MAX) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	*size = (size_t)st.st_size;
+	return map;
+#endif
+}
+
+void sdl_unmap_file(void *map, size_t size)
+{
+	if (!map) {
+		return;
+	}
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(map);
+#else
+	munmap(map, size);
+#endif
+}
+
+// ============================================================================
+// Central directory
+// ============================================================================
+
+static uint16_t za_rd16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t za_rd32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t za_rd64(const uint8_t *p)
+{
+	return (uint64_t)za_rd32(p) | ((uint64_t)za_rd32(p + 4) << 32);
+}
+
+static uint32_t za_hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Find the central directory: its offset, number of entries and size.
+// Returns 0 if there is none.
+static int za_find_directory(const uint8_t *map, size_t size, uint64_t *offset, uint64_t *count, uint64_t *bytes)
+{
+	const uint8_t *p;
+	size_t pos, stop;
+	uint64_t e64;
+
+	if (size < 22) {
+		return 0;
+	}
+
+	// The end record is the last 22 bytes, unless the archive has a comment
+	stop = size > 22 + 65535 ? size - 22 - 65535 : 0;
+	for (pos = size - 22;; pos--) {
+		if (za_rd32(map + pos) == ZA_EOCD && pos + 22 + za_rd16(map + pos + 20) == size) {
+			break;
+		}
+		if (pos == stop) {
+			return 0;
+		}
+	}
+	p = map + pos;
+
+	if (za_rd16(p + 4) || za_rd16(p + 6)) {
+		return 0; // spans several disks
+	}
+	*count = za_rd16(p + 10);
+	*bytes = za_rd32(p + 12);
+	*offset = za_rd32(p + 16);
+
+	if (*count == 0xffff || *bytes == 0xffffffff || *offset == 0xffffffff) {
+		if (pos < 20 || za_rd32(p - 20) != ZA_LOCATOR64) {
+			return 0;
+		}
+		e64 = za_rd64(p - 20 + 8);
+		if (size < 56 || e64 > size - 56 || za_rd32(map + e64) != ZA_EOCD64) {
+			return 0;
+		}
+		*count = za_rd64(map + e64 + 32);
+		*bytes = za_rd64(map + e64 + 40);
+		*offset = za_rd64(map + e64 + 48);
+	}
+
+	return *offset <= size && *bytes <= size - *offset;
+}
+
+// Pick the ZIP64 sizes and offset from the extra field for the values the
+// central header could not hold.
+static int za_zip64(const uint8_t *extra, size_t len, struct za_entry *e)
+{
+	const uint8_t *p = extra, *end = extra + len, *f;
+	uint16_t id, flen;
+
+	while (end - p >= 4) {
+		id = za_rd16(p);
+		flen = za_rd16(p + 2);
+		p += 4;
+		if (flen > (size_t)(end - p)) {
+			return 0;
+		}
+		if (id == 0x0001) {
+			f = p;
+			if (e->usize == 0xffffffff) {
+				if (p + flen - f < 8) {
+					return 0;
+				}
+				e->usize = za_rd64(f);
+				f += 8;
+			}
+			if (e->csize == 0xffffffff) {
+				if (p + flen - f < 8) {
+					return 0;
+				}
+				e->csize = za_rd64(f);
+				f += 8;
+			}
+			if (e->offset == 0xffffffff) {
+				if (p + flen - f < 8) {
+					return 0;
+				}
+				e->offset = za_rd64(f);
+			}
+			return 1;
+		}
+		p += flen;
+	}
+
+	return 0;
+}
+
+static void za_free(struct sdl_archive *za)
+{
+	if (za->entry) {
+		xfree(za->entry);
+	}
+	if (za->names) {
+		xfree(za->names);
+	}
+	if (za->hash) {
+		xfree(za->hash);
+	}
+	sdl_unmap_file(za->map, za->size);
+	xfree(za);
+}
+
+// ============================================================================
+// Public interface
+// ============================================================================
+
+// Map filename and read its central directory. Returns NULL if the file is
+// missing (quietly) or not an archive we can read (with a warning).
+struct sdl_archive *sdl_archive_open(const char *filename)
+{
+	struct sdl_archive *za;
+	struct za_entry *e;
+	const uint8_t *p, *end;
+	uint64_t count, bytes, offset, names;
+	uint32_t i, h, slots;
+	uint16_t nlen, xlen, clen, flags;
+	size_t size;
+	char *name;
+	void *map;
+
+	map = sdl_map_file(filename, &size);
+	if (!map) {
+		return NULL;
+	}
+
+	if (!za_find_directory(map, size, &offset, &count, &bytes) || count >= UINT32_MAX / 4 || bytes / 46 < count) {
+		warn("Archive %s: no central directory, ignoring it", filename);
+		sdl_unmap_file(map, size);
+		return NULL;
+	}
+
+	za = xmalloc(sizeof(struct sdl_archive), MEM_SDL_BASE);
+	if (!za) {
+		sdl_unmap_file(map, size);
+		return NULL;
+	}
+	za->map = map;
+	za->size = size;
+	za->count = (uint32_t)count;
+
+	slots = 16;
+	while (slots < za->count * 2) {
+		slots *= 2;
+	}
+	za->hashmask = slots - 1;
+
+	// Every name is stored after a 46 byte header, so bytes holds them all
+	za->entry = xmalloc((za->count ? za->count : 1) * sizeof(struct za_entry), MEM_SDL_BASE);
+	za->names = xmalloc(bytes ? (size_t)bytes : 1, MEM_SDL_BASE);
+	za->hash = xmalloc(slots * sizeof(uint32_t), MEM_SDL_BASE);
+	if (!za->entry || !za->names || !za->hash) {
+		za_free(za);
+		return NULL;
+	}
+
+	p = za->map + offset;
+	end = p + bytes;
+	names = 0;
+	for (i = 0; i < za->count; i++) {
+		e = &za->entry[i];
+		if (end - p < 46 || za_rd32(p) != ZA_CENTRAL) {
+			warn("Archive %s: central directory damaged at entry %u, ignoring it", filename, i);
+			za_free(za);
+			return NULL;
+		}
+		flags = za_rd16(p + 8);
+		e->method = za_rd16(p + 10);
+		e->csize = za_rd32(p + 20);
+		e->usize = za_rd32(p + 24);
+		nlen = za_rd16(p + 28);
+		xlen = za_rd16(p + 30);
+		clen = za_rd16(p + 32);
+		e->offset = za_rd32(p + 42);
+		if ((size_t)(end - p) - 46 < (size_t)nlen + xlen + clen) {
+			warn("Archive %s: central directory damaged at entry %u, ignoring it", filename, i);
+			za_free(za);
+			return NULL;
+		}
+		if ((e->usize == 0xffffffff || e->csize == 0xffffffff || e->offset == 0xffffffff) &&
+		    !za_zip64(p + 46 + nlen, xlen, e)) {
+			warn("Archive %s: ZIP64 record of entry %u damaged, ignoring it", filename, i);
+			za_free(za);
+			return NULL;
+		}
+		if (flags & 1) {
+			e->method = 0xffff; // encrypted, can not be read
+		}
+
+		name = za->names + names;
+		memcpy(name, p + 46, nlen);
+		name[nlen] = 0;
+		e->name = (uint32_t)names;
+		names += nlen + 1u;
+
+		// First entry of a name wins, as with zip_name_locate()
+		for (h = za_hash(name) & za->hashmask; za->hash[h]; h = (h + 1) & za->hashmask) {
+			if (!strcmp(za->names + za->entry[za->hash[h] - 1].name, name)) {
+				break;
+			}
+		}
+		if (!za->hash[h]) {
+			za->hash[h] = i + 1;
+		}
+
+		p += 46 + nlen + xlen + clen;
+	}
+
+	return za;
+}
+
+void sdl_archive_close(struct sdl_archive *za)
+{
+	if (za) {
+		za_free(za);
+	}
+}
+
+int64_t sdl_archive_entries(const struct sdl_archive *za)
+{
+	return za ? za->count : 0;
+}
+
+const char *sdl_archive_name(const struct sdl_archive *za, int64_t entry)
+{
+	if (!za || entry < 0 || entry >= za->count) {
+		return NULL;
+	}
+	return za->names + za->entry[entry].name;
+}
+
+// Uncompressed size of entry, -1 if there is no such entry
+int64_t sdl_archive_size(const struct sdl_archive *za, int64_t entry)
+{
+	if (!za || entry < 0 || entry >= za->count) {
+		return -1;
+	}
+	return (int64_t)za->entry[entry].usize;
+}
+
+// Entry named name, -1 if there is none
+int64_t sdl_archive_locate(const struct sdl_archive *za, const char *name)
+{
+	uint32_t h;
+
+	if (!za) {
+		return -1;
+	}
+	for (h = za_hash(name) & za->hashmask; za->hash[h]; h = (h + 1) & za->hashmask) {
+		if (!strcmp(za->names + za->entry[za->hash[h] - 1].name, name)) {
+			return za->hash[h] - 1;
+		}
+	}
+	return -1;
+}
+
+// Open entry for reading into zf, which belongs to the calling thread. Returns
+// 0 on success, -1 if the entry is missing, damaged or can not be read.
+int sdl_archive_fopen(struct sdl_archive_file *zf, const struct sdl_archive *za, int64_t entry)
+{
+	const struct za_entry *e;
+	const uint8_t *p;
+	uint64_t data;
+
+	if (!za || entry < 0 || entry >= za->count) {
+		return -1;
+	}
+	e = &za->entry[entry];
+	if (e->method != ZA_STORED && e->method != ZA_DEFLATE) {
+		return -1;
+	}
+	if (e->method == ZA_STORED && e->csize != e->usize) {
+		return -1;
+	}
+
+	if (e->offset > za->size || za->size - e->offset < 30 || za_rd32(za->map + e->offset) != ZA_LOCAL) {
+		return -1;
+	}
+	p = za->map + e->offset;
+	data = e->offset + 30 + za_rd16(p + 26) + za_rd16(p + 28);
+	if (data > za->size || za->size - data < e->csize) {
+		return -1;
+	}
+
+	memset(zf, 0, sizeof(*zf));
+	zf->src = za->map + data;
+	zf->csize = e->csize;
+	zf->left = e->usize;
+	zf->method = e->method;
+
+	if (zf->method == ZA_DEFLATE && inflateInit2(&zf->zs, -MAX_WBITS) != Z_OK) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Read up to len bytes. Returns the number of bytes read, 0 at the end of the
+// entry and -1 if the data is damaged.
+int64_t sdl_archive_fread(struct sdl_archive_file *zf, void *buf, size_t len)
+{
+	uint64_t step;
+	size_t done;
+	int ret;
+
+	if (len > zf->left) {
+		len = (size_t)zf->left;
+	}
+	if (!len) {
+		return 0;
+	}
+
+	if (zf->method == ZA_STORED) {
+		memcpy(buf, zf->src, len);
+		zf->src += len;
+		zf->left -= len;
+		return (int64_t)len;
+	}
+
+	zf->zs.next_out = buf;
+	zf->zs.avail_out = len > UINT_MAX ? UINT_MAX : (uInt)len;
+	for (;;) {
+		if (!zf->zs.avail_in && zf->csize) {
+			step = zf->csize > UINT_MAX ? UINT_MAX : zf->csize;
+			zf->zs.next_in = zf->src;
+			zf->zs.avail_in = (uInt)step;
+			zf->src += step;
+			zf->csize -= step;
+		}
+		ret = inflate(&zf->zs, Z_NO_FLUSH);
+		done = (size_t)((uint8_t *)zf->zs.next_out - (uint8_t *)buf);
+		if (ret == Z_STREAM_END || !zf->zs.avail_out) {
+			break;
+		}
+		if (ret != Z_OK || (!zf->zs.avail_in && !zf->csize)) {
+			return -1;
+		}
+	}
+	if (ret == Z_STREAM_END && done < len) {
+		return -1; // shorter than the directory said
+	}
+
+	zf->left -= done;
+	return (int64_t)done;
+}
+
+void sdl_archive_fclose(struct sdl_archive_file *zf)
+{
+	if (zf->method == ZA_DEFLATE) {
+		inflateEnd(&zf->zs);
+	}
+	zf->left = 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * SDL - Sprite Atlas Module
+ *
+ * Packs small finished sprites into a few shared texture pages, so that the
+ * thousands of small blits of a frame mostly use the same texture and SDL can
+ * batch them instead of switching textures for every item, tile and GUI piece.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define STB_RECT_PACK_IMPLEMENTATION
+#define STBRP_STATIC
+#include "imgui/imstb_rectpack.h"
+#pragma GCC diagnostic pop
+
+// The skyline packer can not free single rectangles. A page only gets its
+// space back once every sprite on it has been evicted. If all pages are full,
+// the page with the fewest sprites is emptied and reused.
+//
+// Everything in here runs on the render thread (stage 3 of sdl_make() and
+// texture cache eviction), so there is no locking.
+
+struct atlas_page {
+	SDL_Texture *tex;
+	stbrp_context ctx;
+	int live; // sdlt entries placed on this page
+};
+
+static struct atlas_page atlas[ATLAS_MAX_PAGES];
+static stbrp_node atlas_nodes[ATLAS_MAX_PAGES][ATLAS_PAGE_SIZE];
+
+long long atlas_placed = 0, atlas_recycled = 0;
+
+static void atlas_reset(int page)
+{
+	stbrp_init_target(&atlas[page].ctx, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, atlas_nodes[page], ATLAS_PAGE_SIZE);
+	atlas[page].live = 0;
+}
+
+static int atlas_create(int page)
+{
+	atlas[page].tex =
+	    SDL_CreateTexture(sdlren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+	if (!atlas[page].tex) {
+		warn("SDL_texture Error: %s in atlas page %d", SDL_GetError(), page);
+		return 0;
+	}
+	SDL_SetTextureBlendMode(atlas[page].tex, SDL_BLENDMODE_BLEND);
+	atlas_reset(page);
+
+	return 1;
+}
+
+// Try to fit w x h texels on a page. Leaves one texel of gutter on every side,
+// so filtering never picks up a neighbour. Returns the sprite's own corner.
+static int atlas_pack(int page, int w, int h, int *x, int *y)
+{
+	stbrp_rect r = {0};
+
+	r.w = w + 2;
+	r.h = h + 2;
+	if (!stbrp_pack_rects(&atlas[page].ctx, &r, 1)) {
+		return 0;
+	}
+	*x = r.x + 1;
+	*y = r.y + 1;
+
+	return 1;
+}
+
+// Empty the page with the fewest sprites by evicting its texture cache entries
+static int atlas_recycle(void)
+{
+	int page, best = STX_NONE;
+
+	for (page = 0; page < ATLAS_MAX_PAGES; page++) {
+		if (best == STX_NONE || atlas[page].live < atlas[best].live) {
+			best = page;
+		}
+	}
+	if (best == STX_NONE) {
+		return STX_NONE;
+	}
+
+	if (sdl_texcache_evict_atlas_page(best)) {
+		return STX_NONE; // some entry could not be evicted, leave the page alone
+	}
+	atlas_reset(best);
+	atlas_recycled++;
+
+	return best;
+}
+
+// Put the finished pixels of a sprite entry on an atlas page and point st->tex
+// at that page. Returns 0 if the sprite should get its own texture instead.
+int sdl_atlas_place(struct sdl_texture *st)
+{
+	int page, x = 0, y = 0;
+	int w = st->xres * sdl_scale, h = st->yres * sdl_scale;
+
+	if (w > ATLAS_MAX_SPRITE || h > ATLAS_MAX_SPRITE) {
+		return 0;
+	}
+
+	for (page = 0; page < ATLAS_MAX_PAGES; page++) {
+		if (!atlas[page].tex && !atlas_create(page)) {
+			return 0;
+		}
+		if (atlas_pack(page, w, h, &x, &y)) {
+			break;
+		}
+	}
+	if (page == ATLAS_MAX_PAGES) {
+		page = atlas_recycle();
+		if (page == STX_NONE || !atlas_pack(page, w, h, &x, &y)) {
+			return 0;
+		}
+	}
+
+	// Space can be reused after evictions, and quads still waiting in the batch
+	// must show what was there before
+	sdl_batch_flush_tex(atlas[page].tex);
+
+	SDL_Rect r = {x, y, w, h};
+	SDL_UpdateTexture(atlas[page].tex, &r, st->pixel, (int)(st->xres * sizeof(uint32_t) * (size_t)sdl_scale));
+
+	// A recycled page still holds the old sprites, clear the gutter around ours
+	static const uint32_t clear[ATLAS_MAX_SPRITE + 2] = {0};
+	SDL_Rect g[4] = {{x - 1, y - 1, w + 2, 1}, {x - 1, y + h, w + 2, 1}, {x - 1, y, 1, h}, {x + w, y, 1, h}};
+	for (int i = 0; i < 4; i++) {
+		SDL_UpdateTexture(atlas[page].tex, &g[i], clear, g[i].w * (int)sizeof(uint32_t));
+	}
+
+	st->tex = atlas[page].tex;
+	st->atlas = (int8_t)page;
+	st->ax = (uint16_t)x;
+	st->ay = (uint16_t)y;
+	atlas[page].live++;
+	atlas_placed++;
+
+	return 1;
+}
+
+// Give up the atlas space of an evicted entry
+void sdl_atlas_release(struct sdl_texture *st)
+{
+	int page = st->atlas;
+
+	if (page == STX_NONE) {
+		return;
+	}
+
+	st->atlas = STX_NONE;
+	st->tex = NULL;
+
+	if (--atlas[page].live == 0) {
+		atlas_reset(page);
+	}
+}
+
+// Destroy all pages. The texture cache must not reference them anymore.
+void sdl_atlas_exit(void)
+{
+	int page;
+
+	for (page = 0; page < ATLAS_MAX_PAGES; page++) {
+		if (atlas[page].tex) {
+			sdl_batch_flush_tex(atlas[page].tex);
+			SDL_DestroyTexture(atlas[page].tex);
+		}
+	}
+	memset(atlas, 0, sizeof(atlas));
+	atlas_placed = atlas_recycled = 0;
+}
+
+int sdl_atlas_pages(void)
+{
+	int page, cnt = 0;
+
+	for (page = 0; page < ATLAS_MAX_PAGES; page++) {
+		if (atlas[page].tex) {
+			cnt++;
+		}
+	}
+	return cnt;
+}
+
+int sdl_atlas_sprites(void)
+{
+	int page, cnt = 0;
+
+	for (page = 0; page < ATLAS_MAX_PAGES; page++) {
+		cnt += atlas[page].live;
+	}
+	return cnt;
+}
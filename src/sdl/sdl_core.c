@@ -10,7 +10,6 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <zip.h>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_timer.h>
 #include <SDL3_mixer/SDL_mixer.h>
@@ -31,13 +30,13 @@ DLL_EXPORT SDL_Renderer *sdlren = NULL;
 // Cursors
 static SDL_Cursor *curs[20];
 
-// Zip archives for graphics
-zip_t *sdl_zip1 = NULL;
-zip_t *sdl_zip2 = NULL;
-zip_t *sdl_zip1p = NULL;
-zip_t *sdl_zip2p = NULL;
-zip_t *sdl_zip1m = NULL;
-zip_t *sdl_zip2m = NULL;
+// Zip archives for graphics, shared by the render thread and all workers
+struct sdl_archive *sdl_zip1 = NULL;
+struct sdl_archive *sdl_zip2 = NULL;
+struct sdl_archive *sdl_zip1p = NULL;
+struct sdl_archive *sdl_zip2p = NULL;
+struct sdl_archive *sdl_zip1m = NULL;
+struct sdl_archive *sdl_zip2m = NULL;
 
 // Prefetch threading (shared with sdl_texture.c)
 SDL_Semaphore *prework = NULL;
@@ -51,13 +50,14 @@ MIX_Track *sdl_tracks[MAX_SOUND_CHANNELS] = {NULL};
 DLL_EXPORT int sdl_scale = 1;
 DLL_EXPORT int sdl_frames = 0;
 DLL_EXPORT int sdl_multi = 4;
-DLL_EXPORT int sdl_cache_size = 8000;
+DLL_EXPORT int sdl_cache_size = DEF_TEXCACHE;
+DLL_EXPORT int sdl_cache_budget = 0;
+DLL_EXPORT int sdl_image_budget = 0;
+DLL_EXPORT int sdl_disk_budget = 0;
 DLL_EXPORT int __yres = YRES0;
 
 // Worker thread management
 
-struct zip_handles;
-struct zip_handles *worker_zips = NULL;
 SDL_AtomicInt worker_quit;
 SDL_Thread **worker_threads = NULL;
 
@@ -75,13 +75,33 @@ void sdl_dump(FILE *fp)
 	fprintf(fp, "sdl_scale: %d\n", sdl_scale);
 	fprintf(fp, "sdl_frames: %d\n", sdl_frames);
 	fprintf(fp, "sdl_multi: %d\n", sdl_multi);
-	fprintf(fp, "sdl_cache_size: %d (max=%d)\n", sdl_cache_size, MAX_TEXCACHE);
+	fprintf(fp, "sdl_cache_size: %d (using %d, max=%d)\n", sdl_cache_size, sdlt_size, MAX_TEXCACHE);
+	fprintf(fp, "sdl_cache_budget: %d (using %.2fMB)\n", sdl_cache_budget, (double)texc_budget / (1024.0 * 1024.0));
 
 	fprintf(fp, "mem_png: %lld\n", (long long)__atomic_load_n(&mem_png, __ATOMIC_RELAXED));
 	fprintf(fp, "mem_tex: %lld\n", (long long)__atomic_load_n(&mem_tex, __ATOMIC_RELAXED));
 	fprintf(fp, "texc_hit: %lld\n", texc_hit);
 	fprintf(fp, "texc_miss: %lld\n", texc_miss);
 	fprintf(fp, "texc_pre: %lld\n", texc_pre);
+	fprintf(fp, "texc_evict: %lld (%lld over budget)\n", texc_evict, texc_evict_budget);
+	fprintf(fp, "texc_upload: %lld (%.2fMB)\n", texc_upload, (double)texc_upload_bytes / (1024.0 * 1024.0));
+	fprintf(fp, "texc_hitrate: %.2f%%\n", sdl_texcache_hitrate());
+	fprintf(fp, "imgc_used: %d (%.2fMB of %.2fMB)\n", imgc_used,
+	    (double)__atomic_load_n(&mem_png, __ATOMIC_RELAXED) / (1024.0 * 1024.0),
+	    (double)imgc_budget / (1024.0 * 1024.0));
+	fprintf(fp, "imgc_evict: %lld\n", imgc_evict);
+	fprintf(fp, "atlas: %d pages, %d sprites (%lld placed, %lld pages recycled)\n", sdl_atlas_pages(),
+	    sdl_atlas_sprites(), atlas_placed, atlas_recycled);
+	fprintf(fp, "batch: %lld quads in %lld draw calls\n", sdl_batch_quads, sdl_batch_calls);
+	fprintf(fp, "glyph atlas: %d fonts, %lld glyphs drawn\n", sdl_glyph_fonts(), glyph_quads);
+	fprintf(fp, "disk cache: %lld hits, %lld misses, %lld stored, %lld over budget\n", dc_hits, dc_misses, dc_stores,
+	    dc_full);
+	fprintf(fp, "sprite pack: %d sprites, %lld loaded\n", sdl_pack_sprites(), spk_hits);
+	fprintf(fp, "archive index: %lld name lookups saved\n", zip_index_saved);
+#ifdef DEVELOPER
+	fprintf(fp, "image load: %.2fms reading PNGs, %.2fms converting rows, %.2fms trimming and scaling\n",
+	    (double)sdl_time_load_png / 1e6, (double)sdl_time_load_rows / 1e6, (double)sdl_time_load_trim / 1e6);
+#endif
 
 	fprintf(fp, "\n");
 }
@@ -90,10 +110,38 @@ void sdl_dump(FILE *fp)
 
 // #define GO_DEFAULTS (GO_CONTEXT|GO_ACTION|GO_BIGBAR|GO_PREDICT|GO_SHORT|GO_MAPSAVE|GO_NOMAP)
 
-int sdl_init(int width, int height, char *title)
+// Open the sprite disk cache next to the other files we write
+static void sdl_disk_cache_open(void)
 {
-	int i;
+	char filename[MAX_PATH];
+	int megabytes = sdl_disk_budget;
+
+	if (megabytes < 0) {
+		return;
+	}
+	if (!megabytes) {
+		megabytes = DEF_DISKBUDGET * sdl_scale * sdl_scale;
+	}
+
+	if (localdata) {
+		snprintf(filename, sizeof(filename), "%s%s", localdata, "sprites.cache");
+	} else {
+		snprintf(filename, sizeof(filename), "%s", "bin/data/sprites.cache");
+	}
+	sdl_dc_init(filename, (long long)megabytes * 1024 * 1024);
+}
+
+// Sprites in res/gx<scale>.pack are used instead of decoding them from the zips
+static void sdl_sprite_pack_open(void)
+{
+	char filename[MAX_PATH];
+
+	snprintf(filename, sizeof(filename), "res/gx%d.pack", sdl_scale);
+	sdl_pack_open(filename);
+}
 
+int sdl_init(int width, int height, char *title)
+{
 	if (!SDL_Init(SDL_INIT_VIDEO | ((game_options & GO_SOUND) ? SDL_INIT_AUDIO : 0))) {
 		fail("SDL_Init Error: %s", SDL_GetError());
 		return 0;
@@ -101,6 +149,8 @@ int sdl_init(int width, int height, char *title)
 
 	SDL_SetHint(SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH, "1");
 
+	sdl_light_init();
+
 	SDL_DisplayID display_id = SDL_GetPrimaryDisplay();
 	const SDL_DisplayMode *DM = SDL_GetCurrentDisplayMode(display_id);
 
@@ -155,7 +205,8 @@ int sdl_init(int width, int height, char *title)
 	const char *renderers_to_try[] = {"metal", NULL};
 #endif
 
-	for (int i = 0; renderers_to_try[i] != NULL; i++) {
+	// An explicit SDL_HINT_RENDER_DRIVER (e.g. "software" for the benchmark) wins
+	for (int i = 0; renderers_to_try[i] != NULL && !SDL_GetHint(SDL_HINT_RENDER_DRIVER); i++) {
 		SDL_PropertiesID renderer_props_create = SDL_CreateProperties();
 		if (renderer_props_create != 0) {
 			SDL_SetPointerProperty(renderer_props_create, SDL_PROP_RENDERER_CREATE_WINDOW_POINTER, sdlwnd);
@@ -184,29 +235,13 @@ int sdl_init(int width, int height, char *title)
 
 	SDL_SetRenderVSync(sdlren, 1);
 
-	// Initialize hash table (statically allocated)
-	for (i = 0; i < MAX_TEXHASH; i++) {
-		sdlt_cache[i] = STX_NONE;
-	}
-
-	// Initialize texture cache (statically allocated)
-	for (i = 0; i < MAX_TEXCACHE; i++) {
-		// Initialize flags atomically
-		uint16_t *flags_ptr = (uint16_t *)&sdlt[i].flags;
-		__atomic_store_n(flags_ptr, 0, __ATOMIC_RELAXED);
-		sdlt[i].prev = i - 1;
-		sdlt[i].next = i + 1;
-		sdlt[i].hnext = STX_NONE;
-		sdlt[i].hprev = STX_NONE;
-		// Initialize new fields:
-		// Generation starts at 1 (0 is reserved for "never valid for jobs")
-		sdlt[i].generation = 1;
-		sdlt[i].work_state = TX_WORK_IDLE;
-	}
-	sdlt[0].prev = STX_NONE;
-	sdlt[MAX_TEXCACHE - 1].next = STX_NONE;
-	sdlt_best = 0;
-	sdlt_last = MAX_TEXCACHE - 1;
+	// Initialize texture cache and hash table
+	if (!sdl_texcache_init(sdl_cache_size)) {
+		SDL_DestroyRenderer(sdlren);
+		SDL_DestroyWindow(sdlwnd);
+		SDL_Quit();
+		return 0;
+	}
 
 	// Initialize the new texture job queue
 	tex_jobs_init();
@@ -288,35 +323,44 @@ int sdl_init(int width, int height, char *title)
 	}
 	note("SDL using %dx%d scale %d, options=%" PRIu64, XRES, YRES, sdl_scale, game_options);
 
+	sdl_texcache_set_budget(sdl_cache_budget, sdl_scale);
+	sdl_ic_set_budget(sdl_image_budget, sdl_scale);
+	note("SDL texture cache: %d entries, %.0fMB budget, %.0fMB for decoded images", sdlt_size,
+	    (double)texc_budget / (1024.0 * 1024.0), (double)imgc_budget / (1024.0 * 1024.0));
+
 	// Let SDL3 use its default rendering behavior
 	// The game's sdl_scale and render_set_offset() handle all scaling and centering
 
 	sdl_create_cursors();
 
-	sdl_zip1 = zip_open("res/gx1.zip", ZIP_RDONLY, NULL);
-	sdl_zip1p = zip_open("res/gx1_patch.zip", ZIP_RDONLY, NULL);
-	sdl_zip1m = zip_open("res/gx1_mod.zip", ZIP_RDONLY, NULL);
+	sdl_zip1 = sdl_archive_open("res/gx1.zip");
+	sdl_zip1p = sdl_archive_open("res/gx1_patch.zip");
+	sdl_zip1m = sdl_archive_open("res/gx1_mod.zip");
 
 	switch (sdl_scale) {
 	case 2:
-		sdl_zip2 = zip_open("res/gx2.zip", ZIP_RDONLY, NULL);
-		sdl_zip2p = zip_open("res/gx2_patch.zip", ZIP_RDONLY, NULL);
-		sdl_zip2m = zip_open("res/gx2_mod.zip", ZIP_RDONLY, NULL);
+		sdl_zip2 = sdl_archive_open("res/gx2.zip");
+		sdl_zip2p = sdl_archive_open("res/gx2_patch.zip");
+		sdl_zip2m = sdl_archive_open("res/gx2_mod.zip");
 		break;
 	case 3:
-		sdl_zip2 = zip_open("res/gx3.zip", ZIP_RDONLY, NULL);
-		sdl_zip2p = zip_open("res/gx3_patch.zip", ZIP_RDONLY, NULL);
-		sdl_zip2m = zip_open("res/gx3_mod.zip", ZIP_RDONLY, NULL);
+		sdl_zip2 = sdl_archive_open("res/gx3.zip");
+		sdl_zip2p = sdl_archive_open("res/gx3_patch.zip");
+		sdl_zip2m = sdl_archive_open("res/gx3_mod.zip");
 		break;
 	case 4:
-		sdl_zip2 = zip_open("res/gx4.zip", ZIP_RDONLY, NULL);
-		sdl_zip2p = zip_open("res/gx4_patch.zip", ZIP_RDONLY, NULL);
-		sdl_zip2m = zip_open("res/gx4_mod.zip", ZIP_RDONLY, NULL);
+		sdl_zip2 = sdl_archive_open("res/gx4.zip");
+		sdl_zip2p = sdl_archive_open("res/gx4_patch.zip");
+		sdl_zip2m = sdl_archive_open("res/gx4_mod.zip");
 		break;
 	default:
 		break;
 	}
 
+	sdl_zip_index_init();
+	sdl_sprite_pack_open();
+	sdl_disk_cache_open();
+
 	if (game_options & GO_SOUND) {
 		if (!MIX_Init()) {
 			warn("MIX_Init failed: %s", SDL_GetError());
@@ -361,142 +405,32 @@ int sdl_init(int width, int height, char *title)
 		char buf[80];
 		int n;
 
-		// Allocate worker zip handles
-		worker_zips = xmalloc((size_t)sdl_multi * sizeof(struct zip_handles), MEM_SDL_BASE);
-		if (!worker_zips) {
-			fail("Out of memory for worker zip handles");
+		// Workers read from the shared archives, they need nothing of their own
+		worker_threads = xmalloc((size_t)sdl_multi * sizeof(SDL_Thread *), MEM_SDL_BASE);
+		if (!worker_threads) {
+			fail("Out of memory for thread handles");
 			sdl_multi = 0;
 		} else {
-			// Open zip handles for each worker
+			// Create all threads
 			for (n = 0; n < sdl_multi; n++) {
-				worker_zips[n].zip1 = zip_open("res/gx1.zip", ZIP_RDONLY, NULL);
-				worker_zips[n].zip1p = zip_open("res/gx1_patch.zip", ZIP_RDONLY, NULL);
-				worker_zips[n].zip1m = zip_open("res/gx1_mod.zip", ZIP_RDONLY, NULL);
-
-				switch (sdl_scale) {
-				case 2:
-					worker_zips[n].zip2 = zip_open("res/gx2.zip", ZIP_RDONLY, NULL);
-					worker_zips[n].zip2p = zip_open("res/gx2_patch.zip", ZIP_RDONLY, NULL);
-					worker_zips[n].zip2m = zip_open("res/gx2_mod.zip", ZIP_RDONLY, NULL);
-					break;
-				case 3:
-					worker_zips[n].zip2 = zip_open("res/gx3.zip", ZIP_RDONLY, NULL);
-					worker_zips[n].zip2p = zip_open("res/gx3_patch.zip", ZIP_RDONLY, NULL);
-					worker_zips[n].zip2m = zip_open("res/gx3_mod.zip", ZIP_RDONLY, NULL);
-					break;
-				case 4:
-					worker_zips[n].zip2 = zip_open("res/gx4.zip", ZIP_RDONLY, NULL);
-					worker_zips[n].zip2p = zip_open("res/gx4_patch.zip", ZIP_RDONLY, NULL);
-					worker_zips[n].zip2m = zip_open("res/gx4_mod.zip", ZIP_RDONLY, NULL);
-					break;
-				default:
-					break;
-				}
-
-				if (!worker_zips[n].zip1) {
-					warn("Worker %d: Failed to open res/gx1.zip - aborting initialization", n);
-					// Clean up already opened zips
+				sprintf(buf, "moac background worker %d", n);
+				worker_threads[n] = SDL_CreateThread(sdl_pre_backgnd, buf, (void *)(long long)n);
+				if (!worker_threads[n]) {
+					warn("Failed to create worker thread %d", n);
+					// Signal quit and join already created threads
+					SDL_SetAtomicInt(&worker_quit, 1);
 					for (int i = 0; i < n; i++) {
-						if (worker_zips[i].zip1) {
-							zip_close(worker_zips[i].zip1);
-						}
-						if (worker_zips[i].zip1p) {
-							zip_close(worker_zips[i].zip1p);
-						}
-						if (worker_zips[i].zip1m) {
-							zip_close(worker_zips[i].zip1m);
-						}
-						if (worker_zips[i].zip2) {
-							zip_close(worker_zips[i].zip2);
-						}
-						if (worker_zips[i].zip2p) {
-							zip_close(worker_zips[i].zip2p);
-						}
-						if (worker_zips[i].zip2m) {
-							zip_close(worker_zips[i].zip2m);
+						if (worker_threads[i]) {
+							SDL_WaitThread(worker_threads[i], NULL);
 						}
 					}
-					xfree(worker_zips);
-					worker_zips = NULL;
+					// Clean up
+					xfree(worker_threads);
+					worker_threads = NULL;
 					sdl_multi = 0;
 					break;
 				}
 			}
-
-			// Only create threads if all zip handles succeeded
-			if (sdl_multi > 0) {
-				worker_threads = xmalloc((size_t)sdl_multi * sizeof(SDL_Thread *), MEM_SDL_BASE);
-				if (!worker_threads) {
-					fail("Out of memory for thread handles");
-					// Clean up zip handles
-					for (n = 0; n < sdl_multi; n++) {
-						if (worker_zips[n].zip1) {
-							zip_close(worker_zips[n].zip1);
-						}
-						if (worker_zips[n].zip1p) {
-							zip_close(worker_zips[n].zip1p);
-						}
-						if (worker_zips[n].zip1m) {
-							zip_close(worker_zips[n].zip1m);
-						}
-						if (worker_zips[n].zip2) {
-							zip_close(worker_zips[n].zip2);
-						}
-						if (worker_zips[n].zip2p) {
-							zip_close(worker_zips[n].zip2p);
-						}
-						if (worker_zips[n].zip2m) {
-							zip_close(worker_zips[n].zip2m);
-						}
-					}
-					xfree(worker_zips);
-					worker_zips = NULL;
-					sdl_multi = 0;
-				} else {
-					// Create all threads
-					for (n = 0; n < sdl_multi; n++) {
-						sprintf(buf, "moac background worker %d", n);
-						worker_threads[n] = SDL_CreateThread(sdl_pre_backgnd, buf, (void *)(long long)n);
-						if (!worker_threads[n]) {
-							warn("Failed to create worker thread %d", n);
-							// Signal quit and join already created threads
-							SDL_SetAtomicInt(&worker_quit, 1);
-							for (int i = 0; i < n; i++) {
-								if (worker_threads[i]) {
-									SDL_WaitThread(worker_threads[i], NULL);
-								}
-							}
-							// Clean up
-							xfree(worker_threads);
-							worker_threads = NULL;
-							for (int i = 0; i < sdl_multi; i++) {
-								if (worker_zips[i].zip1) {
-									zip_close(worker_zips[i].zip1);
-								}
-								if (worker_zips[i].zip1p) {
-									zip_close(worker_zips[i].zip1p);
-								}
-								if (worker_zips[i].zip1m) {
-									zip_close(worker_zips[i].zip1m);
-								}
-								if (worker_zips[i].zip2) {
-									zip_close(worker_zips[i].zip2);
-								}
-								if (worker_zips[i].zip2p) {
-									zip_close(worker_zips[i].zip2p);
-								}
-								if (worker_zips[i].zip2m) {
-									zip_close(worker_zips[i].zip2m);
-								}
-							}
-							xfree(worker_zips);
-							worker_zips = NULL;
-							sdl_multi = 0;
-							break;
-						}
-					}
-				}
-			}
 		}
 	}
 
@@ -523,6 +457,7 @@ int sdl_render(void)
 {
 	SDL_RenderPresent(sdlren);
 	sdl_frames++;
+	sdl_stats_frame();
 	return 1;
 }
 
@@ -549,50 +484,19 @@ void sdl_exit(void)
 		worker_threads = NULL;
 	}
 
-	// Close worker zip handles
-	if (worker_zips) {
-		for (int n = 0; n < sdl_multi; n++) {
-			if (worker_zips[n].zip1) {
-				zip_close(worker_zips[n].zip1);
-			}
-			if (worker_zips[n].zip1p) {
-				zip_close(worker_zips[n].zip1p);
-			}
-			if (worker_zips[n].zip1m) {
-				zip_close(worker_zips[n].zip1m);
-			}
-			if (worker_zips[n].zip2) {
-				zip_close(worker_zips[n].zip2);
-			}
-			if (worker_zips[n].zip2p) {
-				zip_close(worker_zips[n].zip2p);
-			}
-			if (worker_zips[n].zip2m) {
-				zip_close(worker_zips[n].zip2m);
-			}
-		}
-		xfree(worker_zips);
-		worker_zips = NULL;
-	}
+	// Workers are gone, nobody reads or writes the disk cache anymore
+	sdl_dc_exit();
+	sdl_pack_close();
 
-	if (sdl_zip1) {
-		zip_close(sdl_zip1);
-	}
-	if (sdl_zip1m) {
-		zip_close(sdl_zip1m);
-	}
-	if (sdl_zip1p) {
-		zip_close(sdl_zip1p);
-	}
-	if (sdl_zip2) {
-		zip_close(sdl_zip2);
-	}
-	if (sdl_zip2m) {
-		zip_close(sdl_zip2m);
-	}
-	if (sdl_zip2p) {
-		zip_close(sdl_zip2p);
-	}
+	sdl_zip_index_exit();
+
+	sdl_archive_close(sdl_zip1);
+	sdl_archive_close(sdl_zip1m);
+	sdl_archive_close(sdl_zip1p);
+	sdl_archive_close(sdl_zip2);
+	sdl_archive_close(sdl_zip2m);
+	sdl_archive_close(sdl_zip2p);
+	sdl_zip1 = sdl_zip1m = sdl_zip1p = sdl_zip2 = sdl_zip2m = sdl_zip2p = NULL;
 
 	if (prework) {
 		SDL_DestroySemaphore(prework);
@@ -604,9 +508,6 @@ void sdl_exit(void)
 		premutex = NULL;
 	}
 
-	// Shutdown the new texture job queue
-	tex_jobs_shutdown();
-
 	if (game_options & GO_SOUND) {
 		MIX_Quit();
 	}
@@ -617,6 +518,16 @@ void sdl_exit(void)
 #ifdef DEVELOPER
 	sdl_dump_spritecache();
 #endif
+
+	note("Texture cache: %.2f%% hits (%lld hits, %lld misses) with %.0fMB budget, %lld evictions (%lld over budget)",
+	    sdl_texcache_hitrate(), texc_hit, texc_miss, (double)texc_budget / (1024.0 * 1024.0), texc_evict,
+	    texc_evict_budget);
+	note("Image cache: %d images resident, %lld evicted", imgc_used, imgc_evict);
+	note("Sprite atlas: %d pages, %lld sprites placed, %lld pages recycled", sdl_atlas_pages(), atlas_placed,
+	    atlas_recycled);
+	sdl_glyph_exit();
+	sdl_atlas_exit();
+	sdl_texcache_exit();
 }
 
 void cmd_proc(int key);
@@ -895,7 +806,7 @@ int if_single_thread_process_one_job(void)
 
 	// Pop a job from the queue (non-blocking)
 	texture_job_t job;
-	if (!tex_jobs_pop(&job, 0)) {
+	if (!tex_jobs_pop(&job)) {
 		return 0; // Queue empty
 	}
 
@@ -908,27 +819,27 @@ int if_single_thread_process_one_job(void)
 		return 0;
 	}
 
-	// Mark in-worker (no lock needed in single-threaded mode)
-	tex->work_state = TX_WORK_IN_WORKER;
+	// Claim it like a worker would; the render thread may have made it already
+	if (!work_state_cas(tex, TX_WORK_QUEUED, TX_WORK_IN_WORKER)) {
+		return 0;
+	}
 
 	// Do the actual work: load image and do stages 1+2
-	unsigned int sprite = tex->sprite;
-
-	if (sdl_ic_load(sprite, NULL) < 0) {
+	if (sdl_make_sprite(tex) < 0) {
 		// Failed: mark idle and leave DIDMAKE unset
 		// Generation can't change under us in single-threaded mode.
+		work_state_store(tex, TX_WORK_IDLE);
 		return 0;
 	}
-
-	// Stage 1 + 2
-	sdl_make(tex, &sdli[sprite], 1);
-	sdl_make(tex, &sdli[sprite], 2);
+	tex_ready_push(cache_index);
+	work_state_store(tex, TX_WORK_IDLE);
 
 	return 1;
 }
 
 void sdl_pre_add(unsigned int sprite, signed char sink, unsigned char freeze, unsigned char scale, char cr, char cg,
-    char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl)
+    char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl,
+    int urgent)
 {
 	Uint64 start;
 
@@ -937,6 +848,11 @@ void sdl_pre_add(unsigned int sprite, signed char sink, unsigned char freeze, un
 		return;
 	}
 
+	// Lit at draw time: prefetch the unlit texture the blit will use
+	if (sdl_light_at_draw(freeze, ml, ll, rl, ul, dl)) {
+		ml = ll = rl = ul = dl = 15;
+	}
+
 	// Ensure there is a cache slot (but don't force full make+tex)
 	start = SDL_GetTicks();
 	int cache_index = sdl_tx_load(sprite, sink, freeze, scale, cr, cg, cb, light, sat, c1, c2, c3, shine, ml, ll, rl,
@@ -959,26 +875,28 @@ void sdl_pre_add(unsigned int sprite, signed char sink, unsigned char freeze, un
 	// Single-threaded: do the CPU work inline
 	if (!sdl_multi) {
 		if (!(flags_load(slot) & SF_DIDMAKE)) {
-			unsigned int sprite_id = slot->sprite;
-			if (sdl_ic_load(sprite_id, NULL) >= 0) {
-				sdl_make(slot, &sdli[sprite_id], 1);
-				sdl_make(slot, &sdli[sprite_id], 2);
+			if (sdl_make_sprite(slot) >= 0) {
+				tex_ready_push(cache_index);
 			}
 		}
 		return;
 	}
 
-	// Multi-threaded: enqueue background job
-	SDL_LockMutex(g_tex_jobs.mutex);
-
-	// Check if already queued or in-progress
-	if (slot->work_state != TX_WORK_IDLE) {
-		SDL_UnlockMutex(g_tex_jobs.mutex);
+	// Multi-threaded: claim the slot, then enqueue a background job. Only this
+	// thread moves a slot out of TX_WORK_IDLE, so if the claim fails a job is
+	// already queued or in progress.
+	if (!work_state_cas(slot, TX_WORK_IDLE, TX_WORK_QUEUED)) {
 		return;
 	}
 
-	// Check if queue is full
-	if (g_tex_jobs.count >= TEX_JOB_CAPACITY) {
+	texture_job_t job;
+	job.cache_index = cache_index;
+	job.generation = slot->generation;
+	job.kind = TEXTURE_JOB_MAKE_STAGES_1_2;
+
+	if (!tex_jobs_push(&job, urgent ? TEX_LANE_NOW : TEX_LANE_PREFETCH)) {
+		// Lane is full, give the slot back
+		work_state_store(slot, TX_WORK_IDLE);
 #ifdef DEVELOPER
 		static uint64_t last_log_time = 0;
 		uint64_t now = SDL_GetTicks();
@@ -987,25 +905,9 @@ void sdl_pre_add(unsigned int sprite, signed char sink, unsigned char freeze, un
 			last_log_time = now;
 		}
 #endif
-		SDL_UnlockMutex(g_tex_jobs.mutex);
 		return;
 	}
 
-	// Add job to queue
-	texture_job_t *job = &g_tex_jobs.jobs[g_tex_jobs.tail];
-	job->cache_index = cache_index;
-	job->generation = slot->generation;
-	job->kind = TEXTURE_JOB_MAKE_STAGES_1_2;
-
-	g_tex_jobs.tail = (g_tex_jobs.tail + 1) % TEX_JOB_CAPACITY;
-	g_tex_jobs.count++;
-
-	// Mark as queued
-	slot->work_state = TX_WORK_QUEUED;
-
-	SDL_SignalCondition(g_tex_jobs.cond);
-	SDL_UnlockMutex(g_tex_jobs.mutex);
-
 	// Wake a worker
 	SDL_SignalSemaphore(prework);
 }
@@ -1021,7 +923,65 @@ void sdl_lock(void *a)
 
 #define SDL_LockMutex(a) sdl_lock(a)
 
-int sdl_pre_do(void)
+// Upload budget of sdl_pre_do(), see there
+#define PRE_UPLOAD_RESERVE_NS SDL_MS_TO_NS(1) // left free before the deadline for prediction errors
+#define PRE_UPLOAD_LATE_NS    SDL_MS_TO_NS(1) // spent per call once the deadline has passed
+
+static double pre_upload_ns_per_byte = 1.0; // running estimate of the stage 3 cost
+uint64_t sdl_pre_upload_bytes = 0;
+
+// Upload entries from the ready list that fit the budget (ns). An entry that
+// does not fit is kept for the next call. If late is set, the first entry is
+// uploaded in any case so a client that is always behind still makes progress.
+static int sdl_pre_upload(int64_t budget, int late)
+{
+	uint64_t start = SDL_GetTicksNS();
+	int uploads = 0;
+	texture_job_t job;
+
+	for (;;) {
+		if (g_tex_jobs.ready_has_next) {
+			job = g_tex_jobs.ready_next;
+			g_tex_jobs.ready_has_next = 0;
+		} else if (!tex_ready_pop(&job)) {
+			break;
+		}
+
+		// Evicted, reused or uploaded by the render path since it was pushed
+		struct sdl_texture *slot = &sdlt[job.cache_index];
+		uint16_t flags = flags_load(slot);
+		if (slot->generation != job.generation || !(flags & SF_SPRITE) || !(flags & SF_DIDMAKE) ||
+		    (flags & SF_DIDTEX)) {
+			continue;
+		}
+
+		// Do not start an upload we expect to overrun the budget with
+		size_t bytes = (size_t)slot->xres * (size_t)slot->yres * (size_t)(sdl_scale * sdl_scale) * sizeof(uint32_t);
+		int64_t spent = (int64_t)(SDL_GetTicksNS() - start);
+		if (spent + (int64_t)((double)bytes * pre_upload_ns_per_byte) > budget && (uploads || !late)) {
+			g_tex_jobs.ready_next = job;
+			g_tex_jobs.ready_has_next = 1;
+			break;
+		}
+
+		uint64_t t = SDL_GetTicksNS();
+		sdl_make(slot, &sdli[slot->sprite], 3);
+		t = SDL_GetTicksNS() - t;
+
+		if (bytes) {
+			pre_upload_ns_per_byte += ((double)t / (double)bytes - pre_upload_ns_per_byte) / 8.0;
+		}
+		sdl_pre_upload_bytes += bytes;
+		uploads++;
+	}
+
+	return uploads;
+}
+
+// Background bookkeeping for the main thread, called while waiting for the
+// next frame. deadline is the SDL_GetTicks() time the frame is due, GPU
+// uploads (stage 3) stop short of it. Returns the number of uploads done.
+int sdl_pre_do(uint64_t deadline)
 {
 	Uint64 start;
 	int uploads = 0;
@@ -1031,25 +991,29 @@ int sdl_pre_do(void)
 	// Single-threaded: process jobs from queue (will no-op if called from multi)
 	if_single_thread_process_one_job();
 
-	// Main thread: upload any textures where CPU work is done (SF_DIDMAKE) but
-	// GPU upload hasn't happened (!SF_DIDTEX)
-	// This is stage 3: creating the actual SDL_Texture
-	const int max_uploads_per_call = 64; // Safety bound to avoid stalling frame
-
-	for (int i = 0; i < MAX_TEXCACHE && uploads < max_uploads_per_call; i++) {
-		struct sdl_texture *slot = &sdlt[i];
-
-		uint16_t flags = flags_load(slot);
-		if (!(flags & SF_SPRITE)) {
-			continue;
+	// Drop decoded images nobody needs anymore if we are over budget
+	sdl_ic_trim();
+
+	// The ready list ran full at some point: find what it lost
+	if (__atomic_exchange_n(&g_tex_jobs.ready_overflow, 0, __ATOMIC_ACQ_REL)) {
+		for (int i = 0; i < sdlt_size; i++) {
+			uint16_t flags = flags_load(&sdlt[i]);
+			if ((flags & SF_SPRITE) && (flags & SF_DIDMAKE) && !(flags & SF_DIDTEX)) {
+				tex_ready_push(i);
+				if (__atomic_load_n(&g_tex_jobs.ready_overflow, __ATOMIC_ACQUIRE)) {
+					break; // still full, try again next call
+				}
+			}
 		}
+	}
 
-		// Worker did stage 1+2, GPU upload hasn't happened yet
-		if ((flags & SF_DIDMAKE) && !(flags & SF_DIDTEX)) {
-			unsigned int sprite = slot->sprite;
-			sdl_make(slot, &sdli[sprite], 3);
-			uploads++;
-		}
+	// Main thread: upload textures whose CPU work is done (stage 3), using the
+	// time left until the frame is due
+	int64_t left = (int64_t)SDL_MS_TO_NS(deadline) - (int64_t)SDL_GetTicksNS();
+	if (left > 0) {
+		uploads = sdl_pre_upload(left - (int64_t)PRE_UPLOAD_RESERVE_NS, 0);
+	} else {
+		uploads = sdl_pre_upload((int64_t)PRE_UPLOAD_LATE_NS, 1);
 	}
 
 	extern long long sdl_time_pre2;
@@ -1062,10 +1026,10 @@ uint64_t sdl_backgnd_wait = 0, sdl_backgnd_work = 0, sdl_backgnd_jobs = 0;
 
 int sdl_pre_backgnd(void *ptr)
 {
-	int worker_id = (int)(long long)ptr;
-	struct zip_handles *zips = worker_zips ? &worker_zips[worker_id] : NULL;
 	uint64_t wait_start, work_start;
 
+	(void)ptr;
+
 	SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_LOW);
 
 	for (;;) {
@@ -1088,7 +1052,7 @@ int sdl_pre_backgnd(void *ptr)
 
 		// Pop a job from the queue
 		texture_job_t job;
-		if (!tex_jobs_pop(&job, 0)) {
+		if (!tex_jobs_pop(&job)) {
 			// No work found
 			continue;
 		}
@@ -1097,42 +1061,27 @@ int sdl_pre_backgnd(void *ptr)
 		struct sdl_texture *tex = &sdlt[cache_index];
 
 		// Check generation: if stale, skip
-		if (tex->generation != job.generation) {
+		if (__atomic_load_n(&tex->generation, __ATOMIC_ACQUIRE) != job.generation) {
 			continue;
 		}
 
-		// Mark in-worker
-		SDL_LockMutex(g_tex_jobs.mutex);
-		if (tex->generation != job.generation) {
-			SDL_UnlockMutex(g_tex_jobs.mutex);
+		// Claim the slot; fails if another worker has it or the work is done.
+		// Should the slot have been evicted and queued again in between, we
+		// simply do the work for its current contents.
+		if (!work_state_cas(tex, TX_WORK_QUEUED, TX_WORK_IN_WORKER)) {
 			continue;
 		}
-		tex->work_state = TX_WORK_IN_WORKER;
-		SDL_UnlockMutex(g_tex_jobs.mutex);
-
-		// Do the actual work: load image and do stages 1+2
-		unsigned int sprite = tex->sprite;
 
-		if (sdl_ic_load(sprite, zips) < 0) {
+		// Do the actual work: stages 1+2, from the disk cache if possible
+		if (sdl_make_sprite(tex) < 0) {
 			// Failed: leave DIDMAKE unset, allow main thread to handle fallback
-			SDL_LockMutex(g_tex_jobs.mutex);
-			if (tex->generation == job.generation) {
-				tex->work_state = TX_WORK_IDLE;
-			}
-			SDL_UnlockMutex(g_tex_jobs.mutex);
+			work_state_store(tex, TX_WORK_IDLE);
 			continue;
 		}
 
-		// Stage 1 + 2
-		sdl_make(tex, &sdli[sprite], 1);
-		sdl_make(tex, &sdli[sprite], 2);
-
-		SDL_LockMutex(g_tex_jobs.mutex);
-		if (tex->generation == job.generation) {
-			// CPU work done; GPU creation is main-thread
-			tex->work_state = TX_WORK_IDLE;
-		}
-		SDL_UnlockMutex(g_tex_jobs.mutex);
+		// CPU work done; GPU creation is main-thread
+		tex_ready_push(cache_index);
+		work_state_store(tex, TX_WORK_IDLE);
 
 		sdl_backgnd_work += SDL_GetTicks() - work_start;
 		sdl_backgnd_jobs++;
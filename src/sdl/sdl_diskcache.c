@@ -0,0 +1,565 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * SDL - Sprite Disk Cache
+ *
+ * Keeps the results of sdl_make() stages 1 and 2 (scaled, colorized, color
+ * balanced and lit pixels) in a file between sessions, so that logging into a
+ * busy area does not decode and process the same sprites all over again.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+// The file is a header followed by records, each a struct dc_record and the
+// pixels. New records are appended. An index of all records is built when the
+// file is opened and kept in memory.
+//
+// The header holds a stamp of everything besides the texture key that changes
+// the pixels: the graphics archives (size and time of gx*.zip, _patch.zip and
+// _mod.zip), sdl_scale and the light mode. If it does not match, the file is
+// started over. Bump DC_VERSION whenever sdl_make() output changes.
+//
+// Records used in a session get that session's number. When the file grows
+// past 3/4 of its budget, sdl_dc_exit() copies the most recently used records
+// into a new file until half the budget is used. Stores that would go over the
+// budget are dropped until then.
+//
+// Workers read and write through one stream under dc_mutex. A read is a single
+// copy into the pixel buffer of the texture entry, which is far cheaper than
+// decoding the PNG it replaces.
+
+#define DC_MAGIC        0x43505341 // "ASPC"
+#define DC_RECORD_MAGIC 0x52505341 // "ASPR"
+#define DC_VERSION      1
+
+struct dc_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t stamp;
+	uint32_t session;
+	uint32_t pad;
+};
+
+// Everything sdl_tx_load() tells sprite entries apart by
+struct dc_key {
+	uint32_t sprite;
+	uint16_t c1, c2, c3, shine;
+	int16_t cr, cg, cb, light, sat;
+	int8_t sink;
+	uint8_t scale, freeze;
+	int8_t ml, ll, rl, ul, dl;
+};
+
+struct dc_record {
+	uint32_t magic;
+	uint32_t used; // session that used it last
+	struct dc_key key;
+	uint16_t xres, yres;
+	int16_t xoff, yoff;
+	uint32_t bytes; // pixel bytes following the record
+	uint32_t pad;
+};
+
+struct dc_entry {
+	uint64_t hash; // 0 = free
+	int64_t offset; // of the record in the file
+	uint32_t bytes;
+	uint32_t used;
+	int dirty; // used changed since the file was opened
+};
+
+static SDL_Mutex *dc_mutex = NULL;
+static SDL_IOStream *dc_io = NULL;
+static char dc_filename[MAX_PATH];
+static uint32_t dc_session;
+static int64_t dc_size; // end of the last valid record
+static int64_t dc_budget;
+
+static struct dc_entry *dc_index = NULL;
+static int dc_index_size; // power of two
+static int dc_entries;
+
+long long dc_hits = 0, dc_misses = 0, dc_stores = 0, dc_full = 0;
+
+static uint64_t dc_fnv(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+static uint64_t dc_hash(const struct dc_key *key)
+{
+	uint64_t h = dc_fnv(0xcbf29ce484222325ull, key, sizeof(*key));
+
+	return h ? h : 1;
+}
+
+static void dc_key_of(const struct sdl_texture *st, struct dc_key *key)
+{
+	memset(key, 0, sizeof(*key)); // the padding is hashed and compared too
+	key->sprite = st->sprite;
+	key->c1 = st->c1;
+	key->c2 = st->c2;
+	key->c3 = st->c3;
+	key->shine = st->shine;
+	key->cr = st->cr;
+	key->cg = st->cg;
+	key->cb = st->cb;
+	key->light = st->light;
+	key->sat = st->sat;
+	key->sink = st->sink;
+	key->scale = st->scale;
+	key->freeze = st->freeze;
+	key->ml = st->ml;
+	key->ll = st->ll;
+	key->rl = st->rl;
+	key->ul = st->ul;
+	key->dl = st->dl;
+}
+
+static uint64_t dc_stamp(void)
+{
+	uint64_t h = 0xcbf29ce484222325ull, mode = game_options & (GO_LIGHTER | GO_LIGHTER2);
+	uint64_t archives = sdl_archive_stamp(sdl_scale);
+	uint32_t version = DC_VERSION;
+
+	h = dc_fnv(h, &version, sizeof(version));
+	h = dc_fnv(h, &sdl_scale, sizeof(sdl_scale));
+	h = dc_fnv(h, &mode, sizeof(mode));
+	h = dc_fnv(h, &archives, sizeof(archives));
+
+	return h;
+}
+
+// ============================================================================
+// Index
+// ============================================================================
+
+static struct dc_entry *dc_find(uint64_t hash)
+{
+	int i, mask = dc_index_size - 1;
+
+	for (i = (int)(hash & (uint64_t)mask); dc_index[i].hash; i = (i + 1) & mask) {
+		if (dc_index[i].hash == hash) {
+			return &dc_index[i];
+		}
+	}
+	return NULL;
+}
+
+static int dc_index_grow(void)
+{
+	struct dc_entry *old = dc_index;
+	int i, j, mask, old_size = dc_index_size;
+
+	dc_index_size = old_size ? old_size * 2 : 4096;
+	dc_index = xmalloc(sizeof(struct dc_entry) * (size_t)dc_index_size, MEM_SDL_BASE);
+	if (!dc_index) {
+		dc_index = old;
+		dc_index_size = old_size;
+		return 0;
+	}
+
+	mask = dc_index_size - 1;
+	for (i = 0; i < old_size; i++) {
+		if (!old[i].hash) {
+			continue;
+		}
+		for (j = (int)(old[i].hash & (uint64_t)mask); dc_index[j].hash; j = (j + 1) & mask) {
+		}
+		dc_index[j] = old[i];
+	}
+	xfree(old);
+
+	return 1;
+}
+
+// Add or replace the entry for hash. Keeps the table at most half full.
+static struct dc_entry *dc_insert(uint64_t hash, int64_t offset, uint32_t bytes, uint32_t used)
+{
+	struct dc_entry *e;
+	int i, mask;
+
+	e = dc_find(hash);
+	if (!e) {
+		if ((dc_entries + 1) * 2 > dc_index_size && !dc_index_grow()) {
+			return NULL;
+		}
+		mask = dc_index_size - 1;
+		for (i = (int)(hash & (uint64_t)mask); dc_index[i].hash; i = (i + 1) & mask) {
+		}
+		e = &dc_index[i];
+		e->hash = hash;
+		dc_entries++;
+	}
+	e->offset = offset;
+	e->bytes = bytes;
+	e->used = used;
+	e->dirty = 0;
+
+	return e;
+}
+
+// ============================================================================
+// File
+// ============================================================================
+
+static int dc_read_at(int64_t offset, void *buf, size_t len)
+{
+	if (SDL_SeekIO(dc_io, offset, SDL_IO_SEEK_SET) != offset) {
+		return 0;
+	}
+	return SDL_ReadIO(dc_io, buf, len) == len;
+}
+
+static int dc_write_at(int64_t offset, const void *buf, size_t len)
+{
+	if (SDL_SeekIO(dc_io, offset, SDL_IO_SEEK_SET) != offset) {
+		return 0;
+	}
+	return SDL_WriteIO(dc_io, buf, len) == len;
+}
+
+static uint32_t dc_pixel_bytes(const struct dc_record *rec)
+{
+	return (uint32_t)rec->xres * rec->yres * (uint32_t)(sdl_scale * sdl_scale) * sizeof(uint32_t);
+}
+
+// Build the index from the records in the file. A record cut short by a crash
+// ends the scan, the next store overwrites it.
+static void dc_scan(void)
+{
+	struct dc_record rec;
+	int64_t offset = sizeof(struct dc_header), size = SDL_GetIOSize(dc_io);
+
+	while (offset + (int64_t)sizeof(rec) <= size) {
+		if (!dc_read_at(offset, &rec, sizeof(rec))) {
+			break;
+		}
+		if (rec.magic != DC_RECORD_MAGIC || rec.bytes != dc_pixel_bytes(&rec) ||
+		    offset + (int64_t)sizeof(rec) + rec.bytes > size) {
+			break;
+		}
+		if (!dc_insert(dc_hash(&rec.key), offset, rec.bytes, rec.used)) {
+			break;
+		}
+		offset += (int64_t)sizeof(rec) + rec.bytes;
+	}
+	dc_size = offset;
+}
+
+static int dc_cmp_used(const void *a, const void *b)
+{
+	const struct dc_entry *ea = a, *eb = b;
+
+	if (ea->used != eb->used) {
+		return ea->used > eb->used ? -1 : 1;
+	}
+	return ea->offset > eb->offset ? -1 : (ea->offset < eb->offset ? 1 : 0);
+}
+
+// Copy the most recently used records into a new file, up to half the budget.
+// Closes dc_io.
+static void dc_compact(void)
+{
+	struct dc_entry *list;
+	struct dc_header head;
+	struct dc_record rec;
+	SDL_IOStream *out;
+	char tmpname[MAX_PATH + 4];
+	unsigned char *buf = NULL;
+	uint32_t buf_size = 0;
+	int64_t size;
+	int i, n, kept = 0, ok = 1;
+
+	list = xmalloc(sizeof(struct dc_entry) * (size_t)(dc_entries + 1), MEM_TEMP);
+	if (!list) {
+		return;
+	}
+	for (i = n = 0; i < dc_index_size; i++) {
+		if (dc_index[i].hash) {
+			list[n++] = dc_index[i];
+		}
+	}
+	qsort(list, (size_t)n, sizeof(struct dc_entry), dc_cmp_used);
+
+	snprintf(tmpname, sizeof(tmpname), "%s.new", dc_filename);
+	out = SDL_IOFromFile(tmpname, "wb");
+	if (!out) {
+		warn("Disk cache: cannot create %s: %s", tmpname, SDL_GetError());
+		xfree(list);
+		return;
+	}
+
+	if (!dc_read_at(0, &head, sizeof(head)) || SDL_WriteIO(out, &head, sizeof(head)) != sizeof(head)) {
+		ok = 0;
+	}
+	size = sizeof(head);
+
+	for (i = 0; i < n && ok; i++) {
+		if (size + (int64_t)sizeof(rec) + list[i].bytes > dc_budget / 2) {
+			continue; // smaller ones may still fit
+		}
+		if (list[i].bytes > buf_size) {
+			xfree(buf);
+			buf_size = list[i].bytes;
+			buf = xmalloc(buf_size, MEM_TEMP);
+			if (!buf) {
+				ok = 0;
+				break;
+			}
+		}
+		if (!dc_read_at(list[i].offset, &rec, sizeof(rec)) ||
+		    !dc_read_at(list[i].offset + (int64_t)sizeof(rec), buf, list[i].bytes)) {
+			continue;
+		}
+		rec.used = list[i].used;
+		if (SDL_WriteIO(out, &rec, sizeof(rec)) != sizeof(rec) || SDL_WriteIO(out, buf, rec.bytes) != rec.bytes) {
+			ok = 0;
+			break;
+		}
+		size += (int64_t)sizeof(rec) + rec.bytes;
+		kept++;
+	}
+	xfree(buf);
+	xfree(list);
+
+	if (!SDL_CloseIO(out)) {
+		ok = 0;
+	}
+	SDL_CloseIO(dc_io);
+	dc_io = NULL;
+
+	if (!ok || !SDL_RenamePath(tmpname, dc_filename)) {
+		warn("Disk cache: compaction failed, starting over: %s", SDL_GetError());
+		SDL_RemovePath(tmpname);
+		SDL_RemovePath(dc_filename);
+		return;
+	}
+	note("Disk cache: compacted to %d of %d sprites, %.1fMB", kept, n, (double)size / (1024.0 * 1024.0));
+}
+
+// ============================================================================
+// Interface
+// ============================================================================
+
+// Open (or create) the disk cache in filename, limited to budget bytes.
+// Returns 1 if the cache is usable.
+int sdl_dc_init(const char *filename, long long budget)
+{
+	struct dc_header head;
+	uint64_t stamp = dc_stamp();
+
+	if (dc_io || budget <= 0) {
+		return 0;
+	}
+
+	snprintf(dc_filename, sizeof(dc_filename), "%s", filename);
+	dc_budget = budget;
+	dc_size = 0;
+	dc_hits = dc_misses = dc_stores = dc_full = 0;
+
+	dc_mutex = SDL_CreateMutex();
+	if (!dc_mutex) {
+		return 0;
+	}
+
+	dc_io = SDL_IOFromFile(dc_filename, "r+b");
+	if (dc_io && (!dc_read_at(0, &head, sizeof(head)) || head.magic != DC_MAGIC || head.version != DC_VERSION ||
+	                 head.stamp != stamp)) {
+		note("Disk cache: graphics or settings changed, starting over");
+		SDL_CloseIO(dc_io);
+		dc_io = NULL;
+	} else if (dc_io) {
+		dc_session = head.session + 1;
+	}
+	if (!dc_io) {
+		dc_io = SDL_IOFromFile(dc_filename, "w+b");
+		if (!dc_io) {
+			warn("Disk cache: cannot open %s: %s", dc_filename, SDL_GetError());
+			SDL_DestroyMutex(dc_mutex);
+			dc_mutex = NULL;
+			return 0;
+		}
+		dc_session = 1;
+	}
+
+	head.magic = DC_MAGIC;
+	head.version = DC_VERSION;
+	head.stamp = stamp;
+	head.session = dc_session;
+	head.pad = 0;
+	if (!dc_write_at(0, &head, sizeof(head)) || !dc_index_grow()) {
+		warn("Disk cache: cannot write %s: %s", dc_filename, SDL_GetError());
+		SDL_CloseIO(dc_io);
+		dc_io = NULL;
+		sdl_dc_exit();
+		return 0;
+	}
+
+	dc_scan();
+	note("Disk cache: %d sprites, %.1fMB of %.0fMB in %s", dc_entries, (double)dc_size / (1024.0 * 1024.0),
+	    (double)dc_budget / (1024.0 * 1024.0), dc_filename);
+
+	return 1;
+}
+
+// Write back the use marks, compact if needed and close the cache.
+// Workers must be stopped.
+void sdl_dc_exit(void)
+{
+	int i;
+	uint32_t used;
+
+	if (dc_io) {
+		for (i = 0; i < dc_index_size; i++) {
+			if (dc_index[i].hash && dc_index[i].dirty) {
+				used = dc_index[i].used;
+				dc_write_at(dc_index[i].offset + (int64_t)offsetof(struct dc_record, used), &used, sizeof(used));
+			}
+		}
+		note("Disk cache: %lld hits, %lld misses, %lld stored, %lld dropped over budget", dc_hits, dc_misses,
+		    dc_stores, dc_full);
+
+		if (dc_size > dc_budget / 4 * 3) {
+			dc_compact();
+		}
+		if (dc_io) {
+			SDL_CloseIO(dc_io);
+			dc_io = NULL;
+		}
+	}
+
+	xfree(dc_index);
+	dc_index = NULL;
+	dc_index_size = dc_entries = 0;
+
+	if (dc_mutex) {
+		SDL_DestroyMutex(dc_mutex);
+		dc_mutex = NULL;
+	}
+}
+
+// Fill the sprite entry st with stages 1 and 2 from the disk cache. Returns 1
+// on a hit, with SF_DIDALLOC and SF_DIDMAKE set, 0 if st is left untouched.
+int sdl_dc_load(struct sdl_texture *st)
+{
+	struct dc_key key;
+	struct dc_record rec;
+	struct dc_entry *e;
+	uint32_t *pixel;
+	uint64_t hash;
+
+	if (!dc_io || (flags_load(st) & SF_DIDALLOC)) {
+		return 0;
+	}
+
+	dc_key_of(st, &key);
+	hash = dc_hash(&key);
+
+	SDL_LockMutex(dc_mutex);
+	e = dc_io ? dc_find(hash) : NULL;
+	if (!e || !dc_read_at(e->offset, &rec, sizeof(rec)) || memcmp(&rec.key, &key, sizeof(key)) ||
+	    rec.bytes != e->bytes || rec.bytes != dc_pixel_bytes(&rec)) {
+		dc_misses++;
+		SDL_UnlockMutex(dc_mutex);
+		return 0;
+	}
+
+#ifdef SDL_FAST_MALLOC
+	pixel = MALLOC(rec.bytes);
+#else
+	pixel = xmalloc(rec.bytes, MEM_SDL_PIXEL);
+#endif
+	if (pixel && !dc_read_at(e->offset + (int64_t)sizeof(rec), pixel, rec.bytes)) {
+#ifdef SDL_FAST_MALLOC
+		FREE(pixel);
+#else
+		xfree(pixel);
+#endif
+		pixel = NULL;
+	}
+	if (!pixel) {
+		dc_misses++;
+		SDL_UnlockMutex(dc_mutex);
+		return 0;
+	}
+	e->used = dc_session;
+	e->dirty = 1;
+	dc_hits++;
+	SDL_UnlockMutex(dc_mutex);
+
+	st->xres = rec.xres;
+	st->yres = rec.yres;
+	st->xoff = rec.xoff;
+	st->yoff = rec.yoff;
+	st->pixel = pixel;
+
+	uint16_t *flags_ptr = (uint16_t *)&st->flags;
+	__atomic_fetch_or(flags_ptr, SF_DIDALLOC | SF_DIDMAKE, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+// Add the finished stage 2 pixels of st to the disk cache
+void sdl_dc_store(struct sdl_texture *st)
+{
+	struct dc_record rec;
+	int64_t offset;
+
+	if (!dc_io || !(flags_load(st) & SF_DIDMAKE) || !st->pixel) {
+		return;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.magic = DC_RECORD_MAGIC;
+	dc_key_of(st, &rec.key);
+	rec.xres = st->xres;
+	rec.yres = st->yres;
+	rec.xoff = st->xoff;
+	rec.yoff = st->yoff;
+	rec.bytes = dc_pixel_bytes(&rec);
+	if (!rec.bytes) {
+		return;
+	}
+
+	SDL_LockMutex(dc_mutex);
+	rec.used = dc_session;
+	offset = dc_size;
+	if (!dc_io || dc_find(dc_hash(&rec.key))) {
+		SDL_UnlockMutex(dc_mutex);
+		return;
+	}
+	if (offset + (int64_t)sizeof(rec) + rec.bytes > dc_budget) {
+		dc_full++;
+		SDL_UnlockMutex(dc_mutex);
+		return;
+	}
+	if (!dc_write_at(offset, &rec, sizeof(rec)) || SDL_WriteIO(dc_io, st->pixel, rec.bytes) != rec.bytes) {
+		// Whatever made it into the file is past dc_size and gets overwritten
+		warn("Disk cache: write failed: %s", SDL_GetError());
+		SDL_UnlockMutex(dc_mutex);
+		return;
+	}
+	if (dc_insert(dc_hash(&rec.key), offset, rec.bytes, rec.used)) {
+		dc_size = offset + (int64_t)sizeof(rec) + rec.bytes;
+		dc_stores++;
+	}
+	SDL_UnlockMutex(dc_mutex);
+}
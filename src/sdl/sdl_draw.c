@@ -40,20 +40,264 @@
 // Current blend mode for rendering operations (used by all drawing functions)
 static SDL_BlendMode current_blend_mode = SDL_BLENDMODE_BLEND;
 
-static void sdl_blit_tex(
-    SDL_Texture *tex, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset)
+// ============================================================================
+// Quad batching
+// ============================================================================
+//
+// While a batch is open (dl_play() opens one around the display list), blits
+// are collected as textured quads and consecutive quads using the same texture
+// go out with a single SDL_RenderGeometry() call. Every other kind of drawing
+// must call sdl_batch_flush() first to keep the painter's order. Clipping is
+// done on the CPU in sdl_blit_area(), so clip changes never force a flush.
+// Textures have a fixed blend mode, so the texture alone decides the run.
+
+#define BATCH_MAX_QUADS 1024
+
+static struct {
+	int open;
+	SDL_Texture *tex;
+	int quads;
+	SDL_Vertex vert[BATCH_MAX_QUADS * 4];
+	int index[BATCH_MAX_QUADS * 6];
+} batch;
+
+long long sdl_batch_quads = 0, sdl_batch_calls = 0;
+
+void sdl_batch_begin(void)
+{
+	int i;
+
+	if (!batch.index[1]) { // first use: the index pattern never changes
+		for (i = 0; i < BATCH_MAX_QUADS; i++) {
+			batch.index[i * 6 + 0] = i * 4 + 0;
+			batch.index[i * 6 + 1] = i * 4 + 1;
+			batch.index[i * 6 + 2] = i * 4 + 2;
+			batch.index[i * 6 + 3] = i * 4 + 0;
+			batch.index[i * 6 + 4] = i * 4 + 2;
+			batch.index[i * 6 + 5] = i * 4 + 3;
+		}
+	}
+	batch.open = 1;
+}
+
+void sdl_batch_flush(void)
+{
+	Uint8 alpha = 255;
+
+	if (!batch.quads) {
+		return;
+	}
+
+	// The alpha of every quad is in its vertex colors already
+	SDL_GetTextureAlphaMod(batch.tex, &alpha);
+	if (alpha != 255) {
+		SDL_SetTextureAlphaMod(batch.tex, 255);
+	}
+	SDL_RenderGeometry(sdlren, batch.tex, batch.vert, batch.quads * 4, batch.index, batch.quads * 6);
+	if (alpha != 255) {
+		SDL_SetTextureAlphaMod(batch.tex, alpha);
+	}
+
+	sdl_batch_calls++;
+	batch.quads = 0;
+	batch.tex = NULL;
+}
+
+void sdl_batch_end(void)
+{
+	sdl_batch_flush();
+	batch.open = 0;
+}
+
+// Flush pending quads that use tex. Call before destroying or overwriting a texture.
+void sdl_batch_flush_tex(SDL_Texture *tex)
+{
+	if (batch.quads && batch.tex == tex) {
+		sdl_batch_flush();
+	}
+}
+
+// Queue one quad. col holds the colors of the top left, top right, bottom right
+// and bottom left corner.
+static void sdl_batch_quad(
+    SDL_Texture *tex, int tw, int th, const SDL_FRect *sr, const SDL_FRect *dr, const SDL_FColor col[4])
+{
+	SDL_Vertex *v;
+	float u0, v0, u1, v1;
+
+	if (batch.tex != tex || batch.quads == BATCH_MAX_QUADS) {
+		sdl_batch_flush();
+		batch.tex = tex;
+	}
+
+	u0 = sr->x / (float)tw;
+	v0 = sr->y / (float)th;
+	u1 = (sr->x + sr->w) / (float)tw;
+	v1 = (sr->y + sr->h) / (float)th;
+
+	v = &batch.vert[batch.quads * 4];
+	v[0].position.x = dr->x;
+	v[0].position.y = dr->y;
+	v[0].tex_coord.x = u0;
+	v[0].tex_coord.y = v0;
+	v[1].position.x = dr->x + dr->w;
+	v[1].position.y = dr->y;
+	v[1].tex_coord.x = u1;
+	v[1].tex_coord.y = v0;
+	v[2].position.x = dr->x + dr->w;
+	v[2].position.y = dr->y + dr->h;
+	v[2].tex_coord.x = u1;
+	v[2].tex_coord.y = v1;
+	v[3].position.x = dr->x;
+	v[3].position.y = dr->y + dr->h;
+	v[3].tex_coord.x = u0;
+	v[3].tex_coord.y = v1;
+	v[0].color = col[0];
+	v[1].color = col[1];
+	v[2].color = col[2];
+	v[3].color = col[3];
+
+	batch.quads++;
+	sdl_batch_quads++;
+}
+
+static void sdl_batch_add(SDL_Texture *tex, int tw, int th, const SDL_FRect *sr, const SDL_FRect *dr)
+{
+	Uint8 alpha = 255;
+	SDL_FColor col[4];
+
+	SDL_GetTextureAlphaMod(tex, &alpha);
+	col[0].r = col[0].g = col[0].b = 1.0f;
+	col[0].a = (float)alpha / 255.0f;
+	col[1] = col[2] = col[3] = col[0];
+
+	sdl_batch_quad(tex, tw, th, sr, dr, col);
+}
+
+// ============================================================================
+// Draw time lighting
+// ============================================================================
+//
+// With GO_VERTEXLIGHT, map sprites are made once with all lights at 15 (which
+// leaves the pixels alone in every light mode) and the light is applied as
+// vertex color when drawing. Lighting is linear in the pixel value, so a
+// uniformly lit sprite comes out the same as the baked one, up to rounding.
+// Sprites with five different lights are cut into cells of 10 * sdl_scale
+// texels, each cell corner gets the five way blend of sdl_make() and the GPU
+// interpolates in between. That is an approximation of the per pixel blend,
+// but all light variants of a sprite share one texture instead of filling the
+// cache with one copy per light combination.
+
+// Returns true if a sprite with these lights should be drawn with sdl_blit_light().
+// The caller must then load it with all lights at 15.
+int sdl_light_at_draw(unsigned char freeze, char ml, char ll, char rl, char ul, char dl)
+{
+	if (!(game_options & GO_VERTEXLIGHT)) {
+		return 0;
+	}
+	// Freeze is added after lighting, light 0 means bright and higher values
+	// are not plain scale factors. These keep their baked textures.
+	if (freeze || ml < 1 || ml > 15 || ll < 1 || ll > 15 || rl < 1 || rl > 15 || ul < 1 || ul > 15 || dl < 1 ||
+	    dl > 15) {
+		return 0;
+	}
+	return 1;
+}
+
+// Draw time light of a blit, see sdl_blit_light()
+struct draw_light {
+	float f[ROWFX_LIGHTS]; // factors, indexed by ROWFX_ML..ROWFX_DL
+	int uniform; // all five lights are the same
+};
+
+// Color of the sprite texel x, y for the light factors lf
+static SDL_FColor light_color(int x, int y, const float *lf, float alpha)
+{
+	SDL_FColor col;
+	int v[ROWFX_LIGHTS], i, div = 0;
+	float f = 0.0f;
+
+	sdl_light_weights(x, y, v);
+	for (i = 0; i < ROWFX_LIGHTS; i++) {
+		div += v[i];
+		f += lf[i] * (float)v[i];
+	}
+
+	if (div == 0) { // sdl_make() leaves these pixels transparent
+		col.r = col.g = col.b = col.a = 0.0f;
+		return col;
+	}
+
+	f /= (float)div;
+	if (f < 0.0f) {
+		f = 0.0f;
+	} else if (f > 1.0f) {
+		f = 1.0f;
+	}
+	col.r = col.g = col.b = f;
+	col.a = alpha;
+
+	return col;
+}
+
+// Like sdl_batch_add(), with draw time lighting. lx, ly is the position of sr
+// within the sprite, in texels.
+static void sdl_batch_add_lit(SDL_Texture *tex, int tw, int th, const SDL_FRect *sr, const SDL_FRect *dr, int lx,
+    int ly, const struct draw_light *l)
+{
+	Uint8 alpha = 255;
+	SDL_FColor col[4];
+	SDL_FRect csr, cdr;
+	int step = 10 * sdl_scale, ex, ey, x0, y0, x1, y1;
+	float a;
+
+	SDL_GetTextureAlphaMod(tex, &alpha);
+	a = (float)alpha / 255.0f;
+
+	if (l->uniform) { // one quad does it
+		col[0].r = col[0].g = col[0].b = l->f[ROWFX_ML];
+		col[0].a = a;
+		col[1] = col[2] = col[3] = col[0];
+		sdl_batch_quad(tex, tw, th, sr, dr, col);
+		return;
+	}
+
+	ex = lx + (int)sr->w;
+	ey = ly + (int)sr->h;
+	for (y0 = ly; y0 < ey; y0 = y1) {
+		y1 = min(ey, (y0 / step + 1) * step);
+		for (x0 = lx; x0 < ex; x0 = x1) {
+			x1 = min(ex, (x0 / step + 1) * step);
+
+			csr.x = sr->x + (float)(x0 - lx);
+			csr.y = sr->y + (float)(y0 - ly);
+			csr.w = (float)(x1 - x0);
+			csr.h = (float)(y1 - y0);
+			cdr.x = dr->x + (float)(x0 - lx);
+			cdr.y = dr->y + (float)(y0 - ly);
+			cdr.w = csr.w;
+			cdr.h = csr.h;
+
+			col[0] = light_color(x0, y0, l->f, a);
+			col[1] = light_color(x1, y0, l->f, a);
+			col[2] = light_color(x1, y1, l->f, a);
+			col[3] = light_color(x0, y1, l->f, a);
+			sdl_batch_quad(tex, tw, th, &csr, &cdr, col);
+		}
+	}
+}
+
+// Clip the w x h texels at (tx, ty) drawn at screen position sx, sy and return
+// the source and destination rectangles. Sizes are in texels, positions in
+// screen pixels. Returns 0 if nothing is left.
+static int sdl_blit_rects(int tx, int ty, int w, int h, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey,
+    int x_offset, int y_offset, SDL_FRect *sr, SDL_FRect *dr)
 {
 	int addx = 0, addy = 0;
-	float f_dx, f_dy;
-	SDL_FRect dr, sr;
-	Uint64 start = SDL_GetTicks();
 
-	SDL_GetTextureSize(tex, &f_dx, &f_dy);
-	int dx = (int)f_dx;
-	int dy = (int)f_dy;
+	int dx = w / sdl_scale;
+	int dy = h / sdl_scale;
 
-	dx /= sdl_scale;
-	dy /= sdl_scale;
 	if (sx < clipsx) {
 		addx = clipsx - sx;
 		dx -= addx;
@@ -73,27 +317,344 @@ static void sdl_blit_tex(
 	dx *= sdl_scale;
 	dy *= sdl_scale;
 
-	dr.x = (float)((sx + x_offset) * sdl_scale);
-	dr.w = (float)dx;
-	dr.y = (float)((sy + y_offset) * sdl_scale);
-	dr.h = (float)dy;
+	dr->x = (float)((sx + x_offset) * sdl_scale);
+	dr->w = (float)dx;
+	dr->y = (float)((sy + y_offset) * sdl_scale);
+	dr->h = (float)dy;
 
-	sr.x = (float)(addx * sdl_scale);
-	sr.w = (float)dx;
-	sr.y = (float)(addy * sdl_scale);
-	sr.h = (float)dy;
+	sr->x = (float)(tx + addx * sdl_scale);
+	sr->w = (float)dx;
+	sr->y = (float)(ty + addy * sdl_scale);
+	sr->h = (float)dy;
+
+	return dx > 0 && dy > 0;
+}
 
-	SDL_RenderTexture(sdlren, tex, &sr, &dr);
+// Blit the w x h texels at (tx, ty) of a tw x th texture. Sizes are in texels, positions in screen pixels.
+// l is the draw time light, NULL for none.
+static void sdl_blit_area(SDL_Texture *tex, int tw, int th, int tx, int ty, int w, int h, int sx, int sy, int clipsx,
+    int clipsy, int clipex, int clipey, int x_offset, int y_offset, const struct draw_light *l)
+{
+	SDL_FRect dr, sr;
+	Uint64 start = SDL_GetTicks();
+	int visible;
+
+	visible =
+	    sdl_blit_rects(tx, ty, w, h, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset, &sr, &dr);
+
+	if (l) {
+		// Vertex colors need geometry, open a batch of our own if there is none
+		if (visible) {
+			int own = !batch.open;
+
+			if (own) {
+				sdl_batch_begin();
+			}
+			sdl_batch_add_lit(tex, tw, th, &sr, &dr, (int)sr.x - tx, (int)sr.y - ty, l);
+			if (own) {
+				sdl_batch_end();
+			}
+		}
+	} else if (batch.open) {
+		if (visible) {
+			sdl_batch_add(tex, tw, th, &sr, &dr);
+		}
+	} else if (visible) {
+		SDL_RenderTexture(sdlren, tex, &sr, &dr);
+	}
 
 	sdl_time_blit += (long long)(SDL_GetTicks() - start);
 }
 
+static void sdl_blit_tex(SDL_Texture *tex, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey,
+    int x_offset, int y_offset, const struct draw_light *l)
+{
+	float f_dx, f_dy;
+
+	SDL_GetTextureSize(tex, &f_dx, &f_dy);
+	sdl_blit_area(tex, (int)f_dx, (int)f_dy, 0, 0, (int)f_dx, (int)f_dy, sx, sy, clipsx, clipsy, clipex, clipey,
+	    x_offset, y_offset, l);
+}
+
+static void sdl_blit_cache(int cache_index, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey,
+    int x_offset, int y_offset, const struct draw_light *l)
+{
+	struct sdl_texture *st = &sdlt[cache_index];
+
+	if (!st->tex) {
+		return;
+	}
+	if (st->atlas != STX_NONE) {
+		sdl_blit_area(st->tex, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, st->ax, st->ay, st->xres * sdl_scale,
+		    st->yres * sdl_scale, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset, l);
+	} else {
+		sdl_blit_tex(st->tex, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset, l);
+	}
+}
+
 void sdl_blit(
     int cache_index, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset)
 {
-	if (sdlt[cache_index].tex) {
-		sdl_blit_tex(sdlt[cache_index].tex, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+	sdl_blit_cache(cache_index, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset, NULL);
+}
+
+// Blit a sprite loaded with all lights at 15 and light it with ml..dl, see sdl_light_at_draw()
+void sdl_blit_light(int cache_index, int sx, int sy, int clipsx, int clipsy, int clipex, int clipey, int x_offset,
+    int y_offset, char ml, char ll, char rl, char ul, char dl)
+{
+	struct draw_light l;
+
+	l.f[ROWFX_ML] = (float)sdl_light_table(ml)[255] / 255.0f;
+	l.f[ROWFX_LL] = (float)sdl_light_table(ll)[255] / 255.0f;
+	l.f[ROWFX_RL] = (float)sdl_light_table(rl)[255] / 255.0f;
+	l.f[ROWFX_UL] = (float)sdl_light_table(ul)[255] / 255.0f;
+	l.f[ROWFX_DL] = (float)sdl_light_table(dl)[255] / 255.0f;
+	l.uniform = ll == ml && rl == ml && ul == ml && dl == ml;
+
+	sdl_blit_cache(cache_index, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset, &l);
+}
+
+// ============================================================================
+// Glyph atlas
+// ============================================================================
+//
+// Every font variant (normal, shaded and framed of each size) gets all its
+// glyphs rasterized once, in white, into a band of one shared glyph page. Text
+// is then drawn as one quad per character, tinted with the vertex color, and
+// goes out with the other quads of the batch. Since all fonts share the page,
+// a shaded or framed string and its outline are a single run of quads, and so
+// is all text in a row. Strings no longer get textures of their own, so chat,
+// names and damage numbers stay out of the texture cache.
+//
+// The glyph cells are rounded out to multiples of sdl_scale, because
+// sdl_blit_rects() clips in screen pixels.
+
+#define GLYPH_MAX_FONTS 16
+#define GLYPH_PAGE_SIZE 2048
+
+struct glyph {
+	uint16_t tx, ty; // cell in the texture
+	uint8_t w, h; // cell size in texels, 0 for blank characters
+	int8_t gx, gy; // cell offset from the character origin, in screen pixels
+};
+
+struct glyph_font {
+	struct renderfont *font;
+	int ok; // 0 if the font did not fit or the page could not be made
+	struct glyph glyph[128];
+};
+
+static struct glyph_font glyph_fonts[GLYPH_MAX_FONTS];
+static int glyph_font_cnt = 0;
+static SDL_Texture *glyph_tex = NULL;
+static int glyph_used = 0; // texel rows of the page taken by fonts
+
+long long glyph_quads = 0;
+
+// Bounding box of a rawrun glyph in texels, ex and ey exclusive. Returns 0 if the glyph has no pixels.
+static int glyph_bounds(const unsigned char *rawrun, int *sx, int *sy, int *ex, int *ey)
+{
+	int x = 0, y = 0;
+
+	*sx = *sy = 64;
+	*ex = *ey = 0;
+
+	while (*rawrun != 255) {
+		if (*rawrun == 254) {
+			y++;
+			x = 0;
+			rawrun++;
+			continue;
+		}
+		x += *rawrun++;
+
+		*sx = min(*sx, x);
+		*sy = min(*sy, y);
+		*ex = max(*ex, x + 1);
+		*ey = max(*ey, y + 1);
+	}
+
+	return *ex > 0;
+}
+
+// Lay out the cells of all glyphs of gf->font in rows, starting at texel row
+// top of the page, and draw them into pixel (the band from top on) if it is
+// not NULL. Returns the height of the band.
+static int glyph_layout(struct glyph_font *gf, int top, uint32_t *pixel)
+{
+	const unsigned char *rawrun;
+	struct glyph *g;
+	int c, sx, sy, ex, ey, x = 0, y = 0, rowh = 0, px, py;
+
+	for (c = 0; c < 128; c++) {
+		g = &gf->glyph[c];
+		memset(g, 0, sizeof(*g));
+
+		rawrun = gf->font[c].raw;
+		if (!rawrun || !glyph_bounds(rawrun, &sx, &sy, &ex, &ey)) {
+			continue;
+		}
+
+		sx = sx / sdl_scale * sdl_scale;
+		sy = sy / sdl_scale * sdl_scale;
+		ex = (ex + sdl_scale - 1) / sdl_scale * sdl_scale;
+		ey = (ey + sdl_scale - 1) / sdl_scale * sdl_scale;
+
+		// One texel of gutter to the right and below each cell
+		if (x + ex - sx + 1 > GLYPH_PAGE_SIZE) {
+			x = 0;
+			y += rowh;
+			rowh = 0;
+		}
+		g->tx = (uint16_t)x;
+		g->ty = (uint16_t)(top + y);
+		g->w = (uint8_t)(ex - sx);
+		g->h = (uint8_t)(ey - sy);
+		g->gx = (int8_t)(sx / sdl_scale);
+		g->gy = (int8_t)(sy / sdl_scale);
+		x += ex - sx + 1;
+		rowh = max(rowh, ey - sy + 1);
+
+		if (!pixel) {
+			continue;
+		}
+
+		// Same walk as sdl_maketext(), relative to the cell
+		px = -sx;
+		py = -sy;
+		while (*rawrun != 255) {
+			if (*rawrun == 254) {
+				py++;
+				px = -sx;
+				rawrun++;
+				continue;
+			}
+			px += *rawrun++;
+			pixel[g->tx + px + (y + py) * GLYPH_PAGE_SIZE] = 0xffffffff;
+		}
+	}
+
+	return y + rowh;
+}
+
+// The glyphs of font, added to the page on first use. Returns NULL if there are none.
+static struct glyph_font *glyph_font(struct renderfont *font)
+{
+	struct glyph_font *gf;
+	uint32_t *pixel;
+	SDL_Rect rc;
+	int i, h;
+
+	if (!font) {
+		return NULL;
+	}
+	for (i = 0; i < glyph_font_cnt; i++) {
+		if (glyph_fonts[i].font == font) {
+			return glyph_fonts[i].ok ? &glyph_fonts[i] : NULL;
+		}
+	}
+	if (glyph_font_cnt == GLYPH_MAX_FONTS) {
+		return NULL;
+	}
+
+	gf = &glyph_fonts[glyph_font_cnt++];
+	gf->font = font;
+	gf->ok = 0;
+
+	if (!glyph_tex) {
+		glyph_tex = SDL_CreateTexture(
+		    sdlren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE);
+		if (!glyph_tex) {
+			warn("SDL_texture Error: %s in glyph atlas", SDL_GetError());
+			return NULL;
+		}
+		SDL_SetTextureBlendMode(glyph_tex, SDL_BLENDMODE_BLEND);
+	}
+
+	h = max(1, glyph_layout(gf, glyph_used, NULL));
+	if (glyph_used + h > GLYPH_PAGE_SIZE) {
+		warn("glyph atlas is full, font %d drawn the old way", glyph_font_cnt - 1);
+		return NULL;
+	}
+
+#ifdef SDL_FAST_MALLOC
+	pixel = CALLOC((size_t)GLYPH_PAGE_SIZE * (size_t)h, sizeof(uint32_t));
+#else
+	pixel = xmalloc((int)((size_t)GLYPH_PAGE_SIZE * (size_t)h * sizeof(uint32_t)), MEM_SDL_PIXEL2);
+#endif
+	if (!pixel) {
+		return NULL;
 	}
+	glyph_layout(gf, glyph_used, pixel);
+
+	rc.x = 0;
+	rc.y = glyph_used;
+	rc.w = GLYPH_PAGE_SIZE;
+	rc.h = h;
+	sdl_batch_flush_tex(glyph_tex);
+	gf->ok = SDL_UpdateTexture(glyph_tex, &rc, pixel, (int)(GLYPH_PAGE_SIZE * sizeof(uint32_t)));
+	glyph_used += h;
+#ifdef SDL_FAST_MALLOC
+	FREE(pixel);
+#else
+	xfree(pixel);
+#endif
+
+	return gf->ok ? gf : NULL;
+}
+
+// Destroy the glyph page, fonts are added again when needed
+void sdl_glyph_exit(void)
+{
+	if (glyph_tex) {
+		sdl_batch_flush_tex(glyph_tex);
+		SDL_DestroyTexture(glyph_tex);
+	}
+	memset(glyph_fonts, 0, sizeof(glyph_fonts));
+	glyph_font_cnt = 0;
+	glyph_tex = NULL;
+	glyph_used = 0;
+}
+
+int sdl_glyph_fonts(void)
+{
+	return glyph_font_cnt;
+}
+
+// Queue the glyphs of text, starting at sx, sy, as quads of color col
+static void glyph_draw(struct glyph_font *gf, int sx, int sy, const SDL_FColor *col, const char *text, int clipsx,
+    int clipsy, int clipex, int clipey, int x_offset, int y_offset)
+{
+	SDL_FColor cols[4];
+	SDL_FRect sr, dr;
+	struct glyph *g;
+
+	cols[0] = cols[1] = cols[2] = cols[3] = *col;
+
+	for (; *text && *text != RENDER_TEXT_TERMINATOR; text++) {
+		if (*text < 0) { // sdl_maketext() complains about these, once per string is enough
+			continue;
+		}
+		g = &gf->glyph[(unsigned char)*text];
+		if (g->w && sdl_blit_rects(g->tx, g->ty, g->w, g->h, sx + g->gx, sy + g->gy, clipsx, clipsy, clipex, clipey,
+		                x_offset, y_offset, &sr, &dr)) {
+			sdl_batch_quad(glyph_tex, GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE, &sr, &dr, cols);
+			glyph_quads++;
+		}
+		sx += gf->font[(unsigned char)*text].dim;
+	}
+}
+
+static SDL_FColor glyph_color(unsigned short int color)
+{
+	SDL_FColor col;
+
+	col.r = (float)R16TO32(color) / 255.0f;
+	col.g = (float)G16TO32(color) / 255.0f;
+	col.b = (float)B16TO32(color) / 255.0f;
+	col.a = 1.0f;
+
+	return col;
 }
 
 SDL_Texture *sdl_maketext(const char *text, struct renderfont *font, uint32_t color, int flags)
@@ -184,17 +745,13 @@ SDL_Texture *sdl_maketext(const char *text, struct renderfont *font, uint32_t co
 	return texture;
 }
 
-int sdl_drawtext(int sx, int sy, unsigned short int color, int flags, const char *text, struct renderfont *font,
-    int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset)
+// The old way: a texture for the whole string, from the texture cache unless
+// RENDER_TEXT_NOCACHE. Draws at sx, alignment is up to the caller.
+static void sdl_drawtext_tex(int sx, int sy, unsigned short int color, int flags, const char *text,
+    struct renderfont *font, int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset)
 {
-	int dx, cache_index;
 	SDL_Texture *tex;
-	int r, g, b, a;
-	const char *c;
-
-	if (!*text) {
-		return sx;
-	}
+	int r, g, b, a, cache_index;
 
 	r = R16TO32(color);
 	g = G16TO32(color);
@@ -209,27 +766,86 @@ int sdl_drawtext(int sx, int sy, unsigned short int color, int flags, const char
 		tex = sdlt[cache_index].tex;
 	}
 
-	for (dx = 0, c = text; *c; c++) {
-		dx += font[(unsigned char)*c].dim;
-	}
-
 	if (tex) {
-		if (flags & RENDER_ALIGN_CENTER) {
-			sx -= dx / 2;
-		} else if (flags & RENDER_TEXT_RIGHT) {
-			sx -= dx;
-		}
-
-		sdl_blit_tex(tex, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+		sdl_blit_tex(tex, sx, sy, clipsx, clipsy, clipex, clipey, x_offset, y_offset, NULL);
 
 		if (flags & RENDER_TEXT_NOCACHE) {
+			sdl_batch_flush_tex(tex);
 			SDL_DestroyTexture(tex);
 		}
 	}
+}
+
+// Draw text in font, with its outline or shadow in ofont and ocolor first if
+// ofont is not NULL. The outline is drawn one pixel up and left, like the
+// shaded and framed fonts expect. dx is the width of the text if the caller
+// knows it already, -1 otherwise. Returns the x position after the text.
+int sdl_drawtext_outlined(int sx, int sy, unsigned short int color, unsigned short int ocolor, int flags,
+    const char *text, struct renderfont *font, struct renderfont *ofont, int dx, int clipsx, int clipsy, int clipex,
+    int clipey, int x_offset, int y_offset)
+{
+	struct glyph_font *gf, *ogf = NULL;
+	SDL_FColor col;
+	const char *c;
+	Uint64 start;
+	int own;
+
+	if (!*text) {
+		return sx;
+	}
+
+	if (dx < 0) {
+		for (dx = 0, c = text; *c; c++) {
+			dx += font[(unsigned char)*c].dim;
+		}
+	}
+	if (flags & RENDER_ALIGN_CENTER) {
+		sx -= dx / 2;
+	} else if (flags & RENDER_TEXT_RIGHT) {
+		sx -= dx;
+	}
+
+	gf = glyph_font(font);
+	if (ofont) {
+		ogf = glyph_font(ofont);
+	}
+	if (!gf || (ofont && !ogf)) {
+		// No glyphs, fall back to a texture for each pass. Either outline flag
+		// makes sdl_maketext() leave room for the outline.
+		if (ofont) {
+			sdl_drawtext_tex(sx - 1, sy - 1, ocolor, flags | RENDER__SHADED_FONT, text, ofont, clipsx, clipsy, clipex,
+			    clipey, x_offset, y_offset);
+		}
+		sdl_drawtext_tex(sx, sy, color, flags, text, font, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+		return sx + dx;
+	}
+
+	start = SDL_GetTicks();
+	own = !batch.open;
+	if (own) {
+		sdl_batch_begin();
+	}
+	if (ogf) {
+		col = glyph_color(ocolor);
+		glyph_draw(ogf, sx - 1, sy - 1, &col, text, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+	}
+	col = glyph_color(color);
+	glyph_draw(gf, sx, sy, &col, text, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+	if (own) {
+		sdl_batch_end();
+	}
+	sdl_time_text += (long long)(SDL_GetTicks() - start);
 
 	return sx + dx;
 }
 
+int sdl_drawtext(int sx, int sy, unsigned short int color, int flags, const char *text, struct renderfont *font,
+    int clipsx, int clipsy, int clipex, int clipey, int x_offset, int y_offset)
+{
+	return sdl_drawtext_outlined(
+	    sx, sy, color, 0, flags, text, font, NULL, -1, clipsx, clipsy, clipex, clipey, x_offset, y_offset);
+}
+
 void sdl_rect(int sx, int sy, int ex, int ey, unsigned short int color, int clipsx, int clipsy, int clipex, int clipey,
     int x_offset, int y_offset)
 {
@@ -25,18 +25,24 @@
 #define OGET_G(c) ((((unsigned short int)(c)) >> 5) & 0x1F)
 #define OGET_B(c) ((((unsigned short int)(c)) >> 0) & 0x1F)
 
-static inline int light_calc(int val, int light)
+// Lighting mode from the GO_LIGHTER bits of game_options, 0...3
+static inline int light_mode(void)
+{
+	return ((game_options & GO_LIGHTER) ? 1 : 0) | ((game_options & GO_LIGHTER2) ? 2 : 0);
+}
+
+static inline int light_calc(int val, int light, int mode)
 {
 	int v1, v2, m = 3, d = 4;
 
-	if (game_options & (GO_LIGHTER | GO_LIGHTER2)) {
+	if (mode) {
 		v1 = val * light / 15;
 		v2 = (int)(val * sqrt(light) / 3.87);
-		if (game_options & GO_LIGHTER) {
+		if (mode & 1) {
 			m--;
 			d--;
 		}
-		if (game_options & GO_LIGHTER2) {
+		if (mode & 2) {
 			m -= 2;
 			d -= 2;
 		}
@@ -46,25 +52,57 @@ static inline int light_calc(int val, int light)
 	}
 }
 
+// Light tables for the normal light range 0...15, one set per lighting mode.
+// All four are built once, so changing game_options needs no rebuild and
+// workers never see a half written table.
+static uint8_t light_tab[4][16][256];
+
+void sdl_light_init(void)
+{
+	int mode, light, val;
+
+	for (mode = 0; mode < 4; mode++) {
+		for (light = 0; light < 16; light++) {
+			for (val = 0; val < 256; val++) {
+				if (light == 0) {
+					light_tab[mode][light][val] = (uint8_t)min(255, val * 2 + 4);
+				} else {
+					light_tab[mode][light][val] = (uint8_t)light_calc(val, light, mode);
+				}
+			}
+		}
+	}
+}
+
+// Table for light in the current lighting mode, NULL if light is out of range
+const uint8_t *sdl_light_table(int light)
+{
+	if (light < 0 || light > 15) {
+		return NULL;
+	}
+	return light_tab[light_mode()][light];
+}
+
 uint32_t sdl_light(int light, uint32_t irgb)
 {
-	int r, g, b, a;
+	int r, g, b, a, mode;
+	const uint8_t *tab;
 
 	r = IGET_R(irgb);
 	g = IGET_G(irgb);
 	b = IGET_B(irgb);
 	a = IGET_A(irgb);
 
-	if (light == 0) {
-		r = min(255, r * 2 + 4);
-		g = min(255, g * 2 + 4);
-		b = min(255, b * 2 + 4);
-	} else {
-		r = light_calc(r, light);
-		g = light_calc(g, light);
-		b = light_calc(b, light);
+	if (light >= 0 && light <= 15) {
+		tab = light_tab[light_mode()][light];
+		return IRGBA(tab[r], tab[g], tab[b], a);
 	}
 
+	mode = light_mode();
+	r = light_calc(r, light, mode);
+	g = light_calc(g, light, mode);
+	b = light_calc(b, light, mode);
+
 	return IRGBA(r, g, b, a);
 }
 
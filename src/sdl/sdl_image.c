@@ -7,23 +7,26 @@
  * that transforms sprite data into textures with applied effects.
  */
 
+#include <assert.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <SDL3/SDL.h>
 #include <png.h>
-#include <zip.h>
 
 #include "dll.h"
 #include "astonia.h"
 #include "sdl/sdl.h"
 #include "sdl/sdl_private.h"
 
+#ifndef STANDALONE
 // Module-local variables
 static int sdlm_sprite = 0;
 static int sdlm_scale = 0;
 static void *sdlm_pixel = NULL;
+#endif
 
 // libpng custom allocator functions - use our MALLOC/FREE macros which switch between mimalloc and malloc
 static png_voidp png_malloc_fn(png_structp png_ptr __attribute__((unused)), png_alloc_size_t size)
@@ -170,112 +173,283 @@ void sdl_smoothify(uint32_t *pixel, int xres, int yres, int scale __attribute__(
 	}
 }
 
-void sdl_premulti(uint32_t *pixel, int xres, int yres, int scale __attribute__((unused)))
+// ============================================================================
+// PNG rows
+// ============================================================================
+//
+// PNGs are decoded row by row. Each row is converted to IRGBA as soon as
+// libpng has it, while it is still in the cache: keyed (magenta) and fully
+// transparent pixels become 0, the others are premultiplied if asked, and the
+// visible span of the row is noted for trimming. Runs of pixels that are all
+// either transparent or opaque, by far the most common case, are done four at
+// a time with SSE2 or NEON.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PNG_HAVE_SSE2
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PNG_HAVE_NEON
+#endif
+
+// png_recip[a] is 255*65536/a rounded up: (v*png_recip[a])>>16 is exactly
+// v*255/a for every v and a from 0 to 255
+static uint32_t png_recip[256];
+
+static const uint32_t *png_recip_table(void)
+{
+	uint32_t a;
+
+	if (!__atomic_load_n(&png_recip[1], __ATOMIC_ACQUIRE)) {
+		// All threads store the same values, so racing here is harmless
+		for (a = 255; a > 0; a--) {
+			__atomic_store_n(&png_recip[a], ((255u << 16) + a - 1) / a, __ATOMIC_RELEASE);
+		}
+	}
+
+	return png_recip;
+}
+
+static inline uint32_t png_premul(uint32_t v, uint32_t recip)
+{
+	v = (v * recip) >> 16;
+	return v > 255 ? 255 : v;
+}
+
+static inline uint32_t png_pixel(uint32_t r, uint32_t g, uint32_t b, uint32_t a, int premulti, const uint32_t *recip)
+{
+	if (!a || (r == 255 && g == 0 && b == 255)) {
+		return 0;
+	}
+	if (premulti && a != 255) {
+		r = png_premul(r, recip[a]);
+		g = png_premul(g, recip[a]);
+		b = png_premul(b, recip[a]);
+	}
+	return IRGBA(r, g, b, a);
+}
+
+// Convert pixels x to n-1 of a 32bpp row, widening the visible span sx to ex
+static void png_row32(
+    uint32_t *dst, const uint8_t *src, int x, int n, int premulti, const uint32_t *recip, int *sx, int *ex)
 {
-	int n, r, g, b, a;
 	uint32_t c;
 
+	for (; x < n; x++) {
+		c = png_pixel(src[x * 4 + 0], src[x * 4 + 1], src[x * 4 + 2], src[x * 4 + 3], premulti, recip);
+		dst[x] = c;
+		if (c) {
+			if (x < *sx) {
+				*sx = x;
+			}
+			*ex = x + 1;
+		}
+	}
+}
+
+// Best row kernel for this build, sdl_png_row() takes it as isa
+int sdl_png_isa(void)
+{
+#if defined(PNG_HAVE_SSE2)
+	return ROWFX_SSE2;
+#elif defined(PNG_HAVE_NEON)
+	return ROWFX_NEON;
+#else
+	return ROWFX_SCALAR;
+#endif
+}
+
+// Convert n pixels of a decoded PNG row (bpp 24 or 32) to IRGBA in dst.
+// Returns one past the last visible pixel, 0 if there is none, and sets
+// *first to the first visible one.
+int sdl_png_row(uint32_t *dst, const uint8_t *src, int n, int bpp, int premulti, int isa, int *first)
+{
+	const uint32_t *recip = png_recip_table();
+	int x = 0, sx = n, ex = 0;
+
+	if (bpp == 24) {
+		for (x = 0; x < n; x++, src += 3) {
+			dst[x] = png_pixel(src[0], src[1], src[2], 255, premulti, recip);
+			if (dst[x]) {
+				if (x < sx) {
+					sx = x;
+				}
+				ex = x + 1;
+			}
+		}
+		*first = sx;
+		return ex;
+	}
+
+#ifdef PNG_HAVE_SSE2
+	if (isa != ROWFX_SCALAR) {
+		const __m128i rgb = _mm_set1_epi32(0x00ffffff), magenta = _mm_set1_epi32(0x00ff00ff);
+		const __m128i alpha = _mm_set1_epi32((int)0xff000000), ga = _mm_set1_epi32((int)0xff00ff00);
+		const __m128i low = _mm_set1_epi32(0xff), zero = _mm_setzero_si128();
+		__m128i v, a, clear, opaque, out;
+		unsigned int visible;
+
+		for (; x + 4 <= n; x += 4) {
+			v = _mm_loadu_si128((const __m128i *)(src + x * 4));
+			a = _mm_and_si128(v, alpha);
+			clear = _mm_or_si128(_mm_cmpeq_epi32(a, zero), _mm_cmpeq_epi32(_mm_and_si128(v, rgb), magenta));
+			opaque = _mm_cmpeq_epi32(a, alpha);
+			if (_mm_movemask_epi8(_mm_or_si128(clear, opaque)) != 0xffff) {
+				png_row32(dst, src, x, x + 4, premulti, recip, &sx, &ex); // translucent pixels
+				continue;
+			}
+			// R and B change places: RGBA in memory is ABGR as a number
+			out = _mm_or_si128(_mm_and_si128(v, ga),
+			    _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, low), 16), _mm_and_si128(_mm_srli_epi32(v, 16), low)));
+			_mm_storeu_si128((__m128i *)(dst + x), _mm_andnot_si128(clear, out));
+
+			visible = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(clear)) ^ 15u;
+			if (visible) {
+				if (sx == n) {
+					sx = x + __builtin_ctz(visible);
+				}
+				ex = x + 32 - __builtin_clz(visible);
+			}
+		}
+	}
+#endif
+#ifdef PNG_HAVE_NEON
+	if (isa != ROWFX_SCALAR) {
+		const uint32x4_t rgb = vdupq_n_u32(0x00ffffff), magenta = vdupq_n_u32(0x00ff00ff);
+		const uint32x4_t alpha = vdupq_n_u32(0xff000000), ga = vdupq_n_u32(0xff00ff00);
+		const uint32x4_t low = vdupq_n_u32(0xff);
+		uint32x4_t v, a, clear, opaque, out;
+		uint64_t lanes;
+
+		for (; x + 4 <= n; x += 4) {
+			v = vld1q_u32((const uint32_t *)(const void *)(src + x * 4));
+			a = vandq_u32(v, alpha);
+			clear = vorrq_u32(vceqq_u32(a, vdupq_n_u32(0)), vceqq_u32(vandq_u32(v, rgb), magenta));
+			opaque = vceqq_u32(a, alpha);
+			if (vminvq_u32(vorrq_u32(clear, opaque)) != 0xffffffff) {
+				png_row32(dst, src, x, x + 4, premulti, recip, &sx, &ex); // translucent pixels
+				continue;
+			}
+			// R and B change places: RGBA in memory is ABGR as a number
+			out = vorrq_u32(vandq_u32(v, ga),
+			    vorrq_u32(vshlq_n_u32(vandq_u32(v, low), 16), vandq_u32(vshrq_n_u32(v, 16), low)));
+			vst1q_u32(dst + x, vbicq_u32(out, clear));
+
+			// 16 bits per pixel, all set for visible ones
+			lanes = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(vmvnq_u32(clear))), 0);
+			if (lanes) {
+				if (sx == n) {
+					sx = x + __builtin_ctzll(lanes) / 16;
+				}
+				ex = x + (64 - __builtin_clzll(lanes)) / 16;
+			}
+		}
+	}
+#endif
+
+	png_row32(dst, src, x, n, premulti, recip, &sx, &ex);
+
+	*first = sx;
+	return ex;
+}
+
+
+// Pre-multiply what sdl_load_image_png() left straight for sdl_smoothify()
+void sdl_premulti(uint32_t *pixel, int xres, int yres, int scale __attribute__((unused)))
+{
+	const uint32_t *recip = png_recip_table();
+	uint32_t c, a;
+	int n;
+
 	for (n = 0; n < xres * yres; n++) {
 		c = pixel[n];
 
 		a = IGET_A(c);
-		if (!a) {
+		if (!a || a == 255) {
 			continue;
 		}
 
-		r = IGET_R(c);
-		g = IGET_G(c);
-		b = IGET_B(c);
-
-		r = min(255, r * 255 / a);
-		g = min(255, g * 255 / a);
-		b = min(255, b * 255 / a);
-
-		c = IRGBA(r, g, b, a);
-		pixel[n] = c;
+		pixel[n] = IRGBA(png_premul(IGET_R(c), recip[a]), png_premul(IGET_G(c), recip[a]),
+		    png_premul(IGET_B(c), recip[a]), a);
 	}
 }
 
 struct png_helper {
 	char *filename;
-	zip_t *zip;
-	unsigned char **row;
+	struct sdl_archive *zip;
 	int xres;
 	int yres;
 	int bpp;
 
 	png_structp png_ptr;
 	png_infop info_ptr;
+
+	int64_t entry; // index of filename in zip, -1 to look it up by name
+	int passes; // 1, or 7 for interlaced images
+	FILE *fp;
+	struct sdl_archive_file zf;
 };
 
 void png_helper_read(png_structp ps, png_bytep buf, png_size_t len)
 {
-	zip_fread(png_get_io_ptr(ps), buf, len);
+	sdl_archive_fread(png_get_io_ptr(ps), buf, len);
+}
+
+static void png_helper_close(struct png_helper *p)
+{
+	if (p->zip) {
+		sdl_archive_fclose(&p->zf);
+	} else {
+		fclose(p->fp);
+	}
 }
 
+// Open the PNG and read its header. The rows are read by png_load_pixels().
 int png_load_helper(struct png_helper *p)
 {
-	FILE *fp = NULL;
-	zip_file_t *zp = NULL;
 	int tmp;
 
 	if (p->zip) {
-		zp = zip_fopen(p->zip, p->filename, 0);
-		if (!zp) {
+		if (p->entry < 0) {
+			p->entry = sdl_archive_locate(p->zip, p->filename);
+		}
+		if (sdl_archive_fopen(&p->zf, p->zip, p->entry)) {
 			return -1;
 		}
 	} else {
-		fp = fopen(p->filename, "rb");
-		if (!fp) {
+		p->fp = fopen(p->filename, "rb");
+		if (!p->fp) {
 			return -1;
 		}
 	}
 
 	p->png_ptr = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_malloc_fn, png_free_fn);
 	if (!p->png_ptr) {
-		if (zp) {
-			zip_fclose(zp);
-		}
-		if (fp) {
-			fclose(fp);
-		}
+		png_helper_close(p);
 		warn("create read\n");
 		return -1;
 	}
 
 	p->info_ptr = png_create_info_struct(p->png_ptr);
 	if (!p->info_ptr) {
-		if (zp) {
-			zip_fclose(zp);
-		}
-		if (fp) {
-			fclose(fp);
-		}
+		png_helper_close(p);
 		png_destroy_read_struct(&p->png_ptr, (png_infopp)NULL, (png_infopp)NULL);
 		warn("create info1\n");
 		return -1;
 	}
 
 	if (p->zip) {
-		png_set_read_fn(p->png_ptr, zp, png_helper_read);
+		png_set_read_fn(p->png_ptr, &p->zf, png_helper_read);
 	} else {
-		png_init_io(p->png_ptr, fp);
+		png_init_io(p->png_ptr, p->fp);
 	}
+	png_read_info(p->png_ptr, p->info_ptr);
 	png_set_strip_16(p->png_ptr);
-	png_read_png(p->png_ptr, p->info_ptr, PNG_TRANSFORM_PACKING, NULL);
-
-	p->row = png_get_rows(p->png_ptr, p->info_ptr);
-	if (!p->row) {
-		if (zp) {
-			zip_fclose(zp);
-		}
-		if (fp) {
-			fclose(fp);
-		}
-		png_destroy_read_struct(&p->png_ptr, &p->info_ptr, (png_infopp)NULL);
-		warn("read row\n");
-		return -1;
-	}
+	png_set_packing(p->png_ptr);
+	p->passes = png_set_interlace_handling(p->png_ptr);
+	png_read_update_info(p->png_ptr, p->info_ptr);
 
 	p->xres = (int)png_get_image_width(p->png_ptr, p->info_ptr);
 	p->yres = (int)png_get_image_height(p->png_ptr, p->info_ptr);
@@ -287,109 +461,165 @@ int png_load_helper(struct png_helper *p)
 	} else if (tmp == p->xres * 4) {
 		p->bpp = 32;
 	} else {
-		if (zp) {
-			zip_fclose(zp);
-		}
-		if (fp) {
-			fclose(fp);
-		}
+		png_helper_close(p);
 		png_destroy_read_struct(&p->png_ptr, &p->info_ptr, (png_infopp)NULL);
 		warn("rowbytes!=xres*4 (%d, %d, %s)", tmp, p->xres, p->filename);
 		return -1;
 	}
 
 	if (png_get_bit_depth(p->png_ptr, p->info_ptr) != 8) {
-		if (zp) {
-			zip_fclose(zp);
-		}
-		if (fp) {
-			fclose(fp);
-		}
+		png_helper_close(p);
 		png_destroy_read_struct(&p->png_ptr, &p->info_ptr, (png_infopp)NULL);
 		warn("bit depth!=8\n");
 		return -1;
 	}
 	if (png_get_channels(p->png_ptr, p->info_ptr) != p->bpp / 8) {
-		if (zp) {
-			zip_fclose(zp);
-		}
-		if (fp) {
-			fclose(fp);
-		}
+		png_helper_close(p);
 		png_destroy_read_struct(&p->png_ptr, &p->info_ptr, (png_infopp)NULL);
 		warn("channels!=format\n");
 		return -1;
 	}
 
-	if (p->zip) {
-		zip_fclose(zp);
-	} else {
-		fclose(fp);
-	}
-
 	return 0;
 }
 
 void png_load_helper_exit(struct png_helper *p)
 {
+	png_helper_close(p);
 	png_destroy_read_struct(&p->png_ptr, &p->info_ptr, (png_infopp)NULL);
 }
 
+#ifdef DEVELOPER
+// Time spent in the stages of sdl_load_image(), in nanoseconds: reading and
+// decoding PNGs, converting their rows, and trimming and up-scaling
+long long sdl_time_load_png = 0, sdl_time_load_rows = 0, sdl_time_load_trim = 0;
+#define PNG_TIME(var, since) __atomic_add_fetch(&(var), (long long)(SDL_GetTicksNS() - (since)), __ATOMIC_RELAXED)
+#endif
+
+// Visible part of a decoded PNG, ex and ey inclusive. ex < sx if nothing is.
+struct png_box {
+	int sx, sy, ex, ey;
+};
+
+// Read the rows of the PNG opened in p and convert each one into pixel
+// (p->xres by p->yres) as libpng delivers it. Interlaced images can only be
+// converted once the last pass is done. Returns the visible part in box.
+static void png_load_pixels(struct png_helper *p, uint32_t *pixel, int premulti, struct png_box *box)
+{
+	size_t rowbytes = png_get_rowbytes(p->png_ptr, p->info_ptr);
+	int isa = sdl_png_isa(), y, sx, ex, rows = p->passes > 1 ? p->yres : 1;
+	png_bytep raw, *row = NULL;
+#ifdef DEVELOPER
+	uint64_t start = SDL_GetTicksNS(), t;
+	long long time_rows = 0;
+#endif
+
+	box->sx = p->xres;
+	box->sy = p->yres;
+	box->ex = box->ey = -1;
+
+	raw = png_malloc(p->png_ptr, rowbytes * (size_t)rows);
+	if (p->passes > 1) {
+		row = png_malloc(p->png_ptr, sizeof(png_bytep) * (size_t)p->yres);
+		for (y = 0; y < p->yres; y++) {
+			row[y] = raw + rowbytes * (size_t)y;
+		}
+		png_read_image(p->png_ptr, row);
+	}
+
+	for (y = 0; y < p->yres; y++) {
+		if (!row) {
+			png_read_row(p->png_ptr, raw, NULL);
+		}
+#ifdef DEVELOPER
+		t = SDL_GetTicksNS();
+#endif
+		ex = sdl_png_row(pixel + (size_t)y * (size_t)p->xres, row ? row[y] : raw, p->xres, p->bpp, premulti, isa, &sx);
+		if (ex) {
+			if (sx < box->sx) {
+				box->sx = sx;
+			}
+			if (ex - 1 > box->ex) {
+				box->ex = ex - 1;
+			}
+			if (y < box->sy) {
+				box->sy = y;
+			}
+			box->ey = y;
+		}
+#ifdef DEVELOPER
+		time_rows += (long long)(SDL_GetTicksNS() - t);
+#endif
+	}
+
+	if (row) {
+		png_free(p->png_ptr, row);
+	}
+	png_free(p->png_ptr, raw);
+
+#ifdef DEVELOPER
+	__atomic_add_fetch(&sdl_time_load_rows, time_rows, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&sdl_time_load_png, (long long)(SDL_GetTicksNS() - start) - time_rows, __ATOMIC_RELAXED);
+#endif
+}
+
+static uint32_t *png_pixel_alloc(size_t bytes)
+{
+	uint32_t *pixel;
+
+#ifdef SDL_FAST_MALLOC
+	pixel = MALLOC(bytes);
+#else
+	pixel = xmalloc(bytes, MEM_SDL_PNG);
+#endif
+	extern long long mem_png;
+	__atomic_add_fetch(&mem_png, (long long)bytes, __ATOMIC_RELAXED);
+
+	return pixel;
+}
+
 // Load high res PNG
-int sdl_load_image_png_(struct sdl_image *si, char *filename, zip_t *zip)
+int sdl_load_image_png_(struct sdl_image *si, char *filename, struct sdl_archive *zip, int64_t entry)
 {
-	int x, y, r, g, b, a, sx, sy, ex, ey;
-	uint32_t c;
+	int y, sx, sy, ex, ey, w, n;
+	uint32_t *full;
 	struct png_helper p;
+	struct png_box box;
+#ifdef DEVELOPER
+	uint64_t start;
+#endif
 
 	p.zip = zip;
+	p.entry = entry;
 	p.filename = filename;
 	if (png_load_helper(&p)) {
 		return -1;
 	}
 
-	// prescan
-	sx = p.xres;
-	sy = p.yres;
-	ex = 0;
-	ey = 0;
-
-	for (y = 0; y < p.yres; y++) {
-		for (x = 0; x < p.xres; x++) {
-			if (p.bpp == 32 && (p.row[y][x * 4 + 3] == 0 || (p.row[y][x * 4 + 0] == 255 && p.row[y][x * 4 + 1] == 0 &&
-			                                                    p.row[y][x * 4 + 2] == 255))) {
-				continue;
-			}
-			if (p.bpp == 24 && (p.row[y][x * 3 + 0] == 255 && p.row[y][x * 3 + 1] == 0 && p.row[y][x * 3 + 2] == 255)) {
-				continue;
-			}
-			if (x < sx) {
-				sx = x;
-			}
-			if (x > ex) {
-				ex = x;
-			}
-			if (y < sy) {
-				sy = y;
-			}
-			if (y > ey) {
-				ey = y;
-			}
-		}
+	full = MALLOC((size_t)p.xres * (size_t)p.yres * sizeof(uint32_t));
+	if (!full) {
+		png_load_helper_exit(&p);
+		return -1;
 	}
+	png_load_pixels(&p, full, 1, &box);
+	png_load_helper_exit(&p);
+#ifdef DEVELOPER
+	start = SDL_GetTicksNS();
+#endif
 
 	// Make sure the new found borders of the image are on multiples
 	// of sd_scale. And never shrink the visible portion to do that.
-	sx = (sx / sdl_scale) * sdl_scale;
-	sy = (sy / sdl_scale) * sdl_scale;
-	ex = ((ex + sdl_scale) / sdl_scale) * sdl_scale;
-	ey = ((ey + sdl_scale) / sdl_scale) * sdl_scale;
+	sx = (box.sx / sdl_scale) * sdl_scale;
+	sy = (box.sy / sdl_scale) * sdl_scale;
+	ex = ((box.ex + sdl_scale) / sdl_scale) * sdl_scale;
+	ey = ((box.ey + sdl_scale) / sdl_scale) * sdl_scale;
 
+	// Nothing visible: an empty image
 	if (ex < sx) {
-		ex = sx - 1;
+		ex = sx;
 	}
 	if (ey < sy) {
-		ey = sy - 1;
+		ey = sy;
 	}
 
 	// write
@@ -399,225 +629,121 @@ int sdl_load_image_png_(struct sdl_image *si, char *filename, zip_t *zip)
 	si->xoff = (int16_t)(-(p.xres / 2) + sx);
 	si->yoff = (int16_t)(-(p.yres / 2) + sy);
 
-#ifdef SDL_FAST_MALLOC
-	si->pixel = MALLOC((size_t)si->xres * si->yres * sizeof(uint32_t));
-#else
-	si->pixel = xmalloc((size_t)si->xres * si->yres * sizeof(uint32_t), MEM_SDL_PNG);
-#endif
-	extern long long mem_png;
-	__atomic_add_fetch(&mem_png, (long long)((size_t)si->xres * si->yres * sizeof(uint32_t)), __ATOMIC_RELAXED);
+	si->pixel = png_pixel_alloc((size_t)si->xres * si->yres * sizeof(uint32_t));
 
+	// The rounded borders may reach past the PNG, those pixels stay empty
+	w = max(0, min(si->xres, p.xres - sx));
 	for (y = 0; y < si->yres; y++) {
-		for (x = 0; x < si->xres; x++) {
-			if (p.bpp == 32) {
-				if (sx + x >= p.xres || sy + y >= p.yres) {
-					r = g = b = a = 0;
-				} else {
-					r = p.row[(sy + y)][(sx + x) * 4 + 0];
-					g = p.row[(sy + y)][(sx + x) * 4 + 1];
-					b = p.row[(sy + y)][(sx + x) * 4 + 2];
-					a = p.row[(sy + y)][(sx + x) * 4 + 3];
-				}
-			} else {
-				if (sx + x >= p.xres || sy + y >= p.yres) {
-					r = g = b = a = 0;
-				} else {
-					r = p.row[(sy + y)][(sx + x) * 3 + 0];
-					g = p.row[(sy + y)][(sx + x) * 3 + 1];
-					b = p.row[(sy + y)][(sx + x) * 3 + 2];
-					if (r == 255 && g == 0 && b == 255) {
-						a = 0;
-					} else {
-						a = 255;
-					}
-				}
-			}
-
-			if (r == 255 && g == 0 && b == 255) {
-				a = 0;
-			}
-
-			if (a) { // pre-multiply rgb channel by alpha
-				r = min(255, r * 255 / a);
-				g = min(255, g * 255 / a);
-				b = min(255, b * 255 / a);
-			} else {
-				r = g = b = 0;
-			}
-
-			c = IRGBA(r, g, b, a);
-
-			si->pixel[x + y * si->xres] = c;
+		n = sy + y < p.yres ? w : 0;
+		if (n) {
+			memcpy(si->pixel + y * si->xres, full + (size_t)(sy + y) * (size_t)p.xres + sx,
+			    (size_t)n * sizeof(uint32_t));
 		}
+		memset(si->pixel + y * si->xres + n, 0, (size_t)(si->xres - n) * sizeof(uint32_t));
 	}
 
-	png_load_helper_exit(&p);
+	FREE(full);
 
 	si->xres /= sdl_scale;
 	si->yres /= sdl_scale;
 	si->xoff /= sdl_scale;
 	si->yoff /= sdl_scale;
 
+#ifdef DEVELOPER
+	PNG_TIME(sdl_time_load_trim, start);
+#endif
+
 	return 0;
 }
 
 // Load and up-scale low res PNG
 // TODO: add support for using a 2X image as a base for 4X
 // and possibly the other way around too
-int sdl_load_image_png(struct sdl_image *si, char *filename, zip_t *zip, int smoothify)
+int sdl_load_image_png(struct sdl_image *si, char *filename, struct sdl_archive *zip, int smoothify, int64_t entry)
 {
-	int x, y, r, g, b, a, sx, sy, ex, ey;
-	uint32_t c;
+	int x, y, i, j, premulti;
+	size_t width;
+	uint32_t *full, *src, *dst, c;
 	struct png_helper p;
+	struct png_box box;
+#ifdef DEVELOPER
+	uint64_t start;
+#endif
+
+	if (sdl_scale < 1 || sdl_scale > 4) {
+		warn("Unsupported scale %d in sdl_load_image_png()", sdl_scale);
+		return -1;
+	}
 
 	p.zip = zip;
+	p.entry = entry;
 	p.filename = filename;
 	if (png_load_helper(&p)) {
 		return -1;
 	}
 
-	// prescan
-	sx = p.xres;
-	sy = p.yres;
-	ex = 0;
-	ey = 0;
-
-	for (y = 0; y < p.yres; y++) {
-		for (x = 0; x < p.xres; x++) {
-			if (p.bpp == 32 && (p.row[y][x * 4 + 3] == 0 || (p.row[y][x * 4 + 0] == 255 && p.row[y][x * 4 + 1] == 0 &&
-			                                                    p.row[y][x * 4 + 2] == 255))) {
-				continue;
-			}
-			if (p.bpp == 24 && (p.row[y][x * 3 + 0] == 255 && p.row[y][x * 3 + 1] == 0 && p.row[y][x * 3 + 2] == 255)) {
-				continue;
-			}
-			if (x < sx) {
-				sx = x;
-			}
-			if (x > ex) {
-				ex = x;
-			}
-			if (y < sy) {
-				sy = y;
-			}
-			if (y > ey) {
-				ey = y;
-			}
-		}
+	full = MALLOC((size_t)p.xres * (size_t)p.yres * sizeof(uint32_t));
+	if (!full) {
+		png_load_helper_exit(&p);
+		return -1;
 	}
 
-	if (ex < sx) {
-		ex = sx - 1;
+	// Smoothing has to see the colors before they are pre-multiplied,
+	// otherwise it can happen right away
+	premulti = !(sdl_scale > 1 && smoothify);
+	png_load_pixels(&p, full, premulti, &box);
+	png_load_helper_exit(&p);
+#ifdef DEVELOPER
+	start = SDL_GetTicksNS();
+#endif
+
+	if (box.ex < box.sx) {
+		box.ex = box.sx - 1;
 	}
-	if (ey < sy) {
-		ey = sy - 1;
+	if (box.ey < box.sy) {
+		box.ey = box.sy - 1;
 	}
 
 	// write
 	si->flags = 1;
-	si->xres = (uint16_t)(ex - sx + 1);
-	si->yres = (uint16_t)(ey - sy + 1);
-	si->xoff = (int16_t)(-(p.xres / 2) + sx);
-	si->yoff = (int16_t)(-(p.yres / 2) + sy);
+	si->xres = (uint16_t)(box.ex - box.sx + 1);
+	si->yres = (uint16_t)(box.ey - box.sy + 1);
+	si->xoff = (int16_t)(-(p.xres / 2) + box.sx);
+	si->yoff = (int16_t)(-(p.yres / 2) + box.sy);
 
-#ifdef SDL_FAST_MALLOC
-	si->pixel = MALLOC((size_t)si->xres * si->yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale);
-#else
-	si->pixel =
-	    xmalloc((size_t)si->xres * si->yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale, MEM_SDL_PNG);
-#endif
-	extern long long mem_png;
-	__atomic_add_fetch(&mem_png,
-	    (long long)((size_t)si->xres * (size_t)si->yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale),
-	    __ATOMIC_RELAXED);
+	width = (size_t)si->xres * (size_t)sdl_scale;
+	si->pixel = png_pixel_alloc(width * si->yres * sizeof(uint32_t) * (size_t)sdl_scale);
 
+	// Every source pixel becomes a block of sdl_scale by sdl_scale: build the
+	// first line of the block, then copy it to the others
 	for (y = 0; y < si->yres; y++) {
-		for (x = 0; x < si->xres; x++) {
-			if (p.bpp == 32) {
-				r = p.row[(sy + y)][(sx + x) * 4 + 0];
-				g = p.row[(sy + y)][(sx + x) * 4 + 1];
-				b = p.row[(sy + y)][(sx + x) * 4 + 2];
-				a = p.row[(sy + y)][(sx + x) * 4 + 3];
-			} else {
-				r = p.row[(sy + y)][(sx + x) * 3 + 0];
-				g = p.row[(sy + y)][(sx + x) * 3 + 1];
-				b = p.row[(sy + y)][(sx + x) * 3 + 2];
-				if (r == 255 && g == 0 && b == 255) {
-					a = 0;
-				} else {
-					a = 255;
-				}
-			}
-
-			if (r == 255 && g == 0 && b == 255) {
-				a = 0;
-			}
-
-			if (!a) { // don't pre-multiply rgb channel by alpha because that needs to happen after scaling
-				r = g = b = 0;
-			}
-
-			c = IRGBA(r, g, b, a);
-
-			switch (sdl_scale) {
-			case 1:
-				si->pixel[x + y * si->xres] = c;
-				break;
-			case 2:
-				si->pixel[x * 2 + y * si->xres * 4] = c;
-				si->pixel[x * 2 + y * si->xres * 4 + 1] = c;
-				si->pixel[x * 2 + y * si->xres * 4 + si->xres * 2] = c;
-				si->pixel[x * 2 + y * si->xres * 4 + 1 + si->xres * 2] = c;
-				break;
-			case 3:
-				si->pixel[x * 3 + y * si->xres * 9 + 0] = c;
-				si->pixel[x * 3 + y * si->xres * 9 + 0 + si->xres * 3] = c;
-				si->pixel[x * 3 + y * si->xres * 9 + 0 + si->xres * 6] = c;
-
-				si->pixel[x * 3 + y * si->xres * 9 + 1] = c;
-				si->pixel[x * 3 + y * si->xres * 9 + 1 + si->xres * 3] = c;
-				si->pixel[x * 3 + y * si->xres * 9 + 1 + si->xres * 6] = c;
-
-				si->pixel[x * 3 + y * si->xres * 9 + 2] = c;
-				si->pixel[x * 3 + y * si->xres * 9 + 2 + si->xres * 3] = c;
-				si->pixel[x * 3 + y * si->xres * 9 + 2 + si->xres * 6] = c;
-				break;
-			case 4:
-				si->pixel[x * 4 + y * si->xres * 16 + 0] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 0 + si->xres * 4] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 0 + si->xres * 8] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 0 + si->xres * 12] = c;
-
-				si->pixel[x * 4 + y * si->xres * 16 + 1] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 1 + si->xres * 4] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 1 + si->xres * 8] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 1 + si->xres * 12] = c;
-
-				si->pixel[x * 4 + y * si->xres * 16 + 2] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 2 + si->xres * 4] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 2 + si->xres * 8] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 2 + si->xres * 12] = c;
-
-				si->pixel[x * 4 + y * si->xres * 16 + 3] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 3 + si->xres * 4] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 3 + si->xres * 8] = c;
-				si->pixel[x * 4 + y * si->xres * 16 + 3 + si->xres * 12] = c;
-				break;
-			default:
-				warn("Unsupported scale %d in sdl_load_image_png()", sdl_scale);
-				break;
+		src = full + (size_t)(box.sy + y) * (size_t)p.xres + box.sx;
+		dst = si->pixel + (size_t)y * width * (size_t)sdl_scale;
+		if (sdl_scale == 1) {
+			memcpy(dst, src, width * sizeof(uint32_t));
+			continue;
+		}
+		for (x = i = 0; x < si->xres; x++) {
+			c = src[x];
+			for (j = 0; j < sdl_scale; j++) {
+				dst[i++] = c;
 			}
 		}
+		for (j = 1; j < sdl_scale; j++) {
+			memcpy(dst + width * (size_t)j, dst, width * sizeof(uint32_t));
+		}
 	}
 
-	if (sdl_scale > 1 && smoothify) {
+	FREE(full);
+
+	if (!premulti) {
 		sdl_smoothify(si->pixel, si->xres * sdl_scale, si->yres * sdl_scale, sdl_scale);
 		sdl_premulti(si->pixel, si->xres * sdl_scale, si->yres * sdl_scale, sdl_scale);
-	} else {
-		sdl_premulti(si->pixel, si->xres * sdl_scale, si->yres * sdl_scale, sdl_scale);
 	}
 
-	png_load_helper_exit(&p);
+#ifdef DEVELOPER
+	PNG_TIME(sdl_time_load_trim, start);
+#endif
 
 	return 0;
 }
@@ -660,49 +786,200 @@ int do_smoothify(int sprite)
 	return 0;
 }
 
-int sdl_load_image(struct sdl_image *si, int sprite, struct zip_handles *zips)
+// ============================================================================
+// Archive index
+// ============================================================================
+//
+// sdl_zip_index_init() reads the central directory of every archive once and
+// records, for each sprite, the archive sdl_load_image() finds it in first and
+// the index of its PNG there. Loads then open the entry by index instead of
+// looking the name up in up to six archives.
+
+// Archives in the order sdl_load_image() searches them
+#define ZA_NONE  0
+#define ZA_2M    1
+#define ZA_2P    2
+#define ZA_2     3
+#define ZA_1M    4
+#define ZA_1P    5
+#define ZA_1     6
+#define ZA_COUNT 7
+
+struct zip_index {
+	uint32_t entry;
+	uint8_t archive; // ZA_*
+	uint8_t probes; // name lookups a search by name needs to find it
+};
+
+static struct zip_index *zip_index = NULL;
+static int zip_index_archives = 0;
+long long zip_index_saved = 0;
+
+static void zip_index_handles(struct sdl_archive **archive)
 {
-	char filename[1024];
-	zip_t *zip1, *zip1p, *zip1m, *zip2, *zip2p, *zip2m;
-
-	if (zips) {
-		zip1 = zips->zip1;
-		zip1p = zips->zip1p;
-		zip1m = zips->zip1m;
-		zip2 = zips->zip2;
-		zip2p = zips->zip2p;
-		zip2m = zips->zip2m;
+	archive[ZA_NONE] = NULL;
+	archive[ZA_2M] = sdl_zip2m;
+	archive[ZA_2P] = sdl_zip2p;
+	archive[ZA_2] = sdl_zip2;
+	archive[ZA_1M] = sdl_zip1m;
+	archive[ZA_1P] = sdl_zip1p;
+	archive[ZA_1] = sdl_zip1;
+}
+
+// Sprite number of an entry named like sdl_load_image() asks for ("%08d.png"), or -1
+static int zip_index_sprite(const char *name)
+{
+	int i, sprite = 0;
+
+	if (!name || strlen(name) != 12 || strcmp(name + 8, ".png")) {
+		return -1;
+	}
+	for (i = 0; i < 8; i++) {
+		if (name[i] < '0' || name[i] > '9') {
+			return -1;
+		}
+		sprite = sprite * 10 + (name[i] - '0');
+		if (sprite >= MAXSPRITE) {
+			return -1;
+		}
+	}
+	return sprite;
+}
+
+// Build the index from the archives in sdl_zip1 to sdl_zip2m. Call once they
+// are open and before any image is loaded.
+void sdl_zip_index_init(void)
+{
+	struct sdl_archive *archive[ZA_COUNT];
+	int64_t i, n;
+	int a, sprite, found = 0;
+	long long probes = 0;
+
+	zip_index_handles(archive);
+
+	zip_index = xmalloc(MAXSPRITE * sizeof(struct zip_index), MEM_SDL_BASE);
+	if (!zip_index) {
+		return;
+	}
+
+	zip_index_archives = 0;
+	for (a = ZA_2M; a < ZA_COUNT; a++) {
+		if (!archive[a]) {
+			continue;
+		}
+		zip_index_archives++;
+
+		n = sdl_archive_entries(archive[a]);
+		for (i = 0; i < n; i++) {
+			sprite = zip_index_sprite(sdl_archive_name(archive[a], i));
+			if (sprite < 0 || zip_index[sprite].archive) {
+				continue; // not a sprite, or an archive searched earlier has it
+			}
+			zip_index[sprite].entry = (uint32_t)i;
+			zip_index[sprite].archive = (uint8_t)a;
+			zip_index[sprite].probes = (uint8_t)zip_index_archives;
+			probes += zip_index_archives;
+			found++;
+		}
+	}
+
+	note("Archive index: %d sprites in %d archives, replaces %.2f name lookups per sprite", found,
+	    zip_index_archives, found ? (double)probes / found : 0.0);
+}
+
+int sdl_zip_index_has(unsigned int sprite)
+{
+	return zip_index && sprite < MAXSPRITE && zip_index[sprite].archive != ZA_NONE;
+}
+
+void sdl_zip_index_exit(void)
+{
+	if (!zip_index) {
+		return;
+	}
+	note("Archive index saved %lld name lookups", zip_index_saved);
+	xfree(zip_index);
+	zip_index = NULL;
+	zip_index_saved = 0;
+}
+
+// Load sprite from the archive the index has it in. Returns 0 on success, 1 if
+// the sprite is in no archive and -1 if the index can not help.
+static int zip_index_load(struct sdl_image *si, int sprite, struct sdl_archive **archive, char *filename)
+{
+	const struct zip_index *zi = &zip_index[sprite];
+	struct sdl_archive *zip = archive[zi->archive];
+
+	if (zi->archive == ZA_NONE) {
+		__atomic_add_fetch(&zip_index_saved, zip_index_archives, __ATOMIC_RELAXED);
+		return 1;
+	}
+	if (!zip) {
+		return -1;
+	}
+
+	if (zi->archive <= ZA_2) {
+		if (sdl_load_image_png_(si, filename, zip, zi->entry)) {
+			return -1;
+		}
 	} else {
-		extern zip_t *sdl_zip1, *sdl_zip2, *sdl_zip1p, *sdl_zip2p, *sdl_zip1m, *sdl_zip2m;
-		zip1 = sdl_zip1;
-		zip1p = sdl_zip1p;
-		zip1m = sdl_zip1m;
-		zip2 = sdl_zip2;
-		zip2p = sdl_zip2p;
-		zip2m = sdl_zip2m;
+		if (sdl_load_image_png(si, filename, zip, do_smoothify(sprite), zi->entry)) {
+			return -1;
+		}
 	}
 
+	__atomic_add_fetch(&zip_index_saved, zi->probes, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int sdl_load_image(struct sdl_image *si, int sprite)
+{
+	char filename[1024];
+	struct sdl_archive *archive[ZA_COUNT];
+	struct sdl_archive *zip1, *zip1p, *zip1m, *zip2, *zip2p, *zip2m;
+
+	zip_index_handles(archive);
+	zip1 = archive[ZA_1];
+	zip1p = archive[ZA_1P];
+	zip1m = archive[ZA_1M];
+	zip2 = archive[ZA_2];
+	zip2p = archive[ZA_2P];
+	zip2m = archive[ZA_2M];
+
 	if (sprite >= MAXSPRITE || sprite < 0) {
 		note("sdl_load_image: illegal sprite %d wanted", sprite);
 		return -1;
 	}
 
+	// get it from the archive the index found it in
+	if (zip_index) {
+		sprintf(filename, "%08d.png", sprite);
+		switch (zip_index_load(si, sprite, archive, filename)) {
+		case 0:
+			return 0;
+		case 1:
+			goto not_found;
+		default:
+			break; // fall back to searching by name
+		}
+	}
+
 #if 0
 	// get patch png
 	sprintf(filename,"../gfxp/x%d/%08d/%08d.png",sdl_scale,(sprite/1000)*1000,sprite);
-	if (sdl_load_image_png_(si,filename,NULL)==0) return 0;
+	if (sdl_load_image_png_(si,filename,NULL,-1)==0) return 0;
 #endif
 
 	// get high res from archive
 	if (zip2 || zip2p || zip2m) {
 		sprintf(filename, "%08d.png", sprite);
-		if (zip2m && sdl_load_image_png_(si, filename, zip2m) == 0) {
+		if (zip2m && sdl_load_image_png_(si, filename, zip2m, -1) == 0) {
 			return 0; // check mod archive first
 		}
-		if (zip2p && sdl_load_image_png_(si, filename, zip2p) == 0) {
+		if (zip2p && sdl_load_image_png_(si, filename, zip2p, -1) == 0) {
 			return 0; // check patch archive second
 		}
-		if (zip2 && sdl_load_image_png_(si, filename, zip2) == 0) {
+		if (zip2 && sdl_load_image_png_(si, filename, zip2, -1) == 0) {
 			return 0; // check base archive third
 		}
 	}
@@ -710,19 +987,19 @@ int sdl_load_image(struct sdl_image *si, int sprite, struct zip_handles *zips)
 #if 0
 	// get high res from base png folder
 	sprintf(filename,"../gfx/x%d/%08d/%08d.png",sdl_scale,(sprite/1000)*1000,sprite);
-	if (sdl_load_image_png_(si,filename,NULL)==0) return 0;
+	if (sdl_load_image_png_(si,filename,NULL,-1)==0) return 0;
 #endif
 
 	// get standard from archive
 	if (zip1 || zip1p || zip1m) {
 		sprintf(filename, "%08d.png", sprite);
-		if (zip1m && sdl_load_image_png(si, filename, zip1m, do_smoothify(sprite)) == 0) {
+		if (zip1m && sdl_load_image_png(si, filename, zip1m, do_smoothify(sprite), -1) == 0) {
 			return 0;
 		}
-		if (zip1p && sdl_load_image_png(si, filename, zip1p, do_smoothify(sprite)) == 0) {
+		if (zip1p && sdl_load_image_png(si, filename, zip1p, do_smoothify(sprite), -1) == 0) {
 			return 0;
 		}
-		if (zip1 && sdl_load_image_png(si, filename, zip1, do_smoothify(sprite)) == 0) {
+		if (zip1 && sdl_load_image_png(si, filename, zip1, do_smoothify(sprite), -1) == 0) {
 			return 0;
 		}
 	}
@@ -730,17 +1007,18 @@ int sdl_load_image(struct sdl_image *si, int sprite, struct zip_handles *zips)
 #if 0
 	// get standard from base png folder
 	sprintf(filename,"../gfx/x1/%08d/%08d.png",(sprite/1000)*1000,sprite);
-	if (sdl_load_image_png(si,filename,NULL,do_smoothify(sprite))==0) return 0;
+	if (sdl_load_image_png(si,filename,NULL,do_smoothify(sprite),-1)==0) return 0;
 	sprintf(filename,"../gfxp/x1/%08d/%08d.png",(sprite/1000)*1000,sprite);
-	if (sdl_load_image_png(si,filename,NULL,do_smoothify(sprite))==0) return 0;
+	if (sdl_load_image_png(si,filename,NULL,do_smoothify(sprite),-1)==0) return 0;
 #endif
 
+not_found:
 	sprintf(filename, "%08d.png", sprite);
 	warn("%s not found", filename);
 
 	// get unknown sprite image
 	sprintf(filename, "%08d.png", 2);
-	if (zip1 && sdl_load_image_png(si, filename, zip1, do_smoothify(sprite)) == 0) {
+	if (zip1 && sdl_load_image_png(si, filename, zip1, do_smoothify(sprite), -1) == 0) {
 		return 0;
 	}
 
@@ -753,7 +1031,138 @@ int sdl_load_image(struct sdl_image *si, int sprite, struct zip_handles *zips)
 	return -1;
 }
 
-int sdl_ic_load(unsigned int sprite, struct zip_handles *zips)
+#ifndef STANDALONE // the gfxpack helper only needs the decoder above
+
+// ============================================================================
+// Decoded image cache
+// ============================================================================
+//
+// sdli[sprite] holds the decoded source image of a sprite. Images are kept in
+// an LRU list (guarded by premutex) while IMG_READY and evicted again once
+// mem_png exceeds imgc_budget. An image is pinned while any sdlt entry of the
+// sprite still needs its pixels for stage 2 of sdl_make().
+//
+// Only the render thread pins and evicts. Workers only ever touch images of
+// pinned entries, so an image can not disappear under a worker.
+//
+// Images used in place from the sprite pack (mapped) never enter the LRU list
+// and stay IMG_READY for the whole session.
+
+static int sdli_best = STX_NONE, sdli_last = STX_NONE;
+
+static size_t sdl_ic_bytes(struct sdl_image *si)
+{
+	return (size_t)si->xres * si->yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale;
+}
+
+// Caller must hold premutex
+static void sdl_ic_unlink(int sprite)
+{
+	if (sdli[sprite].prev == STX_NONE) {
+		sdli_best = sdli[sprite].next;
+	} else {
+		sdli[sdli[sprite].prev].next = sdli[sprite].next;
+	}
+	if (sdli[sprite].next == STX_NONE) {
+		sdli_last = sdli[sprite].prev;
+	} else {
+		sdli[sdli[sprite].next].prev = sdli[sprite].prev;
+	}
+}
+
+// Caller must hold premutex
+static void sdl_ic_link_best(int sprite)
+{
+	sdli[sprite].prev = STX_NONE;
+	sdli[sprite].next = sdli_best;
+	if (sdli_best != STX_NONE) {
+		sdli[sdli_best].prev = sprite;
+	} else {
+		sdli_last = sprite;
+	}
+	sdli_best = sprite;
+}
+
+void sdl_ic_pin(unsigned int sprite)
+{
+	__atomic_add_fetch(&sdli[sprite].pins, 1, __ATOMIC_ACQ_REL);
+}
+
+void sdl_ic_unpin(unsigned int sprite)
+{
+	int pins = __atomic_sub_fetch(&sdli[sprite].pins, 1, __ATOMIC_ACQ_REL);
+	assert(pins >= 0 && "sdl_ic_unpin(): unbalanced unpin");
+	(void)pins;
+}
+
+void sdl_ic_set_budget(int megabytes, int scale)
+{
+	if (megabytes < 0) {
+		megabytes = 0;
+	}
+	if (!megabytes) {
+		megabytes = DEF_IMGBUDGET * scale * scale;
+	}
+	imgc_budget = (long long)megabytes * 1024 * 1024;
+}
+
+// Caller must hold premutex
+static void sdl_ic_evict(int sprite)
+{
+	sdl_ic_unlink(sprite);
+	__atomic_store_n(&sdli_state[sprite], IMG_UNLOADED, __ATOMIC_RELEASE);
+
+	__atomic_sub_fetch(&mem_png, (long long)sdl_ic_bytes(&sdli[sprite]), __ATOMIC_RELAXED);
+#ifdef SDL_FAST_MALLOC
+	FREE(sdli[sprite].pixel);
+#else
+	xfree(sdli[sprite].pixel);
+#endif
+	sdli[sprite].pixel = NULL;
+
+	imgc_used--;
+	imgc_evict++;
+}
+
+// Maximum number of LRU entries looked at per call when over budget
+#define IMGCACHE_TRIM_STEPS 256
+
+// Evict least recently used, unpinned images until mem_png fits the budget.
+// Render thread only.
+void sdl_ic_trim(void)
+{
+	int sprite, prev, steps;
+
+	if (imgc_budget <= 0 || __atomic_load_n(&mem_png, __ATOMIC_RELAXED) <= imgc_budget) {
+		return;
+	}
+
+	SDL_LockMutex(premutex);
+	sprite = sdli_last;
+	for (steps = 0; sprite != STX_NONE && steps < IMGCACHE_TRIM_STEPS; steps++) {
+		if (__atomic_load_n(&mem_png, __ATOMIC_RELAXED) <= imgc_budget) {
+			break;
+		}
+		prev = sdli[sprite].prev;
+		if (!__atomic_load_n(&sdli[sprite].pins, __ATOMIC_ACQUIRE)) {
+			sdl_ic_evict(sprite);
+		}
+		sprite = prev;
+	}
+	SDL_UnlockMutex(premutex);
+}
+
+// Drop every decoded image, pinned or not. Only safe while no worker is busy.
+void sdl_ic_flush(void)
+{
+	SDL_LockMutex(premutex);
+	while (sdli_best != STX_NONE) {
+		sdl_ic_evict(sdli_best);
+	}
+	SDL_UnlockMutex(premutex);
+}
+
+int sdl_ic_load(unsigned int sprite)
 {
 #ifdef DEVELOPER
 	uint64_t start = SDL_GetTicks();
@@ -764,22 +1173,20 @@ int sdl_ic_load(unsigned int sprite, struct zip_handles *zips)
 		return -1;
 	}
 
-	// sdli_state is in sdl_core.c, we need to access it
-	// For now, we'll use a helper function or make it extern
-	extern int *sdli_state; // declared in sdl_core.c
-
-	enum {
-		IMG_UNLOADED = 0,
-		IMG_LOADING = 1,
-		IMG_READY = 2,
-		IMG_FAILED = 3,
-	};
-
 	int state;
 retry:
 	state = __atomic_load_n((int *)&sdli_state[sprite], __ATOMIC_ACQUIRE);
 
 	if (state == IMG_READY) {
+		if (sdli[sprite].mapped) {
+			return (int)sprite;
+		}
+		SDL_LockMutex(premutex);
+		if (sdli_best != (int)sprite) {
+			sdl_ic_unlink((int)sprite);
+			sdl_ic_link_best((int)sprite);
+		}
+		SDL_UnlockMutex(premutex);
 #ifdef DEVELOPER
 		extern long long sdl_time_load;
 		sdl_time_load += SDL_GetTicks() - start;
@@ -805,10 +1212,27 @@ retry:
 		goto retry;
 	}
 
-	// We are the loader now
-	extern struct sdl_image *sdli;
-	if (sdl_load_image(sdli + sprite, (int)sprite, zips) == 0) {
+	// We are the loader now. Decode into a local image first: sdl_make() may read
+	// the dimensions of an evicted image at any time, so they must never show
+	// the intermediate values the loaders write.
+	struct sdl_image tmp = {0};
+	if (sdl_pack_image(&tmp, sprite) || sdl_load_image(&tmp, (int)sprite) == 0) {
+		SDL_LockMutex(premutex);
+		if (!sdli[sprite].flags) {
+			sdli[sprite].xres = tmp.xres;
+			sdli[sprite].yres = tmp.yres;
+			sdli[sprite].xoff = tmp.xoff;
+			sdli[sprite].yoff = tmp.yoff;
+			sdli[sprite].flags = tmp.flags;
+		}
+		sdli[sprite].pixel = tmp.pixel;
+		sdli[sprite].mapped = tmp.mapped;
+		if (!tmp.mapped) {
+			sdl_ic_link_best((int)sprite);
+			imgc_used++;
+		}
 		__atomic_store_n((int *)&sdli_state[sprite], IMG_READY, __ATOMIC_RELEASE);
+		SDL_UnlockMutex(premutex);
 #ifdef DEVELOPER
 		extern long long sdl_time_load;
 		sdl_time_load += SDL_GetTicks() - start;
@@ -820,12 +1244,35 @@ retry:
 	}
 }
 
+// Stages 1 and 2 of sdl_make() for the sprite entry st, taken from the disk
+// cache if it has them. Returns -1 if the image could not be loaded.
+int sdl_make_sprite(struct sdl_texture *st)
+{
+	unsigned int sprite = st->sprite;
+
+	if (sdl_dc_load(st)) {
+		// The source pixels are not needed for this entry
+		sdl_ic_unpin(sprite);
+		return 0;
+	}
+
+	if (sdl_ic_load(sprite) < 0) {
+		return -1;
+	}
+	sdl_make(st, &sdli[sprite], 1);
+	sdl_make(st, &sdli[sprite], 2);
+	sdl_dc_store(st);
+
+	return 0;
+}
+
 void sdl_make(struct sdl_texture *st, struct sdl_image *si, int preload)
 {
 	SDL_Texture *texture;
-	int x, y, scale, sink;
-	double ix, iy, low_x, low_y, high_x, high_y, dbr, dbg, dbb, dba;
-	uint32_t irgb;
+	int x, y, w, scale, sink;
+	uint32_t irgb, *row;
+	struct sdl_rowfx fx;
+	struct sdl_scaler sc = {0};
 #ifdef DEVELOPER
 	Uint64 start = SDL_GetTicks();
 #endif
@@ -842,17 +1289,21 @@ void sdl_make(struct sdl_texture *st, struct sdl_image *si, int preload)
 		scale = (uint8_t)(scale * 0.88);
 	}
 
-	if (scale != 100) {
-		st->xres = (uint16_t)ceil((si->xres - 1) * (double)scale / 100.0);
-		st->yres = (uint16_t)ceil((si->yres - 1) * (double)scale / 100.0);
+	// A made entry has its size already. If it came from the disk cache, si was
+	// never loaded and has none.
+	if (!(flags_load(st) & SF_DIDMAKE)) {
+		if (scale != 100) {
+			st->xres = (uint16_t)ceil((si->xres - 1) * (double)scale / 100.0);
+			st->yres = (uint16_t)ceil((si->yres - 1) * (double)scale / 100.0);
 
-		st->xoff = (int16_t)floor(si->xoff * (double)scale / 100.0 + 0.5);
-		st->yoff = (int16_t)floor(si->yoff * (double)scale / 100.0 + 0.5);
-	} else {
-		st->xres = (uint16_t)si->xres;
-		st->yres = (uint16_t)si->yres;
-		st->xoff = si->xoff;
-		st->yoff = si->yoff;
+			st->xoff = (int16_t)floor(si->xoff * (double)scale / 100.0 + 0.5);
+			st->yoff = (int16_t)floor(si->yoff * (double)scale / 100.0 + 0.5);
+		} else {
+			st->xres = (uint16_t)si->xres;
+			st->yres = (uint16_t)si->yres;
+			st->xoff = si->xoff;
+			st->yoff = si->yoff;
+		}
 	}
 
 	if (st->sink) {
@@ -908,213 +1359,60 @@ void sdl_make(struct sdl_texture *st, struct sdl_image *si, int preload)
 		start = SDL_GetTicks();
 #endif
 
-		for (y = 0; y < st->yres * sdl_scale; y++) {
-			for (x = 0; x < st->xres * sdl_scale; x++) {
-				if (scale != 100) {
-					ix = x * 100.0 / scale;
-					iy = y * 100.0 / scale;
-
-					if (ceil(ix) >= si->xres * sdl_scale) {
-						ix = si->xres * sdl_scale - 1.001;
-					}
-
-					if (ceil(iy) >= si->yres * sdl_scale) {
-						iy = si->yres * sdl_scale - 1.001;
-					}
-
-					high_x = ix - floor(ix);
-					high_y = iy - floor(iy);
-					low_x = 1 - high_x;
-					low_y = 1 - high_y;
-
-					irgb = si->pixel[(int)(floor(ix) + floor(iy) * si->xres * sdl_scale)];
-
-					if (st->c1 || st->c2 || st->c3) {
-						irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)floor(ix), (int)floor(iy), si->xres,
-						    si->yres, si->pixel, (int)st->sprite);
-					}
-					dba = IGET_A(irgb) * low_x * low_y;
-					dbr = IGET_R(irgb) * low_x * low_y;
-					dbg = IGET_G(irgb) * low_x * low_y;
-					dbb = IGET_B(irgb) * low_x * low_y;
-
-					irgb = si->pixel[(int)(ceil(ix) + floor(iy) * si->xres * sdl_scale)];
-
-					if (st->c1 || st->c2 || st->c3) {
-						irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)ceil(ix), (int)floor(iy), si->xres,
-						    si->yres, si->pixel, (int)st->sprite);
-					}
-					dba += IGET_A(irgb) * high_x * low_y;
-					dbr += IGET_R(irgb) * high_x * low_y;
-					dbg += IGET_G(irgb) * high_x * low_y;
-					dbb += IGET_B(irgb) * high_x * low_y;
-
-					irgb = si->pixel[(int)(floor(ix) + ceil(iy) * si->xres * sdl_scale)];
-
-					if (st->c1 || st->c2 || st->c3) {
-						irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)floor(ix), (int)ceil(iy), si->xres,
-						    si->yres, si->pixel, (int)st->sprite);
-					}
-					dba += IGET_A(irgb) * low_x * high_y;
-					dbr += IGET_R(irgb) * low_x * high_y;
-					dbg += IGET_G(irgb) * low_x * high_y;
-					dbb += IGET_B(irgb) * low_x * high_y;
-
-					irgb = si->pixel[(int)(ceil(ix) + ceil(iy) * si->xres * sdl_scale)];
-
-					if (st->c1 || st->c2 || st->c3) {
-						irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)ceil(ix), (int)ceil(iy), si->xres,
-						    si->yres, si->pixel, (int)st->sprite);
-					}
-					dba += IGET_A(irgb) * high_x * high_y;
-					dbr += IGET_R(irgb) * high_x * high_y;
-					dbg += IGET_G(irgb) * high_x * high_y;
-					dbb += IGET_B(irgb) * high_x * high_y;
-
-					irgb = IRGBA((int)dbr, (int)dbg, (int)dbb, (int)dba);
+		w = st->xres * sdl_scale;
+		sdl_rowfx_prepare(&fx, st, w * st->yres * sdl_scale);
+		if (scale != 100) {
+			sdl_scaler_init(&sc, st, si, scale);
+		}
 
-				} else {
+		for (y = 0; y < st->yres * sdl_scale; y++) {
+			row = st->pixel + y * w;
+			if (scale != 100) {
+				sdl_scaler_row(&sc, y, row, w);
+			} else {
+				for (x = 0; x < w; x++) {
 					irgb = si->pixel[x + y * si->xres * sdl_scale];
 					if (st->c1 || st->c2 || st->c3) {
 						irgb = sdl_colorize_pix2(
 						    irgb, st->c1, st->c2, st->c3, x, y, si->xres, si->yres, si->pixel, (int)st->sprite);
 					}
+					row[x] = irgb;
 				}
+			}
 
-				if (st->cr || st->cg || st->cb || st->light || st->sat) {
-					irgb = sdl_colorbalance(
-					    irgb, (char)st->cr, (char)st->cg, (char)st->cb, (char)st->light, (char)st->sat);
-				}
-				if (st->shine) {
-					irgb = sdl_shine_pix(irgb, st->shine);
-				}
-
-				if (st->ll != st->ml || st->rl != st->ml || st->ul != st->ml || st->dl != st->ml) {
-					int r, g, b, a;
-					int r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0;
-					int g1 = 0, g2 = 0, g3 = 0, g4 = 0, g5 = 0;
-					int b1 = 0, b2 = 0, b3 = 0, b4 = 0, b5 = 0;
-					int v1, v2, v3, v4, v5 = 0;
-					int div;
-
-
-					if (y < 10 * sdl_scale + (20 * sdl_scale - abs(20 * sdl_scale - x)) / 2) {
-						// This part calculates a floor tile, or the top of a wall tile
-						if (x / 2 < 20 * sdl_scale - y) {
-							v2 = -(x / 2 - (20 * sdl_scale - y));
-							r2 = IGET_R(sdl_light(st->ll, irgb));
-							g2 = IGET_G(sdl_light(st->ll, irgb));
-							b2 = IGET_B(sdl_light(st->ll, irgb));
-						} else {
-							v2 = 0;
-						}
-						if (x / 2 > 20 * sdl_scale - y) {
-							v3 = (x / 2 - (20 * sdl_scale - y));
-							r3 = IGET_R(sdl_light(st->rl, irgb));
-							g3 = IGET_G(sdl_light(st->rl, irgb));
-							b3 = IGET_B(sdl_light(st->rl, irgb));
-						} else {
-							v3 = 0;
-						}
-						if (x / 2 > y) {
-							v4 = (x / 2 - y);
-							r4 = IGET_R(sdl_light(st->ul, irgb));
-							g4 = IGET_G(sdl_light(st->ul, irgb));
-							b4 = IGET_B(sdl_light(st->ul, irgb));
-						} else {
-							v4 = 0;
-						}
-						if (x / 2 < y) {
-							v5 = -(x / 2 - y);
-							r5 = IGET_R(sdl_light(st->dl, irgb));
-							g5 = IGET_G(sdl_light(st->dl, irgb));
-							b5 = IGET_B(sdl_light(st->dl, irgb));
-						} else {
-							v5 = 0;
-						}
-
-						v1 = 20 * sdl_scale - (v2 + v3 + v4 + v5);
-						r1 = IGET_R(sdl_light(st->ml, irgb));
-						g1 = IGET_G(sdl_light(st->ml, irgb));
-						b1 = IGET_B(sdl_light(st->ml, irgb));
-					} else {
-						// This is for the lower part (left side and front as seen on the screen)
-						if (x < 10 * sdl_scale) {
-							v2 = (10 * sdl_scale - x) * 2 - 2;
-							r2 = IGET_R(sdl_light(st->ll, irgb));
-							g2 = IGET_G(sdl_light(st->ll, irgb));
-							b2 = IGET_B(sdl_light(st->ll, irgb));
-						} else {
-							v2 = 0;
-						}
-						if (x > 10 * sdl_scale && x < 20 * sdl_scale) {
-							v3 = (x - 10 * sdl_scale) * 2 - 2;
-							r3 = IGET_R(sdl_light(st->rl, irgb));
-							g3 = IGET_G(sdl_light(st->rl, irgb));
-							b3 = IGET_B(sdl_light(st->rl, irgb));
-						} else {
-							v3 = 0;
-						}
-						if (x > 20 * sdl_scale && x < 30 * sdl_scale) {
-							v5 = (10 * sdl_scale - (x - 20 * sdl_scale)) * 2 - 2;
-							r5 = IGET_R(sdl_light(st->dl, irgb));
-							g5 = IGET_G(sdl_light(st->dl, irgb));
-							b5 = IGET_B(sdl_light(st->dl, irgb));
-						} else {
-							v5 = 0;
-						}
-						if (x > 30 * sdl_scale) {
-							if (x < 40 * sdl_scale) {
-								v4 = (x - 30 * sdl_scale) * 2 - 2;
-							} else {
-								v4 = 0;
-							}
-							r4 = IGET_R(sdl_light(st->ul, irgb));
-							g4 = IGET_G(sdl_light(st->ul, irgb));
-							b4 = IGET_B(sdl_light(st->ul, irgb));
-						} else {
-							v4 = 0;
-						}
-
-						v1 = 20 * sdl_scale - (v2 + v3 + v4 + v5) / 2;
-						r1 = IGET_R(sdl_light(st->ml, irgb));
-						g1 = IGET_G(sdl_light(st->ml, irgb));
-						b1 = IGET_B(sdl_light(st->ml, irgb));
-					}
-
-					div = v1 + v2 + v3 + v4 + v5;
-
-					if (div == 0) {
-						a = 0;
-						r = g = b = 0;
-					} else {
-						a = IGET_A(irgb);
-						r = (r1 * v1 + r2 * v2 + r3 * v3 + r4 * v4 + r5 * v5) / div;
-						g = (g1 * v1 + g2 * v2 + g3 * v3 + g4 * v4 + g5 * v5) / div;
-						b = (b1 * v1 + b2 * v2 + b3 * v3 + b4 * v4 + b5 * v5) / div;
-					}
-
-					irgb = IRGBA(r, g, b, a);
+			// The effects work on the whole row, see sdl_rowfx.c
+			if (st->cr || st->cg || st->cb || st->light || st->sat) {
+				sdl_rowfx_colorbalance(&fx, row, w);
+			}
+			if (st->shine) {
+				sdl_rowfx_shine(&fx, row, w);
+			}
 
-				} else {
-					irgb = sdl_light(st->ml, irgb);
-				}
+			if (st->ll != st->ml || st->rl != st->ml || st->ul != st->ml || st->dl != st->ml) {
+				sdl_rowfx_light_blend(&fx, row, w, y);
+			} else {
+				sdl_rowfx_light(&fx, ROWFX_ML, row, row, w);
+			}
 
-				if (sink) {
-					if (st->yres * sdl_scale - sink * sdl_scale < y) {
-						irgb &= 0xffffff; // zero alpha to make it transparent
+			if (sink) {
+				if (st->yres * sdl_scale - sink * sdl_scale < y) {
+					for (x = 0; x < w; x++) {
+						row[x] &= 0xffffff; // zero alpha to make it transparent
 					}
 				}
+			}
 
-				if (st->freeze) {
-					irgb = sdl_freeze(st->freeze, irgb);
-				}
-
-				st->pixel[x + y * st->xres * sdl_scale] = irgb;
+			if (st->freeze) {
+				sdl_rowfx_freeze(&fx, row, w);
 			}
 		}
+		if (scale != 100) {
+			sdl_scaler_exit(&sc);
+		}
 		uint16_t *flags_ptr = (uint16_t *)&st->flags;
 		__atomic_fetch_or(flags_ptr, SF_DIDMAKE, __ATOMIC_RELEASE);
+		// The source pixels are no longer needed for this entry
+		sdl_ic_unpin(st->sprite);
 
 #ifdef DEVELOPER
 		if (preload) {
@@ -1145,7 +1443,10 @@ void sdl_make(struct sdl_texture *st, struct sdl_image *si, int preload)
 		start = SDL_GetTicks();
 #endif
 
-		if (st->xres > 0 && st->yres > 0) {
+		if (st->xres > 0 && st->yres > 0 && !st->noatlas && sdl_atlas_place(st)) {
+			// Small sprite, st->tex is now the shared atlas page
+			texture = st->tex;
+		} else if (st->xres > 0 && st->yres > 0) {
 			texture = SDL_CreateTexture(
 			    sdlren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, st->xres * sdl_scale, st->yres * sdl_scale);
 			if (!texture) {
@@ -1155,11 +1456,15 @@ void sdl_make(struct sdl_texture *st, struct sdl_image *si, int preload)
 			}
 			SDL_UpdateTexture(texture, NULL, st->pixel, (int)(st->xres * sizeof(uint32_t) * (size_t)sdl_scale));
 			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		} else {
+			texture = NULL;
+		}
+		if (texture) {
 			// Update memory accounting when texture is actually created
 			extern long long mem_tex;
 			__atomic_add_fetch(&mem_tex, st->xres * st->yres * sizeof(uint32_t), __ATOMIC_RELAXED);
-		} else {
-			texture = NULL;
+			texc_upload++;
+			texc_upload_bytes += (long long)st->xres * st->yres * (long long)sizeof(uint32_t) * sdl_scale * sdl_scale;
 		}
 #ifdef SDL_FAST_MALLOC
 		FREE(st->pixel);
@@ -1311,3 +1616,5 @@ DLL_EXPORT uint32_t *sdl_load_png(char *filename, int *dx, int *dy)
 
 	return pixel;
 }
+
+#endif // STANDALONE
@@ -0,0 +1,292 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * SDL - Sprite Pack
+ *
+ * Reads pre-decoded sprites from a pack file made by the gfxpack helper. The
+ * pack is mapped into memory, raw sprites are used in place, LZ4 compressed
+ * ones are unpacked into a new buffer. Sprites missing from the pack are
+ * loaded from the zip archives as before.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+static uint8_t *spk_map = NULL;
+static size_t spk_size = 0;
+static struct sdl_pack_entry *spk_index = NULL;
+static uint32_t spk_count = 0;
+static int spk_sprites = 0;
+
+long long spk_hits = 0;
+
+// ============================================================================
+// Stamp
+// ============================================================================
+
+static uint64_t spk_fnv(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+static uint64_t spk_stamp_file(uint64_t h, const char *filename)
+{
+	SDL_PathInfo info;
+
+	h = spk_fnv(h, filename, strlen(filename));
+	if (SDL_GetPathInfo(filename, &info)) {
+		h = spk_fnv(h, &info.size, sizeof(info.size));
+		h = spk_fnv(h, &info.modify_time, sizeof(info.modify_time));
+	}
+	return h;
+}
+
+// Hash of the size and modification time of every graphics archive used at
+// the given scale. Changes whenever an archive is added, replaced or patched.
+uint64_t sdl_archive_stamp(int scale)
+{
+	static const char *suffix[3] = {".zip", "_patch.zip", "_mod.zip"};
+	uint64_t h = 0xcbf29ce484222325ull;
+	char filename[MAX_PATH];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		snprintf(filename, sizeof(filename), "res/gx1%s", suffix[i]);
+		h = spk_stamp_file(h, filename);
+		if (scale > 1) {
+			snprintf(filename, sizeof(filename), "res/gx%d%s", scale, suffix[i]);
+			h = spk_stamp_file(h, filename);
+		}
+	}
+
+	return h;
+}
+
+// ============================================================================
+// LZ4
+// ============================================================================
+
+static int spk_lz4_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+
+	do {
+		if (*ip >= iend) {
+			return 0;
+		}
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 1;
+}
+
+// Decode one LZ4 block (the plain block format, no frame). Returns the number
+// of bytes written to dst or 0 if the block is damaged or does not fit.
+size_t sdl_lz4_decode(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
+{
+	const uint8_t *ip = src, *iend = src + srclen;
+	uint8_t *op = dst, *oend = dst + dstlen;
+	size_t len, off;
+	unsigned int token;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		len = token >> 4;
+		if (len == 15 && !spk_lz4_length(&ip, iend, &len)) {
+			return 0;
+		}
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - op)) {
+			return 0;
+		}
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		if (ip == iend) {
+			break; // the last sequence has no match
+		}
+
+		if (iend - ip < 2) {
+			return 0;
+		}
+		off = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (!off || off > (size_t)(op - dst)) {
+			return 0;
+		}
+
+		len = (token & 15) + 4;
+		if ((token & 15) == 15 && !spk_lz4_length(&ip, iend, &len)) {
+			return 0;
+		}
+		if (len > (size_t)(oend - op)) {
+			return 0;
+		}
+		if (off >= len) {
+			memcpy(op, op - off, len);
+			op += len;
+		} else {
+			for (; len; len--, op++) { // overlapping match, repeats the last off bytes
+				*op = *(op - off);
+			}
+		}
+	}
+
+	return (size_t)(op - dst);
+}
+
+// ============================================================================
+// Public interface
+// ============================================================================
+
+// Map the pack and check it against sdl_scale and the archives. Returns 1 if
+// the pack will be used. A missing pack is not an error.
+int sdl_pack_open(const char *filename)
+{
+	const struct sdl_pack_header *head;
+	const struct sdl_pack_entry *e;
+	size_t bytes;
+	uint32_t i;
+
+	spk_map = sdl_map_file(filename, &spk_size);
+	if (!spk_map) {
+		return 0;
+	}
+	if (spk_size < sizeof(struct sdl_pack_header)) {
+		warn("Sprite pack %s: unknown format, ignoring it", filename);
+		sdl_pack_close();
+		return 0;
+	}
+
+	head = (const void *)spk_map;
+	if (head->magic != SPK_MAGIC || head->version != SPK_VERSION) {
+		warn("Sprite pack %s: unknown format, ignoring it", filename);
+		sdl_pack_close();
+		return 0;
+	}
+	if (head->scale != (uint32_t)sdl_scale) {
+		note("Sprite pack %s is for scale %u, not %d, ignoring it", filename, head->scale, sdl_scale);
+		sdl_pack_close();
+		return 0;
+	}
+	if (head->stamp != sdl_archive_stamp(sdl_scale)) {
+		note("Sprite pack %s is older than the graphics archives, ignoring it. Run gfxpack to update it.",
+		    filename);
+		sdl_pack_close();
+		return 0;
+	}
+	if (head->count > MAXSPRITE || head->index % 8 || head->index > spk_size ||
+	    (spk_size - head->index) / sizeof(struct sdl_pack_entry) < head->count) {
+		warn("Sprite pack %s: index damaged, ignoring it", filename);
+		sdl_pack_close();
+		return 0;
+	}
+
+	spk_index = (void *)(spk_map + head->index);
+	spk_count = head->count;
+
+	// Check every entry once here, so sdl_pack_image() can trust them
+	spk_sprites = 0;
+	for (i = 0; i < spk_count; i++) {
+		e = &spk_index[i];
+		if (!e->offset) {
+			continue;
+		}
+		bytes = (size_t)e->xres * e->yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale;
+		if (e->offset % 16 || e->offset > spk_size || spk_size - e->offset < e->bytes ||
+		    (!(e->flags & SPK_LZ4) && e->bytes != bytes)) {
+			warn("Sprite pack %s: entry %u damaged, ignoring the pack", filename, i);
+			sdl_pack_close();
+			return 0;
+		}
+		spk_sprites++;
+	}
+
+	note("Sprite pack %s: %d sprites, %.0fMB", filename, spk_sprites, (double)spk_size / (1024.0 * 1024.0));
+
+	return 1;
+}
+
+// Only safe once no image points into the pack any more
+void sdl_pack_close(void)
+{
+	sdl_unmap_file(spk_map, spk_size);
+	spk_map = NULL;
+	spk_size = 0;
+	spk_index = NULL;
+	spk_count = 0;
+	spk_sprites = 0;
+}
+
+int sdl_pack_sprites(void)
+{
+	return spk_sprites;
+}
+
+// Fill si with sprite from the pack. Raw pixels are used in place and si->mapped
+// is set. Returns 0 if the pack does not have the sprite.
+int sdl_pack_image(struct sdl_image *si, unsigned int sprite)
+{
+	const struct sdl_pack_entry *e;
+	uint32_t *pixel;
+	size_t bytes;
+
+	if (!spk_index || sprite >= spk_count || !spk_index[sprite].offset) {
+		return 0;
+	}
+	e = &spk_index[sprite];
+
+	if (e->flags & SPK_LZ4) {
+		bytes = (size_t)e->xres * e->yres * sizeof(uint32_t) * (size_t)sdl_scale * (size_t)sdl_scale;
+#ifdef SDL_FAST_MALLOC
+		pixel = MALLOC(bytes ? bytes : sizeof(uint32_t));
+#else
+		pixel = xmalloc(bytes ? bytes : sizeof(uint32_t), MEM_SDL_PNG);
+#endif
+		if (!pixel) {
+			return 0;
+		}
+		if (sdl_lz4_decode(spk_map + e->offset, e->bytes, (uint8_t *)pixel, bytes) != bytes) {
+			warn("Sprite pack: sprite %u damaged, loading it from the archives", sprite);
+#ifdef SDL_FAST_MALLOC
+			FREE(pixel);
+#else
+			xfree(pixel);
+#endif
+			return 0;
+		}
+		extern long long mem_png;
+		__atomic_add_fetch(&mem_png, (long long)bytes, __ATOMIC_RELAXED);
+		si->mapped = 0;
+	} else {
+		pixel = (void *)(spk_map + e->offset);
+		si->mapped = 1;
+	}
+
+	si->pixel = pixel;
+	si->flags = 1;
+	si->xres = e->xres;
+	si->yres = e->yres;
+	si->xoff = e->xoff;
+	si->yoff = e->yoff;
+
+	__atomic_add_fetch(&spk_hits, 1, __ATOMIC_RELAXED);
+
+	return 1;
+}
@@ -6,17 +6,40 @@
 #define SDL_PRIVATE_H
 
 #include <stdint.h>
-#include <zip.h>
 #include <png.h>
+#include <zlib.h>
 #include <SDL3/SDL.h>
 #include <SDL3_mixer/SDL_mixer.h>
 
 #include "../dll.h"
 
-// Fixed upper bound for the texture cache metadata.
-// Statically allocated at compile time
-#define MAX_TEXCACHE 8000
-#define MAX_TEXHASH  8000
+// Texture cache metadata is allocated at startup by sdl_texcache_init().
+// sdl_cache_size picks the number of slots and is clamped to this range.
+// How many of those slots may hold textures at once is decided by the byte
+// budget (sdl_cache_budget), not by the slot count.
+#define MIN_TEXCACHE 1000
+#define MAX_TEXCACHE 16000
+#define DEF_TEXCACHE 16000
+
+// Default texture budget in MB at scale 1, multiplied by sdl_scale^2
+#define DEF_TEXBUDGET 64
+
+// Default budget for decoded source images (sdli[]) in MB at scale 1, multiplied by sdl_scale^2
+#define DEF_IMGBUDGET 32
+
+// Decoded image state machine (sdli_state[])
+enum {
+	IMG_UNLOADED = 0,
+	IMG_LOADING = 1,
+	IMG_READY = 2,
+	IMG_FAILED = 3,
+};
+
+// Sprite atlas: small finished sprites share ATLAS_PAGE_SIZE^2 texel pages
+// instead of owning a texture each. Sizes are in texels, i.e. after sdl_scale.
+#define ATLAS_PAGE_SIZE  2048
+#define ATLAS_MAX_PAGES  4
+#define ATLAS_MAX_SPRITE 256 // larger sprites keep their own texture
 
 #define STX_NONE (-1)
 
@@ -42,9 +65,12 @@ typedef enum texture_work_state {
 } texture_work_state_t;
 
 struct sdl_texture {
-	SDL_Texture *tex;
+	SDL_Texture *tex; // own texture, or the atlas page if atlas != STX_NONE
 	uint32_t *pixel;
 
+	int8_t atlas; // atlas page holding this sprite, STX_NONE if it owns tex
+	uint16_t ax, ay; // position in the atlas page in texels, size is xres/yres * sdl_scale
+
 	int prev, next;
 	int hprev, hnext;
 
@@ -52,8 +78,8 @@ struct sdl_texture {
 
 
 	// Versioning and work state for robust job queue
-	uint32_t generation; // Incremented each time this slot is reused (eviction only)
-	// See texture_work_state_t; MUST be modified under g_tex_jobs.mutex
+	uint32_t generation; // Incremented each time this slot is reused (eviction only), atomic for workers
+	// See texture_work_state_t; only changed through work_state_cas() and work_state_store()
 	_Atomic(uint8_t) work_state;
 
 	// ---------- sprites ------------
@@ -65,6 +91,7 @@ struct sdl_texture {
 	uint16_t c1, c2, c3, shine;
 
 	uint8_t freeze;
+	uint8_t noatlas; // keep off the atlas, see sdl_get_sprite_texture()
 
 	// light
 	int8_t ml, ll, rl, ul, dl; // light in middle, left, right, up, down
@@ -85,18 +112,31 @@ struct sdl_texture {
 struct sdl_image {
 	uint32_t *pixel;
 
-	uint16_t flags;
+	uint16_t flags; // dimensions are valid, stays set when the pixels are evicted
 	uint16_t xres, yres;
 	int16_t xoff, yoff;
+	uint16_t mapped; // pixel points into the sprite pack: not in the LRU, not counted in mem_png, never freed
+
+	int prev, next; // image cache LRU, only valid while IMG_READY, guarded by premutex
+	int pins; // atomic: sdlt entries of this sprite still waiting for stage 2
 };
 
 // Texture job queue structures
-#define TEX_JOB_CAPACITY 16384 // Large enough to handle all texture cache entries
+#define TEX_JOB_CAPACITY 16384 // Per lane, large enough to handle all texture cache entries
+
+// Workers always drain TEX_LANE_NOW before looking at TEX_LANE_PREFETCH
+typedef enum texture_job_lane {
+	TEX_LANE_NOW = 0, // sprites of the next tick to be shown
+	TEX_LANE_PREFETCH, // speculative prefetch for ticks further ahead
+	TEX_LANE_COUNT
+} texture_job_lane_t;
 
 // Texture job kind - makes the job semantics explicit
 typedef enum texture_job_kind {
 	// Load from disk, allocate pixels, process effects
 	TEXTURE_JOB_MAKE_STAGES_1_2 = 0,
+	// Pixels are done, create the GPU texture (main thread, ready list only)
+	TEXTURE_JOB_UPLOAD_STAGE_3,
 	// Room for future job types (TEXTURE_JOB_FREE, TEXTURE_JOB_RELOAD, etc.)
 } texture_job_kind_t;
 
@@ -106,16 +146,32 @@ typedef struct texture_job {
 	texture_job_kind_t kind; // what operation to perform
 } texture_job_t;
 
-typedef struct texture_job_queue {
-	texture_job_t jobs[TEX_JOB_CAPACITY];
-	int head; // pop position
-	int tail; // push position
-	int count; // number of jobs in queue
+// One lane is a bounded lock-free MPMC ring (Vyukov). A cell is free for the
+// push at position pos when seq == pos, and holds a job for the pop at position
+// pos when seq == pos + 1. Positions wrap, compare them as int32_t differences.
+typedef struct texture_job_cell {
+	uint32_t seq; // atomic
+	texture_job_t job;
+} texture_job_cell_t;
+
+typedef struct texture_job_ring {
+	_Alignas(64) uint32_t enqueue_pos; // atomic, next push position
+	_Alignas(64) uint32_t dequeue_pos; // atomic, next pop position
+	_Alignas(64) texture_job_cell_t cells[TEX_JOB_CAPACITY];
+} texture_job_ring_t;
 
-	SDL_Mutex *mutex;
-	SDL_Condition *cond;
+typedef struct texture_job_queue {
+	texture_job_ring_t lane[TEX_LANE_COUNT];
+	texture_job_ring_t ready; // entries with SF_DIDMAKE waiting for sdl_pre_do() to upload them
+	int ready_overflow; // atomic: ready was full, sdl_pre_do() has to scan the cache once
+	texture_job_t ready_next; // popped from ready but did not fit the last budget, main thread only
+	int ready_has_next;
 } texture_job_queue_t;
 
+// Every slot can have at most one job queued, so each lane must fit the largest cache
+_Static_assert(MAX_TEXCACHE <= TEX_JOB_CAPACITY, "texture job queue smaller than texture cache");
+_Static_assert((TEX_JOB_CAPACITY & (TEX_JOB_CAPACITY - 1)) == 0, "texture job queue size must be a power of two");
+
 // Lock-free flag operation helpers
 // These provide consistent atomic ordering across all SDL modules
 // Must be defined after struct sdl_texture is complete
@@ -126,8 +182,8 @@ static inline uint16_t flags_load(struct sdl_texture *st)
 }
 
 // Work state load helper
-// Can be called without mutex for diagnostic reads, but any decision based on
-// the value that affects eviction or queue state MUST be done under mutex.
+// Only the render thread moves a slot out of TX_WORK_IDLE, so on the render
+// thread a load of TX_WORK_IDLE stays true until it queues a job itself.
 static inline uint8_t work_state_load(struct sdl_texture *st)
 {
 	uint8_t *state_ptr = (uint8_t *)&st->work_state;
@@ -135,14 +191,24 @@ static inline uint8_t work_state_load(struct sdl_texture *st)
 }
 
 // Work state store helper
-// Caller MUST hold g_tex_jobs.mutex.
-// Stores are always coordinated with queue state changes under the mutex.
+// Caller MUST own the slot: the render thread while it is TX_WORK_IDLE or
+// just claimed as TX_WORK_QUEUED, the worker that moved it to TX_WORK_IN_WORKER.
 static inline void work_state_store(struct sdl_texture *st, texture_work_state_t new_state)
 {
 	uint8_t *state_ptr = (uint8_t *)&st->work_state;
 	__atomic_store_n(state_ptr, (uint8_t)new_state, __ATOMIC_RELEASE);
 }
 
+// Work state transition helper
+// Returns 1 if the state was 'from' and is now 'to'. This is how ownership of a
+// slot passes between the render thread and the workers.
+static inline int work_state_cas(struct sdl_texture *st, texture_work_state_t from, texture_work_state_t to)
+{
+	uint8_t *state_ptr = (uint8_t *)&st->work_state;
+	uint8_t expected = (uint8_t)from;
+	return __atomic_compare_exchange_n(state_ptr, &expected, (uint8_t)to, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
 #ifndef HAVE_DDFONT
 #define HAVE_DDFONT
 
@@ -154,23 +220,14 @@ struct renderfont {
 
 #define RENDER_TEXT_TERMINATOR '\xB0' // draw text terminator - (zero stays one, too)
 
-struct zip_handles {
-	zip_t *zip1;
-	zip_t *zip2;
-	zip_t *zip1p;
-	zip_t *zip2p;
-	zip_t *zip1m;
-	zip_t *zip2m;
-};
-
-int sdl_ic_load(unsigned int sprite, struct zip_handles *zips);
 int sdl_pre_backgnd(void *ptr);
 int sdl_create_cursors(void);
 SDL_Cursor *sdl_create_cursor(char *filename);
 void sdl_pre_add(unsigned int sprite, signed char sink, unsigned char freeze, unsigned char scale, char cr, char cg,
-    char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl);
+    char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl,
+    int urgent);
 void sdl_lock(void *a);
-int sdl_pre_do(void);
+int sdl_pre_do(uint64_t deadline);
 
 #define MAX_SOUND_CHANNELS 32
 #define MAXSOUND           100
@@ -188,28 +245,38 @@ void png_load_helper_exit(struct png_helper *p);
 // ============================================================================
 DLL_EXPORT extern SDL_Window *sdlwnd;
 DLL_EXPORT extern SDL_Renderer *sdlren;
-extern zip_t *sdl_zip1;
-extern zip_t *sdl_zip2;
-extern zip_t *sdl_zip1p;
-extern zip_t *sdl_zip2p;
-extern zip_t *sdl_zip1m;
-extern zip_t *sdl_zip2m;
+extern struct sdl_archive *sdl_zip1;
+extern struct sdl_archive *sdl_zip2;
+extern struct sdl_archive *sdl_zip1p;
+extern struct sdl_archive *sdl_zip2p;
+extern struct sdl_archive *sdl_zip1m;
+extern struct sdl_archive *sdl_zip2m;
 extern SDL_Mutex *premutex;
 extern int *sdli_state; // Image loading state machine
 extern texture_job_queue_t g_tex_jobs; // Texture job queue
-extern int sdl_cache_size; // Requested size (for logging / config), not allocation
+extern int sdl_cache_size; // Requested number of cache slots (clamped, see MIN/MAX_TEXCACHE)
+extern int sdl_cache_budget; // Requested texture budget in MB, 0 = derive from sdl_scale
+extern int sdl_image_budget; // Requested decoded image budget in MB, 0 = derive from sdl_scale
 
 // ============================================================================
 // Shared variables from sdl_texture.c
 // ============================================================================
-extern struct sdl_texture sdlt[MAX_TEXCACHE];
+extern struct sdl_texture *sdlt;
+extern int sdlt_size;
 extern int sdlt_best, sdlt_last;
-extern int sdlt_cache[MAX_TEXHASH];
+extern int *sdlt_cache;
+extern int sdlt_hash_size;
 extern struct sdl_image *sdli;
 
 extern int texc_used;
 extern long long mem_png, mem_tex;
 extern long long texc_hit, texc_miss, texc_pre;
+extern long long texc_budget;
+extern long long texc_evict, texc_evict_budget;
+extern long long texc_upload, texc_upload_bytes;
+extern uint64_t sdl_render_wait_total;
+extern int imgc_used;
+extern long long imgc_budget, imgc_evict;
 
 extern long long sdl_time_preload;
 extern long long sdl_time_make;
@@ -223,41 +290,165 @@ extern long long sdl_time_blit;
 extern long long sdl_time_pre1;
 extern long long sdl_time_pre2;
 extern long long sdl_time_pre3;
+extern long long sdl_time_load_png, sdl_time_load_rows, sdl_time_load_trim; // ns, DEVELOPER only
 
 extern int maxpanic;
 
 // ============================================================================
 // Internal functions from sdl_texture.c
 // ============================================================================
+int sdl_texcache_init(int size);
+void sdl_texcache_exit(void);
+void sdl_texcache_set_budget(int megabytes, int scale);
+double sdl_texcache_hitrate(void);
 void sdl_tx_best(int cache_index);
 int sdl_tx_load(unsigned int sprite, signed char sink, unsigned char freeze, unsigned char scale, char cr, char cg,
     char cb, char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl,
     const char *text, int text_color, int text_flags, void *text_font, int checkonly, int preload);
 void tex_jobs_init(void);
-void tex_jobs_shutdown(void);
-int tex_jobs_pop(texture_job_t *out_job, int should_block);
+int tex_jobs_push(const texture_job_t *job, int lane);
+int tex_jobs_pop(texture_job_t *out_job);
+int tex_jobs_depth(int lane);
+void tex_ready_push(int cache_index);
+int tex_ready_pop(texture_job_t *out_job);
+int tex_ready_depth(void);
 
 #ifdef DEVELOPER
 void sdl_dump_spritecache(void);
 #endif
 
+int sdl_texcache_evict_atlas_page(int page);
+
+// ============================================================================
+// Internal functions from sdl_atlas.c
+// ============================================================================
+extern long long atlas_placed, atlas_recycled;
+
+int sdl_atlas_place(struct sdl_texture *st);
+void sdl_atlas_release(struct sdl_texture *st);
+void sdl_atlas_exit(void);
+int sdl_atlas_pages(void);
+int sdl_atlas_sprites(void);
+
 // ============================================================================
 // Internal functions from sdl_image.c
 // ============================================================================
 uint32_t mix_argb(uint32_t c1, uint32_t c2, float w1, float w2);
 void sdl_smoothify(uint32_t *pixel, int xres, int yres, int scale);
 void sdl_premulti(uint32_t *pixel, int xres, int yres, int scale);
+int sdl_png_isa(void);
+int sdl_png_row(uint32_t *dst, const uint8_t *src, int n, int bpp, int premulti, int isa, int *first);
 void png_helper_read(png_structp ps, png_bytep buf, png_size_t len);
-int sdl_load_image_png_(struct sdl_image *si, char *filename, zip_t *zip);
-int sdl_load_image_png(struct sdl_image *si, char *filename, zip_t *zip, int smoothify);
+int sdl_load_image_png_(struct sdl_image *si, char *filename, struct sdl_archive *zip, int64_t entry);
+int sdl_load_image_png(struct sdl_image *si, char *filename, struct sdl_archive *zip, int smoothify, int64_t entry);
 int do_smoothify(int sprite);
-int sdl_load_image(struct sdl_image *si, int sprite, struct zip_handles *zips);
-int sdl_ic_load(unsigned int sprite, struct zip_handles *zips);
+void sdl_zip_index_init(void);
+void sdl_zip_index_exit(void);
+int sdl_zip_index_has(unsigned int sprite);
+extern long long zip_index_saved;
+int sdl_load_image(struct sdl_image *si, int sprite);
+int sdl_ic_load(unsigned int sprite);
+void sdl_ic_pin(unsigned int sprite);
+void sdl_ic_unpin(unsigned int sprite);
+void sdl_ic_set_budget(int megabytes, int scale);
+void sdl_ic_trim(void);
+void sdl_ic_flush(void);
 void sdl_make(struct sdl_texture *st, struct sdl_image *si, int preload);
+int sdl_make_sprite(struct sdl_texture *st);
+
+// ============================================================================
+// Internal functions from sdl_diskcache.c
+// ============================================================================
+
+// Default disk cache budget in MB at scale 1, multiplied by sdl_scale^2
+#define DEF_DISKBUDGET 128
+
+extern int sdl_disk_budget; // Requested disk cache size in MB, 0 = derive from sdl_scale, <0 = off
+extern long long dc_hits, dc_misses, dc_stores, dc_full;
+
+int sdl_dc_init(const char *filename, long long budget);
+void sdl_dc_exit(void);
+int sdl_dc_load(struct sdl_texture *st);
+void sdl_dc_store(struct sdl_texture *st);
+
+// ============================================================================
+// Internal functions from sdl_archive.c
+// ============================================================================
+
+// One reader of an archive entry. The archive itself is shared by all threads,
+// each thread reads through its own sdl_archive_file.
+struct sdl_archive_file {
+	uint8_t *src; // next byte not yet handed to zs, in the read only mapping
+	uint64_t csize; // compressed bytes left
+	uint64_t left; // uncompressed bytes left
+	int method;
+	z_stream zs;
+};
+
+struct sdl_archive;
+
+void *sdl_map_file(const char *filename, size_t *size);
+void sdl_unmap_file(void *map, size_t size);
+struct sdl_archive *sdl_archive_open(const char *filename);
+void sdl_archive_close(struct sdl_archive *za);
+int64_t sdl_archive_entries(const struct sdl_archive *za);
+const char *sdl_archive_name(const struct sdl_archive *za, int64_t entry);
+int64_t sdl_archive_size(const struct sdl_archive *za, int64_t entry);
+int64_t sdl_archive_locate(const struct sdl_archive *za, const char *name);
+int sdl_archive_fopen(struct sdl_archive_file *zf, const struct sdl_archive *za, int64_t entry);
+int64_t sdl_archive_fread(struct sdl_archive_file *zf, void *buf, size_t len);
+void sdl_archive_fclose(struct sdl_archive_file *zf);
+
+// ============================================================================
+// Internal functions from sdl_pack.c
+// ============================================================================
+
+// A sprite pack (res/gx<scale>.pack, made by the gfxpack helper) holds the
+// output of sdl_load_image() for every sprite in the archives at one scale:
+// trimmed, scaled and premultiplied, raw or LZ4 compressed. The header is
+// followed by a dense index of count entries, one per sprite number.
+#define SPK_MAGIC   0x4b505341 // "ASPK"
+#define SPK_VERSION 1
+
+#define SPK_LZ4 1 // entry flag: pixels are a single LZ4 block
+
+struct sdl_pack_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t scale;
+	uint32_t count; // index entries, sprite numbers 0 to count-1
+	uint64_t stamp; // sdl_archive_stamp() of the archives the pack was made from
+	uint64_t index; // file offset of the index
+};
+
+struct sdl_pack_entry {
+	uint64_t offset; // file offset of the pixels, 16 byte aligned, 0 if the sprite is not in the pack
+	uint32_t bytes; // stored size of the pixels
+	uint16_t xres, yres; // as in struct sdl_image, the pixels are xres*scale by yres*scale
+	int16_t xoff, yoff;
+	uint16_t flags;
+	uint16_t pad;
+};
+
+extern long long spk_hits;
+
+uint64_t sdl_archive_stamp(int scale);
+int sdl_pack_open(const char *filename);
+void sdl_pack_close(void);
+int sdl_pack_sprites(void);
+int sdl_pack_image(struct sdl_image *si, unsigned int sprite);
+size_t sdl_lz4_decode(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen);
+
+// ============================================================================
+// Internal functions from sdl_stats.c
+// ============================================================================
+void sdl_stats_reset(void);
 
 // ============================================================================
 // Internal functions from sdl_effects.c
 // ============================================================================
+void sdl_light_init(void);
+const uint8_t *sdl_light_table(int light);
 uint32_t sdl_light(int light, uint32_t irgb);
 uint32_t sdl_freeze(int freeze, uint32_t irgb);
 uint32_t sdl_shine_pix(uint32_t irgb, unsigned short shine);
@@ -266,10 +457,80 @@ uint32_t sdl_colorize_pix2(uint32_t irgb, unsigned short c1v, unsigned short c2v
     int xres, int yres, uint32_t *pixel, int sprite);
 uint32_t sdl_colorbalance(uint32_t irgb, char cr, char cg, char cb, char light, char sat);
 
+// ============================================================================
+// Internal functions from sdl_rowfx.c
+// ============================================================================
+#define ROWFX_SCALAR 0
+#define ROWFX_SSE2   1
+#define ROWFX_AVX2   2
+#define ROWFX_NEON   3
+
+// Light numbers, in the order of the fields in struct sdl_texture
+#define ROWFX_ML     0
+#define ROWFX_LL     1
+#define ROWFX_RL     2
+#define ROWFX_UL     3
+#define ROWFX_DL     4
+#define ROWFX_LIGHTS 5
+
+// Effect parameters of one sdl_make() call, prepared once per sprite
+struct sdl_rowfx {
+	int isa; // ROWFX_*, may be lowered by tests
+
+	char cr, cg, cb, light, sat;
+	int dr, dg, db; // color balance shift per channel
+
+	unsigned short shine;
+	int shine_lut;
+	uint8_t shine_tab[256];
+
+	int8_t lights[ROWFX_LIGHTS];
+	uint8_t light_kind[ROWFX_LIGHTS];
+	const uint8_t *light_tab[ROWFX_LIGHTS]; // from sdl_light_table()
+
+	int freeze;
+	uint32_t freeze_add;
+};
+
+int sdl_rowfx_isa(void);
+void sdl_rowfx_prepare(struct sdl_rowfx *fx, const struct sdl_texture *st, int npix);
+void sdl_rowfx_colorbalance(const struct sdl_rowfx *fx, uint32_t *row, int n);
+void sdl_rowfx_shine(const struct sdl_rowfx *fx, uint32_t *row, int n);
+void sdl_rowfx_light(const struct sdl_rowfx *fx, int which, const uint32_t *src, uint32_t *dst, int n);
+void sdl_light_weights(int x, int y, int v[ROWFX_LIGHTS]);
+void sdl_rowfx_light_blend(const struct sdl_rowfx *fx, uint32_t *row, int n, int y);
+void sdl_rowfx_freeze(const struct sdl_rowfx *fx, uint32_t *row, int n);
+
+// Fixed point bilinear scaler for sprites with scale != 100
+struct sdl_scale_tap {
+	int p0, p1; // source columns
+	uint32_t frac; // weight of p1, 16 bit fraction
+};
+
+struct sdl_scaler {
+	const uint32_t *src; // si->pixel, or colorized
+	uint32_t *colorized; // colorized copy of the source, if c1/c2/c3 are set
+	int sw, sh, scale;
+	struct sdl_scale_tap *xt; // one per output column
+	uint32_t *tmp; // vertical pass, 4 channels per source column
+};
+
+void sdl_scaler_init(struct sdl_scaler *sc, const struct sdl_texture *st, const struct sdl_image *si, int scale);
+void sdl_scaler_row(const struct sdl_scaler *sc, int y, uint32_t *row, int w);
+void sdl_scaler_exit(struct sdl_scaler *sc);
+uint32_t sdl_rowfx_scale_pixel_ref(const struct sdl_texture *st, const struct sdl_image *si, int scale, int x, int y);
+
 // ============================================================================
 // Internal functions from sdl_draw.c
 // ============================================================================
+extern long long sdl_batch_quads, sdl_batch_calls;
+
+extern long long glyph_quads;
+
 SDL_Texture *sdl_maketext(const char *text, struct renderfont *font, uint32_t color, int flags);
+void sdl_batch_flush_tex(SDL_Texture *tex);
+void sdl_glyph_exit(void);
+int sdl_glyph_fonts(void);
 
 // ============================================================================
 // Internal functions from sdl_core.c
@@ -295,6 +556,9 @@ int sdl_test_get_render_geometry_count(void);
 int sdl_test_get_render_total_count(void);
 int sdl_test_get_set_draw_color_count(void);
 int sdl_test_get_set_blend_mode_count(void);
+int sdl_test_get_render_texture_count(void);
+int sdl_test_get_texture_switch_count(void);
+int sdl_test_get_render_quad_count(void);
 
 // Initialize SDL subsystems for testing without window/audio/real I/O
 int sdl_init_for_tests(void);
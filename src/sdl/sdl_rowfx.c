@@ -0,0 +1,854 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * SDL - Row Effects Module
+ *
+ * Row kernels for sdl_make() stage 2: the bilinear scaler and the pixel
+ * effects color balance, shine, light and freeze. The effect kernels work on
+ * a whole row of finished pixels and give exactly the same result as the per
+ * pixel functions in sdl_effects.c, which stay the reference.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <SDL3/SDL.h>
+
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ROWFX_HAVE_SSE2
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define ROWFX_HAVE_AVX2
+#define ROWFX_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// NEON needs vdivq_f32 for the saturation divide, which only AArch64 has
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ROWFX_HAVE_NEON
+#endif
+
+#define RENDERFX_MAX_FREEZE 8
+
+// Below this many pixels building the shine table costs more than it saves
+#define ROWFX_LUT_MIN_PIXELS 256
+
+// Chunk size for the five way light blend
+#define ROWFX_CHUNK 64
+
+enum { ROWFX_LIGHT_MUL, ROWFX_LIGHT_LUT, ROWFX_LIGHT_PIXEL };
+
+static int rowfx_best = -1;
+
+// Best kernel set for this CPU. AVX2 is only a runtime option, the build
+// does not assume it.
+int sdl_rowfx_isa(void)
+{
+	int isa = __atomic_load_n(&rowfx_best, __ATOMIC_RELAXED);
+
+	if (isa >= 0) {
+		return isa;
+	}
+
+	isa = ROWFX_SCALAR;
+#ifdef ROWFX_HAVE_SSE2
+	isa = ROWFX_SSE2;
+#ifdef ROWFX_HAVE_AVX2
+	if (SDL_HasAVX2()) {
+		isa = ROWFX_AVX2;
+	}
+#endif
+#endif
+#ifdef ROWFX_HAVE_NEON
+	isa = ROWFX_NEON;
+#endif
+
+	__atomic_store_n(&rowfx_best, isa, __ATOMIC_RELAXED);
+
+	return isa;
+}
+
+void sdl_rowfx_prepare(struct sdl_rowfx *fx, const struct sdl_texture *st, int npix)
+{
+	int i, v;
+	char cr, cg, cb;
+
+	fx->isa = sdl_rowfx_isa();
+
+	// color balance, same conversions as sdl_colorbalance()
+	fx->cr = (char)st->cr;
+	fx->cg = (char)st->cg;
+	fx->cb = (char)st->cb;
+	fx->light = (char)st->light;
+	fx->sat = (char)st->sat;
+
+	cr = (char)((double)fx->cr * 0.75);
+	cg = (char)((double)fx->cg * 0.75);
+	cb = (char)((double)fx->cb * 0.75);
+	fx->dr = cr - cg / 2 - cb / 2;
+	fx->dg = cg - cr / 2 - cb / 2;
+	fx->db = cb - cr / 2 - cg / 2;
+
+	// shine works on each channel alone, so a table of one channel is exact
+	fx->shine = st->shine;
+	fx->shine_lut = st->shine && st->shine <= 100 && npix >= ROWFX_LUT_MIN_PIXELS;
+	if (fx->shine_lut) {
+		for (v = 0; v < 256; v++) {
+			fx->shine_tab[v] = (uint8_t)IGET_R(sdl_shine_pix(IRGBA(v, 0, 0, 0), st->shine));
+		}
+	}
+
+	// light: the multiply kernel for the plain mode, the light tables for the
+	// GO_LIGHTER modes and the per pixel function for anything outside of 0...15
+	fx->lights[ROWFX_ML] = st->ml;
+	fx->lights[ROWFX_LL] = st->ll;
+	fx->lights[ROWFX_RL] = st->rl;
+	fx->lights[ROWFX_UL] = st->ul;
+	fx->lights[ROWFX_DL] = st->dl;
+	for (i = 0; i < ROWFX_LIGHTS; i++) {
+		fx->light_tab[i] = sdl_light_table(fx->lights[i]);
+		if (!fx->light_tab[i]) {
+			fx->light_kind[i] = ROWFX_LIGHT_PIXEL;
+		} else if (!(game_options & (GO_LIGHTER | GO_LIGHTER2))) {
+			fx->light_kind[i] = ROWFX_LIGHT_MUL;
+		} else {
+			fx->light_kind[i] = ROWFX_LIGHT_LUT;
+		}
+	}
+
+	// freeze: min(255, c + k) for each channel is a saturating byte add of k
+	fx->freeze = st->freeze;
+	fx->freeze_add = IRGBA(min(255, 255 * st->freeze / (3 * RENDERFX_MAX_FREEZE - 1)),
+	    min(255, 255 * st->freeze / (3 * RENDERFX_MAX_FREEZE - 1)),
+	    min(255, 255 * 3 * st->freeze / (3 * RENDERFX_MAX_FREEZE - 1)), 0);
+}
+
+// ============================================================================
+// Color balance
+// ============================================================================
+//
+// All channels go through the same steps as sdl_colorbalance(). The two
+// divisions of the saturation step are done in float and truncated: both
+// sides are integers well below 2^24, so the quotient truncates to the same
+// value as the integer division, including for negative values.
+
+#ifdef ROWFX_HAVE_SSE2
+static inline __m128i sse2_max0(__m128i v)
+{
+	return _mm_and_si128(v, _mm_cmpgt_epi32(v, _mm_setzero_si128()));
+}
+
+// Amount by which v is above 255, or 0
+static inline __m128i sse2_over(__m128i v)
+{
+	return sse2_max0(_mm_sub_epi32(v, _mm_set1_epi32(255)));
+}
+
+static inline __m128i sse2_satdiv(__m128i v, __m128i grey, __m128 keep, __m128 sat)
+{
+	__m128 f = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), keep), _mm_mul_ps(_mm_cvtepi32_ps(grey), sat));
+
+	return _mm_cvttps_epi32(_mm_div_ps(f, _mm_set1_ps(20.0f)));
+}
+
+static void sse2_colorbalance(const struct sdl_rowfx *fx, uint32_t *row, int n)
+{
+	const __m128i m8 = _mm_set1_epi32(0xff), ma = _mm_set1_epi32((int)0xff000000);
+	const __m128i lt = _mm_set1_epi32(fx->light);
+	const __m128i dr = _mm_set1_epi32(fx->dr), dg = _mm_set1_epi32(fx->dg), db = _mm_set1_epi32(fx->db);
+	const __m128 keep = _mm_set1_ps((float)(20 - fx->sat)), sat = _mm_set1_ps((float)fx->sat);
+	__m128i p, r, g, b, e, grey;
+	int x;
+
+	for (x = 0; x + 4 <= n; x += 4) {
+		p = _mm_loadu_si128((const __m128i *)(row + x));
+		r = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(p, 16), m8), lt);
+		g = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(p, 8), m8), lt);
+		b = _mm_add_epi32(_mm_and_si128(p, m8), lt);
+
+		if (fx->sat) {
+			grey = _mm_cvttps_epi32(
+			    _mm_div_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(r, g), b)), _mm_set1_ps(3.0f)));
+			r = sse2_satdiv(r, grey, keep, sat);
+			g = sse2_satdiv(g, grey, keep, sat);
+			b = sse2_satdiv(b, grey, keep, sat);
+		}
+
+		r = sse2_max0(_mm_add_epi32(r, dr));
+		g = sse2_max0(_mm_add_epi32(g, dg));
+		b = sse2_max0(_mm_add_epi32(b, db));
+
+		e = sse2_over(r);
+		r = _mm_sub_epi32(r, e);
+		e = _mm_srai_epi32(e, 1);
+		g = _mm_add_epi32(g, e);
+		b = _mm_add_epi32(b, e);
+
+		e = sse2_over(g);
+		g = _mm_sub_epi32(g, e);
+		e = _mm_srai_epi32(e, 1);
+		r = _mm_add_epi32(r, e);
+		b = _mm_add_epi32(b, e);
+
+		e = sse2_over(b);
+		b = _mm_sub_epi32(b, e);
+		e = _mm_srai_epi32(e, 1);
+		r = _mm_add_epi32(r, e);
+		g = _mm_add_epi32(g, e);
+
+		r = _mm_sub_epi32(r, sse2_over(r));
+		g = _mm_sub_epi32(g, sse2_over(g));
+
+		p = _mm_or_si128(_mm_and_si128(p, ma),
+		    _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b));
+		_mm_storeu_si128((__m128i *)(row + x), p);
+	}
+	for (; x < n; x++) {
+		row[x] = sdl_colorbalance(row[x], fx->cr, fx->cg, fx->cb, fx->light, fx->sat);
+	}
+}
+#endif
+
+#ifdef ROWFX_HAVE_AVX2
+static inline ROWFX_AVX2_TARGET __m256i avx2_over(__m256i v)
+{
+	return _mm256_max_epi32(_mm256_sub_epi32(v, _mm256_set1_epi32(255)), _mm256_setzero_si256());
+}
+
+static inline ROWFX_AVX2_TARGET __m256i avx2_satdiv(__m256i v, __m256i grey, __m256 keep, __m256 sat)
+{
+	__m256 f = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), keep), _mm256_mul_ps(_mm256_cvtepi32_ps(grey), sat));
+
+	return _mm256_cvttps_epi32(_mm256_div_ps(f, _mm256_set1_ps(20.0f)));
+}
+
+static ROWFX_AVX2_TARGET void avx2_colorbalance(const struct sdl_rowfx *fx, uint32_t *row, int n)
+{
+	const __m256i m8 = _mm256_set1_epi32(0xff), ma = _mm256_set1_epi32((int)0xff000000);
+	const __m256i zero = _mm256_setzero_si256(), lt = _mm256_set1_epi32(fx->light);
+	const __m256i dr = _mm256_set1_epi32(fx->dr), dg = _mm256_set1_epi32(fx->dg), db = _mm256_set1_epi32(fx->db);
+	const __m256 keep = _mm256_set1_ps((float)(20 - fx->sat)), sat = _mm256_set1_ps((float)fx->sat);
+	__m256i p, r, g, b, e, grey;
+	int x;
+
+	for (x = 0; x + 8 <= n; x += 8) {
+		p = _mm256_loadu_si256((const __m256i *)(row + x));
+		r = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(p, 16), m8), lt);
+		g = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(p, 8), m8), lt);
+		b = _mm256_add_epi32(_mm256_and_si256(p, m8), lt);
+
+		if (fx->sat) {
+			grey = _mm256_cvttps_epi32(
+			    _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(r, g), b)), _mm256_set1_ps(3.0f)));
+			r = avx2_satdiv(r, grey, keep, sat);
+			g = avx2_satdiv(g, grey, keep, sat);
+			b = avx2_satdiv(b, grey, keep, sat);
+		}
+
+		r = _mm256_max_epi32(_mm256_add_epi32(r, dr), zero);
+		g = _mm256_max_epi32(_mm256_add_epi32(g, dg), zero);
+		b = _mm256_max_epi32(_mm256_add_epi32(b, db), zero);
+
+		e = avx2_over(r);
+		r = _mm256_sub_epi32(r, e);
+		e = _mm256_srai_epi32(e, 1);
+		g = _mm256_add_epi32(g, e);
+		b = _mm256_add_epi32(b, e);
+
+		e = avx2_over(g);
+		g = _mm256_sub_epi32(g, e);
+		e = _mm256_srai_epi32(e, 1);
+		r = _mm256_add_epi32(r, e);
+		b = _mm256_add_epi32(b, e);
+
+		e = avx2_over(b);
+		b = _mm256_sub_epi32(b, e);
+		e = _mm256_srai_epi32(e, 1);
+		r = _mm256_add_epi32(r, e);
+		g = _mm256_add_epi32(g, e);
+
+		r = _mm256_min_epi32(r, _mm256_set1_epi32(255));
+		g = _mm256_min_epi32(g, _mm256_set1_epi32(255));
+
+		p = _mm256_or_si256(_mm256_and_si256(p, ma),
+		    _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(g, 8)), b));
+		_mm256_storeu_si256((__m256i *)(row + x), p);
+	}
+	for (; x < n; x++) {
+		row[x] = sdl_colorbalance(row[x], fx->cr, fx->cg, fx->cb, fx->light, fx->sat);
+	}
+}
+#endif
+
+#ifdef ROWFX_HAVE_NEON
+static inline int32x4_t neon_over(int32x4_t v)
+{
+	return vmaxq_s32(vsubq_s32(v, vdupq_n_s32(255)), vdupq_n_s32(0));
+}
+
+static inline int32x4_t neon_satdiv(int32x4_t v, int32x4_t grey, float32x4_t keep, float32x4_t sat)
+{
+	float32x4_t f = vaddq_f32(vmulq_f32(vcvtq_f32_s32(v), keep), vmulq_f32(vcvtq_f32_s32(grey), sat));
+
+	return vcvtq_s32_f32(vdivq_f32(f, vdupq_n_f32(20.0f)));
+}
+
+static void neon_colorbalance(const struct sdl_rowfx *fx, uint32_t *row, int n)
+{
+	const uint32x4_t m8 = vdupq_n_u32(0xff), ma = vdupq_n_u32(0xff000000);
+	const int32x4_t zero = vdupq_n_s32(0), lt = vdupq_n_s32(fx->light);
+	const int32x4_t dr = vdupq_n_s32(fx->dr), dg = vdupq_n_s32(fx->dg), db = vdupq_n_s32(fx->db);
+	const float32x4_t keep = vdupq_n_f32((float)(20 - fx->sat)), sat = vdupq_n_f32((float)fx->sat);
+	uint32x4_t p;
+	int32x4_t r, g, b, e, grey;
+	int x;
+
+	for (x = 0; x + 4 <= n; x += 4) {
+		p = vld1q_u32(row + x);
+		r = vaddq_s32(vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(p, 16), m8)), lt);
+		g = vaddq_s32(vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(p, 8), m8)), lt);
+		b = vaddq_s32(vreinterpretq_s32_u32(vandq_u32(p, m8)), lt);
+
+		if (fx->sat) {
+			grey = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(vaddq_s32(vaddq_s32(r, g), b)), vdupq_n_f32(3.0f)));
+			r = neon_satdiv(r, grey, keep, sat);
+			g = neon_satdiv(g, grey, keep, sat);
+			b = neon_satdiv(b, grey, keep, sat);
+		}
+
+		r = vmaxq_s32(vaddq_s32(r, dr), zero);
+		g = vmaxq_s32(vaddq_s32(g, dg), zero);
+		b = vmaxq_s32(vaddq_s32(b, db), zero);
+
+		e = neon_over(r);
+		r = vsubq_s32(r, e);
+		e = vshrq_n_s32(e, 1);
+		g = vaddq_s32(g, e);
+		b = vaddq_s32(b, e);
+
+		e = neon_over(g);
+		g = vsubq_s32(g, e);
+		e = vshrq_n_s32(e, 1);
+		r = vaddq_s32(r, e);
+		b = vaddq_s32(b, e);
+
+		e = neon_over(b);
+		b = vsubq_s32(b, e);
+		e = vshrq_n_s32(e, 1);
+		r = vaddq_s32(r, e);
+		g = vaddq_s32(g, e);
+
+		r = vminq_s32(r, vdupq_n_s32(255));
+		g = vminq_s32(g, vdupq_n_s32(255));
+
+		p = vorrq_u32(vandq_u32(p, ma),
+		    vorrq_u32(vorrq_u32(vshlq_n_u32(vreinterpretq_u32_s32(r), 16), vshlq_n_u32(vreinterpretq_u32_s32(g), 8)),
+		        vreinterpretq_u32_s32(b)));
+		vst1q_u32(row + x, p);
+	}
+	for (; x < n; x++) {
+		row[x] = sdl_colorbalance(row[x], fx->cr, fx->cg, fx->cb, fx->light, fx->sat);
+	}
+}
+#endif
+
+void sdl_rowfx_colorbalance(const struct sdl_rowfx *fx, uint32_t *row, int n)
+{
+	int x;
+
+	switch (fx->isa) {
+#ifdef ROWFX_HAVE_SSE2
+	case ROWFX_SSE2:
+		sse2_colorbalance(fx, row, n);
+		return;
+#endif
+#ifdef ROWFX_HAVE_AVX2
+	case ROWFX_AVX2:
+		avx2_colorbalance(fx, row, n);
+		return;
+#endif
+#ifdef ROWFX_HAVE_NEON
+	case ROWFX_NEON:
+		neon_colorbalance(fx, row, n);
+		return;
+#endif
+	default:
+		for (x = 0; x < n; x++) {
+			row[x] = sdl_colorbalance(row[x], fx->cr, fx->cg, fx->cb, fx->light, fx->sat);
+		}
+		return;
+	}
+}
+
+// ============================================================================
+// Shine
+// ============================================================================
+//
+// sdl_shine_pix() is double math with a fourth power. Redoing that in float
+// vectors would round differently, so the row kernel looks each channel up in
+// a table made by sdl_shine_pix() itself.
+
+void sdl_rowfx_shine(const struct sdl_rowfx *fx, uint32_t *row, int n)
+{
+	uint32_t irgb;
+	int x;
+
+	if (!fx->shine_lut) {
+		for (x = 0; x < n; x++) {
+			row[x] = sdl_shine_pix(row[x], fx->shine);
+		}
+		return;
+	}
+
+	for (x = 0; x < n; x++) {
+		irgb = row[x];
+		row[x] = IRGBA(fx->shine_tab[IGET_R(irgb)], fx->shine_tab[IGET_G(irgb)], fx->shine_tab[IGET_B(irgb)],
+		    IGET_A(irgb));
+	}
+}
+
+// ============================================================================
+// Light
+// ============================================================================
+//
+// Plain mode is c * light / 15 per channel, or min(255, c * 2 + 4) for light
+// 0. For c * light <= 3825 the division by 15 is exactly (c * light * 0x8889)
+// >> 19, which fits the 16 bit multiply-high instructions.
+
+#ifdef ROWFX_HAVE_SSE2
+static void sse2_light(int light, const uint32_t *src, uint32_t *dst, int n)
+{
+	const __m128i zero = _mm_setzero_si128(), mrgb = _mm_set1_epi32(0x00ffffff), ma = _mm_set1_epi32((int)0xff000000);
+	const __m128i four = _mm_set1_epi32(0x00040404), mul = _mm_set1_epi16((short)light);
+	const __m128i div = _mm_set1_epi16((short)0x8889);
+	__m128i p, lo, hi;
+	int x;
+
+	for (x = 0; x + 4 <= n; x += 4) {
+		p = _mm_loadu_si128((const __m128i *)(src + x));
+		if (light == 0) {
+			p = _mm_adds_epu8(_mm_adds_epu8(p, _mm_and_si128(p, mrgb)), four);
+		} else {
+			lo = _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), mul), div), 3);
+			hi = _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), mul), div), 3);
+			p = _mm_or_si128(_mm_and_si128(_mm_packus_epi16(lo, hi), mrgb), _mm_and_si128(p, ma));
+		}
+		_mm_storeu_si128((__m128i *)(dst + x), p);
+	}
+	for (; x < n; x++) {
+		dst[x] = sdl_light(light, src[x]);
+	}
+}
+#endif
+
+#ifdef ROWFX_HAVE_AVX2
+static ROWFX_AVX2_TARGET void avx2_light(int light, const uint32_t *src, uint32_t *dst, int n)
+{
+	const __m256i zero = _mm256_setzero_si256(), mrgb = _mm256_set1_epi32(0x00ffffff);
+	const __m256i ma = _mm256_set1_epi32((int)0xff000000), four = _mm256_set1_epi32(0x00040404);
+	const __m256i mul = _mm256_set1_epi16((short)light), div = _mm256_set1_epi16((short)0x8889);
+	__m256i p, lo, hi;
+	int x;
+
+	for (x = 0; x + 8 <= n; x += 8) {
+		p = _mm256_loadu_si256((const __m256i *)(src + x));
+		if (light == 0) {
+			p = _mm256_adds_epu8(_mm256_adds_epu8(p, _mm256_and_si256(p, mrgb)), four);
+		} else {
+			// unpack and pack both work within 128 bit lanes, so the order survives
+			lo = _mm256_srli_epi16(
+			    _mm256_mulhi_epu16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p, zero), mul), div), 3);
+			hi = _mm256_srli_epi16(
+			    _mm256_mulhi_epu16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p, zero), mul), div), 3);
+			p = _mm256_or_si256(_mm256_and_si256(_mm256_packus_epi16(lo, hi), mrgb), _mm256_and_si256(p, ma));
+		}
+		_mm256_storeu_si256((__m256i *)(dst + x), p);
+	}
+	for (; x < n; x++) {
+		dst[x] = sdl_light(light, src[x]);
+	}
+}
+#endif
+
+#ifdef ROWFX_HAVE_NEON
+static inline uint16x8_t neon_div15(uint16x8_t v)
+{
+	uint32x4_t lo = vmull_u16(vget_low_u16(v), vdup_n_u16(0x8889));
+	uint32x4_t hi = vmull_u16(vget_high_u16(v), vdup_n_u16(0x8889));
+
+	return vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+}
+
+static void neon_light(int light, const uint32_t *src, uint32_t *dst, int n)
+{
+	const uint8x16_t mrgb = vreinterpretq_u8_u32(vdupq_n_u32(0x00ffffff));
+	const uint8x16_t four = vreinterpretq_u8_u32(vdupq_n_u32(0x00040404));
+	const uint8x8_t mul = vdup_n_u8((uint8_t)light);
+	uint8x16_t p;
+	uint16x8_t lo, hi;
+	int x;
+
+	for (x = 0; x + 4 <= n; x += 4) {
+		p = vreinterpretq_u8_u32(vld1q_u32(src + x));
+		if (light == 0) {
+			p = vqaddq_u8(vqaddq_u8(p, vandq_u8(p, mrgb)), four);
+		} else {
+			lo = vshrq_n_u16(neon_div15(vmull_u8(vget_low_u8(p), mul)), 3);
+			hi = vshrq_n_u16(neon_div15(vmull_u8(vget_high_u8(p), mul)), 3);
+			p = vbslq_u8(mrgb, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)), p);
+		}
+		vst1q_u32(dst + x, vreinterpretq_u32_u8(p));
+	}
+	for (; x < n; x++) {
+		dst[x] = sdl_light(light, src[x]);
+	}
+}
+#endif
+
+// Light n pixels of src into dst with light number which (ROWFX_ML...).
+// src and dst may be the same row.
+void sdl_rowfx_light(const struct sdl_rowfx *fx, int which, const uint32_t *src, uint32_t *dst, int n)
+{
+	const uint8_t *tab = fx->light_tab[which];
+	int light = fx->lights[which], x;
+	uint32_t irgb;
+
+	switch (fx->light_kind[which]) {
+	case ROWFX_LIGHT_MUL:
+		switch (fx->isa) {
+#ifdef ROWFX_HAVE_SSE2
+		case ROWFX_SSE2:
+			sse2_light(light, src, dst, n);
+			return;
+#endif
+#ifdef ROWFX_HAVE_AVX2
+		case ROWFX_AVX2:
+			avx2_light(light, src, dst, n);
+			return;
+#endif
+#ifdef ROWFX_HAVE_NEON
+		case ROWFX_NEON:
+			neon_light(light, src, dst, n);
+			return;
+#endif
+		default:
+			break;
+		}
+		break;
+	case ROWFX_LIGHT_LUT:
+		for (x = 0; x < n; x++) {
+			irgb = src[x];
+			dst[x] = IRGBA(tab[IGET_R(irgb)], tab[IGET_G(irgb)], tab[IGET_B(irgb)], IGET_A(irgb));
+		}
+		return;
+	default:
+		break;
+	}
+
+	for (x = 0; x < n; x++) {
+		dst[x] = sdl_light(light, src[x]);
+	}
+}
+
+// Weights of the five lights (ROWFX_ML..ROWFX_DL) at pixel x, y of a floor or
+// wall tile. These are the weights of the old per pixel code in sdl_make(). A
+// light whose weight is zero does not contribute to the pixel.
+void sdl_light_weights(int x, int y, int v[ROWFX_LIGHTS])
+{
+	int s = sdl_scale;
+
+	if (y < 10 * s + (20 * s - abs(20 * s - x)) / 2) {
+		// This part calculates a floor tile, or the top of a wall tile
+		v[ROWFX_LL] = x / 2 < 20 * s - y ? -(x / 2 - (20 * s - y)) : 0;
+		v[ROWFX_RL] = x / 2 > 20 * s - y ? x / 2 - (20 * s - y) : 0;
+		v[ROWFX_UL] = x / 2 > y ? x / 2 - y : 0;
+		v[ROWFX_DL] = x / 2 < y ? -(x / 2 - y) : 0;
+		v[ROWFX_ML] = 20 * s - (v[ROWFX_LL] + v[ROWFX_RL] + v[ROWFX_UL] + v[ROWFX_DL]);
+	} else {
+		// This is for the lower part (left side and front as seen on the screen)
+		v[ROWFX_LL] = x < 10 * s ? (10 * s - x) * 2 - 2 : 0;
+		v[ROWFX_RL] = x > 10 * s && x < 20 * s ? (x - 10 * s) * 2 - 2 : 0;
+		v[ROWFX_DL] = x > 20 * s && x < 30 * s ? (10 * s - (x - 20 * s)) * 2 - 2 : 0;
+		v[ROWFX_UL] = x > 30 * s && x < 40 * s ? (x - 30 * s) * 2 - 2 : 0;
+		v[ROWFX_ML] = 20 * s - (v[ROWFX_LL] + v[ROWFX_RL] + v[ROWFX_UL] + v[ROWFX_DL]) / 2;
+	}
+}
+
+// The five way light blend of floor and wall tiles for row y. The weights come
+// from sdl_light_weights(), the five lit versions of each pixel from the row
+// kernel.
+void sdl_rowfx_light_blend(const struct sdl_rowfx *fx, uint32_t *row, int n, int y)
+{
+	uint32_t lit[ROWFX_LIGHTS][ROWFX_CHUNK];
+	int x0, x, i, l, cnt;
+
+	for (x0 = 0; x0 < n; x0 += ROWFX_CHUNK) {
+		cnt = min(ROWFX_CHUNK, n - x0);
+		for (l = 0; l < ROWFX_LIGHTS; l++) {
+			sdl_rowfx_light(fx, l, row + x0, lit[l], cnt);
+		}
+
+		for (i = 0; i < cnt; i++) {
+			int r = 0, g = 0, b = 0, a = 0;
+			int v[ROWFX_LIGHTS];
+			int div = 0;
+
+			x = x0 + i;
+			sdl_light_weights(x, y, v);
+
+			for (l = 0; l < ROWFX_LIGHTS; l++) {
+				div += v[l];
+				r += (int)IGET_R(lit[l][i]) * v[l];
+				g += (int)IGET_G(lit[l][i]) * v[l];
+				b += (int)IGET_B(lit[l][i]) * v[l];
+			}
+
+			if (div == 0) {
+				r = g = b = 0;
+			} else {
+				a = (int)IGET_A(row[x]);
+				r /= div;
+				g /= div;
+				b /= div;
+			}
+
+			row[x] = IRGBA(r, g, b, a);
+		}
+	}
+}
+
+// ============================================================================
+// Freeze
+// ============================================================================
+
+void sdl_rowfx_freeze(const struct sdl_rowfx *fx, uint32_t *row, int n)
+{
+	int x = 0;
+
+	switch (fx->isa) {
+#ifdef ROWFX_HAVE_SSE2
+	case ROWFX_SSE2:
+	case ROWFX_AVX2: { // one add per pixel is memory bound, SSE2 is plenty
+		const __m128i add = _mm_set1_epi32((int)fx->freeze_add);
+		for (; x + 4 <= n; x += 4) {
+			_mm_storeu_si128(
+			    (__m128i *)(row + x), _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(row + x)), add));
+		}
+		break;
+	}
+#endif
+#ifdef ROWFX_HAVE_NEON
+	case ROWFX_NEON: {
+		const uint8x16_t add = vreinterpretq_u8_u32(vdupq_n_u32(fx->freeze_add));
+		for (; x + 4 <= n; x += 4) {
+			vst1q_u32(row + x, vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(vld1q_u32(row + x)), add)));
+		}
+		break;
+	}
+#endif
+	default:
+		break;
+	}
+
+	for (; x < n; x++) {
+		row[x] = sdl_freeze(fx->freeze, row[x]);
+	}
+}
+
+// ============================================================================
+// Scaling
+// ============================================================================
+//
+// Bilinear resampling for sprites with scale != 100. Source positions and
+// weights are 16.16 fixed point and computed once per output column and once
+// per output row. Each output row first blends its two source rows into
+// scaler->tmp, then blends two columns of that per output pixel.
+
+// Source taps for output coordinate d, with the same edge handling as
+// sdl_rowfx_scale_pixel_ref()
+static void scale_tap(int d, int scale, int srcres, int *p0, int *p1, uint32_t *frac)
+{
+	int64_t pos = ((int64_t)d * 100 << 16) / scale;
+
+	if (((pos + 0xffff) >> 16) >= srcres) {
+		pos = ((int64_t)(srcres - 1) << 16) - 66; // srcres - 1.001
+	}
+
+	*p0 = (int)(pos >> 16);
+	*frac = (uint32_t)(pos & 0xffff);
+	*p1 = *p0 + (*frac != 0);
+}
+
+void sdl_scaler_init(struct sdl_scaler *sc, const struct sdl_texture *st, const struct sdl_image *si, int scale)
+{
+	int x, y, w = st->xres * sdl_scale;
+
+	sc->sw = si->xres * sdl_scale;
+	sc->sh = si->yres * sdl_scale;
+	sc->scale = scale;
+
+#ifdef SDL_FAST_MALLOC
+	sc->xt = MALLOC((size_t)w * sizeof(struct sdl_scale_tap));
+	sc->tmp = MALLOC((size_t)sc->sw * 4 * sizeof(uint32_t));
+#else
+	sc->xt = xmalloc((size_t)w * sizeof(struct sdl_scale_tap), MEM_SDL_PIXEL2);
+	sc->tmp = xmalloc((size_t)sc->sw * 4 * sizeof(uint32_t), MEM_SDL_PIXEL2);
+#endif
+
+	for (x = 0; x < w; x++) {
+		scale_tap(x, scale, sc->sw, &sc->xt[x].p0, &sc->xt[x].p1, &sc->xt[x].frac);
+	}
+
+	// Colorize each source pixel once instead of once per tap
+	if (st->c1 || st->c2 || st->c3) {
+#ifdef SDL_FAST_MALLOC
+		sc->colorized = MALLOC((size_t)sc->sw * (size_t)sc->sh * sizeof(uint32_t));
+#else
+		sc->colorized = xmalloc((size_t)sc->sw * (size_t)sc->sh * sizeof(uint32_t), MEM_SDL_PIXEL2);
+#endif
+		for (y = 0; y < sc->sh; y++) {
+			for (x = 0; x < sc->sw; x++) {
+				sc->colorized[x + y * sc->sw] = sdl_colorize_pix2(si->pixel[x + y * sc->sw], st->c1, st->c2, st->c3,
+				    x, y, si->xres, si->yres, si->pixel, (int)st->sprite);
+			}
+		}
+		sc->src = sc->colorized;
+	} else {
+		sc->colorized = NULL;
+		sc->src = si->pixel;
+	}
+}
+
+void sdl_scaler_exit(struct sdl_scaler *sc)
+{
+#ifdef SDL_FAST_MALLOC
+	FREE(sc->xt);
+	FREE(sc->tmp);
+	if (sc->colorized) {
+		FREE(sc->colorized);
+	}
+#else
+	xfree(sc->xt);
+	xfree(sc->tmp);
+	if (sc->colorized) {
+		xfree(sc->colorized);
+	}
+#endif
+	sc->xt = NULL;
+	sc->tmp = NULL;
+	sc->colorized = NULL;
+}
+
+// Scale output row y, w pixels wide
+void sdl_scaler_row(const struct sdl_scaler *sc, int y, uint32_t *row, int w)
+{
+	const uint32_t *s0, *s1;
+	const struct sdl_scale_tap *t;
+	uint32_t fy, ly, fx, lx, c0, c1, *v0, *v1;
+	int x, y0, y1;
+
+	scale_tap(y, sc->scale, sc->sh, &y0, &y1, &fy);
+	ly = 0x10000 - fy;
+	s0 = sc->src + y0 * sc->sw;
+	s1 = sc->src + y1 * sc->sw;
+
+	// vertical pass, 8.16 per channel
+	for (x = 0; x < sc->sw; x++) {
+		c0 = s0[x];
+		c1 = s1[x];
+		sc->tmp[x * 4 + 0] = IGET_A(c0) * ly + IGET_A(c1) * fy;
+		sc->tmp[x * 4 + 1] = IGET_R(c0) * ly + IGET_R(c1) * fy;
+		sc->tmp[x * 4 + 2] = IGET_G(c0) * ly + IGET_G(c1) * fy;
+		sc->tmp[x * 4 + 3] = IGET_B(c0) * ly + IGET_B(c1) * fy;
+	}
+
+	// horizontal pass, truncated like the reference
+	for (x = 0; x < w; x++) {
+		t = &sc->xt[x];
+		fx = t->frac;
+		lx = 0x10000 - fx;
+		v0 = sc->tmp + t->p0 * 4;
+		v1 = sc->tmp + t->p1 * 4;
+		row[x] = IRGBA((uint32_t)(((uint64_t)v0[1] * lx + (uint64_t)v1[1] * fx) >> 32),
+		    (uint32_t)(((uint64_t)v0[2] * lx + (uint64_t)v1[2] * fx) >> 32),
+		    (uint32_t)(((uint64_t)v0[3] * lx + (uint64_t)v1[3] * fx) >> 32),
+		    (uint32_t)(((uint64_t)v0[0] * lx + (uint64_t)v1[0] * fx) >> 32));
+	}
+}
+
+// The original double precision scaler of sdl_make(), one output pixel at a
+// time. Kept as the reference for the tests.
+uint32_t sdl_rowfx_scale_pixel_ref(const struct sdl_texture *st, const struct sdl_image *si, int scale, int x, int y)
+{
+	double ix, iy, low_x, low_y, high_x, high_y, dbr, dbg, dbb, dba;
+	uint32_t irgb;
+
+	ix = x * 100.0 / scale;
+	iy = y * 100.0 / scale;
+
+	if (ceil(ix) >= si->xres * sdl_scale) {
+		ix = si->xres * sdl_scale - 1.001;
+	}
+
+	if (ceil(iy) >= si->yres * sdl_scale) {
+		iy = si->yres * sdl_scale - 1.001;
+	}
+
+	high_x = ix - floor(ix);
+	high_y = iy - floor(iy);
+	low_x = 1 - high_x;
+	low_y = 1 - high_y;
+
+	irgb = si->pixel[(int)(floor(ix) + floor(iy) * si->xres * sdl_scale)];
+
+	if (st->c1 || st->c2 || st->c3) {
+		irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)floor(ix), (int)floor(iy), si->xres, si->yres,
+		    si->pixel, (int)st->sprite);
+	}
+	dba = IGET_A(irgb) * low_x * low_y;
+	dbr = IGET_R(irgb) * low_x * low_y;
+	dbg = IGET_G(irgb) * low_x * low_y;
+	dbb = IGET_B(irgb) * low_x * low_y;
+
+	irgb = si->pixel[(int)(ceil(ix) + floor(iy) * si->xres * sdl_scale)];
+
+	if (st->c1 || st->c2 || st->c3) {
+		irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)ceil(ix), (int)floor(iy), si->xres, si->yres,
+		    si->pixel, (int)st->sprite);
+	}
+	dba += IGET_A(irgb) * high_x * low_y;
+	dbr += IGET_R(irgb) * high_x * low_y;
+	dbg += IGET_G(irgb) * high_x * low_y;
+	dbb += IGET_B(irgb) * high_x * low_y;
+
+	irgb = si->pixel[(int)(floor(ix) + ceil(iy) * si->xres * sdl_scale)];
+
+	if (st->c1 || st->c2 || st->c3) {
+		irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)floor(ix), (int)ceil(iy), si->xres, si->yres,
+		    si->pixel, (int)st->sprite);
+	}
+	dba += IGET_A(irgb) * low_x * high_y;
+	dbr += IGET_R(irgb) * low_x * high_y;
+	dbg += IGET_G(irgb) * low_x * high_y;
+	dbb += IGET_B(irgb) * low_x * high_y;
+
+	irgb = si->pixel[(int)(ceil(ix) + ceil(iy) * si->xres * sdl_scale)];
+
+	if (st->c1 || st->c2 || st->c3) {
+		irgb = sdl_colorize_pix2(irgb, st->c1, st->c2, st->c3, (int)ceil(ix), (int)ceil(iy), si->xres, si->yres,
+		    si->pixel, (int)st->sprite);
+	}
+	dba += IGET_A(irgb) * high_x * high_y;
+	dbr += IGET_R(irgb) * high_x * high_y;
+	dbg += IGET_G(irgb) * high_x * high_y;
+	dbb += IGET_B(irgb) * high_x * high_y;
+
+	return IRGBA((int)dbr, (int)dbg, (int)dbb, (int)dba);
+}
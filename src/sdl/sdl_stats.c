@@ -0,0 +1,186 @@
+/*
+ * Part of Astonia Client (c) Daniel Brockhaus. Please read license.txt.
+ *
+ * SDL - Frame Statistics
+ *
+ * Takes a snapshot of the texture cache counters at the end of every frame and
+ * keeps the last STATS_FRAMES of them in a ring. The snapshots hold what
+ * happened during that frame (hits, misses, evictions, uploads, the time the
+ * render thread waited for the workers) and the state at its end (queued
+ * jobs, cache entries in use). They can be written to a CSV or JSON file and
+ * drawn as bar graphs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <SDL3/SDL.h>
+
+#include "dll.h"
+#include "astonia.h"
+#include "sdl/sdl.h"
+#include "sdl/sdl_private.h"
+
+#define STATS_FRAMES 1024 // power of two
+
+static struct sdl_stats stats_ring[STATS_FRAMES];
+static uint64_t stats_count = 0; // snapshots taken, the newest is at (stats_count-1)&(STATS_FRAMES-1)
+
+// Counter values at the last snapshot, the ring gets the difference
+static long long stats_hit, stats_miss, stats_pre, stats_evict, stats_upload, stats_upload_bytes;
+static uint64_t stats_wait;
+
+void sdl_stats_reset(void)
+{
+	stats_count = 0;
+	stats_hit = texc_hit;
+	stats_miss = texc_miss;
+	stats_pre = texc_pre;
+	stats_evict = texc_evict;
+	stats_upload = texc_upload;
+	stats_upload_bytes = texc_upload_bytes;
+	stats_wait = sdl_render_wait_total;
+}
+
+static uint32_t stats_delta(long long now, long long *last)
+{
+	long long d = now - *last;
+
+	*last = now;
+	return d > 0 ? (uint32_t)d : 0;
+}
+
+// Called by sdl_render() once the frame is shown
+void sdl_stats_frame(void)
+{
+	struct sdl_stats *s = &stats_ring[stats_count & (STATS_FRAMES - 1)];
+	int lane, queue = 0;
+
+	s->frame = (uint32_t)sdl_frames;
+	s->time = (uint32_t)SDL_GetTicks();
+	s->hit = stats_delta(texc_hit, &stats_hit);
+	s->miss = stats_delta(texc_miss, &stats_miss);
+	s->pre = stats_delta(texc_pre, &stats_pre);
+	s->evict = stats_delta(texc_evict, &stats_evict);
+	s->upload = stats_delta(texc_upload, &stats_upload);
+	s->upload_bytes = stats_delta(texc_upload_bytes, &stats_upload_bytes);
+	s->wait = (uint32_t)(sdl_render_wait_total - stats_wait);
+	stats_wait = sdl_render_wait_total;
+
+	for (lane = 0; lane < TEX_LANE_COUNT; lane++) {
+		queue += tex_jobs_depth(lane);
+	}
+	s->queue = (uint32_t)queue;
+	s->used = (uint32_t)texc_used;
+
+	stats_count++;
+}
+
+int sdl_stats_frames(void)
+{
+	return stats_count < STATS_FRAMES ? (int)stats_count : STATS_FRAMES;
+}
+
+// Snapshot of the frame back frames ago, 0 is the last one. Returns 0 if
+// there is none.
+int sdl_stats_get(int back, struct sdl_stats *s)
+{
+	if (back < 0 || back >= sdl_stats_frames()) {
+		return 0;
+	}
+
+	*s = stats_ring[(stats_count - 1 - (uint64_t)back) & (STATS_FRAMES - 1)];
+	return 1;
+}
+
+// Write all snapshots we have, oldest first. Returns the number of frames
+// written, -1 if the file could not be written.
+int sdl_stats_write(const char *filename, int json)
+{
+	struct sdl_stats s;
+	int n, frames = sdl_stats_frames();
+	FILE *fp;
+
+	fp = fopen(filename, "w");
+	if (!fp) {
+		warn("Could not write frame statistics to %s", filename);
+		return -1;
+	}
+
+	if (json) {
+		fprintf(fp, "{\n\"scale\": %d,\n\"cache_size\": %d,\n\"workers\": %d,\n\"frames\": [\n", sdl_scale, sdlt_size,
+		    sdl_multi);
+	} else {
+		fprintf(fp, "frame,time,hit,miss,pre,evict,upload,upload_bytes,queue,wait,used\n");
+	}
+
+	for (n = frames - 1; n >= 0; n--) {
+		sdl_stats_get(n, &s);
+		if (json) {
+			fprintf(fp,
+			    "{\"frame\": %u, \"time\": %u, \"hit\": %u, \"miss\": %u, \"pre\": %u, \"evict\": %u, \"upload\": %u, "
+			    "\"upload_bytes\": %u, \"queue\": %u, \"wait\": %u, \"used\": %u}%s\n",
+			    s.frame, s.time, s.hit, s.miss, s.pre, s.evict, s.upload, s.upload_bytes, s.queue, s.wait, s.used,
+			    n ? "," : "");
+		} else {
+			fprintf(fp, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", s.frame, s.time, s.hit, s.miss, s.pre, s.evict, s.upload,
+			    s.upload_bytes, s.queue, s.wait, s.used);
+		}
+	}
+
+	if (json) {
+		fprintf(fp, "]\n}\n");
+	}
+
+	if (fclose(fp)) {
+		warn("Could not write frame statistics to %s", filename);
+		return -1;
+	}
+
+	return frames;
+}
+
+static uint32_t stats_value(const struct sdl_stats *s, int what)
+{
+	switch (what) {
+	case SDL_STAT_HIT:
+		return s->hit;
+	case SDL_STAT_MISS:
+		return s->miss;
+	case SDL_STAT_EVICT:
+		return s->evict;
+	case SDL_STAT_UPLOAD:
+		return s->upload;
+	case SDL_STAT_UPLOAD_KB:
+		return s->upload_bytes / 1024;
+	case SDL_STAT_QUEUE:
+		return s->queue;
+	case SDL_STAT_WAIT:
+		return s->wait;
+	default:
+		return 0;
+	}
+}
+
+// Bar graph of one value over the last 100 frames, newest on the left, each
+// bar is the value divided by div
+void sdl_stats_graph(int sx, int sy, int what, int div, int x_offset, int y_offset)
+{
+	unsigned char data[100];
+	struct sdl_stats s;
+	uint32_t val;
+	int n;
+
+	if (div < 1) {
+		div = 1;
+	}
+
+	for (n = 0; n < (int)sizeof(data); n++) {
+		if (!sdl_stats_get(n, &s)) {
+			data[n] = 0;
+			continue;
+		}
+		val = stats_value(&s, what) / (uint32_t)div;
+		data[n] = (unsigned char)(val > 42 ? 42 : val);
+	}
+	sdl_bargraph(sx, sy, (int)sizeof(data), data, x_offset, y_offset);
+}
@@ -18,7 +18,6 @@
 // Forward declarations for test-exposed functions
 extern SDL_AtomicInt worker_quit;
 extern SDL_Thread **worker_threads;
-extern struct zip_handles *worker_zips;
 extern int sdl_multi;
 extern SDL_Semaphore *prework;
 
@@ -30,41 +29,30 @@ static void sdl_zero_state_for_tests(void)
 {
 	int i;
 
-	// Texture cache - reset to clean state
-	for (i = 0; i < MAX_TEXCACHE; i++) {
-		// Use atomic store for flags
-		uint16_t *flags_ptr = (uint16_t *)&sdlt[i].flags;
-		__atomic_store_n(flags_ptr, 0, __ATOMIC_RELAXED);
-
-		sdlt[i].tex = NULL;
-		sdlt[i].pixel = NULL;
-		sdlt[i].hnext = STX_NONE;
-		sdlt[i].hprev = STX_NONE;
-		sdlt[i].prev = i - 1;
-		sdlt[i].next = i + 1;
+	// Texture cache and hash table - reallocate in clean state
+	sdl_atlas_exit();
+	sdl_texcache_init(sdl_cache_size);
+	for (i = 0; i < sdlt_size; i++) {
 		sdlt[i].sprite = -1;
-		sdlt[i].xres = 0;
-		sdlt[i].yres = 0;
-		sdlt[i].text = NULL;
-		sdlt[i].generation = 1; // Start at 1 (0 is reserved)
-		sdlt[i].work_state = TX_WORK_IDLE;
 	}
 
-	if (MAX_TEXCACHE > 0) {
-		sdlt[0].prev = STX_NONE;
-		sdlt[MAX_TEXCACHE - 1].next = STX_NONE;
+	// Decoded images - drop them all, no entry holds a pin anymore
+	sdl_ic_flush();
+	for (i = 0; i < MAXSPRITE; i++) {
+		sdli[i].pins = 0;
 	}
 
-	sdlt_best = 0;
-	sdlt_last = MAX_TEXCACHE - 1;
-
-	// Hash table - clear all heads
-	for (i = 0; i < MAX_TEXHASH; i++) {
-		sdlt_cache[i] = STX_NONE;
-	}
+	// No byte budgets unless a test asks for one
+	texc_budget = 0;
+	imgc_budget = 0;
+	texc_hit = texc_miss = texc_pre = 0;
+	texc_evict = texc_evict_budget = 0;
+	texc_upload = texc_upload_bytes = 0;
+	sdl_render_wait_total = 0;
+	imgc_evict = 0;
+	sdl_stats_reset();
 
 	// Job queue
-	tex_jobs_shutdown();
 	tex_jobs_init();
 
 	// Reset performance counters
@@ -88,22 +76,25 @@ int sdl_init_for_tests(void)
 	sdl_multi = 0;
 
 	// Open graphics ZIP files (needed for real I/O)
-	sdl_zip1 = zip_open("res/gx1.zip", ZIP_RDONLY, NULL);
-	sdl_zip1p = zip_open("res/gx1_patch.zip", ZIP_RDONLY, NULL);
-	sdl_zip1m = zip_open("res/gx1_mod.zip", ZIP_RDONLY, NULL);
-	sdl_zip2 = zip_open("res/gx2.zip", ZIP_RDONLY, NULL);
-	sdl_zip2p = zip_open("res/gx2_patch.zip", ZIP_RDONLY, NULL);
-	sdl_zip2m = zip_open("res/gx2_mod.zip", ZIP_RDONLY, NULL);
+	sdl_zip1 = sdl_archive_open("res/gx1.zip");
+	sdl_zip1p = sdl_archive_open("res/gx1_patch.zip");
+	sdl_zip1m = sdl_archive_open("res/gx1_mod.zip");
+	sdl_zip2 = sdl_archive_open("res/gx2.zip");
+	sdl_zip2p = sdl_archive_open("res/gx2_patch.zip");
+	sdl_zip2m = sdl_archive_open("res/gx2_mod.zip");
 
 	if (!sdl_zip1) {
 		fprintf(stderr, "sdl_init_for_tests: Failed to open res/gx1.zip\n");
 		fprintf(stderr, "Make sure to run tests from repository root!\n");
 		return 0;
 	}
+	sdl_zip_index_init();
 
 	// Initialize job queue
 	tex_jobs_init();
 
+	sdl_light_init();
+
 	// Create mutex for prefetch operations
 	premutex = SDL_CreateMutex();
 	if (!premutex) {
@@ -153,9 +144,6 @@ int sdl_init_for_tests_with_workers(int worker_count)
 		return 0;
 	}
 
-	// Don't allocate zip handles for tests - workers will use NULL
-	worker_zips = NULL;
-
 	SDL_SetAtomicInt(&worker_quit, 0);
 
 	for (i = 0; i < worker_count; i++) {
@@ -182,11 +170,6 @@ void sdl_shutdown_for_tests(void)
 	if (sdl_multi && worker_threads) {
 		SDL_SetAtomicInt(&worker_quit, 1);
 
-		// Also signal the job queue condition variable (for any waiting on cond)
-		SDL_LockMutex(g_tex_jobs.mutex);
-		SDL_BroadcastCondition(g_tex_jobs.cond);
-		SDL_UnlockMutex(g_tex_jobs.mutex);
-
 		// Wake up all workers from semaphore wait
 		// Each worker needs one semaphore post to wake from SDL_WaitSemaphore
 		for (i = 0; i < sdl_multi; i++) {
@@ -204,27 +187,18 @@ void sdl_shutdown_for_tests(void)
 	}
 
 	// Close ZIP files
-	if (sdl_zip1) {
-		zip_close(sdl_zip1);
-	}
-	if (sdl_zip1p) {
-		zip_close(sdl_zip1p);
-	}
-	if (sdl_zip1m) {
-		zip_close(sdl_zip1m);
-	}
-	if (sdl_zip2) {
-		zip_close(sdl_zip2);
-	}
-	if (sdl_zip2p) {
-		zip_close(sdl_zip2p);
-	}
-	if (sdl_zip2m) {
-		zip_close(sdl_zip2m);
-	}
-
-	// Shutdown job queue
-	tex_jobs_shutdown();
+	sdl_zip_index_exit();
+	sdl_archive_close(sdl_zip1);
+	sdl_archive_close(sdl_zip1p);
+	sdl_archive_close(sdl_zip1m);
+	sdl_archive_close(sdl_zip2);
+	sdl_archive_close(sdl_zip2p);
+	sdl_archive_close(sdl_zip2m);
+	sdl_zip1 = sdl_zip1p = sdl_zip1m = sdl_zip2 = sdl_zip2p = sdl_zip2m = NULL;
+
+	sdl_glyph_exit();
+	sdl_atlas_exit();
+	sdl_texcache_exit();
 
 	if (premutex) {
 		SDL_DestroyMutex(premutex);
@@ -240,7 +214,8 @@ void sdl_shutdown_for_tests(void)
 
 int sdl_pre_tick_for_tests(void)
 {
-	return sdl_pre_do();
+	// A deadline far away: upload everything that is ready
+	return sdl_pre_do(SDL_GetTicks() + 1000);
 }
 
 // ============================================================================
@@ -258,6 +233,10 @@ static int sdl_check_texture_entry_invariants(int cache_index)
 			fprintf(stderr, "BUG: unused entry %d has tex != NULL\n", cache_index);
 			return -1;
 		}
+		if (e->atlas != STX_NONE) {
+			fprintf(stderr, "BUG: unused entry %d still holds atlas page %d\n", cache_index, e->atlas);
+			return -1;
+		}
 		// Note: pixel might still be set temporarily during cleanup, so we don't check it
 		return 0;
 	}
@@ -284,6 +263,12 @@ static int sdl_check_texture_entry_invariants(int cache_index)
 		return -1;
 	}
 
+	// Atlas space is only handed out in stage 3
+	if (e->atlas != STX_NONE && !(flags & SF_DIDTEX)) {
+		fprintf(stderr, "BUG: entry %d is on atlas page %d without DIDTEX\n", cache_index, e->atlas);
+		return -1;
+	}
+
 	// Text vs Sprite mutual exclusion
 	if ((flags & SF_TEXT) && (flags & SF_SPRITE)) {
 		fprintf(stderr, "BUG: entry %d has both SF_TEXT and SF_SPRITE\n", cache_index);
@@ -328,19 +313,19 @@ static int sdl_check_hash_chain_invariants(void)
 {
 	int h;
 
-	for (h = 0; h < MAX_TEXHASH; h++) {
+	for (h = 0; h < sdlt_hash_size; h++) {
 		int steps = 0;
 		int idx = sdlt_cache[h];
 
 		while (idx != STX_NONE) {
 			// Check index is in range
-			if (idx < 0 || idx >= MAX_TEXCACHE) {
+			if (idx < 0 || idx >= sdlt_size) {
 				fprintf(stderr, "BUG: hash[%d] has out-of-range index %d\n", h, idx);
 				return -1;
 			}
 
 			// Detect cycles (no chain should be longer than cache size)
-			if (steps++ > MAX_TEXCACHE) {
+			if (steps++ > sdlt_size) {
 				fprintf(stderr, "BUG: hash[%d] appears to have a cycle (steps=%d)\n", h, steps);
 				return -1;
 			}
@@ -360,12 +345,12 @@ static int sdl_check_lru_list_invariants(void)
 	// Forward walk from sdlt_best
 	idx = sdlt_best;
 	while (idx != STX_NONE) {
-		if (idx < 0 || idx >= MAX_TEXCACHE) {
+		if (idx < 0 || idx >= sdlt_size) {
 			fprintf(stderr, "BUG: LRU forward walk found out-of-range index %d\n", idx);
 			return -1;
 		}
 
-		if (count++ > MAX_TEXCACHE) {
+		if (count++ > sdlt_size) {
 			fprintf(stderr, "BUG: LRU forward walk detected cycle (count=%d)\n", count);
 			return -1;
 		}
@@ -373,7 +358,7 @@ static int sdl_check_lru_list_invariants(void)
 		// Check prev/next consistency
 		int next = sdlt[idx].next;
 		if (next != STX_NONE) {
-			if (next < 0 || next >= MAX_TEXCACHE) {
+			if (next < 0 || next >= sdlt_size) {
 				fprintf(stderr, "BUG: LRU entry %d has out-of-range next=%d\n", idx, next);
 				return -1;
 			}
@@ -390,60 +375,107 @@ static int sdl_check_lru_list_invariants(void)
 	return 0;
 }
 
-static int sdl_check_job_queue_invariants(void)
+// Check one job ring. Other threads may push (concurrent_push) or pop while
+// this runs, so cells around the positions we read may be in flight.
+static int sdl_check_job_ring_invariants(
+    texture_job_ring_t *q, const char *name, texture_job_kind_t kind, int concurrent_push)
 {
-	texture_job_queue_t *q = &g_tex_jobs;
+	const uint32_t cap = (uint32_t)TEX_JOB_CAPACITY;
 
-	SDL_LockMutex(q->mutex);
+	uint32_t deq = __atomic_load_n(&q->dequeue_pos, __ATOMIC_ACQUIRE);
+	uint32_t enq = __atomic_load_n(&q->enqueue_pos, __ATOMIC_ACQUIRE);
+	int32_t depth = (int32_t)(enq - deq);
 
 	// Basic queue state
-	if (q->count < 0 || q->count > TEX_JOB_CAPACITY) {
-		fprintf(stderr, "BUG: job queue count=%d out of range [0, %d]\n", q->count, TEX_JOB_CAPACITY);
-		SDL_UnlockMutex(q->mutex);
+	if (depth < 0 || depth > TEX_JOB_CAPACITY) {
+		fprintf(stderr, "BUG: %s depth=%d out of range [0, %d] (enqueue=%u, dequeue=%u)\n", name, depth,
+		    TEX_JOB_CAPACITY, enq, deq);
 		return -1;
 	}
 
-	if (q->head < 0 || q->head >= TEX_JOB_CAPACITY) {
-		fprintf(stderr, "BUG: job queue head=%d out of range [0, %d)\n", q->head, TEX_JOB_CAPACITY);
-		SDL_UnlockMutex(q->mutex);
-		return -1;
-	}
+	// Every cell must be in one of the states its position allows
+	for (uint32_t pos = deq; pos != deq + cap; pos++) {
+		texture_job_cell_t *cell = &q->cells[pos & (cap - 1)];
+		uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
 
-	if (q->tail < 0 || q->tail >= TEX_JOB_CAPACITY) {
-		fprintf(stderr, "BUG: job queue tail=%d out of range [0, %d)\n", q->tail, TEX_JOB_CAPACITY);
-		SDL_UnlockMutex(q->mutex);
-		return -1;
-	}
+		if ((int32_t)(pos - enq) >= 0) {
+			// Free for a future push. A consumer may still be releasing it, or
+			// a producer filled it since we read enqueue_pos.
+			if (seq != pos && seq != pos - cap + 1 && !(concurrent_push && seq == pos + 1)) {
+				fprintf(stderr, "BUG: %s free cell at position %u has seq=%u\n", name, pos, seq);
+				return -1;
+			}
+			continue;
+		}
 
-	// Check that queued jobs reference valid cache indices
-	int checked = 0;
-	int idx = q->head;
-	for (int i = 0; i < q->count; i++) {
-		texture_job_t *job = &q->jobs[idx];
+		if (seq == pos + cap) {
+			continue; // popped since we read dequeue_pos
+		}
+		if (concurrent_push && seq == pos) {
+			continue; // producer claimed the position but is still writing the job
+		}
+		if (seq != pos + 1) {
+			fprintf(stderr, "BUG: %s queued cell at position %u has seq=%u\n", name, pos, seq);
+			return -1;
+		}
+
+		// Check that queued jobs reference valid cache indices
+		texture_job_t *job = &cell->job;
 
-		if (job->cache_index < 0 || job->cache_index >= MAX_TEXCACHE) {
-			fprintf(stderr, "BUG: queued job at slot %d has invalid cache_index=%d\n", idx, job->cache_index);
-			SDL_UnlockMutex(q->mutex);
+		if (job->cache_index < 0 || job->cache_index >= sdlt_size) {
+			fprintf(stderr, "BUG: %s position %u has invalid cache_index=%d\n", name, pos, job->cache_index);
 			return -1;
 		}
 
 		if (job->generation == 0) {
-			fprintf(stderr, "BUG: queued job at slot %d has generation==0\n", idx);
-			SDL_UnlockMutex(q->mutex);
+			fprintf(stderr, "BUG: %s position %u has generation==0\n", name, pos);
+			return -1;
+		}
+
+		if (job->kind != kind) {
+			fprintf(stderr, "BUG: %s position %u has unexpected kind=%d\n", name, pos, (int)job->kind);
+			return -1;
+		}
+
+		// The generation only changes on eviction, and eviction clears the flags
+		// before a new sprite can be set up and queued. A job for the current
+		// contents may be left over after the render thread made the sprite
+		// itself, but its entry must still hold a sprite.
+		struct sdl_texture *e = &sdlt[job->cache_index];
+		if (job->generation == e->generation && !(flags_load(e) & SF_SPRITE)) {
+			fprintf(stderr, "BUG: %s position %u for entry %d is current but entry flags=0x%x\n", name, pos,
+			    job->cache_index, (unsigned)flags_load(e));
 			return -1;
 		}
+	}
+
+	return 0;
+}
 
-		idx = (idx + 1) % TEX_JOB_CAPACITY;
-		checked++;
+static int sdl_check_job_queue_invariants(void)
+{
+	static const char *lane_name[TEX_LANE_COUNT] = {"job lane now", "job lane prefetch"};
 
-		if (checked > TEX_JOB_CAPACITY) {
-			fprintf(stderr, "BUG: job queue appears to have infinite loop\n");
-			SDL_UnlockMutex(q->mutex);
+	// Workers pop the lanes, but only the thread running the checks pushes
+	for (int lane = 0; lane < TEX_LANE_COUNT; lane++) {
+		if (sdl_check_job_ring_invariants(&g_tex_jobs.lane[lane], lane_name[lane], TEXTURE_JOB_MAKE_STAGES_1_2, 0) !=
+		    0) {
 			return -1;
 		}
 	}
 
-	SDL_UnlockMutex(q->mutex);
+	// Workers push the ready list, only the thread running the checks pops
+	if (sdl_check_job_ring_invariants(&g_tex_jobs.ready, "ready list", TEXTURE_JOB_UPLOAD_STAGE_3, 1) != 0) {
+		return -1;
+	}
+
+	// An entry kept back by the last upload budget
+	if (g_tex_jobs.ready_has_next &&
+	    (g_tex_jobs.ready_next.cache_index < 0 || g_tex_jobs.ready_next.cache_index >= sdlt_size)) {
+		fprintf(stderr, "BUG: held ready entry has invalid cache_index=%d\n", g_tex_jobs.ready_next.cache_index);
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -452,7 +484,7 @@ int sdl_check_invariants_for_tests(void)
 	int i;
 
 	// 1. Check all texture entries
-	for (i = 0; i < MAX_TEXCACHE; i++) {
+	for (i = 0; i < sdlt_size; i++) {
 		if (sdl_check_texture_entry_invariants(i) != 0) {
 			return -1;
 		}
@@ -489,9 +521,15 @@ static struct {
 	int geometry;
 	int set_draw_color;
 	int set_blend_mode;
+	int textures;
+	int texture_switches;
+	int quads;
 	int total;
 } render_counters = {0};
 
+// Last texture passed to SDL_RenderTexture, to count texture switches
+static SDL_Texture *render_last_texture = NULL;
+
 void sdl_test_reset_render_counters(void)
 {
 	render_counters.points = 0;
@@ -501,7 +539,11 @@ void sdl_test_reset_render_counters(void)
 	render_counters.geometry = 0;
 	render_counters.set_draw_color = 0;
 	render_counters.set_blend_mode = 0;
+	render_counters.textures = 0;
+	render_counters.texture_switches = 0;
+	render_counters.quads = 0;
 	render_counters.total = 0;
+	render_last_texture = NULL;
 }
 
 int sdl_test_get_render_point_count(void)
@@ -544,6 +586,21 @@ int sdl_test_get_set_blend_mode_count(void)
 	return render_counters.set_blend_mode;
 }
 
+int sdl_test_get_render_texture_count(void)
+{
+	return render_counters.textures;
+}
+
+int sdl_test_get_texture_switch_count(void)
+{
+	return render_counters.texture_switches;
+}
+
+int sdl_test_get_render_quad_count(void)
+{
+	return render_counters.quads;
+}
+
 // ============================================================================
 // GPU Stub Implementations (SDL Texture Operations)
 // ============================================================================
@@ -551,8 +608,8 @@ int sdl_test_get_set_blend_mode_count(void)
 // We use REAL I/O (PNG loading, decompression, CPU processing)
 // but STUB GPU operations (which require a real renderer/window)
 
-// Fake SDL_Texture object for tests
-static int dummy_texture;
+// Fake SDL_Texture objects for tests. Each one is a distinct allocation, so
+// texture switches between blits can be counted.
 
 // ============================================================================
 // SDL Render Function Stubs with Counters
@@ -604,10 +661,18 @@ bool SDL_RenderFillRect(SDL_Renderer *renderer __attribute__((unused)), const SD
 	return true;
 }
 
-bool SDL_RenderGeometry(SDL_Renderer *renderer __attribute__((unused)), SDL_Texture *texture __attribute__((unused)),
+bool SDL_RenderGeometry(SDL_Renderer *renderer __attribute__((unused)), SDL_Texture *texture,
     const SDL_Vertex *vertices __attribute__((unused)), int num_vertices __attribute__((unused)),
-    const int *indices __attribute__((unused)), int num_indices __attribute__((unused)))
+    const int *indices __attribute__((unused)), int num_indices)
 {
+	// Textured geometry is how batched blits arrive, six indices per quad
+	if (texture) {
+		if (texture != render_last_texture) {
+			render_counters.texture_switches++;
+			render_last_texture = texture;
+		}
+		render_counters.quads += num_indices / 6;
+	}
 	render_counters.geometry++;
 	render_counters.total++;
 	return true;
@@ -627,9 +692,14 @@ bool SDL_SetRenderDrawBlendMode(
 	return true;
 }
 
-bool SDL_RenderTexture(SDL_Renderer *renderer __attribute__((unused)), SDL_Texture *texture __attribute__((unused)),
+bool SDL_RenderTexture(SDL_Renderer *renderer __attribute__((unused)), SDL_Texture *texture,
     const SDL_FRect *srcrect __attribute__((unused)), const SDL_FRect *dstrect __attribute__((unused)))
 {
+	if (texture != render_last_texture) {
+		render_counters.texture_switches++;
+		render_last_texture = texture;
+	}
+	render_counters.textures++;
 	render_counters.total++;
 	return true;
 }
@@ -651,7 +721,7 @@ SDL_Texture *SDL_CreateTexture(SDL_Renderer *renderer __attribute__((unused)),
     int w __attribute__((unused)), int h __attribute__((unused)))
 {
 	// Return non-NULL pointer (cache code just checks != NULL)
-	return (SDL_Texture *)&dummy_texture;
+	return (SDL_Texture *)SDL_malloc(sizeof(int));
 }
 
 // Stub: Update texture with pixel data
@@ -663,9 +733,9 @@ bool SDL_UpdateTexture(SDL_Texture *texture __attribute__((unused)), const SDL_R
 }
 
 // Stub: Destroy texture
-void SDL_DestroyTexture(SDL_Texture *texture __attribute__((unused)))
+void SDL_DestroyTexture(SDL_Texture *texture)
 {
-	// No-op in tests
+	SDL_free(texture);
 }
 
 // Stub: Query texture info
@@ -694,7 +764,7 @@ int SDL_QueryTexture(SDL_Texture *texture __attribute__((unused)), Uint32 *forma
 // Return flags for a cache entry (read-only, no side effects)
 uint16_t sdl_texture_get_flags_for_test(int cache_index)
 {
-	if (cache_index < 0 || cache_index >= MAX_TEXCACHE) {
+	if (cache_index < 0 || cache_index >= sdlt_size) {
 		return 0;
 	}
 	return flags_load(&sdlt[cache_index]);
@@ -703,7 +773,7 @@ uint16_t sdl_texture_get_flags_for_test(int cache_index)
 // Return sprite id for a cache entry (read-only, no side effects)
 int sdl_texture_get_sprite_for_test(int cache_index)
 {
-	if (cache_index < 0 || cache_index >= MAX_TEXCACHE) {
+	if (cache_index < 0 || cache_index >= sdlt_size) {
 		return -1;
 	}
 	return sdlt[cache_index].sprite;
@@ -712,7 +782,7 @@ int sdl_texture_get_sprite_for_test(int cache_index)
 // Return work_state for a cache entry (read-only, no side effects)
 uint8_t sdl_texture_get_work_state_for_test(int cache_index)
 {
-	if (cache_index < 0 || cache_index >= MAX_TEXCACHE) {
+	if (cache_index < 0 || cache_index >= sdlt_size) {
 		return 0xFF; // Invalid
 	}
 	return work_state_load(&sdlt[cache_index]);
@@ -721,9 +791,10 @@ uint8_t sdl_texture_get_work_state_for_test(int cache_index)
 // Return rough job queue depth (read-only, no side effects)
 int sdl_get_job_queue_depth_for_test(void)
 {
-	SDL_LockMutex(g_tex_jobs.mutex);
-	int depth = g_tex_jobs.count;
-	SDL_UnlockMutex(g_tex_jobs.mutex);
+	int depth = 0;
+	for (int lane = 0; lane < TEX_LANE_COUNT; lane++) {
+		depth += tex_jobs_depth(lane);
+	}
 	return depth;
 }
 
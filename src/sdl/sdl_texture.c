@@ -22,10 +22,12 @@
 extern int sockstate; // Declare early for use in wait logging
 #endif
 
-// Texture cache data (statically allocated)
-struct sdl_texture sdlt[MAX_TEXCACHE];
+// Texture cache data (allocated by sdl_texcache_init())
+struct sdl_texture *sdlt = NULL;
+int sdlt_size = 0;
 int sdlt_best, sdlt_last;
-int sdlt_cache[MAX_TEXHASH];
+int *sdlt_cache = NULL;
+int sdlt_hash_size = 0;
 
 // Image cache
 static struct sdl_image sdli_storage[MAXSPRITE];
@@ -39,11 +41,18 @@ int texc_used = 0;
 long long mem_png = 0;
 long long mem_tex = 0;
 long long texc_hit = 0, texc_miss = 0, texc_pre = 0;
-
-#ifdef DEVELOPER
-uint64_t sdl_render_wait = 0;
-uint64_t sdl_render_wait_count = 0;
-#endif
+long long texc_budget = 0; // bytes of mem_tex we allow before evicting by size, 0 = no limit
+long long texc_evict = 0, texc_evict_budget = 0;
+long long texc_upload = 0, texc_upload_bytes = 0; // sprite textures made on the GPU
+int imgc_used = 0; // decoded images resident in sdli[]
+long long imgc_budget = 0; // bytes of mem_png we allow before evicting images, 0 = no limit
+long long imgc_evict = 0;
+
+// Render thread stalls on unfinished sprites, reset by the frame graphs
+uint64_t sdl_render_wait = 0; // ms waited or spent making stolen sprites
+uint64_t sdl_render_wait_count = 0; // sprites the render thread had to wait for
+uint64_t sdl_render_steals = 0; // of those, made by the render thread itself
+uint64_t sdl_render_wait_total = 0; // sdl_render_wait, but never reset
 
 // Timing
 long long sdl_time_preload = 0;
@@ -62,78 +71,240 @@ long long sdl_time_pre3 = 0;
 int maxpanic = 0;
 
 // ============================================================================
-// New texture job queue implementation
+// Texture job queue: lock-free rings for the job lanes and the upload-ready list
 // ============================================================================
 
-void tex_jobs_init(void)
+static void tex_ring_init(texture_job_ring_t *q)
 {
-	memset(&g_tex_jobs, 0, sizeof(g_tex_jobs));
-	g_tex_jobs.mutex = SDL_CreateMutex();
-	g_tex_jobs.cond = SDL_CreateCondition();
-	if (!g_tex_jobs.mutex || !g_tex_jobs.cond) {
-		fail("Failed to create texture job queue mutex/cond");
-		exit(1);
+	for (int i = 0; i < TEX_JOB_CAPACITY; i++) {
+		q->cells[i].seq = (uint32_t)i;
 	}
 }
 
-void tex_jobs_shutdown(void)
+// Add a job to a ring. Returns 0 if the ring is full. Safe from any thread.
+static int tex_ring_push(texture_job_ring_t *q, const texture_job_t *job)
 {
-	if (g_tex_jobs.mutex) {
-		SDL_DestroyMutex(g_tex_jobs.mutex);
-		g_tex_jobs.mutex = NULL;
+	uint32_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+
+	for (;;) {
+		texture_job_cell_t *cell = &q->cells[pos & (TEX_JOB_CAPACITY - 1u)];
+		uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		int32_t diff = (int32_t)(seq - pos);
+
+		if (diff == 0) {
+			// Cell is free, try to claim the position (pos is reloaded on failure)
+			if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				cell->job = *job;
+				__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (diff < 0) {
+			// Cell still holds the job from one lap ago
+			return 0;
+		} else {
+			// Another producer got this position first
+			pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+		}
 	}
-	if (g_tex_jobs.cond) {
-		SDL_DestroyCondition(g_tex_jobs.cond);
-		g_tex_jobs.cond = NULL;
+}
+
+static int tex_ring_pop(texture_job_ring_t *q, texture_job_t *out_job)
+{
+	uint32_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+
+	for (;;) {
+		texture_job_cell_t *cell = &q->cells[pos & (TEX_JOB_CAPACITY - 1u)];
+		uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		int32_t diff = (int32_t)(seq - (pos + 1));
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*out_job = cell->job;
+				// Free the cell for the push one lap ahead
+				__atomic_store_n(&cell->seq, pos + (uint32_t)TEX_JOB_CAPACITY, __ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (diff < 0) {
+			// Ring is empty
+			return 0;
+		} else {
+			// Another consumer got this position first
+			pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+		}
 	}
 }
 
-int tex_jobs_pop(texture_job_t *out_job, int should_block)
+// Number of jobs in a ring. Only a snapshot while other threads push or pop.
+static int tex_ring_depth(texture_job_ring_t *q)
 {
-	texture_job_queue_t *q = &g_tex_jobs;
-	SDL_LockMutex(q->mutex);
+	uint32_t deq = __atomic_load_n(&q->dequeue_pos, __ATOMIC_ACQUIRE);
+	uint32_t enq = __atomic_load_n(&q->enqueue_pos, __ATOMIC_ACQUIRE);
+	int32_t depth = (int32_t)(enq - deq);
 
-	// Assert queue invariants
-	assert(q->count <= TEX_JOB_CAPACITY && "tex_jobs_pop: count > capacity");
-	assert(q->head < TEX_JOB_CAPACITY && "tex_jobs_pop: head >= capacity");
-	assert(q->tail < TEX_JOB_CAPACITY && "tex_jobs_pop: tail >= capacity");
+	return depth < 0 ? 0 : depth;
+}
 
-	while (q->count == 0) {
-		if (!should_block) {
-			SDL_UnlockMutex(q->mutex);
-			return 0;
+void tex_jobs_init(void)
+{
+	memset(&g_tex_jobs, 0, sizeof(g_tex_jobs));
+	for (int lane = 0; lane < TEX_LANE_COUNT; lane++) {
+		tex_ring_init(&g_tex_jobs.lane[lane]);
+	}
+	tex_ring_init(&g_tex_jobs.ready);
+}
+
+// Add a job to a lane. Returns 0 if the lane is full.
+// Safe to call from any thread; wake a worker with prework afterwards.
+int tex_jobs_push(const texture_job_t *job, int lane)
+{
+	assert(lane >= 0 && lane < TEX_LANE_COUNT && "tex_jobs_push: invalid lane");
+	assert(job->generation != 0 && "tex_jobs_push: job with generation=0");
+
+	return tex_ring_push(&g_tex_jobs.lane[lane], job);
+}
+
+// Take the next job, TEX_LANE_NOW first. Never blocks, returns 0 if all lanes are empty.
+// The job may be stale: claim the slot with work_state_cas() and check the generation.
+int tex_jobs_pop(texture_job_t *out_job)
+{
+	for (int lane = 0; lane < TEX_LANE_COUNT; lane++) {
+		if (tex_ring_pop(&g_tex_jobs.lane[lane], out_job)) {
+			// Assert the popped job has valid values
+			assert(out_job->cache_index >= 0 && out_job->cache_index < sdlt_size &&
+			       "tex_jobs_pop: popped invalid cache_index");
+			assert(out_job->generation != 0 && "tex_jobs_pop: popped job with generation=0");
+			assert(out_job->kind == TEXTURE_JOB_MAKE_STAGES_1_2 && "tex_jobs_pop: unknown job kind");
+			return 1;
 		}
-		SDL_WaitCondition(q->cond, q->mutex);
 	}
 
-	// Pop job from queue
-	int head_index = q->head;
-	*out_job = q->jobs[head_index];
-	q->head = (q->head + 1) % TEX_JOB_CAPACITY;
-	q->count--;
+	return 0;
+}
 
-	// Zero out the popped slot for debugging clarity
-	// (Makes it obvious in debugger/memory dumps when a slot is free vs stale)
-	memset(&q->jobs[head_index], 0, sizeof(texture_job_t));
+int tex_jobs_depth(int lane)
+{
+	return tex_ring_depth(&g_tex_jobs.lane[lane]);
+}
 
-	// Assert the popped job has valid values
-	assert(
-	    out_job->cache_index >= 0 && out_job->cache_index < MAX_TEXCACHE && "tex_jobs_pop: popped invalid cache_index");
-	assert(out_job->generation != 0 && "tex_jobs_pop: popped job with generation=0");
-	assert(out_job->kind == TEXTURE_JOB_MAKE_STAGES_1_2 && "tex_jobs_pop: unknown job kind");
+// Tell the main thread that stage 2 of an entry is done. Call it from the
+// thread that did stage 2, while it still owns the entry.
+void tex_ready_push(int cache_index)
+{
+	texture_job_t job;
 
-	SDL_UnlockMutex(q->mutex);
-	return 1;
+	job.cache_index = cache_index;
+	job.generation = sdlt[cache_index].generation;
+	job.kind = TEXTURE_JOB_UPLOAD_STAGE_3;
+
+	if (!tex_ring_push(&g_tex_jobs.ready, &job)) {
+		__atomic_store_n(&g_tex_jobs.ready_overflow, 1, __ATOMIC_RELEASE);
+	}
+}
+
+// Main thread only. The entry may have been uploaded or evicted since,
+// check the generation and flags before using it.
+int tex_ready_pop(texture_job_t *out_job)
+{
+	return tex_ring_pop(&g_tex_jobs.ready, out_job);
+}
+
+int tex_ready_depth(void)
+{
+	return tex_ring_depth(&g_tex_jobs.ready);
 }
 
 // ============================================================================
 // End of texture job queue implementation
 // ============================================================================
 
+// Allocate the cache metadata and hash table and link all slots into the LRU list.
+// Safe to call again; any previous tables are released (textures are not).
+int sdl_texcache_init(int size)
+{
+	int i;
+
+	if (size < MIN_TEXCACHE) {
+		size = MIN_TEXCACHE;
+	}
+	if (size > MAX_TEXCACHE) {
+		size = MAX_TEXCACHE;
+	}
+
+	sdl_texcache_exit();
+
+	sdlt = xmalloc(sizeof(struct sdl_texture) * (size_t)size, MEM_SDL_BASE);
+	sdlt_cache = xmalloc(sizeof(int) * (size_t)size, MEM_SDL_BASE);
+	if (!sdlt || !sdlt_cache) {
+		fail("Out of memory for texture cache (%d entries)", size);
+		sdl_texcache_exit();
+		return 0;
+	}
+	sdlt_size = size;
+	sdlt_hash_size = size;
+
+	for (i = 0; i < sdlt_hash_size; i++) {
+		sdlt_cache[i] = STX_NONE;
+	}
+
+	for (i = 0; i < sdlt_size; i++) {
+		uint16_t *flags_ptr = (uint16_t *)&sdlt[i].flags;
+		__atomic_store_n(flags_ptr, 0, __ATOMIC_RELAXED);
+		sdlt[i].prev = i - 1;
+		sdlt[i].next = i + 1;
+		sdlt[i].hnext = STX_NONE;
+		sdlt[i].hprev = STX_NONE;
+		sdlt[i].tex = NULL;
+		sdlt[i].atlas = STX_NONE;
+		// Generation starts at 1 (0 is reserved for "never valid for jobs")
+		sdlt[i].generation = 1;
+		sdlt[i].work_state = TX_WORK_IDLE;
+	}
+	sdlt[0].prev = STX_NONE;
+	sdlt[sdlt_size - 1].next = STX_NONE;
+	sdlt_best = 0;
+	sdlt_last = sdlt_size - 1;
+
+	return 1;
+}
+
+void sdl_texcache_exit(void)
+{
+	if (sdlt) {
+		xfree(sdlt);
+		sdlt = NULL;
+	}
+	if (sdlt_cache) {
+		xfree(sdlt_cache);
+		sdlt_cache = NULL;
+	}
+	sdlt_size = sdlt_hash_size = 0;
+}
+
+// Texture memory grows with the square of the scale, and so does the default budget.
+void sdl_texcache_set_budget(int megabytes, int scale)
+{
+	if (megabytes < 0) {
+		megabytes = 0;
+	}
+	if (!megabytes) {
+		megabytes = DEF_TEXBUDGET * scale * scale;
+	}
+	texc_budget = (long long)megabytes * 1024 * 1024;
+}
+
+// Percentage of non-preload sprite requests served from the cache
+double sdl_texcache_hitrate(void)
+{
+	if (texc_hit + texc_miss == 0) {
+		return 0.0;
+	}
+	return 100.0 * (double)texc_hit / (double)(texc_hit + texc_miss);
+}
+
 void sdl_tx_best(int cache_index)
 {
 	assert(cache_index != STX_NONE && "sdl_tx_best(): sidx=SIDX_NONE");
-	assert(cache_index < MAX_TEXCACHE && "sdl_tx_best(): sidx>max_systemcache");
+	assert(cache_index < sdlt_size && "sdl_tx_best(): sidx>max_systemcache");
 
 	if (sdlt[cache_index].prev == STX_NONE) {
 		assert(cache_index == sdlt_best && "sdl_tx_best(): cache_index should be best");
@@ -177,7 +348,7 @@ static inline unsigned int hashfunc(unsigned int sprite, int ml, int ll, int rl,
 	hash = (hash ^ (uint32_t)(ul & 0xFF)) * 16777619u;
 	hash = (hash ^ (uint32_t)(dl & 0xFF)) * 16777619u;
 
-	return hash % (unsigned int)MAX_TEXHASH;
+	return hash % (unsigned int)sdlt_hash_size;
 }
 
 static inline unsigned int hashfunc_text(const char *text, int color, int flags)
@@ -197,7 +368,7 @@ static inline unsigned int hashfunc_text(const char *text, int color, int flags)
 	hash = (hash ^ (uint32_t)color) * 16777619u;
 	hash = (hash ^ (uint32_t)flags) * 16777619u;
 
-	return hash % (unsigned int)MAX_TEXHASH;
+	return hash % (unsigned int)sdlt_hash_size;
 }
 
 #ifdef UNIT_TEST
@@ -234,6 +405,15 @@ extern int if_single_thread_process_one_job(void); // in sdl_core.c
 //   - TX_WORK_QUEUED: Job queued but not yet claimed by a worker
 //   - TX_WORK_IN_WORKER: Worker actively processing this entry
 //
+//   Transitions are the ownership hand-off, there is no lock around them:
+//   - IDLE -> QUEUED: render thread, work_state_cas() before pushing the job
+//   - QUEUED -> IDLE: render thread, if the push failed (lane full)
+//   - QUEUED -> IN_WORKER: worker, work_state_cas() after popping the job
+//   - QUEUED/IDLE -> IN_WORKER: render thread, when it needs the sprite before
+//     any worker started on it (tex_entry_steal). The job stays in the queue
+//     and is skipped when popped.
+//   - IN_WORKER -> IDLE: whoever claimed it, after stage 2 (or a failed load)
+//
 // OWNERSHIP RULES:
 //   Render thread (main):
 //     - WRITES: All flags, work_state, LRU pointers (prev/next), hash chains (hnext/hprev)
@@ -258,10 +438,11 @@ extern int if_single_thread_process_one_job(void); // in sdl_core.c
 //   - This establishes happens-before relationship per C11 memory model
 //
 // EVICTION SAFETY:
-//   - Render thread checks work_state under g_tex_jobs.mutex before evicting
+//   - Render thread checks work_state before evicting
 //   - If work_state != TX_WORK_IDLE, entry cannot be evicted
+//   - Only the render thread leaves TX_WORK_IDLE, so the check can not go stale
 //   - Generation counter (uint32_t) invalidates in-flight jobs after eviction
-//   - Workers check generation before writing results to detect stale jobs
+//   - Workers skip jobs whose generation is stale before claiming the slot
 //
 // WORKER CONTRACT:
 //   - Workers never touch LRU pointers (prev/next)
@@ -297,6 +478,7 @@ struct tex_request {
 	/* 8-bit fields packed together */
 	signed char sink;
 	unsigned char freeze;
+	unsigned char noatlas;
 	unsigned char scale;
 
 	char cr, cg, cb;
@@ -326,6 +508,7 @@ static struct tex_request tex_request_from_args(uint32_t sprite, signed char sin
 
 	r.sink = sink;
 	r.freeze = freeze;
+	r.noatlas = 0;
 	r.scale = scale;
 
 	r.cr = cr;
@@ -390,7 +573,7 @@ static int tex_entry_matches_request(int idx, const struct tex_request *r)
 		    sdlt[idx].cr != r->cr || sdlt[idx].cg != r->cg || sdlt[idx].cb != r->cb || sdlt[idx].light != r->light ||
 		    sdlt[idx].sat != r->sat || sdlt[idx].c1 != r->c1 || sdlt[idx].c2 != r->c2 || sdlt[idx].c3 != r->c3 ||
 		    sdlt[idx].shine != r->shine || sdlt[idx].ml != r->ml || sdlt[idx].ll != r->ll || sdlt[idx].rl != r->rl ||
-		    sdlt[idx].ul != r->ul || sdlt[idx].dl != r->dl) {
+		    sdlt[idx].ul != r->ul || sdlt[idx].dl != r->dl || sdlt[idx].noatlas != r->noatlas) {
 			return 0;
 		}
 		return 1;
@@ -492,6 +675,9 @@ static int tex_entry_build_text(int cache_index, const struct tex_request *r, in
 		SDL_GetTextureSize(sdlt[cache_index].tex, &w, &h);
 		sdlt[cache_index].xres = (uint16_t)w;
 		sdlt[cache_index].yres = (uint16_t)h;
+		// Count text against the texture budget, eviction subtracts it again
+		__atomic_add_fetch(
+		    &mem_tex, sdlt[cache_index].xres * sdlt[cache_index].yres * sizeof(uint32_t), __ATOMIC_RELAXED);
 		// Set flags ONLY if tex creation succeeded
 		uint16_t *flags_ptr = (uint16_t *)&sdlt[cache_index].flags;
 		__atomic_store_n(flags_ptr, SF_USED | SF_TEXT | SF_DIDALLOC | SF_DIDMAKE | SF_DIDTEX, __ATOMIC_RELEASE);
@@ -524,7 +710,7 @@ static int tex_entry_build_sprite(int cache_index, const struct tex_request *r,
 	int ntx;
 
 	if (r->preload != 1) {
-		if (sdl_ic_load(r->sprite, NULL) < 0) {
+		if (sdl_ic_load(r->sprite) < 0) {
 			return STX_NONE;
 		}
 	}
@@ -533,6 +719,7 @@ static int tex_entry_build_sprite(int cache_index, const struct tex_request *r,
 	sdlt[cache_index].sprite = r->sprite;
 	sdlt[cache_index].sink = r->sink;
 	sdlt[cache_index].freeze = r->freeze;
+	sdlt[cache_index].noatlas = r->noatlas;
 	sdlt[cache_index].scale = r->scale;
 	sdlt[cache_index].cr = r->cr;
 	sdlt[cache_index].cg = r->cg;
@@ -554,6 +741,9 @@ static int tex_entry_build_sprite(int cache_index, const struct tex_request *r,
 	uint16_t *flags_ptr = (uint16_t *)&sdlt[cache_index].flags;
 	__atomic_store_n(flags_ptr, SF_USED | SF_SPRITE, __ATOMIC_RELEASE);
 
+	// Keep the decoded image around until stage 2 is done
+	sdl_ic_pin(r->sprite);
+
 	if (r->preload != 1) {
 		sdl_make(sdlt + cache_index, sdli + r->sprite, r->preload);
 	}
@@ -573,12 +763,160 @@ static int tex_entry_build_sprite(int cache_index, const struct tex_request *r,
 	return cache_index;
 }
 
+// Release everything a cache entry holds and unlink it from its hash chain.
+// The slot keeps its position in the LRU list and is empty afterwards.
+// Returns 0 without touching the slot if workers still have a job for it.
+static int texcache_evict(int cache_index)
+{
+	int ptx, ntx, hash2;
+
+	// Slot has queued or in-progress work, cannot evict. Only this thread moves a
+	// slot out of TX_WORK_IDLE, so the answer can not change until we return.
+	if (sdl_multi && (flags_load(&sdlt[cache_index]) & SF_SPRITE) &&
+	    work_state_load(&sdlt[cache_index]) != TX_WORK_IDLE) {
+		return 0;
+	}
+
+	uint16_t flags = flags_load(&sdlt[cache_index]);
+	if (flags & SF_SPRITE) {
+		hash2 = (int)hashfunc(sdlt[cache_index].sprite, sdlt[cache_index].ml, sdlt[cache_index].ll,
+		    sdlt[cache_index].rl, sdlt[cache_index].ul, sdlt[cache_index].dl);
+	} else if (flags & SF_TEXT) {
+		hash2 = (int)hashfunc_text(
+		    sdlt[cache_index].text, (int)sdlt[cache_index].text_color, sdlt[cache_index].text_flags);
+	} else {
+		hash2 = 0;
+		warn("weird entry in texture cache!");
+	}
+
+	ntx = sdlt[cache_index].hnext;
+	ptx = sdlt[cache_index].hprev;
+
+	if (ptx == STX_NONE) {
+		if (sdlt_cache[hash2] != cache_index) {
+			fail("sdli[sprite].cache_index!=cache_index\n");
+			exit(42);
+		}
+		sdlt_cache[hash2] = ntx;
+	} else {
+		sdlt[ptx].hnext = sdlt[cache_index].hnext;
+	}
+
+	if (ntx != STX_NONE) {
+		sdlt[ntx].hprev = sdlt[cache_index].hprev;
+	}
+
+	flags = flags_load(&sdlt[cache_index]);
+	if ((flags & SF_SPRITE) && !(flags & SF_DIDMAKE)) {
+		sdl_ic_unpin(sdlt[cache_index].sprite);
+	}
+	if (flags & SF_DIDTEX) {
+		__atomic_sub_fetch(
+		    &mem_tex, sdlt[cache_index].xres * sdlt[cache_index].yres * sizeof(uint32_t), __ATOMIC_RELAXED);
+		if (sdlt[cache_index].atlas != STX_NONE) {
+			sdl_atlas_release(&sdlt[cache_index]);
+		} else if (sdlt[cache_index].tex) {
+			sdl_batch_flush_tex(sdlt[cache_index].tex);
+			SDL_DestroyTexture(sdlt[cache_index].tex);
+			sdlt[cache_index].tex = NULL; // Clear pointer after destroying
+		}
+	} else if (flags & SF_DIDALLOC) {
+		if (sdlt[cache_index].pixel) {
+#ifdef SDL_FAST_MALLOC
+			FREE(sdlt[cache_index].pixel);
+#else
+			xfree(sdlt[cache_index].pixel);
+#endif
+			sdlt[cache_index].pixel = NULL;
+		}
+	}
+#ifdef SDL_FAST_MALLOC
+	if (flags & SF_TEXT) {
+		FREE(sdlt[cache_index].text);
+		sdlt[cache_index].text = NULL;
+	}
+#else
+	if (flags & SF_TEXT) {
+		xfree(sdlt[cache_index].text);
+		sdlt[cache_index].text = NULL;
+	}
+#endif
+
+	uint16_t *flags_ptr = (uint16_t *)&sdlt[cache_index].flags;
+	__atomic_store_n(flags_ptr, 0, __ATOMIC_RELEASE);
+
+	// Bump generation to invalidate any in-flight jobs for old contents
+	// Guard against wraparound: skip 0 which is reserved for "never valid"
+	uint32_t new_gen = sdlt[cache_index].generation + 1;
+	if (new_gen == 0) {
+		new_gen = 1;
+	}
+	__atomic_store_n(&sdlt[cache_index].generation, new_gen, __ATOMIC_RELEASE);
+	// Reset work_state to IDLE (we verified it was IDLE above, and flags are now
+	// cleared so no job can be queued for this slot until we reinitialize it)
+	work_state_store(&sdlt[cache_index], TX_WORK_IDLE);
+
+	texc_evict++;
+
+	return 1;
+}
+
+// Evict every entry placed on the given atlas page so the page can be reused.
+// Returns the number of entries that are still on the page.
+int sdl_texcache_evict_atlas_page(int page)
+{
+	int cache_index, left = 0;
+
+	for (cache_index = 0; cache_index < sdlt_size; cache_index++) {
+		if (sdlt[cache_index].atlas != page) {
+			continue;
+		}
+		if (!texcache_evict(cache_index)) {
+			left++;
+		}
+	}
+
+	return left;
+}
+
+// Maximum number of LRU entries looked at per call when over budget
+#define TEXCACHE_BUDGET_STEPS 256
+
+// Evict least recently used textures until mem_tex fits the byte budget again.
+// Only entries that own a GPU texture count against the budget, so only
+// those are evicted here. Slot-count eviction in texcache_acquire_slot()
+// still handles the case of running out of entries.
+static void texcache_enforce_budget(void)
+{
+	int cache_index, prev, steps;
+
+	if (texc_budget <= 0 || __atomic_load_n(&mem_tex, __ATOMIC_RELAXED) <= texc_budget) {
+		return;
+	}
+
+	cache_index = sdlt_last;
+	for (steps = 0; cache_index != STX_NONE && steps < TEXCACHE_BUDGET_STEPS; steps++) {
+		if (__atomic_load_n(&mem_tex, __ATOMIC_RELAXED) <= texc_budget) {
+			break;
+		}
+
+		prev = sdlt[cache_index].prev;
+		if ((flags_load(&sdlt[cache_index]) & SF_DIDTEX) && texcache_evict(cache_index)) {
+			texc_evict_budget++;
+		}
+		cache_index = prev;
+	}
+}
+
 // Acquire a slot from the cache (evicting LRU entry if needed)
 // Returns a cache index that is safe to reuse, or STX_NONE if we must bail
 static int texcache_acquire_slot(void)
 {
-	int cache_index = sdlt_last;
-	int ptx, ntx;
+	int cache_index;
+
+	texcache_enforce_budget();
+
+	cache_index = sdlt_last;
 
 	// Try to evict an entry, potentially trying multiple LRU candidates if workers are stuck
 #ifdef DEVELOPER
@@ -591,113 +929,23 @@ static int texcache_acquire_slot(void)
 			break;
 		}
 
-		int hash2;
-		int can_evict = 1;
-
-		// Check work_state under lock
-		if (sdl_multi && (flags_load(&sdlt[cache_index]) & SF_SPRITE)) {
-			SDL_LockMutex(g_tex_jobs.mutex);
-			if (sdlt[cache_index].work_state != TX_WORK_IDLE) {
-				// Slot has queued or in-progress work, cannot evict
-				SDL_UnlockMutex(g_tex_jobs.mutex);
-				can_evict = 0;
-				int candidate = sdlt[cache_index].prev;
-				if (candidate == STX_NONE) {
-					// No more candidates, give up
-#ifdef DEVELOPER
-					sdl_eviction_failures++;
-					if (sdl_eviction_failures == 1 || (sdl_eviction_failures % 100) == 0) {
-						warn("SDL: texture cache eviction failed %d times; workers may be busy", sdl_eviction_failures);
-					}
-#endif
-					return STX_NONE;
-				}
-				cache_index = candidate;
-				continue;
-			}
-			SDL_UnlockMutex(g_tex_jobs.mutex);
+		if (texcache_evict(cache_index)) {
+			break; // Successfully evicted, exit the retry loop
 		}
 
 		// If we can't evict this entry, try the next candidate
-		if (!can_evict) {
-			continue;
-		}
-
-		uint16_t flags = flags_load(&sdlt[cache_index]);
-		if (flags & SF_SPRITE) {
-			hash2 = (int)hashfunc(sdlt[cache_index].sprite, sdlt[cache_index].ml, sdlt[cache_index].ll,
-			    sdlt[cache_index].rl, sdlt[cache_index].ul, sdlt[cache_index].dl);
-		} else if (flags & SF_TEXT) {
-			hash2 = (int)hashfunc_text(
-			    sdlt[cache_index].text, (int)sdlt[cache_index].text_color, sdlt[cache_index].text_flags);
-		} else {
-			hash2 = 0;
-			warn("weird entry in texture cache!");
-		}
-
-		ntx = sdlt[cache_index].hnext;
-		ptx = sdlt[cache_index].hprev;
-
-		if (ptx == STX_NONE) {
-			if (sdlt_cache[hash2] != cache_index) {
-				fail("sdli[sprite].cache_index!=cache_index\n");
-				exit(42);
-			}
-			sdlt_cache[hash2] = ntx;
-		} else {
-			sdlt[ptx].hnext = sdlt[cache_index].hnext;
-		}
-
-		if (ntx != STX_NONE) {
-			sdlt[ntx].hprev = sdlt[cache_index].hprev;
-		}
-
-		flags = flags_load(&sdlt[cache_index]);
-		if (flags & SF_DIDTEX) {
-			__atomic_sub_fetch(
-			    &mem_tex, sdlt[cache_index].xres * sdlt[cache_index].yres * sizeof(uint32_t), __ATOMIC_RELAXED);
-			if (sdlt[cache_index].tex) {
-				SDL_DestroyTexture(sdlt[cache_index].tex);
-				sdlt[cache_index].tex = NULL; // Clear pointer after destroying
-			}
-		} else if (flags & SF_DIDALLOC) {
-			if (sdlt[cache_index].pixel) {
-#ifdef SDL_FAST_MALLOC
-				FREE(sdlt[cache_index].pixel);
-#else
-				xfree(sdlt[cache_index].pixel);
-#endif
-				sdlt[cache_index].pixel = NULL;
+		int candidate = sdlt[cache_index].prev;
+		if (candidate == STX_NONE) {
+			// No more candidates, give up
+#ifdef DEVELOPER
+			sdl_eviction_failures++;
+			if (sdl_eviction_failures == 1 || (sdl_eviction_failures % 100) == 0) {
+				warn("SDL: texture cache eviction failed %d times; workers may be busy", sdl_eviction_failures);
 			}
-		}
-#ifdef SDL_FAST_MALLOC
-		if (flags & SF_TEXT) {
-			FREE(sdlt[cache_index].text);
-			sdlt[cache_index].text = NULL;
-		}
-#else
-		if (flags & SF_TEXT) {
-			xfree(sdlt[cache_index].text);
-			sdlt[cache_index].text = NULL;
-		}
 #endif
-
-		uint16_t *flags_ptr = (uint16_t *)&sdlt[cache_index].flags;
-		__atomic_store_n(flags_ptr, 0, __ATOMIC_RELEASE);
-
-		// Bump generation to invalidate any in-flight jobs for old contents
-		// Guard against wraparound: skip 0 which is reserved for "never valid"
-		uint32_t new_gen = sdlt[cache_index].generation + 1;
-		if (new_gen == 0) {
-			new_gen = 1;
+			return STX_NONE;
 		}
-		sdlt[cache_index].generation = new_gen;
-		// Reset work_state to IDLE (safe without mutex here: we already verified
-		// work_state was IDLE under mutex above, and flags are now cleared so no
-		// worker can queue new jobs for this slot until we reinitialize it)
-		sdlt[cache_index].work_state = TX_WORK_IDLE;
-
-		break; // Successfully evicted, exit the retry loop
+		cache_index = candidate;
 	}
 
 	// *** SAFETY CHECK ***
@@ -721,6 +969,27 @@ static int texcache_acquire_slot(void)
 	return cache_index;
 }
 
+// Take over stages 1+2 of a sprite entry the render thread is waiting for, if
+// no worker has started on it. A job still in the queue for it is skipped by
+// the worker that pops it. Returns 0 if a worker owns the entry.
+static int tex_entry_steal(int cache_index)
+{
+	struct sdl_texture *st = &sdlt[cache_index];
+
+	if (!work_state_cas(st, TX_WORK_QUEUED, TX_WORK_IN_WORKER) &&
+	    !work_state_cas(st, TX_WORK_IDLE, TX_WORK_IN_WORKER)) {
+		return 0;
+	}
+
+	if (!(flags_load(st) & SF_DIDMAKE)) {
+		sdl_make_sprite(st);
+	}
+	work_state_store(st, TX_WORK_IDLE);
+	sdl_render_steals++;
+
+	return 1;
+}
+
 // Ensure an existing cache entry is ready for rendering
 // For text: always ready (created synchronously)
 // For sprites: wait for workers if needed, then create GPU texture if needed
@@ -736,17 +1005,22 @@ static int tex_entry_ensure_ready(int cache_index, const struct tex_request *r)
 	if (!r->preload && (flags_load(&sdlt[cache_index]) & SF_SPRITE)) {
 		// Wait for background workers to complete processing
 		int panic = 0;
-#ifdef DEVELOPER
 		uint64_t wait_start = 0;
-#endif
+
 		while (!(flags_load(&sdlt[cache_index]) & SF_DIDMAKE)) {
-#ifdef DEVELOPER
 			if (wait_start == 0) {
 				wait_start = SDL_GetTicks();
-				extern uint64_t sdl_render_wait_count;
 				sdl_render_wait_count++;
 			}
-#endif
+
+			// No worker has started it: do not wait for the job to come up behind
+			// the speculative prefetches, make it right here
+			if (tex_entry_steal(cache_index)) {
+				if (!(flags_load(&sdlt[cache_index]) & SF_DIDMAKE)) {
+					return STX_NONE; // image failed to load
+				}
+				break;
+			}
 
 			// (function guards on sdl_multi internally)
 			if_single_thread_process_one_job();
@@ -770,11 +1044,10 @@ static int tex_entry_ensure_ready(int cache_index, const struct tex_request *r)
 				return STX_NONE;
 			}
 		}
-#ifdef DEVELOPER
 		if (wait_start > 0) {
 			uint64_t wait_time = SDL_GetTicks() - wait_start;
-			extern uint64_t sdl_render_wait;
 			sdl_render_wait += wait_time;
+			sdl_render_wait_total += wait_time;
 #ifdef DEVELOPER_NOISY
 			// Suppress warnings during boot - only show "real" stalls (>= 10ms)
 			extern int sockstate;
@@ -783,7 +1056,6 @@ static int tex_entry_ensure_ready(int cache_index, const struct tex_request *r)
 			}
 #endif
 		}
-#endif
 
 		// make texture now if preload didn't finish it
 		if (!(flags_load(&sdlt[cache_index]) & SF_DIDTEX)) {
@@ -804,32 +1076,26 @@ static int tex_entry_ensure_ready(int cache_index, const struct tex_request *r)
 // End of request struct helpers
 // ============================================================================
 
-int sdl_tx_load(uint32_t sprite, signed char sink, unsigned char freeze, unsigned char scale, char cr, char cg, char cb,
-    char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl,
-    const char *text, int text_color, int text_flags, void *text_font, int checkonly, int preload)
+static int tex_load(const struct tex_request *r)
 {
 	int cache_index, panic = 0;
 	int hash;
 
-	// Build request struct for cleaner parameter handling
-	struct tex_request req = tex_request_from_args(sprite, sink, freeze, scale, cr, cg, cb, light, sat, c1, c2, c3,
-	    shine, ml, ll, rl, ul, dl, text, text_color, text_flags, text_font, checkonly, preload);
-
-	hash = tex_request_hash(&req);
+	hash = tex_request_hash(r);
 
-	if (sprite >= MAXSPRITE) {
-		note("illegal sprite %u wanted in sdl_tx_load", sprite);
+	if (r->sprite >= MAXSPRITE) {
+		note("illegal sprite %u wanted in sdl_tx_load", r->sprite);
 		return STX_NONE;
 	}
 
 	// Try to find existing entry in cache
-	cache_index = texcache_lookup(&req, hash, &panic);
+	cache_index = texcache_lookup(r, hash, &panic);
 	if (cache_index != STX_NONE) {
 		// Found existing entry
-		if (checkonly) {
+		if (r->checkonly) {
 			return 1;
 		}
-		if (preload == 1) {
+		if (r->preload == 1) {
 			return -1;
 		}
 
@@ -838,7 +1104,7 @@ int sdl_tx_load(uint32_t sprite, signed char sink, unsigned char freeze, unsigne
 		}
 
 		// Ensure texture is ready for rendering (wait for workers, create GPU texture if needed)
-		cache_index = tex_entry_ensure_ready(cache_index, &req);
+		cache_index = tex_entry_ensure_ready(cache_index, r);
 		if (cache_index == STX_NONE) {
 			return STX_NONE;
 		}
@@ -848,13 +1114,13 @@ int sdl_tx_load(uint32_t sprite, signed char sink, unsigned char freeze, unsigne
 		texcache_promote_to_hash_head(cache_index, hash);
 
 		// Update statistics
-		if (!preload) {
+		if (!r->preload) {
 			texc_hit++;
 		}
 
 		return cache_index;
 	}
-	if (checkonly) {
+	if (r->checkonly) {
 		return 0;
 	}
 
@@ -865,10 +1131,10 @@ int sdl_tx_load(uint32_t sprite, signed char sink, unsigned char freeze, unsigne
 	}
 
 	// Build text or sprite entry
-	if (text) {
-		cache_index = tex_entry_build_text(cache_index, &req, hash);
+	if (r->text) {
+		cache_index = tex_entry_build_text(cache_index, r, hash);
 	} else {
-		cache_index = tex_entry_build_sprite(cache_index, &req, hash);
+		cache_index = tex_entry_build_sprite(cache_index, r, hash);
 	}
 
 	if (cache_index == STX_NONE) {
@@ -876,15 +1142,26 @@ int sdl_tx_load(uint32_t sprite, signed char sink, unsigned char freeze, unsigne
 	}
 
 	// update statistics
-	if (preload) {
+	if (r->preload) {
 		texc_pre++;
-	} else if (sprite) { // Do not count missed text sprites. Those are expected.
+	} else if (r->sprite) { // Do not count missed text sprites. Those are expected.
 		texc_miss++;
 	}
 
 	return cache_index;
 }
 
+int sdl_tx_load(uint32_t sprite, signed char sink, unsigned char freeze, unsigned char scale, char cr, char cg, char cb,
+    char light, char sat, int c1, int c2, int c3, int shine, char ml, char ll, char rl, char ul, char dl,
+    const char *text, int text_color, int text_flags, void *text_font, int checkonly, int preload)
+{
+	// Build request struct for cleaner parameter handling
+	struct tex_request req = tex_request_from_args(sprite, sink, freeze, scale, cr, cg, cb, light, sat, c1, c2, c3,
+	    shine, ml, ll, rl, ul, dl, text, text_color, text_flags, text_font, checkonly, preload);
+
+	return tex_load(&req);
+}
+
 #ifdef DEVELOPER
 int *dumpidx;
 
@@ -936,12 +1213,12 @@ void sdl_dump_spritecache(void)
 	char filename[MAX_PATH];
 	FILE *fp;
 
-	dumpidx = xmalloc(sizeof(int) * (size_t)MAX_TEXCACHE, MEM_TEMP);
-	for (i = 0; i < MAX_TEXCACHE; i++) {
+	dumpidx = xmalloc(sizeof(int) * (size_t)sdlt_size, MEM_TEMP);
+	for (i = 0; i < sdlt_size; i++) {
 		dumpidx[i] = i;
 	}
 
-	qsort(dumpidx, (size_t)MAX_TEXCACHE, sizeof(int), dump_cmp);
+	qsort(dumpidx, (size_t)sdlt_size, sizeof(int), dump_cmp);
 
 	if (localdata) {
 		sprintf(filename, "%s%s", localdata, "sdlt.txt");
@@ -954,7 +1231,7 @@ void sdl_dump_spritecache(void)
 		return;
 	}
 
-	for (i = 0; i < MAX_TEXCACHE; i++) {
+	for (i = 0; i < sdlt_size; i++) {
 		n = dumpidx[i];
 		if (!flags_load(&sdlt[n])) {
 			break;
@@ -1003,7 +1280,7 @@ void sdl_dump_spritecache(void)
 		size += (double)(sdlt[n].xres) * (double)(sdlt[n].yres) * sizeof(uint32_t);
 	}
 	fprintf(fp, "\n%d unique sprites, %d sprites + %d texts of %d used. %.2fM texture memory.\n", uni, cnt, text,
-	    MAX_TEXCACHE, size / (1024.0 * 1024.0));
+	    sdlt_size, size / (1024.0 * 1024.0));
 	fclose(fp);
 	xfree(dumpidx);
 }
@@ -1054,8 +1331,11 @@ long long sdl_get_mem_tex(void)
 // Get SDL_Texture* for a sprite with default item lighting
 // Returns NULL if sprite loading fails
 // Caller should NOT destroy the returned texture - it's managed by the cache
-DLL_EXPORT SDL_Texture *sdl_get_sprite_texture(unsigned int sprite, int *out_width, int *out_height)
+static SDL_Texture *sprite_texture(unsigned int sprite, int *out_width, int *out_height, float *uv, int noatlas)
 {
+	struct tex_request req;
+	int cache_index;
+
 	if (sprite == 0 || sprite >= MAXSPRITE) {
 		return NULL;
 	}
@@ -1063,10 +1343,11 @@ DLL_EXPORT SDL_Texture *sdl_get_sprite_texture(unsigned int sprite, int *out_wid
 	// Load sprite with default item lighting (light=15, no color mods)
 	// sink=0, freeze=0, scale=100, no color shift, normal light, no saturation
 	// c1/c2/c3=0 (no palette swap), shine=0, uniform directional lighting at 15
-	int cache_index = sdl_tx_load(sprite, 0, 0, 100, 0, 0, 0, 15, 0, 0, 0, 0, 0, 15, 15, 15, 15, 15,
-	                              NULL, 0, 0, NULL, 0, 0);
+	req = tex_request_from_args(sprite, 0, 0, 100, 0, 0, 0, 15, 0, 0, 0, 0, 0, 15, 15, 15, 15, 15, NULL, 0, 0, NULL, 0, 0);
+	req.noatlas = (unsigned char)noatlas;
+	cache_index = tex_load(&req);
 
-	if (cache_index < 0 || cache_index >= MAX_TEXCACHE) {
+	if (cache_index < 0 || cache_index >= sdlt_size) {
 		return NULL;
 	}
 
@@ -1078,5 +1359,31 @@ DLL_EXPORT SDL_Texture *sdl_get_sprite_texture(unsigned int sprite, int *out_wid
 	if (out_width) *out_width = sdlt[cache_index].xres;
 	if (out_height) *out_height = sdlt[cache_index].yres;
 
+	if (uv) {
+		if (sdlt[cache_index].atlas != STX_NONE) {
+			uv[0] = (float)sdlt[cache_index].ax / ATLAS_PAGE_SIZE;
+			uv[1] = (float)sdlt[cache_index].ay / ATLAS_PAGE_SIZE;
+			uv[2] = (float)(sdlt[cache_index].ax + sdlt[cache_index].xres * sdl_scale) / ATLAS_PAGE_SIZE;
+			uv[3] = (float)(sdlt[cache_index].ay + sdlt[cache_index].yres * sdl_scale) / ATLAS_PAGE_SIZE;
+		} else {
+			uv[0] = uv[1] = 0.0f;
+			uv[2] = uv[3] = 1.0f;
+		}
+	}
+
 	return sdlt[cache_index].tex;
 }
+
+// Small sprites live on a shared atlas page: uv (u0, v0, u1, v1) receives the
+// part of the returned texture that holds the sprite.
+DLL_EXPORT SDL_Texture *sdl_get_sprite_texture_uv(unsigned int sprite, int *out_width, int *out_height, float *uv)
+{
+	return sprite_texture(sprite, out_width, out_height, uv, 0);
+}
+
+// Same as above for callers that draw the whole texture. The sprite gets a
+// texture of its own, separate from the entry the game blits from the atlas.
+DLL_EXPORT SDL_Texture *sdl_get_sprite_texture(unsigned int sprite, int *out_width, int *out_height)
+{
+	return sprite_texture(sprite, out_width, out_height, NULL, 1);
+}
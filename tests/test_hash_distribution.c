@@ -11,7 +11,6 @@
 
 #include <string.h>
 #include <stdio.h>
-#include <zip.h>
 
 // ============================================================================
 // Valid sprite list (populated from ZIP at test startup)
@@ -33,16 +32,16 @@ static void build_valid_sprite_list(void)
 
 	fprintf(stderr, "  Enumerating sprites from gx1.zip...\n");
 	
-	zip_int64_t n = zip_get_num_entries(sdl_zip1, 0);
-	for (zip_int64_t i = 0; i < n && num_valid_sprites < MAX_VALID_SPRITES; i++) {
-		const char *name = zip_get_name(sdl_zip1, (zip_uint64_t)i, 0);
+	int64_t n = sdl_archive_entries(sdl_zip1);
+	for (int64_t i = 0; i < n && num_valid_sprites < MAX_VALID_SPRITES; i++) {
+		const char *name = sdl_archive_name(sdl_zip1, i);
 		if (!name)
 			continue;
 
 		unsigned int sprite_num = 0;
 		if (sscanf(name, "%u.png", &sprite_num) == 1) {
 			// Try to load it (validates PNG)
-			if (sdl_ic_load(sprite_num, NULL) >= 0) {
+			if (sdl_ic_load(sprite_num) >= 0) {
 				if (sdli[sprite_num].xres > 0 && sdli[sprite_num].yres > 0) {
 					valid_sprites[num_valid_sprites++] = sprite_num;
 				}
@@ -121,7 +120,7 @@ static void print_hash_distribution(const char *label)
 
 	fprintf(stderr, "\n=== Hash Distribution: %s ===\n", label);
 
-	for (int hash = 0; hash < MAX_TEXHASH; hash++) {
+	for (int hash = 0; hash < sdlt_hash_size; hash++) {
 		bucket_stats_t stats = analyze_bucket(hash);
 		
 		if (stats.chain_length > 0) {
@@ -148,7 +147,7 @@ static void print_hash_distribution(const char *label)
 
 	fprintf(stderr, "  Total entries: %d\n", total_entries);
 	fprintf(stderr, "  Non-empty buckets: %d / %d (%.1f%%)\n", 
-		nonempty_buckets, MAX_TEXHASH, 100.0 * nonempty_buckets / MAX_TEXHASH);
+		nonempty_buckets, sdlt_hash_size, 100.0 * nonempty_buckets / sdlt_hash_size);
 	fprintf(stderr, "  Max chain length: %d (bucket %d)\n", max_chain, max_chain_hash);
 	fprintf(stderr, "  Buckets with >10 entries: %d\n", buckets_over_10);
 	fprintf(stderr, "  Buckets with >50 entries: %d\n", buckets_over_50);
@@ -206,7 +205,7 @@ TEST(test_text_spam_simulation)
 	int max_chain = 0;
 	int max_chain_hash = -1;
 	
-	for (int hash = 0; hash < MAX_TEXHASH; hash++) {
+	for (int hash = 0; hash < sdlt_hash_size; hash++) {
 		bucket_stats_t stats = analyze_bucket(hash);
 		if (stats.chain_length > 0) {
 			nonempty_buckets++;
@@ -222,7 +221,7 @@ TEST(test_text_spam_simulation)
 	fprintf(stderr, "  Hash Distribution Quality:\n");
 	fprintf(stderr, "    Total entries:      %d\n", total_entries);
 	fprintf(stderr, "    Non-empty buckets:  %d / %d (%.1f%%)\n", 
-		nonempty_buckets, MAX_TEXHASH, 100.0 * nonempty_buckets / MAX_TEXHASH);
+		nonempty_buckets, sdlt_hash_size, 100.0 * nonempty_buckets / sdlt_hash_size);
 	fprintf(stderr, "    Max chain length:   %d (bucket %d)\n", max_chain, max_chain_hash);
 	fprintf(stderr, "    Expected max:       1-2 (with good hash)\n");
 	fprintf(stderr, "\n");
@@ -302,12 +301,12 @@ TEST(test_text_hash_distribution)
 	fprintf(stderr, "     Low bucket clustering: %d/%d (%.2f%%)\n",
 		low_bucket_count, total_hashes, 100.0 * low_bucket_count / total_hashes);
 	fprintf(stderr, "     Expected with uniform hash: ~%.1f%% (%d hashes in buckets 0-99)\n",
-		100.0 * 100 / MAX_TEXHASH, total_hashes * 100 / MAX_TEXHASH);
+		100.0 * 100 / sdlt_hash_size, total_hashes * 100 / sdlt_hash_size);
 	fprintf(stderr, "\n");
 	
-	// With uniform distribution, expect (100/MAX_TEXHASH)% in first 100 buckets
+	// With uniform distribution, expect (100/sdlt_hash_size)% in first 100 buckets
 	// Allow 3x the expected percentage to account for statistical variance
-	int expected_in_low_buckets = (total_hashes * 100) / MAX_TEXHASH;
+	int expected_in_low_buckets = (total_hashes * 100) / sdlt_hash_size;
 	int threshold = expected_in_low_buckets * 3;
 	ASSERT_TRUE(low_bucket_count < threshold);
 }
@@ -355,7 +354,7 @@ TEST(test_hash_function_quality)
 	// Load ALL valid sprites - this will exceed cache size (32,768) and force evictions
 	// This is the true stress test: 50,000+ sprites will cause ~20k evictions
 	fprintf(stderr, "     Loading %d sprites (cache size = %d, will force evictions)...\n", 
-		num_valid_sprites, MAX_TEXCACHE);
+		num_valid_sprites, sdlt_size);
 	
 	int loaded = 0;
 	int low_bucket_count = 0;
@@ -378,7 +377,7 @@ TEST(test_hash_function_quality)
 
 	// Now count final distribution (cache contains most recent ~32k entries)
 	int total_entries = 0;
-	for (int hash = 0; hash < MAX_TEXHASH; hash++) {
+	for (int hash = 0; hash < sdlt_hash_size; hash++) {
 		bucket_stats_t stats = analyze_bucket(hash);
 		total_entries += stats.chain_length;
 		
@@ -389,16 +388,16 @@ TEST(test_hash_function_quality)
 	}
 
 	fprintf(stderr, "     Loaded %d sprites total (%d evicted due to cache limit)\n", 
-		loaded, loaded > MAX_TEXCACHE ? loaded - MAX_TEXCACHE : 0);
+		loaded, loaded > sdlt_size ? loaded - sdlt_size : 0);
 	fprintf(stderr, "     Final cache contains: %d entries\n", total_entries);
 	fprintf(stderr, "     Low bucket clustering: %d/%d (%.1f%%)\n", 
 		low_bucket_count, total_entries, 100.0 * low_bucket_count / total_entries);
-	fprintf(stderr, "     Expected with uniform hash: ~%.1f%%\n", 100.0 * 100 / MAX_TEXHASH);
+	fprintf(stderr, "     Expected with uniform hash: ~%.1f%%\n", 100.0 * 100 / sdlt_hash_size);
 	fprintf(stderr, "\n");
 	
-	// With uniform distribution, we expect (100/MAX_TEXHASH)% in first 100 buckets
+	// With uniform distribution, we expect (100/sdlt_hash_size)% in first 100 buckets
 	// Allow 3x the expected percentage to account for variance with evictions
-	int expected_in_low_buckets = (total_entries * 100) / MAX_TEXHASH;
+	int expected_in_low_buckets = (total_entries * 100) / sdlt_hash_size;
 	int threshold = expected_in_low_buckets * 3;
 	ASSERT_TRUE(low_bucket_count < threshold);
 }
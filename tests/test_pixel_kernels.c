@@ -0,0 +1,560 @@
+/*
+ * Pixel Kernel Tests - Row kernels of sdl_make() stage 2
+ *
+ * The SSE2/AVX2/NEON row kernels in sdl_rowfx.c must give exactly the same
+ * pixels as the per pixel functions in sdl_effects.c. Every kernel set the CPU
+ * supports is run against the scalar functions, with row lengths that are not
+ * a multiple of the vector width so the tail loops get tested too.
+ */
+
+#include "../src/astonia.h"
+#include "../src/sdl/sdl_private.h"
+#include "../src/sdl/sdl.h"
+#include "test.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define ROW_LEN 77
+
+static uint32_t rnd_state = 12345;
+
+static uint32_t rnd(void)
+{
+	rnd_state = rnd_state * 1103515245u + 12345u;
+	return rnd_state >> 8;
+}
+
+static int isa_supported(int isa)
+{
+	int best = sdl_rowfx_isa();
+
+	return isa == ROWFX_SCALAR || isa == best || (isa == ROWFX_SSE2 && best == ROWFX_AVX2);
+}
+
+// Random pixels, plus every byte value in every channel so tables and
+// clamping see the full range
+static void fill_row(uint32_t *row, int n, int base)
+{
+	int x, v;
+
+	for (x = 0; x < n; x++) {
+		v = (base + x) & 255;
+		if (x & 1) {
+			row[x] = rnd() | (rnd() << 24);
+		} else {
+			row[x] = IRGBA(v, 255 - v, (v * 7) & 255, rnd() & 255);
+		}
+	}
+}
+
+static int first_mismatch(const uint32_t *a, const uint32_t *b, int n)
+{
+	int x;
+
+	for (x = 0; x < n; x++) {
+		if (a[x] != b[x]) {
+			return x;
+		}
+	}
+	return -1;
+}
+
+// ============================================================================
+// Test: Color balance
+// ============================================================================
+
+TEST(test_rowfx_colorbalance_matches_scalar)
+{
+	static const int16_t vals[] = {-128, -100, -77, -20, -3, -1, 0, 1, 2, 13, 20, 50, 99, 127};
+	struct sdl_texture st;
+	struct sdl_rowfx fx;
+	uint32_t src[ROW_LEN], ref[ROW_LEN], out[ROW_LEN];
+	int i, x, isa, bad;
+
+	fprintf(stderr, "  → Testing colorbalance row kernels...\n");
+
+	for (i = 0; i < 4000; i++) {
+		memset(&st, 0, sizeof(st));
+		st.cr = vals[rnd() % 14];
+		st.cg = vals[rnd() % 14];
+		st.cb = vals[rnd() % 14];
+		st.light = vals[rnd() % 14];
+		st.sat = vals[rnd() % 14];
+		if (i & 1) {
+			st.sat = 0;
+		}
+
+		fill_row(src, ROW_LEN, i);
+		for (x = 0; x < ROW_LEN; x++) {
+			ref[x] =
+			    sdl_colorbalance(src[x], (char)st.cr, (char)st.cg, (char)st.cb, (char)st.light, (char)st.sat);
+		}
+
+		for (isa = ROWFX_SCALAR; isa <= ROWFX_NEON; isa++) {
+			if (!isa_supported(isa)) {
+				continue;
+			}
+			sdl_rowfx_prepare(&fx, &st, 1024);
+			fx.isa = isa;
+			memcpy(out, src, sizeof(out));
+			sdl_rowfx_colorbalance(&fx, out, ROW_LEN);
+			bad = first_mismatch(ref, out, ROW_LEN);
+			if (bad >= 0) {
+				fprintf(stderr, "     isa %d cr=%d cg=%d cb=%d light=%d sat=%d pixel %08X: want %08X got %08X\n", isa,
+				    st.cr, st.cg, st.cb, st.light, st.sat, src[bad], ref[bad], out[bad]);
+			}
+			ASSERT_EQ_INT(-1, bad);
+		}
+	}
+
+	fprintf(stderr, "     Colorbalance kernels OK\n");
+}
+
+// ============================================================================
+// Test: Shine
+// ============================================================================
+
+TEST(test_rowfx_shine_matches_scalar)
+{
+	struct sdl_texture st;
+	struct sdl_rowfx fx;
+	uint32_t src[256], ref[256], out[256];
+	int shine, x, npix, bad;
+
+	fprintf(stderr, "  → Testing shine row kernel...\n");
+
+	for (shine = 1; shine <= 120; shine++) {
+		memset(&st, 0, sizeof(st));
+		st.shine = (uint16_t)shine;
+
+		fill_row(src, 256, shine);
+		for (x = 0; x < 256; x++) {
+			ref[x] = sdl_shine_pix(src[x], st.shine);
+		}
+
+		// with and without the table
+		for (npix = 16; npix <= 1024; npix *= 64) {
+			sdl_rowfx_prepare(&fx, &st, npix);
+			memcpy(out, src, sizeof(out));
+			sdl_rowfx_shine(&fx, out, 256);
+			bad = first_mismatch(ref, out, 256);
+			if (bad >= 0) {
+				fprintf(stderr, "     shine=%d npix=%d pixel %08X: want %08X got %08X\n", shine, npix, src[bad], ref[bad],
+				    out[bad]);
+			}
+			ASSERT_EQ_INT(-1, bad);
+		}
+	}
+
+	fprintf(stderr, "     Shine kernel OK\n");
+}
+
+// ============================================================================
+// Test: Light
+// ============================================================================
+
+// The old per pixel light formula, before sdl_light() used tables
+static int light_formula(int val, int light, uint64_t options)
+{
+	int v1, v2, m = 3, d = 4;
+
+	if (light == 0) {
+		return min(255, val * 2 + 4);
+	}
+	if (options & (GO_LIGHTER | GO_LIGHTER2)) {
+		v1 = val * light / 15;
+		v2 = (int)(val * sqrt(light) / 3.87);
+		if (options & GO_LIGHTER) {
+			m--;
+			d--;
+		}
+		if (options & GO_LIGHTER2) {
+			m -= 2;
+			d -= 2;
+		}
+		return (v1 * m + v2) / d;
+	}
+	return val * light / 15;
+}
+
+TEST(test_light_tables_match_formula)
+{
+	static const uint64_t modes[] = {0, GO_LIGHTER, GO_LIGHTER2, GO_LIGHTER | GO_LIGHTER2};
+	uint64_t old_options = game_options;
+	uint32_t want, got;
+	int m, light, val, bad = 0;
+
+	fprintf(stderr, "  → Testing light tables...\n");
+
+	for (m = 0; m < 4; m++) {
+		game_options = (old_options & ~(uint64_t)(GO_LIGHTER | GO_LIGHTER2)) | modes[m];
+		for (light = 0; light < 16; light++) {
+			for (val = 0; val < 256; val++) {
+				want = IRGBA(light_formula(val, light, modes[m]), light_formula(255 - val, light, modes[m]),
+				    light_formula(val / 2, light, modes[m]), val);
+				got = sdl_light(light, IRGBA(val, 255 - val, val / 2, val));
+				bad += (want != got);
+			}
+		}
+		ASSERT_TRUE(sdl_light_table(-1) == NULL);
+		ASSERT_TRUE(sdl_light_table(16) == NULL);
+		ASSERT_TRUE(sdl_light_table(7)[100] == light_formula(100, 7, modes[m]));
+	}
+	game_options = old_options;
+
+	ASSERT_EQ_INT(0, bad);
+
+	fprintf(stderr, "     Light tables OK\n");
+}
+
+TEST(test_rowfx_light_matches_scalar)
+{
+	static const uint64_t modes[] = {0, GO_LIGHTER, GO_LIGHTER2, GO_LIGHTER | GO_LIGHTER2};
+	uint64_t old_options = game_options;
+	struct sdl_texture st;
+	struct sdl_rowfx fx;
+	uint32_t src[ROW_LEN], ref[ROW_LEN], out[ROW_LEN];
+	int m, light, x, isa, bad;
+
+	fprintf(stderr, "  → Testing light row kernels...\n");
+
+	for (m = 0; m < 4; m++) {
+		game_options = (old_options & ~(uint64_t)(GO_LIGHTER | GO_LIGHTER2)) | modes[m];
+
+		// sdl_light() takes the square root of the light in the GO_LIGHTER modes
+		for (light = m ? 0 : -2; light <= 20; light++) {
+			memset(&st, 0, sizeof(st));
+			st.ml = st.ll = st.rl = st.ul = st.dl = (int8_t)light;
+
+			fill_row(src, ROW_LEN, light * 31);
+			for (x = 0; x < ROW_LEN; x++) {
+				ref[x] = sdl_light(light, src[x]);
+			}
+
+			for (isa = ROWFX_SCALAR; isa <= ROWFX_NEON; isa++) {
+				if (!isa_supported(isa)) {
+					continue;
+				}
+				sdl_rowfx_prepare(&fx, &st, 1024);
+				fx.isa = isa;
+				sdl_rowfx_light(&fx, ROWFX_ML, src, out, ROW_LEN);
+				bad = first_mismatch(ref, out, ROW_LEN);
+				if (bad >= 0) {
+					fprintf(stderr, "     isa %d mode %d light=%d pixel %08X: want %08X got %08X\n", isa, m, light,
+					    src[bad], ref[bad], out[bad]);
+				}
+				ASSERT_EQ_INT(-1, bad);
+			}
+		}
+	}
+
+	game_options = old_options;
+
+	fprintf(stderr, "     Light kernels OK\n");
+}
+
+TEST(test_rowfx_light_blend_same_on_all_isas)
+{
+	struct sdl_texture st;
+	struct sdl_rowfx fx;
+	uint32_t src[40 * 4], ref[40 * 4], out[40 * 4];
+	int i, y, n, isa, bad, old_scale = sdl_scale;
+
+	fprintf(stderr, "  → Testing five way light blend...\n");
+
+	for (sdl_scale = 1; sdl_scale <= 4; sdl_scale++) {
+		n = 40 * sdl_scale;
+		for (i = 0; i < 50; i++) {
+			memset(&st, 0, sizeof(st));
+			st.ml = (int8_t)(rnd() % 16);
+			st.ll = (int8_t)(rnd() % 16);
+			st.rl = (int8_t)(rnd() % 16);
+			st.ul = (int8_t)(rnd() % 16);
+			st.dl = (int8_t)(rnd() % 16);
+
+			for (y = 0; y < 60 * sdl_scale; y += 7) {
+				fill_row(src, n, y + i);
+
+				sdl_rowfx_prepare(&fx, &st, 1024);
+				fx.isa = ROWFX_SCALAR;
+				memcpy(ref, src, sizeof(ref));
+				sdl_rowfx_light_blend(&fx, ref, n, y);
+
+				for (isa = ROWFX_SSE2; isa <= ROWFX_NEON; isa++) {
+					if (!isa_supported(isa)) {
+						continue;
+					}
+					fx.isa = isa;
+					memcpy(out, src, sizeof(out));
+					sdl_rowfx_light_blend(&fx, out, n, y);
+					bad = first_mismatch(ref, out, n);
+					ASSERT_EQ_INT(-1, bad);
+				}
+			}
+		}
+	}
+	sdl_scale = old_scale;
+
+	fprintf(stderr, "     Light blend OK\n");
+}
+
+// ============================================================================
+// Test: Freeze
+// ============================================================================
+
+TEST(test_rowfx_freeze_matches_scalar)
+{
+	struct sdl_texture st;
+	struct sdl_rowfx fx;
+	uint32_t src[ROW_LEN], ref[ROW_LEN], out[ROW_LEN];
+	int freeze, x, isa, bad;
+
+	fprintf(stderr, "  → Testing freeze row kernels...\n");
+
+	for (freeze = 0; freeze < 256; freeze++) {
+		memset(&st, 0, sizeof(st));
+		st.freeze = (uint8_t)freeze;
+
+		fill_row(src, ROW_LEN, freeze);
+		for (x = 0; x < ROW_LEN; x++) {
+			ref[x] = sdl_freeze(freeze, src[x]);
+		}
+
+		for (isa = ROWFX_SCALAR; isa <= ROWFX_NEON; isa++) {
+			if (!isa_supported(isa)) {
+				continue;
+			}
+			sdl_rowfx_prepare(&fx, &st, 1024);
+			fx.isa = isa;
+			memcpy(out, src, sizeof(out));
+			sdl_rowfx_freeze(&fx, out, ROW_LEN);
+			bad = first_mismatch(ref, out, ROW_LEN);
+			ASSERT_EQ_INT(-1, bad);
+		}
+	}
+
+	fprintf(stderr, "     Freeze kernels OK\n");
+}
+
+// ============================================================================
+// Test: Scaler
+// ============================================================================
+
+// Mostly random pixels, with some strongly green, blue and red ones so the
+// colorize channels kick in
+static void fill_image(struct sdl_image *si)
+{
+	int n, cnt = si->xres * si->yres * sdl_scale * sdl_scale;
+
+	for (n = 0; n < cnt; n++) {
+		switch (rnd() % 5) {
+		case 0:
+			si->pixel[n] = IRGBA(rnd() % 60, 128 + rnd() % 128, rnd() % 60, 255);
+			break;
+		case 1:
+			si->pixel[n] = IRGBA(rnd() % 60, rnd() % 60, 128 + rnd() % 128, 255);
+			break;
+		case 2:
+			si->pixel[n] = IRGBA(128 + rnd() % 128, rnd() % 40, rnd() % 40, rnd() & 255);
+			break;
+		default:
+			si->pixel[n] = rnd() | (rnd() << 24);
+			break;
+		}
+	}
+}
+
+// The fixed point scaler against the old double precision one. Both truncate,
+// but they round differently on the way, so a few channels are off by one.
+TEST(test_scaler_matches_double_reference)
+{
+	static const int scales[] = {50, 75, 88, 99, 101, 133, 200};
+	static const uint16_t colors[][3] = {{0, 0, 0}, {0x7c00, 0, 0}, {0x03e0 | 0x8000, 0x001f, 0x7fff}};
+	static uint32_t src[48 * 32 * 4], out[48 * 2 * 32 * 2 * 4];
+	struct sdl_texture st;
+	struct sdl_image si;
+	struct sdl_scaler sc;
+	int old_scale = sdl_scale, s, c, sprite, x, y, w, h, d, maxdiff = 0, off = 0, total = 0;
+	uint32_t ref, got;
+
+	fprintf(stderr, "  → Testing fixed point scaler against the double reference...\n");
+
+	for (sdl_scale = 1; sdl_scale <= 2; sdl_scale++) {
+		for (s = 0; s < 7; s++) {
+			for (c = 0; c < 3; c++) {
+				for (sprite = 100; sprite <= 230000; sprite += 229900) {
+					memset(&si, 0, sizeof(si));
+					si.xres = 48;
+					si.yres = 32;
+					si.pixel = src;
+					fill_image(&si);
+
+					memset(&st, 0, sizeof(st));
+					st.sprite = (unsigned int)sprite;
+					st.c1 = colors[c][0];
+					st.c2 = colors[c][1];
+					st.c3 = colors[c][2];
+					st.xres = (uint16_t)ceil((si.xres - 1) * (double)scales[s] / 100.0);
+					st.yres = (uint16_t)ceil((si.yres - 1) * (double)scales[s] / 100.0);
+					w = st.xres * sdl_scale;
+					h = st.yres * sdl_scale;
+
+					sdl_scaler_init(&sc, &st, &si, scales[s]);
+					for (y = 0; y < h; y++) {
+						sdl_scaler_row(&sc, y, out + y * w, w);
+					}
+					sdl_scaler_exit(&sc);
+
+					for (y = 0; y < h; y++) {
+						for (x = 0; x < w; x++) {
+							ref = sdl_rowfx_scale_pixel_ref(&st, &si, scales[s], x, y);
+							got = out[x + y * w];
+							d = max(max(abs((int)IGET_A(ref) - (int)IGET_A(got)), abs((int)IGET_R(ref) - (int)IGET_R(got))),
+							    max(abs((int)IGET_G(ref) - (int)IGET_G(got)), abs((int)IGET_B(ref) - (int)IGET_B(got))));
+							maxdiff = max(maxdiff, d);
+							off += (ref != got);
+							total++;
+						}
+					}
+				}
+			}
+		}
+	}
+	sdl_scale = old_scale;
+
+	fprintf(stderr, "     %d of %d pixels differ, by at most %d\n", off, total, maxdiff);
+	ASSERT_TRUE(maxdiff <= 1);
+	ASSERT_TRUE(off * 20 < total);
+
+	fprintf(stderr, "     Scaler OK\n");
+}
+
+// ============================================================================
+// Test: PNG rows
+// ============================================================================
+
+// What sdl_load_image_png() did per pixel before it used sdl_png_row()
+static uint32_t png_pixel_reference(int r, int g, int b, int a, int premulti)
+{
+	if (r == 255 && g == 0 && b == 255) {
+		a = 0;
+	}
+	if (!a) {
+		return 0;
+	}
+	if (premulti) {
+		r = min(255, r * 255 / a);
+		g = min(255, g * 255 / a);
+		b = min(255, b * 255 / a);
+	}
+	return IRGBA(r, g, b, a);
+}
+
+TEST(test_png_row_matches_reference)
+{
+	uint8_t src[ROW_LEN * 4];
+	uint32_t ref[ROW_LEN], out[ROW_LEN];
+	int isas[2] = {ROWFX_SCALAR, sdl_png_isa()};
+	int n, x, i, bpp, premulti, sx, ex, first, last, bad;
+
+	fprintf(stderr, "  → Testing PNG row conversion...\n");
+
+	for (n = 0; n <= ROW_LEN; n++) {
+		for (bpp = 24; bpp <= 32; bpp += 8) {
+			// Mostly runs of clear and opaque pixels, with keyed and translucent ones mixed in
+			for (x = 0; x < n * 4; x++) {
+				src[x] = (uint8_t)rnd();
+			}
+			for (x = 0; x < n; x++) {
+				switch (rnd() % 6) {
+				case 0:
+					src[x * 4 + 0] = 255;
+					src[x * 4 + 1] = 0;
+					src[x * 4 + 2] = 255;
+					break;
+				case 1:
+				case 2:
+					src[x * 4 + 3] = 0;
+					break;
+				case 3:
+					break;
+				default:
+					src[x * 4 + 3] = 255;
+					break;
+				}
+			}
+
+			for (premulti = 0; premulti < 2; premulti++) {
+				first = n;
+				last = 0;
+				for (x = 0; x < n; x++) {
+					if (bpp == 24) {
+						ref[x] = png_pixel_reference(src[x * 3], src[x * 3 + 1], src[x * 3 + 2], 255, premulti);
+					} else {
+						ref[x] = png_pixel_reference(
+						    src[x * 4], src[x * 4 + 1], src[x * 4 + 2], src[x * 4 + 3], premulti);
+					}
+					if (ref[x]) {
+						first = min(first, x);
+						last = x + 1;
+					}
+				}
+
+				for (i = 0; i < 2; i++) {
+					ex = sdl_png_row(out, src, n, bpp, premulti, isas[i], &sx);
+					bad = first_mismatch(ref, out, n);
+					ASSERT_EQ_INT(-1, bad);
+					ASSERT_EQ_INT(last, ex);
+					if (ex) {
+						ASSERT_EQ_INT(first, sx);
+					}
+				}
+			}
+		}
+	}
+
+	fprintf(stderr, "     PNG rows OK\n");
+}
+
+// sdl_premulti() uses a reciprocal table, it must still divide exactly
+TEST(test_premulti_matches_divide)
+{
+	uint32_t pixel[256], ref[256];
+	int a, v, bad;
+
+	fprintf(stderr, "  → Testing pre-multiply table...\n");
+
+	for (a = 0; a < 256; a++) {
+		for (v = 0; v < 256; v++) {
+			pixel[v] = IRGBA(v, 255 - v, (v * 7) & 255, a);
+			ref[v] = pixel[v];
+			if (a) {
+				ref[v] = IRGBA(min(255, v * 255 / a), min(255, (255 - v) * 255 / a),
+				    min(255, ((v * 7) & 255) * 255 / a), a);
+			}
+		}
+		sdl_premulti(pixel, 16, 16, 1);
+		bad = first_mismatch(ref, pixel, 256);
+		ASSERT_EQ_INT(-1, bad);
+	}
+
+	fprintf(stderr, "     Pre-multiply OK\n");
+}
+
+TEST_MAIN(
+	fprintf(stderr, "\n=== Pixel Kernel Tests (kernel set %d) ===\n\n", sdl_rowfx_isa());
+	sdl_light_init();
+
+	test_rowfx_colorbalance_matches_scalar();
+	test_rowfx_shine_matches_scalar();
+	test_light_tables_match_formula();
+	test_rowfx_light_matches_scalar();
+	test_rowfx_light_blend_same_on_all_isas();
+	test_rowfx_freeze_matches_scalar();
+	test_scaler_matches_double_reference();
+	test_png_row_matches_reference();
+	test_premulti_matches_divide();
+)
@@ -11,11 +11,11 @@
 
 #include "../src/astonia.h"  // Must come first for tick_t and other typedefs
 #include "../src/sdl/sdl_private.h"
+#include "../src/sdl/sdl.h"
 #include "test.h"
 
 #include <string.h>
 #include <time.h>
-#include <zip.h>
 
 // ============================================================================
 // Valid sprite list (populated from ZIP at test startup)
@@ -39,14 +39,14 @@ static void build_valid_sprite_list(void)
 
 	fprintf(stderr, "Enumerating and validating sprites from gx1.zip...\n");
 
-	zip_int64_t n = zip_get_num_entries(sdl_zip1, 0);
+	int64_t n = sdl_archive_entries(sdl_zip1);
 	int candidates = 0;
 	int filtered_not_png = 0;
 	int filtered_bad_signature = 0;
 	int filtered_load_failed = 0;
 
-	for (zip_int64_t i = 0; i < n && num_valid_sprites < MAX_VALID_SPRITES; i++) {
-		const char *name = zip_get_name(sdl_zip1, (zip_uint64_t)i, 0);
+	for (int64_t i = 0; i < n && num_valid_sprites < MAX_VALID_SPRITES; i++) {
+		const char *name = sdl_archive_name(sdl_zip1, i);
 		if (!name)
 			continue;
 
@@ -56,36 +56,35 @@ static void build_valid_sprite_list(void)
 			candidates++;
 
 			// Step 1: Check PNG signature
-			struct zip_stat st;
-			if (zip_stat_index(sdl_zip1, (zip_uint64_t)i, 0, &st) != 0) {
+			if (sdl_archive_size(sdl_zip1, i) < 8) {
 				filtered_not_png++;
 				continue;
 			}
 
-			zip_file_t *zf = zip_fopen_index(sdl_zip1, (zip_uint64_t)i, 0);
-			if (!zf) {
+			struct sdl_archive_file zf;
+			if (sdl_archive_fopen(&zf, sdl_zip1, i)) {
 				filtered_not_png++;
 				continue;
 			}
 
 			unsigned char header[8];
-			if (zip_fread(zf, header, 8) != 8) {
-				zip_fclose(zf);
+			if (sdl_archive_fread(&zf, header, 8) != 8) {
+				sdl_archive_fclose(&zf);
 				filtered_not_png++;
 				continue;
 			}
 
 			// PNG signature: 137 80 78 71 13 10 26 10
 			if (!(header[0] == 137 && header[1] == 80 && header[2] == 78 && header[3] == 71)) {
-				zip_fclose(zf);
+				sdl_archive_fclose(&zf);
 				filtered_bad_signature++;
 				continue;
 			}
-			zip_fclose(zf);
+			sdl_archive_fclose(&zf);
 
 			// Step 2: Try to actually load it with sdl_ic_load
 			// This validates the PNG can be decoded and has valid dimensions
-			if (sdl_ic_load(sprite_num, NULL) < 0) {
+			if (sdl_ic_load(sprite_num) < 0) {
 				filtered_load_failed++;
 				continue;
 			}
@@ -188,7 +187,7 @@ TEST(test_basic_insert_and_lookup)
 	    /* checkonly */ 0,
 	    /* preload */ 0);
 
-	ASSERT_IN_RANGE(idx1, 0, MAX_TEXCACHE - 1);
+	ASSERT_IN_RANGE(idx1, 0, sdlt_size - 1);
 
 	uint16_t flags = flags_load(&sdlt[idx1]);
 	ASSERT_TRUE(flags & SF_USED);
@@ -270,7 +269,7 @@ TEST(test_hash_chains_no_corruption_after_insertions)
 		unsigned int sprite = get_valid_sprite(i);
 		int idx =
 		    sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
-		ASSERT_IN_RANGE(idx, 0, MAX_TEXCACHE - 1);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
 	}
 
 	// Check all invariants (including hash chains)
@@ -323,7 +322,7 @@ TEST(test_eviction_basic)
 		unsigned int sprite = get_valid_sprite(i);
 		int idx =
 		    sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
-		ASSERT_IN_RANGE(idx, 0, MAX_TEXCACHE - 1);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
 
 		// Every 100 iterations, check invariants
 		if (i % 100 == 0) {
@@ -336,26 +335,267 @@ TEST(test_eviction_basic)
 	sdl_shutdown_for_tests();
 }
 
+TEST(test_eviction_by_budget)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing byte budget eviction (1MB budget, 1000 sprites)...\n");
+
+	// Far below what 1000 sprites need, so the budget has to evict long before the slots run out
+	texc_budget = 1024 * 1024;
+
+	for (int i = 0; i < 1000; i++) {
+		unsigned int sprite = get_valid_sprite(i);
+		int idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+
+		// Only the texture just created may push us over the budget
+		long long size = (long long)sdlt[idx].xres * sdlt[idx].yres * (long long)sizeof(uint32_t);
+		ASSERT_TRUE(mem_tex <= texc_budget + size);
+
+		if (i % 100 == 0) {
+			ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+		}
+	}
+
+	ASSERT_TRUE(texc_evict_budget > 0);
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	fprintf(stderr, "  ✓ Budget eviction keeps mem_tex in bounds (%lld evictions over budget)\n", texc_evict_budget);
+
+	sdl_shutdown_for_tests();
+}
+
+TEST(test_image_cache_eviction)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing decoded image eviction and pinning...\n");
+
+	// A slot that was allocated but not made yet must keep its image
+	unsigned int pinned = get_valid_sprite(0);
+	int pidx = sdl_tx_load(pinned, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 1);
+	ASSERT_IN_RANGE(pidx, 0, sdlt_size - 1);
+	ASSERT_TRUE(sdl_ic_load(pinned) >= 0);
+
+	for (int i = 1; i < 200; i++) {
+		unsigned int sprite = get_valid_sprite(i);
+		(void)sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+	}
+
+	// Squeeze the budget down to a single byte: everything unpinned has to go
+	imgc_budget = 1;
+	sdl_ic_trim();
+
+	ASSERT_TRUE(imgc_evict > 0);
+	ASSERT_EQ_INT(IMG_READY, sdli_state[pinned]);
+	ASSERT_PTR_NOT_NULL(sdli[pinned].pixel);
+
+	unsigned int evicted = get_valid_sprite(1);
+	if (evicted != pinned) {
+		ASSERT_EQ_INT(IMG_UNLOADED, sdli_state[evicted]);
+		ASSERT_TRUE(sdli[evicted].pixel == NULL);
+		ASSERT_TRUE(sdli[evicted].xres > 0); // dimensions survive eviction
+
+		// Evicted images load again on demand
+		imgc_budget = 0;
+		int idx = sdl_tx_load(evicted, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+		ASSERT_EQ_INT(IMG_READY, sdli_state[evicted]);
+	}
+
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	fprintf(stderr, "  ✓ Unpinned images evicted (%lld), pinned image kept\n", imgc_evict);
+
+	sdl_shutdown_for_tests();
+}
+
+TEST(test_atlas_batches_small_sprites)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing sprite atlas placement...\n");
+
+	int placed[200], n = 0;
+
+	for (int i = 0; i < 200; i++) {
+		unsigned int sprite = get_valid_sprite(i);
+		int idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+		if (sdlt[idx].atlas != STX_NONE) {
+			placed[n++] = idx;
+		}
+	}
+	ASSERT_TRUE(n > 0);
+	ASSERT_EQ_INT(n, sdl_atlas_sprites());
+
+	// Blitting atlas sprites back to back must not switch textures per blit
+	sdl_test_reset_render_counters();
+	for (int page = 0; page < ATLAS_MAX_PAGES; page++) {
+		for (int i = 0; i < n; i++) {
+			if (sdlt[placed[i]].atlas == page) {
+				sdl_blit(placed[i], 10, 10, 0, 0, 800, 600, 0, 0);
+			}
+		}
+	}
+	ASSERT_EQ_INT(n, sdl_test_get_render_texture_count());
+	ASSERT_TRUE(sdl_test_get_texture_switch_count() <= sdl_atlas_pages());
+
+	// The mod API hands out whole textures, never an atlas page
+	SDL_Texture *tex = sdl_get_sprite_texture(sdlt[placed[0]].sprite, NULL, NULL);
+	ASSERT_TRUE(tex != NULL);
+	ASSERT_TRUE(tex != sdlt[placed[0]].tex);
+
+	// Emptying a page gives its space back and leaves no entry pointing at it
+	ASSERT_EQ_INT(0, sdl_texcache_evict_atlas_page(sdlt[placed[0]].atlas));
+	ASSERT_TRUE(sdl_atlas_sprites() < n);
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	fprintf(stderr, "  ✓ %d sprites on %d atlas pages, %d texture switches\n", n, sdl_atlas_pages(),
+	    sdl_test_get_texture_switch_count());
+
+	sdl_shutdown_for_tests();
+}
+
+TEST(test_batched_blits_draw_calls)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing batched blit submission...\n");
+
+	int placed[200], n = 0;
+
+	for (int i = 0; i < 200; i++) {
+		unsigned int sprite = get_valid_sprite(i);
+		int idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+		if (sdlt[idx].atlas == 0) {
+			placed[n++] = idx;
+		}
+	}
+	ASSERT_TRUE(n > 1);
+
+	// Before: one draw call per blit
+	sdl_test_reset_render_counters();
+	for (int i = 0; i < n; i++) {
+		sdl_blit(placed[i], 10, 10, 0, 0, 800, 600, 0, 0);
+	}
+	int before = sdl_test_get_render_total_count();
+	ASSERT_EQ_INT(n, before);
+
+	// After: all quads of the page in one call, the alpha of each blit rides along
+	sdl_test_reset_render_counters();
+	sdl_batch_begin();
+	for (int i = 0; i < n; i++) {
+		if (i == 1) {
+			sdl_tex_alpha(placed[i], 128);
+		}
+		sdl_blit(placed[i], 10, 10, 0, 0, 800, 600, 0, 0);
+		if (i == 1) {
+			sdl_tex_alpha(placed[i], 255);
+		}
+	}
+	ASSERT_EQ_INT(0, sdl_test_get_render_total_count()); // nothing submitted before the flush
+	sdl_batch_end();
+	int after = sdl_test_get_render_total_count();
+	ASSERT_EQ_INT(1, after);
+	ASSERT_EQ_INT(n, sdl_test_get_render_quad_count());
+
+	// Fully clipped blits add no quads
+	sdl_test_reset_render_counters();
+	sdl_batch_begin();
+	sdl_blit(placed[0], 900, 900, 0, 0, 800, 600, 0, 0);
+	sdl_batch_end();
+	ASSERT_EQ_INT(0, sdl_test_get_render_total_count());
+
+	fprintf(stderr, "  ✓ %d blits: %d draw calls unbatched, %d batched\n", n, before, after);
+
+	sdl_shutdown_for_tests();
+}
+
+TEST(test_text_uses_glyph_atlas)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing text drawn from the glyph atlas...\n");
+
+	// A 2x2 block for every letter, nothing for the space
+	static unsigned char block[] = {0, 1, 254, 0, 1, 255}, blank[] = {255};
+	struct renderfont font[128];
+	for (int c = 0; c < 128; c++) {
+		font[c].dim = 3;
+		font[c].raw = (c == ' ') ? blank : block;
+	}
+
+	int used = texc_used;
+
+	// One draw call per string, one quad per visible letter, no cache entries
+	sdl_test_reset_render_counters();
+	int x = sdl_drawtext(10, 10, 0x7fff, 0, "two words", &font[0], 0, 0, 800, 600, 0, 0);
+	ASSERT_EQ_INT(10 + 9 * 3, x);
+	ASSERT_EQ_INT(1, sdl_test_get_render_total_count());
+	ASSERT_EQ_INT(8, sdl_test_get_render_quad_count());
+
+	// Other colors reuse the same atlas
+	sdl_test_reset_render_counters();
+	sdl_drawtext(10, 20, 0x001f, 0, "two words", &font[0], 0, 0, 800, 600, 0, 0);
+	sdl_drawtext(10, 30, 0x7c00, 0, "other", &font[0], 0, 0, 800, 600, 0, 0);
+	ASSERT_EQ_INT(2, sdl_test_get_render_total_count());
+	ASSERT_EQ_INT(1, sdl_test_get_texture_switch_count());
+	ASSERT_EQ_INT(1, sdl_glyph_fonts());
+	ASSERT_EQ_INT(used, texc_used);
+
+	// An outline font shares the page, text and outline are one draw call
+	static unsigned char frame[] = {0, 1, 1, 254, 0, 2, 254, 0, 1, 1, 255};
+	struct renderfont ofont[128];
+	for (int c = 0; c < 128; c++) {
+		ofont[c].dim = 3;
+		ofont[c].raw = (c == ' ') ? blank : frame;
+	}
+
+	sdl_test_reset_render_counters();
+	x = sdl_drawtext_outlined(10, 40, 0x7fff, 0, 0, "two words", &font[0], &ofont[0], -1, 0, 0, 800, 600, 0, 0);
+	ASSERT_EQ_INT(10 + 9 * 3, x);
+	ASSERT_EQ_INT(1, sdl_test_get_render_total_count());
+	ASSERT_EQ_INT(16, sdl_test_get_render_quad_count());
+	ASSERT_EQ_INT(2, sdl_glyph_fonts());
+	ASSERT_EQ_INT(used, texc_used);
+
+	// Inside an open batch text joins the sprite quads, clipped letters add none
+	sdl_test_reset_render_counters();
+	sdl_batch_begin();
+	sdl_drawtext(10, 10, 0x7fff, 0, "abc", &font[0], 0, 0, 14, 600, 0, 0);
+	sdl_drawtext(10, 900, 0x7fff, 0, "abc", &font[0], 0, 0, 800, 600, 0, 0);
+	ASSERT_EQ_INT(0, sdl_test_get_render_total_count());
+	sdl_batch_end();
+	ASSERT_EQ_INT(2, sdl_test_get_render_quad_count());
+
+	fprintf(stderr, "  ✓ Text drawn as glyph quads, %d cache entries used\n", texc_used - used);
+
+	sdl_shutdown_for_tests();
+}
+
 TEST(test_full_cache_stress)
 {
 	ASSERT_TRUE(sdl_init_for_tests());
 
-	fprintf(stderr, "Loading full cache (%d textures)...\n", MAX_TEXCACHE);
+	fprintf(stderr, "Loading full cache (%d textures)...\n", sdlt_size);
 
-	// Fill the ENTIRE cache (8000 textures) to simulate real gameplay
+	// Fill the ENTIRE cache (every slot) to simulate real gameplay
 	// This is critical - real gameplay fills the cache in minutes
-	for (int i = 0; i < MAX_TEXCACHE; i++) {
+	for (int i = 0; i < sdlt_size; i++) {
 		// Cycle through valid sprites, using different parameters to create unique cache entries
 		unsigned int sprite = get_valid_sprite(i);
 		int scale = 1 + (i % 3); // Vary scale 1-3 to create more cache entries
 
 		int idx = sdl_tx_load(sprite, 0, 0, (unsigned char)scale, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0,
 		    NULL, 0, 0);
-		ASSERT_IN_RANGE(idx, 0, MAX_TEXCACHE - 1);
+		ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
 
 		// Check invariants every 5000 textures (don't slow down too much)
 		if (i > 0 && i % 5000 == 0) {
-			fprintf(stderr, "  Loaded %d/%d textures...\n", i, MAX_TEXCACHE);
+			fprintf(stderr, "  Loaded %d/%d textures...\n", i, sdlt_size);
 			ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
 		}
 	}
@@ -366,7 +606,7 @@ TEST(test_full_cache_stress)
 	// Now force eviction by loading MORE textures (should evict LRU)
 	fprintf(stderr, "  Testing eviction under full cache...\n");
 	for (int i = 0; i < 1000; i++) {
-		unsigned int sprite = get_valid_sprite(MAX_TEXCACHE + i);
+		unsigned int sprite = get_valid_sprite(sdlt_size + i);
 		(void)sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
 	}
 
@@ -392,7 +632,7 @@ TEST(test_cache_deduplication)
 	int initial_used = 0;
 
 	// Count initial cache usage
-	for (int i = 0; i < MAX_TEXCACHE; i++) {
+	for (int i = 0; i < sdlt_size; i++) {
 		if (flags_load(&sdlt[i]) & SF_USED) {
 			initial_used++;
 		}
@@ -419,7 +659,7 @@ TEST(test_cache_deduplication)
 
 	// Verify we only added a few entries, not 100+
 	int final_used = 0;
-	for (int i = 0; i < MAX_TEXCACHE; i++) {
+	for (int i = 0; i < sdlt_size; i++) {
 		if (flags_load(&sdlt[i]) & SF_USED) {
 			final_used++;
 		}
@@ -446,12 +686,10 @@ TEST(test_eviction_refuses_in_flight_jobs)
 	// Load a sprite
 	unsigned int sprite = get_valid_sprite(0);
 	int idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
-	ASSERT_IN_RANGE(idx, 0, MAX_TEXCACHE - 1);
+	ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
 
 	// Simulate a worker taking the job (set work_state to IN_WORKER)
-	SDL_LockMutex(g_tex_jobs.mutex);
-	sdlt[idx].work_state = TX_WORK_IN_WORKER;
-	SDL_UnlockMutex(g_tex_jobs.mutex);
+	work_state_store(&sdlt[idx], TX_WORK_IN_WORKER);
 
 	// Now try to evict this entry by loading many other sprites
 	// The eviction logic should skip this entry because work_state != IDLE
@@ -465,9 +703,7 @@ TEST(test_eviction_refuses_in_flight_jobs)
 	ASSERT_EQ_INT(TX_WORK_IN_WORKER, sdlt[idx].work_state);
 
 	// Clean up
-	SDL_LockMutex(g_tex_jobs.mutex);
-	sdlt[idx].work_state = TX_WORK_IDLE;
-	SDL_UnlockMutex(g_tex_jobs.mutex);
+	work_state_store(&sdlt[idx], TX_WORK_IDLE);
 
 	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
 
@@ -504,6 +740,587 @@ TEST(test_generation_invalidates_stale_jobs)
 	sdl_shutdown_for_tests();
 }
 
+TEST(test_job_lanes_priority_and_stale_jobs)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing job queue lanes, full lanes and stale jobs...\n");
+
+	unsigned int sprite_a = get_valid_sprite(0);
+	unsigned int sprite_b = get_valid_sprite(1);
+	int idx_a = sdl_tx_load(sprite_a, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+	int idx_b = sdl_tx_load(sprite_b, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+	ASSERT_IN_RANGE(idx_a, 0, sdlt_size - 1);
+	ASSERT_IN_RANGE(idx_b, 0, sdlt_size - 1);
+	ASSERT_NE_INT(idx_a, idx_b);
+
+	// Queue a prefetch job first, then one needed this frame
+	texture_job_t job_a = {idx_a, sdlt[idx_a].generation, TEXTURE_JOB_MAKE_STAGES_1_2};
+	texture_job_t job_b = {idx_b, sdlt[idx_b].generation, TEXTURE_JOB_MAKE_STAGES_1_2};
+	work_state_store(&sdlt[idx_a], TX_WORK_QUEUED);
+	ASSERT_TRUE(tex_jobs_push(&job_a, TEX_LANE_PREFETCH));
+	work_state_store(&sdlt[idx_b], TX_WORK_QUEUED);
+	ASSERT_TRUE(tex_jobs_push(&job_b, TEX_LANE_NOW));
+
+	ASSERT_EQ_INT(2, sdl_get_job_queue_depth_for_test());
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	// The NOW lane is drained first, regardless of push order
+	texture_job_t job;
+	ASSERT_TRUE(tex_jobs_pop(&job));
+	ASSERT_EQ_INT(idx_b, job.cache_index);
+	ASSERT_TRUE(tex_jobs_pop(&job));
+	ASSERT_EQ_INT(idx_a, job.cache_index);
+	ASSERT_FALSE(tex_jobs_pop(&job));
+	ASSERT_EQ_INT(0, sdl_get_job_queue_depth_for_test());
+
+	work_state_store(&sdlt[idx_a], TX_WORK_IDLE);
+	work_state_store(&sdlt[idx_b], TX_WORK_IDLE);
+
+	// A job from before the slot was reused is dropped without touching the slot
+	uint32_t stale_gen = sdlt[idx_a].generation + 1;
+	if (stale_gen == 0) {
+		stale_gen = 1;
+	}
+	texture_job_t stale = {idx_a, stale_gen, TEXTURE_JOB_MAKE_STAGES_1_2};
+	ASSERT_TRUE(tex_jobs_push(&stale, TEX_LANE_NOW));
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+	ASSERT_EQ_INT(0, if_single_thread_process_one_job());
+	ASSERT_EQ_INT(TX_WORK_IDLE, work_state_load(&sdlt[idx_a]));
+	ASSERT_EQ_INT(0, sdl_get_job_queue_depth_for_test());
+
+	// Fill the prefetch lane: it refuses more jobs, the NOW lane still takes them
+	for (int i = 0; i < TEX_JOB_CAPACITY; i++) {
+		ASSERT_TRUE(tex_jobs_push(&stale, TEX_LANE_PREFETCH));
+	}
+	ASSERT_FALSE(tex_jobs_push(&stale, TEX_LANE_PREFETCH));
+	ASSERT_TRUE(tex_jobs_push(&stale, TEX_LANE_NOW));
+	ASSERT_EQ_INT(TEX_JOB_CAPACITY + 1, sdl_get_job_queue_depth_for_test());
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	int popped = 0;
+	while (tex_jobs_pop(&job)) {
+		popped++;
+	}
+	ASSERT_EQ_INT(TEX_JOB_CAPACITY + 1, popped);
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	fprintf(stderr, "  ✓ NOW lane drains first, full lanes refuse jobs, stale jobs are dropped\n");
+
+	sdl_shutdown_for_tests();
+}
+
+TEST(test_render_thread_steals_queued_job)
+{
+	extern uint64_t sdl_render_steals, sdl_render_wait_count;
+
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing render thread taking over a queued job...\n");
+
+	// A preloaded entry whose job is still waiting in the prefetch lane
+	unsigned int sprite = get_valid_sprite(0);
+	int idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 1);
+	ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+	ASSERT_FALSE(flags_load(&sdlt[idx]) & SF_DIDMAKE);
+
+	texture_job_t job = {idx, sdlt[idx].generation, TEXTURE_JOB_MAKE_STAGES_1_2};
+	work_state_store(&sdlt[idx], TX_WORK_QUEUED);
+	ASSERT_TRUE(tex_jobs_push(&job, TEX_LANE_PREFETCH));
+
+	uint64_t steals = sdl_render_steals, waits = sdl_render_wait_count;
+
+	// Needing it now makes it on the render thread instead of waiting for the job
+	int idx2 = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
+	ASSERT_EQ_INT(idx, idx2);
+	ASSERT_TRUE(flags_load(&sdlt[idx]) & SF_DIDMAKE);
+	ASSERT_TRUE(flags_load(&sdlt[idx]) & SF_DIDTEX);
+	ASSERT_EQ_INT(TX_WORK_IDLE, work_state_load(&sdlt[idx]));
+	ASSERT_EQ_INT(steals + 1, sdl_render_steals);
+	ASSERT_EQ_INT(waits + 1, sdl_render_wait_count);
+
+	// The job is left over and skipped when it comes up
+	ASSERT_EQ_INT(1, sdl_get_job_queue_depth_for_test());
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+	ASSERT_EQ_INT(0, if_single_thread_process_one_job());
+	ASSERT_EQ_INT(0, sdl_get_job_queue_depth_for_test());
+	ASSERT_EQ_INT(TX_WORK_IDLE, work_state_load(&sdlt[idx]));
+
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	fprintf(stderr, "  ✓ Render thread made the queued sprite itself, the left-over job was skipped\n");
+
+	sdl_shutdown_for_tests();
+}
+
+TEST(test_upload_ready_list)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing the upload-ready list and its time budget...\n");
+
+	// Single-threaded preloads do stages 1+2 inline and queue the upload
+	int idx[8];
+	for (int i = 0; i < 8; i++) {
+		unsigned int sprite = get_valid_sprite(i);
+		sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		idx[i] = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 1, 0);
+		ASSERT_EQ_INT(1, idx[i]); // checkonly: present
+	}
+	ASSERT_EQ_INT(8, tex_ready_depth());
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	// A frame that is already due still gets at least one upload
+	int uploads = sdl_pre_do(SDL_GetTicks());
+	ASSERT_TRUE(uploads >= 1);
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	// Plenty of time: the rest goes
+	uploads += sdl_pre_tick_for_tests();
+	ASSERT_EQ_INT(8, uploads);
+	ASSERT_EQ_INT(0, tex_ready_depth());
+	ASSERT_FALSE(g_tex_jobs.ready_has_next);
+
+	for (int i = 0; i < sdlt_size; i++) {
+		uint16_t flags = flags_load(&sdlt[i]);
+		if (flags & SF_DIDMAKE) {
+			ASSERT_TRUE(flags & SF_DIDTEX);
+		}
+	}
+
+	// Entries lost to a full list are found by the overflow scan
+	for (int i = 8; i < 12; i++) {
+		sdl_pre_add(get_valid_sprite(i), 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	}
+	texture_job_t job;
+	while (tex_ready_pop(&job)) {
+	}
+	__atomic_store_n(&g_tex_jobs.ready_overflow, 1, __ATOMIC_RELEASE);
+	ASSERT_EQ_INT(4, sdl_pre_tick_for_tests());
+	ASSERT_EQ_INT(0, g_tex_jobs.ready_overflow);
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	fprintf(stderr, "  ✓ Ready list uploads within budget, overflow scan recovers lost entries\n");
+
+	sdl_shutdown_for_tests();
+}
+
+// ============================================================================
+// Frame statistics
+// ============================================================================
+
+#define TEST_STATS_CSV "bin/test_texstats.csv"
+
+TEST(test_frame_stats_ring)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing per frame statistics...\n");
+
+	struct sdl_stats s;
+	ASSERT_EQ_INT(0, sdl_stats_frames());
+	ASSERT_FALSE(sdl_stats_get(0, &s));
+
+	// Frame n has n hits, one miss every other frame and a 4KB upload
+	for (int n = 0; n < 1100; n++) {
+		texc_hit += n;
+		texc_miss += n & 1;
+		texc_upload++;
+		texc_upload_bytes += 4096;
+		sdl_stats_frame();
+	}
+
+	// The ring keeps the newest frames
+	int frames = sdl_stats_frames();
+	ASSERT_TRUE(frames > 0 && frames < 1100);
+	ASSERT_TRUE(sdl_stats_get(0, &s));
+	ASSERT_EQ_INT(1099, (int)s.hit);
+	ASSERT_EQ_INT(1, (int)s.miss);
+	ASSERT_EQ_INT(1, (int)s.upload);
+	ASSERT_EQ_INT(4096, (int)s.upload_bytes);
+	ASSERT_TRUE(sdl_stats_get(frames - 1, &s));
+	ASSERT_EQ_INT(1100 - frames, (int)s.hit);
+	ASSERT_FALSE(sdl_stats_get(frames, &s));
+
+	// Counters reset behind our back do not show up as huge values
+	texc_hit = 0;
+	sdl_stats_frame();
+	ASSERT_TRUE(sdl_stats_get(0, &s));
+	ASSERT_EQ_INT(0, (int)s.hit);
+
+	// One CSV line per frame after the header
+	ASSERT_EQ_INT(frames, sdl_stats_write(TEST_STATS_CSV, 0));
+	FILE *fp = fopen(TEST_STATS_CSV, "r");
+	ASSERT_PTR_NOT_NULL(fp);
+	char line[256];
+	int lines = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		lines++;
+	}
+	fclose(fp);
+	remove(TEST_STATS_CSV);
+	ASSERT_EQ_INT(frames + 1, lines);
+
+	fprintf(stderr, "  ✓ %d frames kept, newest first\n", frames);
+
+	sdl_shutdown_for_tests();
+}
+
+// ============================================================================
+// Sprite disk cache
+// ============================================================================
+
+#define TEST_DISK_CACHE "bin/test_sprites.cache"
+
+// Allocate a slot for sprite without making it and run stages 1+2 like a worker
+static int disk_cache_make(unsigned int sprite)
+{
+	int idx = sdl_tx_load(sprite, 0, 0, 100, 10, 0, 0, 0, 0, 0, 0, 0, 0, 12, 12, 12, 12, 12, NULL, 0, 0, NULL, 0, 1);
+	if (idx < 0 || idx >= sdlt_size) {
+		return STX_NONE;
+	}
+	if (sdl_make_sprite(&sdlt[idx]) < 0) {
+		return STX_NONE;
+	}
+	return idx;
+}
+
+TEST(test_disk_cache_roundtrip)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing sprites made from the disk cache...\n");
+
+	SDL_RemovePath(TEST_DISK_CACHE);
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, 64ll * 1024 * 1024));
+
+	// First session: a miss, the sprite is made and stored
+	unsigned int sprite = get_valid_sprite(3);
+	int idx = disk_cache_make(sprite);
+	ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+	ASSERT_EQ_INT(1, (int)dc_misses);
+	ASSERT_EQ_INT(1, (int)dc_stores);
+
+	struct sdl_texture made = sdlt[idx];
+	size_t bytes = (size_t)made.xres * made.yres * (size_t)(sdl_scale * sdl_scale) * sizeof(uint32_t);
+	uint32_t *copy = xmalloc(bytes, MEM_TEMP);
+	ASSERT_PTR_NOT_NULL(copy);
+	memcpy(copy, made.pixel, bytes);
+
+	sdl_dc_exit();
+	sdl_shutdown_for_tests();
+
+	// Second session: the same entry comes from the file without decoding
+	ASSERT_TRUE(sdl_init_for_tests());
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, 64ll * 1024 * 1024));
+	idx = disk_cache_make(sprite);
+	ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+	ASSERT_EQ_INT(1, (int)dc_hits);
+	ASSERT_EQ_INT(0, (int)dc_stores);
+	ASSERT_EQ_INT(IMG_UNLOADED, sdli_state[sprite]);
+	ASSERT_EQ_INT(0, sdli[sprite].pins);
+	ASSERT_TRUE(flags_load(&sdlt[idx]) & SF_DIDMAKE);
+	ASSERT_EQ_INT(made.xres, sdlt[idx].xres);
+	ASSERT_EQ_INT(made.yres, sdlt[idx].yres);
+	ASSERT_EQ_INT(made.xoff, sdlt[idx].xoff);
+	ASSERT_EQ_INT(made.yoff, sdlt[idx].yoff);
+	ASSERT_EQ_INT(0, memcmp(copy, sdlt[idx].pixel, bytes));
+	xfree(copy);
+
+	// Stage 3 keeps the size from the file, sdli[sprite] was never loaded
+	sdl_make(&sdlt[idx], &sdli[sprite], 3);
+	ASSERT_EQ_INT(made.xres, sdlt[idx].xres);
+	ASSERT_EQ_INT(made.yres, sdlt[idx].yres);
+	ASSERT_TRUE(sdlt[idx].xres > 0 && sdlt[idx].yres > 0);
+	ASSERT_PTR_NOT_NULL(sdlt[idx].tex);
+	ASSERT_TRUE(flags_load(&sdlt[idx]) & SF_DIDTEX);
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	// Other light settings make other pixels: the file starts over
+	sdl_dc_exit();
+	game_options |= GO_LIGHTER;
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, 64ll * 1024 * 1024));
+	ASSERT_EQ_INT(0, (int)dc_hits);
+	game_options &= ~GO_LIGHTER;
+	sdl_dc_exit();
+
+	SDL_RemovePath(TEST_DISK_CACHE);
+
+	fprintf(stderr, "  ✓ Stored sprite came back identical and got its texture, changed settings invalidate the file\n");
+
+	sdl_shutdown_for_tests();
+}
+
+// Make valid sprites from *next on until at least want bytes of pixels were stored
+static long long disk_cache_fill(int *next, long long want)
+{
+	long long stored = 0, stores;
+	int idx;
+
+	while (stored < want && *next < num_valid_sprites) {
+		stores = dc_stores;
+		idx = disk_cache_make(get_valid_sprite((*next)++));
+		if (idx != STX_NONE && dc_stores > stores) {
+			stored += (long long)sdlt[idx].xres * sdlt[idx].yres * sdl_scale * sdl_scale * (long long)sizeof(uint32_t);
+		}
+	}
+	return stored;
+}
+
+TEST(test_disk_cache_budget)
+{
+	const long long budget = 16 * 1024 * 1024;
+	SDL_PathInfo info;
+	int next = 1, idx;
+
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing the disk cache budget and compaction...\n");
+
+	SDL_RemovePath(TEST_DISK_CACHE);
+
+	// Session 1: the first sprite, then others up to a bit over half the budget
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, budget));
+	unsigned int first = get_valid_sprite(0);
+	unsigned int oldest = get_valid_sprite(1);
+	ASSERT_IN_RANGE(disk_cache_make(first), 0, sdlt_size - 1);
+	ASSERT_TRUE(disk_cache_fill(&next, budget * 55 / 100) < budget * 3 / 4);
+	sdl_dc_exit();
+	sdl_shutdown_for_tests();
+
+	// Session 2: only the first sprite is used
+	ASSERT_TRUE(sdl_init_for_tests());
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, budget));
+	ASSERT_IN_RANGE(disk_cache_make(first), 0, sdlt_size - 1);
+	ASSERT_EQ_INT(1, (int)dc_hits);
+	sdl_dc_exit();
+	sdl_shutdown_for_tests();
+
+	// Session 3: new sprites push the file past 3/4 of the budget, then past the
+	// budget; closing compacts it to half
+	ASSERT_TRUE(sdl_init_for_tests());
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, budget));
+	disk_cache_fill(&next, budget / 4);
+	while (!dc_full && next < num_valid_sprites) {
+		disk_cache_fill(&next, 1);
+	}
+	ASSERT_TRUE(dc_full > 0);
+	ASSERT_TRUE(SDL_GetPathInfo(TEST_DISK_CACHE, &info));
+	ASSERT_TRUE((long long)info.size <= budget);
+	sdl_dc_exit();
+	ASSERT_TRUE(SDL_GetPathInfo(TEST_DISK_CACHE, &info));
+	ASSERT_TRUE((long long)info.size <= budget / 2);
+	sdl_shutdown_for_tests();
+
+	// Session 4: the sprite used in session 2 survived, the oldest unused one did not
+	ASSERT_TRUE(sdl_init_for_tests());
+	ASSERT_TRUE(sdl_dc_init(TEST_DISK_CACHE, budget));
+	idx = disk_cache_make(first);
+	ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+	ASSERT_EQ_INT(1, (int)dc_hits);
+	idx = disk_cache_make(oldest);
+	ASSERT_IN_RANGE(idx, 0, sdlt_size - 1);
+	ASSERT_EQ_INT(1, (int)dc_hits);
+	ASSERT_EQ_INT(1, (int)dc_misses);
+	sdl_dc_exit();
+
+	SDL_RemovePath(TEST_DISK_CACHE);
+
+	fprintf(stderr, "  ✓ Stores stop at the budget, compaction keeps the recently used sprites\n");
+
+	sdl_shutdown_for_tests();
+}
+
+// ============================================================================
+// Archive index
+// ============================================================================
+
+static int same_image(struct sdl_image *a, struct sdl_image *b)
+{
+	size_t bytes = (size_t)a->xres * a->yres * sizeof(uint32_t) * (size_t)(sdl_scale * sdl_scale);
+
+	return a->xres == b->xres && a->yres == b->yres && a->xoff == b->xoff && a->yoff == b->yoff &&
+	       !memcmp(a->pixel, b->pixel, bytes);
+}
+
+TEST(test_archive_index)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing images opened through the archive index...\n");
+
+	// Opening the entry the index points to gives the image a search by name finds
+	for (int i = 0; i < 8; i++) {
+		unsigned int sprite = get_valid_sprite(i * 37);
+		struct sdl_image indexed = {0}, named = {0};
+		long long saved = zip_index_saved;
+
+		ASSERT_TRUE(sdl_zip_index_has(sprite));
+		ASSERT_EQ_INT(0, sdl_load_image(&indexed, (int)sprite));
+		ASSERT_TRUE(zip_index_saved > saved);
+
+		sdl_zip_index_exit();
+		ASSERT_FALSE(sdl_zip_index_has(sprite));
+		ASSERT_EQ_INT(0, sdl_load_image(&named, (int)sprite));
+		sdl_zip_index_init();
+
+		ASSERT_TRUE(same_image(&indexed, &named));
+		FREE(indexed.pixel);
+		FREE(named.pixel);
+	}
+
+	// A sprite in no archive skips the search and gets the unknown sprite image
+	unsigned int missing = MAXSPRITE - 1;
+	struct sdl_image unknown = {0}, two = {0};
+	ASSERT_FALSE(sdl_zip_index_has(missing));
+	ASSERT_EQ_INT(0, sdl_load_image(&unknown, (int)missing));
+	ASSERT_EQ_INT(0, sdl_load_image_png(&two, "00000002.png", sdl_zip1, do_smoothify((int)missing), -1));
+	ASSERT_TRUE(same_image(&unknown, &two));
+	FREE(unknown.pixel);
+	FREE(two.pixel);
+
+	fprintf(stderr, "  ✓ Indexed loads match loads by name, %lld name lookups saved\n", zip_index_saved);
+
+	sdl_shutdown_for_tests();
+}
+
+// ============================================================================
+// Sprite pack
+// ============================================================================
+
+#define TEST_SPRITE_PACK "bin/test_sprites.pack"
+#define TEST_PACK_COLOR  0xff204060u
+
+// Write an LZ4 length continuation
+static uint8_t *pack_put_length(uint8_t *p, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		*p++ = 255;
+	}
+	*p++ = (uint8_t)len;
+	return p;
+}
+
+// Write a pack holding the decoded image of sprite raw and a 4x4 image of
+// TEST_PACK_COLOR as one LZ4 block for sprite packed
+static int write_test_pack(uint64_t stamp, unsigned int raw, struct sdl_image *si, unsigned int packed)
+{
+	struct sdl_pack_header head = {SPK_MAGIC, SPK_VERSION, (uint32_t)sdl_scale, 0, stamp, sizeof(head)};
+	size_t count = (raw > packed ? raw : packed) + 1;
+	size_t bytes = (size_t)si->xres * si->yres * sizeof(uint32_t) * (size_t)(sdl_scale * sdl_scale);
+	size_t lzbytes = 4 * 4 * sizeof(uint32_t) * (size_t)(sdl_scale * sdl_scale);
+	uint8_t block[64], *p = block, pad[16] = {0};
+	uint32_t color = TEST_PACK_COLOR;
+	uint64_t offset;
+	int ok;
+
+	// One literal pixel, a match repeating it, the last pixel as literals again
+	*p++ = 0x4f;
+	memcpy(p, &color, 4);
+	p += 4;
+	*p++ = 4;
+	*p++ = 0;
+	p = pack_put_length(p, lzbytes - 8 - 4 - 15);
+	*p++ = 0x40;
+	memcpy(p, &color, 4);
+	p += 4;
+
+	struct sdl_pack_entry *index = xmalloc(count * sizeof(struct sdl_pack_entry), MEM_TEMP);
+	if (!index) {
+		return 0;
+	}
+	head.count = (uint32_t)count;
+	offset = (sizeof(head) + count * sizeof(struct sdl_pack_entry) + 15) & ~(uint64_t)15;
+
+	index[raw].offset = offset;
+	index[raw].bytes = (uint32_t)bytes;
+	index[raw].xres = si->xres;
+	index[raw].yres = si->yres;
+	index[raw].xoff = si->xoff;
+	index[raw].yoff = si->yoff;
+
+	index[packed].offset = (offset + bytes + 15) & ~(uint64_t)15;
+	index[packed].bytes = (uint32_t)(p - block);
+	index[packed].xres = 4;
+	index[packed].yres = 4;
+	index[packed].flags = SPK_LZ4;
+
+	SDL_IOStream *io = SDL_IOFromFile(TEST_SPRITE_PACK, "wb");
+	ok = io != NULL;
+	ok = ok && SDL_WriteIO(io, &head, sizeof(head)) == sizeof(head);
+	ok = ok && SDL_WriteIO(io, index, count * sizeof(struct sdl_pack_entry)) == count * sizeof(struct sdl_pack_entry);
+	ok = ok && SDL_WriteIO(io, pad, offset - sizeof(head) - count * sizeof(struct sdl_pack_entry)) ==
+	               offset - sizeof(head) - count * sizeof(struct sdl_pack_entry);
+	ok = ok && SDL_WriteIO(io, si->pixel, bytes) == bytes;
+	ok = ok && SDL_WriteIO(io, pad, (size_t)(-bytes & 15)) == (size_t)(-bytes & 15);
+	ok = ok && SDL_WriteIO(io, block, (size_t)(p - block)) == (size_t)(p - block);
+	if (io && !SDL_CloseIO(io)) {
+		ok = 0;
+	}
+
+	xfree(index);
+	return ok;
+}
+
+TEST(test_sprite_pack)
+{
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing images taken from a sprite pack...\n");
+
+	unsigned int raw = get_valid_sprite(5), packed = get_valid_sprite(6);
+	struct sdl_image si = {0};
+	ASSERT_EQ_INT(0, sdl_load_image(&si, (int)raw));
+	size_t bytes = (size_t)si.xres * si.yres * sizeof(uint32_t) * (size_t)(sdl_scale * sdl_scale);
+
+	// A pack made from other archives is not used
+	ASSERT_TRUE(write_test_pack(sdl_archive_stamp(sdl_scale) + 1, raw, &si, packed));
+	ASSERT_FALSE(sdl_pack_open(TEST_SPRITE_PACK));
+
+	ASSERT_TRUE(write_test_pack(sdl_archive_stamp(sdl_scale), raw, &si, packed));
+	ASSERT_TRUE(sdl_pack_open(TEST_SPRITE_PACK));
+	ASSERT_EQ_INT(2, sdl_pack_sprites());
+
+	// Raw images are used in place and stay out of the image cache
+	long long png = mem_png;
+	int used = imgc_used;
+	ASSERT_EQ_INT((int)raw, sdl_ic_load(raw));
+	ASSERT_EQ_INT(IMG_READY, sdli_state[raw]);
+	ASSERT_TRUE(sdli[raw].mapped);
+	ASSERT_EQ_INT(si.xres, sdli[raw].xres);
+	ASSERT_EQ_INT(si.yoff, sdli[raw].yoff);
+	ASSERT_EQ_INT(0, memcmp(si.pixel, sdli[raw].pixel, bytes));
+	ASSERT_EQ_INT(used, imgc_used);
+	ASSERT_TRUE(mem_png == png);
+	ASSERT_EQ_INT((int)raw, sdl_ic_load(raw));
+	ASSERT_EQ_INT(0, sdl_check_invariants_for_tests());
+
+	// Compressed images are unpacked into their own buffer
+	struct sdl_image lz = {0};
+	ASSERT_TRUE(sdl_pack_image(&lz, packed));
+	ASSERT_FALSE(lz.mapped);
+	ASSERT_EQ_INT(4, lz.xres);
+	for (int i = 0; i < 16 * sdl_scale * sdl_scale; i++) {
+		ASSERT_EQ_INT((int)TEST_PACK_COLOR, (int)lz.pixel[i]);
+	}
+	FREE(lz.pixel);
+	mem_png = png;
+
+	// Sprites missing from the pack come from the archives
+	ASSERT_FALSE(sdl_pack_image(&lz, get_valid_sprite(7)));
+
+	sdli_state[raw] = IMG_UNLOADED;
+	sdli[raw].mapped = 0;
+	sdli[raw].pixel = NULL;
+	sdl_pack_close();
+	SDL_RemovePath(TEST_SPRITE_PACK);
+	FREE(si.pixel);
+
+	fprintf(stderr, "  ✓ Pack images match the decoded ones, stale packs are ignored\n");
+
+	sdl_shutdown_for_tests();
+}
+
 // ============================================================================
 // Fuzz test - random operations
 // ============================================================================
@@ -545,7 +1362,7 @@ TEST(test_fuzz_random_cache_operations)
 			// Random preload with valid sprite ID
 			int sprite_idx = test_rng_range(0, num_valid_sprites - 1);
 			unsigned int sprite = get_valid_sprite(sprite_idx);
-			sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+			sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 			break;
 		}
 		case 2: {
@@ -586,10 +1403,31 @@ TEST_MAIN(
     fprintf(stderr, "\n=== LRU and Eviction Tests ===\n");
     test_lru_list_stays_consistent();
     test_eviction_basic();
+    test_eviction_by_budget();
+    test_image_cache_eviction();
+
+    fprintf(stderr, "\n=== Sprite Atlas Tests ===\n");
+    test_atlas_batches_small_sprites();
+    test_batched_blits_draw_calls();
+    test_text_uses_glyph_atlas();
 
     fprintf(stderr, "\n=== Concurrency Edge Cases (Sequential Simulation) ===\n");
     test_eviction_refuses_in_flight_jobs();
     test_generation_invalidates_stale_jobs();
+    test_job_lanes_priority_and_stale_jobs();
+    test_render_thread_steals_queued_job();
+    test_upload_ready_list();
+
+    fprintf(stderr, "\n=== Frame Statistics Tests ===\n");
+    test_frame_stats_ring();
+
+    fprintf(stderr, "\n=== Disk Cache Tests ===\n");
+    test_disk_cache_roundtrip();
+    test_disk_cache_budget();
+
+    fprintf(stderr, "\n=== Archive Index and Sprite Pack Tests ===\n");
+    test_archive_index();
+    test_sprite_pack();
 
     fprintf(stderr, "\n=== Full Cache Stress Test ===\n");
     test_full_cache_stress();
@@ -11,7 +11,6 @@
 
 #include <string.h>
 #include <time.h>
-#include <zip.h>
 
 // ============================================================================
 // Test sprite enumeration
@@ -34,14 +33,14 @@ static void enumerate_valid_sprites(void)
 
 	fprintf(stderr, "Enumerating and validating sprites from gx1.zip...\n");
 
-	zip_int64_t n = zip_get_num_entries(sdl_zip1, 0);
+	int64_t n = sdl_archive_entries(sdl_zip1);
 	int candidates = 0;
 	int filtered_not_png = 0;
 	int filtered_bad_signature = 0;
 	int filtered_load_failed = 0;
 
-	for (zip_int64_t i = 0; i < n && num_valid_sprites < 50145; i++) {
-		const char *name = zip_get_name(sdl_zip1, (zip_uint64_t)i, 0);
+	for (int64_t i = 0; i < n && num_valid_sprites < 50145; i++) {
+		const char *name = sdl_archive_name(sdl_zip1, i);
 		if (!name)
 			continue;
 
@@ -51,36 +50,35 @@ static void enumerate_valid_sprites(void)
 			candidates++;
 
 			// Step 1: Check PNG signature
-			struct zip_stat st;
-			if (zip_stat_index(sdl_zip1, (zip_uint64_t)i, 0, &st) != 0) {
+			if (sdl_archive_size(sdl_zip1, i) < 8) {
 				filtered_not_png++;
 				continue;
 			}
 
-			zip_file_t *zf = zip_fopen_index(sdl_zip1, (zip_uint64_t)i, 0);
-			if (!zf) {
+			struct sdl_archive_file zf;
+			if (sdl_archive_fopen(&zf, sdl_zip1, i)) {
 				filtered_not_png++;
 				continue;
 			}
 
 			unsigned char header[8];
-			if (zip_fread(zf, header, 8) != 8) {
-				zip_fclose(zf);
+			if (sdl_archive_fread(&zf, header, 8) != 8) {
+				sdl_archive_fclose(&zf);
 				filtered_not_png++;
 				continue;
 			}
 
 			// PNG signature: 137 80 78 71 13 10 26 10
 			if (!(header[0] == 137 && header[1] == 80 && header[2] == 78 && header[3] == 71)) {
-				zip_fclose(zf);
+				sdl_archive_fclose(&zf);
 				filtered_bad_signature++;
 				continue;
 			}
-			zip_fclose(zf);
+			sdl_archive_fclose(&zf);
 
 			// Step 2: Try to actually load it with sdl_ic_load
 			// This validates the PNG can be decoded and has valid dimensions
-			if (sdl_ic_load(sprite_num, NULL) < 0) {
+			if (sdl_ic_load(sprite_num) < 0) {
 				filtered_load_failed++;
 				continue;
 			}
@@ -115,6 +113,87 @@ static unsigned int get_valid_sprite(int index)
 	return valid_sprites[index % num_valid_sprites];
 }
 
+// ============================================================================
+// Shared archive reader
+// ============================================================================
+
+#define ARCHIVE_READERS 4
+#define ARCHIVE_ENTRIES 2000
+
+static uint32_t archive_crc[ARCHIVE_ENTRIES];
+static SDL_AtomicInt archive_mismatches;
+
+// CRC of entry, read chunk bytes at a time, 0 if it can not be read
+static uint32_t archive_entry_crc(int64_t entry, size_t chunk)
+{
+	struct sdl_archive_file zf;
+	unsigned char buf[4096];
+	uLong crc = crc32(0L, Z_NULL, 0);
+	int64_t len;
+
+	if (sdl_archive_fopen(&zf, sdl_zip1, entry)) {
+		return 0;
+	}
+	while ((len = sdl_archive_fread(&zf, buf, chunk)) > 0) {
+		crc = crc32(crc, buf, (uInt)len);
+	}
+	sdl_archive_fclose(&zf);
+
+	return len < 0 ? 0 : (uint32_t)crc;
+}
+
+static int archive_reader(void *ptr)
+{
+	int id = (int)(intptr_t)ptr;
+	int64_t n = sdl_archive_entries(sdl_zip1);
+
+	if (n > ARCHIVE_ENTRIES) {
+		n = ARCHIVE_ENTRIES;
+	}
+
+	// Every thread reads every entry, half of them backwards, each with its own chunk size
+	for (int64_t i = 0; i < n; i++) {
+		int64_t entry = (id & 1) ? n - 1 - i : i;
+		if (archive_entry_crc(entry, (size_t)(64 << id)) != archive_crc[entry]) {
+			SDL_AddAtomicInt(&archive_mismatches, 1);
+		}
+	}
+
+	return 0;
+}
+
+TEST(test_shared_archive_reads)
+{
+	SDL_Thread *thread[ARCHIVE_READERS];
+	int64_t n;
+
+	ASSERT_TRUE(sdl_init_for_tests());
+
+	fprintf(stderr, "  → Testing %d threads reading one shared archive...\n", ARCHIVE_READERS);
+
+	n = sdl_archive_entries(sdl_zip1);
+	ASSERT_TRUE(n > 0);
+	for (int64_t i = 0; i < n && i < ARCHIVE_ENTRIES; i++) {
+		ASSERT_EQ_INT((int)i, (int)sdl_archive_locate(sdl_zip1, sdl_archive_name(sdl_zip1, i)));
+		archive_crc[i] = archive_entry_crc(i, 8);
+	}
+
+	SDL_SetAtomicInt(&archive_mismatches, 0);
+	for (int i = 0; i < ARCHIVE_READERS; i++) {
+		thread[i] = SDL_CreateThread(archive_reader, "archive_reader", (void *)(intptr_t)i);
+		ASSERT_PTR_NOT_NULL(thread[i]);
+	}
+	for (int i = 0; i < ARCHIVE_READERS; i++) {
+		SDL_WaitThread(thread[i], NULL);
+	}
+
+	ASSERT_EQ_INT(0, SDL_GetAtomicInt(&archive_mismatches));
+
+	fprintf(stderr, "  ✓ Concurrent reads match single-threaded reads\n");
+
+	sdl_shutdown_for_tests();
+}
+
 // ============================================================================
 // Single-threaded pipeline test
 // ============================================================================
@@ -131,7 +210,7 @@ TEST(test_single_thread_pipeline)
 
 	// Load sprite synchronously
 	int cache_idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
-	ASSERT_IN_RANGE(cache_idx, 0, MAX_TEXCACHE - 1);
+	ASSERT_IN_RANGE(cache_idx, 0, sdlt_size - 1);
 
 	// In single-threaded mode, texture should be immediately available (or nearly so)
 	uint16_t flags = sdl_texture_get_flags_for_test(cache_idx);
@@ -139,7 +218,7 @@ TEST(test_single_thread_pipeline)
 	ASSERT_TRUE(flags & SF_DIDALLOC);
 
 	// Now simulate a prefetch of same sprite
-	sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 
 	// Pump pipeline
 	for (int i = 0; i < 100; i++) {
@@ -180,10 +259,10 @@ TEST(test_workers_process_jobs)
 		unsigned int sprite = get_valid_sprite(i);
 		cache_indices[i] = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0,
 		                                NULL, 0, 0);
-		ASSERT_IN_RANGE(cache_indices[i], 0, MAX_TEXCACHE - 1);
+		ASSERT_IN_RANGE(cache_indices[i], 0, sdlt_size - 1);
 
 		// Queue prefetch for this sprite (workers will process)
-		sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 	}
 
 	// Pump pipeline with workers running
@@ -227,18 +306,18 @@ TEST(test_workers_saturate_cache)
 
 	// Fill the entire cache with workers processing
 	int loaded = 0;
-	for (int i = 0; i < MAX_TEXCACHE && i < num_valid_sprites; i++) {
+	for (int i = 0; i < sdlt_size && i < num_valid_sprites; i++) {
 		unsigned int sprite = get_valid_sprite(i);
 		int idx = sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
 		if (idx != STX_NONE) {
 			loaded++;
 			// Queue prefetch for background processing
-			sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+			sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 		}
 		
 		// Progress indicator
 		if ((i % 5000) == 0 && i > 0) {
-			fprintf(stderr, "  Loaded %d/%d textures...\n", i, MAX_TEXCACHE);
+			fprintf(stderr, "  Loaded %d/%d textures...\n", i, sdlt_size);
 		}
 		
 	// Periodically pump and check invariants
@@ -268,7 +347,7 @@ TEST(test_workers_saturate_cache)
 
 	// Count completed textures
 	int completed = 0;
-	for (int i = 0; i < MAX_TEXCACHE; i++) {
+	for (int i = 0; i < sdlt_size; i++) {
 		uint16_t flags = sdl_texture_get_flags_for_test(i);
 		if ((flags & SF_USED) && (flags & SF_DIDMAKE)) {
 			completed++;
@@ -295,12 +374,12 @@ TEST(test_workers_with_eviction)
 	fprintf(stderr, "  → Testing workers with eviction (thrashing cache)...\n");
 
 	// Load MORE sprites than cache can hold, forcing evictions
-	const int num_sprites = MAX_TEXCACHE + 5000;
+	const int num_sprites = sdlt_size + 5000;
 	
 	for (int i = 0; i < num_sprites && i < num_valid_sprites; i++) {
 		unsigned int sprite = get_valid_sprite(i);
 		sdl_tx_load(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, NULL, 0, 0);
-		sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		sdl_pre_add(sprite, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 		
 		// Progress
 		if ((i % 5000) == 0 && i > 0) {
@@ -387,8 +466,9 @@ TEST(test_worker_fuzz)
 			int cr = test_rng_range(0, 255);
 			int cg = test_rng_range(0, 255);
 		int cb = test_rng_range(0, 255);
+		int urgent = test_rng_range(0, 1);
 
-		sdl_pre_add(sprite, 0, 0, scale, cr, cg, cb, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		sdl_pre_add(sprite, 0, 0, scale, cr, cg, cb, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, urgent);
 		break;
 		}
 	case 2: { // Pipeline tick
@@ -426,6 +506,7 @@ TEST_MAIN(
     test_single_thread_pipeline();
 
     fprintf(stderr, "\n=== Multi-Threaded Worker Tests ===\n");
+    test_shared_archive_reads();
     test_workers_process_jobs();
     test_workers_saturate_cache();
 